@@ -0,0 +1,284 @@
+//! gzip on the wire for the HTTP services.
+//!
+//! [`gzip`] is `from_fn` middleware that inflates request bodies sent with
+//! `Content-Encoding: gzip` before any extractor sees them, and gzips
+//! responses for clients whose `Accept-Encoding` allows it.
+//!
+//! - Inflated bodies are held to [`MAX_BODY_BYTES`], axum's default body
+//!   limit, so a small compressed body cannot expand without bound.
+//! - Only responses whose full size is known up front are compressed: JSON
+//!   and metrics bodies are, streams such as server-sent events pass through.
+
+use std::io::{Read, Write};
+
+use axum::body::{Body, HttpBody};
+use axum::extract::Request;
+use axum::http::{header, HeaderMap, HeaderValue, StatusCode};
+use axum::middleware::Next;
+use axum::response::{IntoResponse, Response};
+use axum::Json;
+use flate2::read::MultiGzDecoder;
+use flate2::write::GzEncoder;
+use flate2::Compression;
+use http_body_util::LengthLimitError;
+
+/// Largest request body accepted, before or after inflating.
+pub const MAX_BODY_BYTES: usize = 2 * 1024 * 1024;
+/// Responses smaller than this go out as they are; gzip's framing would eat the saving.
+pub const MIN_COMPRESS_BYTES: u64 = 1024;
+
+#[derive(Debug, thiserror::Error)]
+pub enum CompressError {
+    #[error("content encoding must be gzip or identity")]
+    UnsupportedEncoding,
+    #[error("request body exceeds {} bytes", MAX_BODY_BYTES)]
+    TooLarge,
+    #[error("malformed gzip body: {0}")]
+    Malformed(String),
+    #[error("request body could not be read")]
+    Unreadable,
+}
+
+impl CompressError {
+    fn code(&self) -> &'static str {
+        match self {
+            CompressError::UnsupportedEncoding => "unsupported_encoding",
+            CompressError::TooLarge => "body_too_large",
+            CompressError::Malformed(_) | CompressError::Unreadable => "invalid_body",
+        }
+    }
+}
+
+impl IntoResponse for CompressError {
+    fn into_response(self) -> Response {
+        let status = match self {
+            CompressError::UnsupportedEncoding => StatusCode::UNSUPPORTED_MEDIA_TYPE,
+            CompressError::TooLarge => StatusCode::PAYLOAD_TOO_LARGE,
+            _ => StatusCode::BAD_REQUEST,
+        };
+        let mut response = (
+            status,
+            Json(serde_json::json!({
+                "error": { "code": self.code(), "message": self.to_string() }
+            })),
+        )
+            .into_response();
+        if status == StatusCode::UNSUPPORTED_MEDIA_TYPE {
+            // RFC 7694: tell the client which request encodings would work.
+            response
+                .headers_mut()
+                .insert(header::ACCEPT_ENCODING, HeaderValue::from_static("gzip"));
+        }
+        response
+    }
+}
+
+/// Middleware: `.layer(from_fn(common_compress::gzip))`.
+pub async fn gzip(request: Request, next: Next) -> Response {
+    let accepts_gzip = accepts_gzip(request.headers());
+    let request = match inflate_request(request).await {
+        Ok(request) => request,
+        Err(err) => return err.into_response(),
+    };
+
+    let mut response = next.run(request).await;
+    if !compressible(&response) {
+        return response;
+    }
+    // Caches must not hand this representation to clients that asked for another.
+    response
+        .headers_mut()
+        .append(header::VARY, HeaderValue::from_static("accept-encoding"));
+    if accepts_gzip {
+        compress_response(response).await
+    } else {
+        response
+    }
+}
+
+async fn inflate_request(request: Request) -> Result<Request, CompressError> {
+    if !request_is_gzip(request.headers())? {
+        return Ok(request);
+    }
+    let (mut parts, body) = request.into_parts();
+    let compressed = axum::body::to_bytes(body, MAX_BODY_BYTES)
+        .await
+        .map_err(|err| {
+            if err.into_inner().is::<LengthLimitError>() {
+                CompressError::TooLarge
+            } else {
+                CompressError::Unreadable
+            }
+        })?;
+    let body = inflate(&compressed, MAX_BODY_BYTES)?;
+    parts.headers.remove(header::CONTENT_ENCODING);
+    parts
+        .headers
+        .insert(header::CONTENT_LENGTH, HeaderValue::from(body.len()));
+    Ok(Request::from_parts(parts, Body::from(body)))
+}
+
+fn compressible(response: &Response) -> bool {
+    !response.headers().contains_key(header::CONTENT_ENCODING)
+        && response
+            .body()
+            .size_hint()
+            .exact()
+            .map_or(false, |size| size >= MIN_COMPRESS_BYTES)
+}
+
+async fn compress_response(response: Response) -> Response {
+    let (mut parts, body) = response.into_parts();
+    // The size is known, so the body is already in memory and cannot fail to collect.
+    let Ok(body) = axum::body::to_bytes(body, usize::MAX).await else {
+        return StatusCode::INTERNAL_SERVER_ERROR.into_response();
+    };
+    let compressed = deflate(&body);
+    if compressed.len() >= body.len() {
+        return Response::from_parts(parts, Body::from(body));
+    }
+    parts
+        .headers
+        .insert(header::CONTENT_ENCODING, HeaderValue::from_static("gzip"));
+    parts
+        .headers
+        .insert(header::CONTENT_LENGTH, HeaderValue::from(compressed.len()));
+    Response::from_parts(parts, Body::from(compressed))
+}
+
+/// Whether the request body is gzip, from its `Content-Encoding`; `identity` and
+/// no header both mean it is sent as is.
+pub fn request_is_gzip(headers: &HeaderMap) -> Result<bool, CompressError> {
+    let mut gzip = false;
+    for value in headers.get_all(header::CONTENT_ENCODING) {
+        let value = value
+            .to_str()
+            .map_err(|_| CompressError::UnsupportedEncoding)?;
+        for coding in value.split(',').map(str::trim) {
+            if coding.is_empty() || coding.eq_ignore_ascii_case("identity") {
+                continue;
+            }
+            let is_gzip =
+                coding.eq_ignore_ascii_case("gzip") || coding.eq_ignore_ascii_case("x-gzip");
+            // One layer of gzip is all that is decoded; anything stacked on it is refused.
+            if !is_gzip || gzip {
+                return Err(CompressError::UnsupportedEncoding);
+            }
+            gzip = true;
+        }
+    }
+    Ok(gzip)
+}
+
+/// Whether `Accept-Encoding` allows a gzip response. An explicit `gzip` entry
+/// wins over `*`; either may be turned off with `q=0`.
+pub fn accepts_gzip(headers: &HeaderMap) -> bool {
+    let mut gzip = None;
+    let mut any = None;
+    for value in headers.get_all(header::ACCEPT_ENCODING) {
+        let Ok(value) = value.to_str() else {
+            continue;
+        };
+        for entry in value.split(',') {
+            let mut params = entry.split(';').map(str::trim);
+            let coding = params.next().unwrap_or_default();
+            let quality = params
+                .filter_map(|param| param.split_once('='))
+                .find(|(name, _)| name.trim().eq_ignore_ascii_case("q"))
+                .map_or(1.0, |(_, q)| q.trim().parse::<f32>().unwrap_or(0.0));
+            if coding.eq_ignore_ascii_case("gzip") || coding.eq_ignore_ascii_case("x-gzip") {
+                gzip = Some(quality > 0.0);
+            } else if coding == "*" {
+                any = Some(quality > 0.0);
+            }
+        }
+    }
+    gzip.or(any).unwrap_or(false)
+}
+
+/// Inflates a gzip body, concatenated members included, refusing to produce
+/// more than `limit` bytes.
+pub fn inflate(body: &[u8], limit: usize) -> Result<Vec<u8>, CompressError> {
+    let mut inflated = Vec::with_capacity(body.len().saturating_mul(4).min(limit));
+    MultiGzDecoder::new(body)
+        .take(limit as u64 + 1)
+        .read_to_end(&mut inflated)
+        .map_err(|err| CompressError::Malformed(err.to_string()))?;
+    if inflated.len() > limit {
+        return Err(CompressError::TooLarge);
+    }
+    Ok(inflated)
+}
+
+pub fn deflate(body: &[u8]) -> Vec<u8> {
+    let mut encoder = GzEncoder::new(Vec::with_capacity(body.len() / 2), Compression::default());
+    // Writing to a Vec cannot fail.
+    encoder.write_all(body).expect("gzip into memory");
+    encoder.finish().expect("gzip into memory")
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn headers(name: header::HeaderName, value: &'static str) -> HeaderMap {
+        let mut headers = HeaderMap::new();
+        headers.insert(name, HeaderValue::from_static(value));
+        headers
+    }
+
+    #[test]
+    fn inflate_round_trips_deflate() {
+        let body = br#"{"envelopes":[{"source":"meter-1","payload":{}}]}"#.repeat(64);
+        let compressed = deflate(&body);
+        assert!(compressed.len() < body.len());
+        assert_eq!(inflate(&compressed, MAX_BODY_BYTES).unwrap(), body);
+    }
+
+    #[test]
+    fn inflate_stops_at_the_limit() {
+        // A few kilobytes of zeros inflate to well past the limit.
+        let bomb = deflate(&vec![0u8; 4 * MAX_BODY_BYTES]);
+        assert!(bomb.len() < 16 * 1024);
+        assert!(matches!(
+            inflate(&bomb, MAX_BODY_BYTES),
+            Err(CompressError::TooLarge)
+        ));
+        let exact = deflate(&vec![0u8; 1024]);
+        assert_eq!(inflate(&exact, 1024).unwrap().len(), 1024);
+    }
+
+    #[test]
+    fn inflate_rejects_non_gzip() {
+        assert!(matches!(
+            inflate(b"{\"envelopes\":[]}", MAX_BODY_BYTES),
+            Err(CompressError::Malformed(_))
+        ));
+    }
+
+    #[test]
+    fn request_encoding_accepts_only_gzip_or_identity() {
+        assert!(!request_is_gzip(&HeaderMap::new()).unwrap());
+        assert!(!request_is_gzip(&headers(header::CONTENT_ENCODING, "identity")).unwrap());
+        assert!(request_is_gzip(&headers(header::CONTENT_ENCODING, "GZIP")).unwrap());
+        assert!(request_is_gzip(&headers(header::CONTENT_ENCODING, "x-gzip")).unwrap());
+        for refused in ["br", "gzip, gzip", "deflate, gzip"] {
+            assert!(matches!(
+                request_is_gzip(&headers(header::CONTENT_ENCODING, refused)),
+                Err(CompressError::UnsupportedEncoding)
+            ));
+        }
+    }
+
+    #[test]
+    fn accept_encoding_honours_quality() {
+        let accepts = |value| accepts_gzip(&headers(header::ACCEPT_ENCODING, value));
+        assert!(!accepts_gzip(&HeaderMap::new()));
+        assert!(accepts("deflate, gzip;q=0.5"));
+        assert!(accepts("*"));
+        assert!(!accepts("br"));
+        assert!(!accepts("gzip;q=0, *"));
+        assert!(!accepts("*;q=0"));
+        assert!(accepts("identity, gzip ; q=1.0"));
+    }
+}
@@ -0,0 +1,349 @@
+//! Resumable server-sent event fan-out.
+//!
+//! Every published event gets an id of the form `<epoch>-<seq>`. The epoch is
+//! a nonce drawn once per process; the sequence counts up from 1 within it. A
+//! subscriber that reconnects with `Last-Event-ID` is replayed what it missed
+//! from a bounded journal, then joins the live feed.
+//!
+//! - An id from another epoch means the service restarted, and this journal
+//!   knows nothing about what came before. The subscriber gets a `resync`
+//!   event, then everything retained.
+//! - Events evicted from the journal, or dropped because the subscriber fell
+//!   behind the broadcast channel, surface as a `gap` event.
+
+use std::collections::hash_map::RandomState;
+use std::collections::VecDeque;
+use std::convert::Infallible;
+use std::fmt;
+use std::hash::{BuildHasher, Hasher};
+use std::str::FromStr;
+use std::sync::{Mutex, OnceLock};
+use std::time::{SystemTime, UNIX_EPOCH};
+
+use axum::http::HeaderMap;
+use axum::response::sse::{Event, KeepAlive, Sse};
+use futures_util::{Stream, StreamExt};
+use tokio::sync::broadcast;
+use tokio_stream::wrappers::BroadcastStream;
+
+/// This process's epoch. `RandomState` is seeded from the OS, and the clock
+/// is mixed in, so a restarted service never reuses its predecessor's epoch.
+pub fn boot_epoch() -> u64 {
+    static EPOCH: OnceLock<u64> = OnceLock::new();
+    *EPOCH.get_or_init(|| {
+        let nanos = SystemTime::now()
+            .duration_since(UNIX_EPOCH)
+            .map_or(0, |elapsed| elapsed.as_nanos());
+        let mut hasher = RandomState::new().build_hasher();
+        hasher.write_u128(nanos);
+        hasher.finish()
+    })
+}
+
+/// Where an event sits in a stream, and which process numbered it.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct EventId {
+    pub epoch: u64,
+    pub seq: u64,
+}
+
+impl fmt::Display for EventId {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "{:016x}-{}", self.epoch, self.seq)
+    }
+}
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct ParseEventIdError;
+
+impl fmt::Display for ParseEventIdError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.write_str("event id must be <hex epoch>-<sequence>")
+    }
+}
+
+impl std::error::Error for ParseEventIdError {}
+
+impl FromStr for EventId {
+    type Err = ParseEventIdError;
+
+    fn from_str(value: &str) -> Result<Self, Self::Err> {
+        let (epoch, seq) = value.trim().split_once('-').ok_or(ParseEventIdError)?;
+        Ok(Self {
+            epoch: u64::from_str_radix(epoch, 16).map_err(|_| ParseEventIdError)?,
+            seq: seq.parse().map_err(|_| ParseEventIdError)?,
+        })
+    }
+}
+
+/// A published payload and the id subscribers resume from.
+#[derive(Debug, Clone)]
+pub struct SequencedEvent<T> {
+    pub id: EventId,
+    pub payload: T,
+}
+
+/// Why a subscriber's backlog does not continue exactly from its id.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Discontinuity {
+    /// Events after the subscriber's id were evicted or dropped.
+    Gap,
+    /// The id came from another epoch, or was not one of ours.
+    Resync,
+}
+
+/// Recent events, so a reconnecting subscriber misses nothing within the window.
+#[derive(Debug)]
+struct Journal<T> {
+    epoch: u64,
+    last_seq: u64,
+    capacity: usize,
+    recent: VecDeque<SequencedEvent<T>>,
+}
+
+impl<T: Clone> Journal<T> {
+    fn record(&mut self, payload: T) -> SequencedEvent<T> {
+        self.last_seq += 1;
+        let event = SequencedEvent {
+            id: EventId {
+                epoch: self.epoch,
+                seq: self.last_seq,
+            },
+            payload,
+        };
+        if self.recent.len() == self.capacity {
+            self.recent.pop_front();
+        }
+        self.recent.push_back(event.clone());
+        event
+    }
+
+    /// Retained events after `last_event_id`, and whether any before them were lost.
+    fn since(&self, last_event_id: &str) -> (Vec<SequencedEvent<T>>, Option<Discontinuity>) {
+        let after = match last_event_id.parse::<EventId>() {
+            Ok(id) if id.epoch == self.epoch && id.seq <= self.last_seq => id.seq,
+            // Everything retained is new to a client whose id we never issued.
+            _ => {
+                return (
+                    self.recent.iter().cloned().collect(),
+                    Some(Discontinuity::Resync),
+                )
+            }
+        };
+        let evicted = self
+            .recent
+            .front()
+            .map_or(false, |oldest| oldest.id.seq > after + 1);
+        let backlog = self
+            .recent
+            .iter()
+            .filter(|event| event.id.seq > after)
+            .cloned()
+            .collect();
+        (backlog, evicted.then_some(Discontinuity::Gap))
+    }
+}
+
+/// What a subscriber gets on connect: retained events after its id, then live ones.
+pub struct Subscription<T> {
+    pub backlog: Vec<SequencedEvent<T>>,
+    /// Set when the backlog does not pick up right after the subscriber's id.
+    pub discontinuity: Option<Discontinuity>,
+    pub live: broadcast::Receiver<SequencedEvent<T>>,
+}
+
+/// Broadcast fan-out with ids. Publishing and subscribing share one lock, so a
+/// subscriber's backlog and live feed meet without duplicates or holes.
+pub struct EventFanout<T> {
+    sender: broadcast::Sender<SequencedEvent<T>>,
+    journal: Mutex<Journal<T>>,
+}
+
+impl<T: Clone> EventFanout<T> {
+    /// `capacity` bounds how far a live subscriber may lag; `replay_capacity`
+    /// how many events a reconnecting one can catch up on.
+    pub fn new(capacity: usize, replay_capacity: usize) -> Self {
+        let (sender, _) = broadcast::channel(capacity);
+        Self {
+            sender,
+            journal: Mutex::new(Journal {
+                epoch: boot_epoch(),
+                last_seq: 0,
+                capacity: replay_capacity,
+                recent: VecDeque::with_capacity(replay_capacity),
+            }),
+        }
+    }
+
+    pub fn publish(&self, payload: T) {
+        let mut journal = self.journal.lock().expect("event journal poisoned");
+        let event = journal.record(payload);
+        // No subscribers is not an error; the journal still keeps the event.
+        let _ = self.sender.send(event);
+    }
+
+    /// Subscribes live, first replaying what followed `last_event_id` if given.
+    pub fn subscribe(&self, last_event_id: Option<&str>) -> Subscription<T> {
+        let journal = self.journal.lock().expect("event journal poisoned");
+        let live = self.sender.subscribe();
+        let (backlog, discontinuity) = match last_event_id {
+            Some(last_event_id) => journal.since(last_event_id),
+            None => (Vec::new(), None),
+        };
+        Subscription {
+            backlog,
+            discontinuity,
+            live,
+        }
+    }
+}
+
+/// Streams `fanout` as server-sent events, resuming from the request's
+/// `Last-Event-ID`.
+pub fn sse_response<T>(
+    fanout: &EventFanout<T>,
+    headers: &HeaderMap,
+) -> Sse<impl Stream<Item = Result<Event, Infallible>>>
+where
+    T: AsRef<str> + Clone + Send + 'static,
+{
+    let last_event_id = headers
+        .get("last-event-id")
+        .and_then(|value| value.to_str().ok());
+    let subscription = fanout.subscribe(last_event_id);
+
+    let backlog = subscription
+        .discontinuity
+        .map(discontinuity_event)
+        .into_iter()
+        .chain(subscription.backlog.iter().map(sse_event))
+        .map(Ok::<Event, Infallible>)
+        .collect::<Vec<_>>();
+    let live = BroadcastStream::new(subscription.live).map(|event| match event {
+        Ok(event) => Ok(sse_event(&event)),
+        // Lagging is the only receive error: this subscriber missed events.
+        Err(_) => Ok(discontinuity_event(Discontinuity::Gap)),
+    });
+    Sse::new(futures_util::stream::iter(backlog).chain(live)).keep_alive(KeepAlive::new())
+}
+
+fn sse_event<T: AsRef<str>>(event: &SequencedEvent<T>) -> Event {
+    Event::default()
+        .id(event.id.to_string())
+        .data(event.payload.as_ref())
+}
+
+fn discontinuity_event(discontinuity: Discontinuity) -> Event {
+    let name = match discontinuity {
+        Discontinuity::Gap => "gap",
+        Discontinuity::Resync => "resync",
+    };
+    Event::default().event(name).data("{}")
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn fanout(replay_capacity: usize) -> EventFanout<String> {
+        EventFanout::new(8, replay_capacity)
+    }
+
+    fn id(seq: u64) -> String {
+        EventId {
+            epoch: boot_epoch(),
+            seq,
+        }
+        .to_string()
+    }
+
+    fn seqs(subscription: &Subscription<String>) -> Vec<u64> {
+        subscription
+            .backlog
+            .iter()
+            .map(|event| event.id.seq)
+            .collect()
+    }
+
+    #[test]
+    fn id_round_trips_through_its_text_form() {
+        let id = EventId {
+            epoch: 0x0123_4567_89ab_cdef,
+            seq: 42,
+        };
+        assert_eq!(id.to_string(), "0123456789abcdef-42");
+        assert_eq!(id.to_string().parse::<EventId>(), Ok(id));
+        assert!("42".parse::<EventId>().is_err());
+        assert!("zz-1".parse::<EventId>().is_err());
+    }
+
+    #[test]
+    fn resume_replays_only_missed_events() {
+        let fanout = fanout(8);
+        for n in 0..3 {
+            fanout.publish(format!("{{\"n\":{n}}}"));
+        }
+        let subscription = fanout.subscribe(Some(id(1).as_str()));
+        assert_eq!(seqs(&subscription), vec![2, 3]);
+        assert_eq!(subscription.discontinuity, None);
+    }
+
+    #[test]
+    fn live_feed_starts_after_backlog() {
+        let fanout = fanout(8);
+        fanout.publish("{}".to_string());
+        let mut subscription = fanout.subscribe(Some(id(0).as_str()));
+        fanout.publish("{}".to_string());
+        assert_eq!(seqs(&subscription), vec![1]);
+        assert_eq!(subscription.live.try_recv().unwrap().id.seq, 2);
+        assert!(subscription.live.try_recv().is_err());
+    }
+
+    #[test]
+    fn evicted_events_are_reported_as_a_gap() {
+        let fanout = fanout(4);
+        for _ in 0..6 {
+            fanout.publish("{}".to_string());
+        }
+        let subscription = fanout.subscribe(Some(id(1).as_str()));
+        assert_eq!(subscription.discontinuity, Some(Discontinuity::Gap));
+        assert_eq!(seqs(&subscription), vec![3, 4, 5, 6]);
+    }
+
+    #[test]
+    fn id_from_another_epoch_resyncs_even_when_behind_ours() {
+        let fanout = fanout(8);
+        for _ in 0..5 {
+            fanout.publish("{}".to_string());
+        }
+        // Numerically this id would resume cleanly; only the epoch gives the restart away.
+        let stale = EventId {
+            epoch: boot_epoch() ^ 1,
+            seq: 2,
+        };
+        let subscription = fanout.subscribe(Some(stale.to_string().as_str()));
+        assert_eq!(subscription.discontinuity, Some(Discontinuity::Resync));
+        assert_eq!(seqs(&subscription), vec![1, 2, 3, 4, 5]);
+    }
+
+    #[test]
+    fn foreign_or_future_ids_resync() {
+        let fanout = fanout(8);
+        fanout.publish("{}".to_string());
+        let future = id(500);
+        for last_event_id in ["500", "not-an-id", future.as_str()] {
+            let subscription = fanout.subscribe(Some(last_event_id));
+            assert_eq!(subscription.discontinuity, Some(Discontinuity::Resync));
+            assert_eq!(seqs(&subscription), vec![1]);
+        }
+    }
+
+    #[test]
+    fn fresh_subscriber_gets_no_backlog() {
+        let fanout = fanout(8);
+        fanout.publish("{}".to_string());
+        let subscription = fanout.subscribe(None);
+        assert!(subscription.backlog.is_empty());
+        assert_eq!(subscription.discontinuity, None);
+    }
+}
@@ -1,45 +1,474 @@
+import gzip
+import hashlib
 import json
 import os
+import re
 import ssl
-from http.server import BaseHTTPRequestHandler, HTTPServer
-from urllib.parse import urlparse
+import struct
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+# Large enough by default that list responses arrive over several reads.
+MOCK_DEVICE_COUNT = 500
+# Responses smaller than this are not worth gzipping.
+GZIP_MIN_BYTES = 1024
+# Clients whose base URL starts with this see a scene service from before the batch endpoint.
+LEGACY_PREFIX = "/legacy"
+# Requests seen per /scene-svc/flaky key, so each test run picks its own key.
+FLAKY_HITS = {}
+FLAKY_LOCK = threading.Lock()
+# Directory of signed OTA bundles, as scripts/ota/sign.sh lays them out, served under /updater/bundles/.
+OTA_BUNDLES = os.environ.get("LOKAN_OTA_BUNDLES")
+OTA_PREFIX = "/updater/bundles/"
+
+
+def _cbor_decode(data: bytes):
+    """Decodes the CBOR subset SDK telemetry batches use: maps, arrays, text, integers, floats, booleans."""
+
+    def item(pos):
+        initial = data[pos]
+        major, info = initial >> 5, initial & 0x1F
+        pos += 1
+        if major == 7:
+            if info in (20, 21):
+                return info == 21, pos
+            if info == 22:
+                return None, pos
+            if info in (25, 26, 27):
+                width = {25: 2, 26: 4, 27: 8}[info]
+                return struct.unpack({2: ">e", 4: ">f", 8: ">d"}[width], data[pos : pos + width])[0], pos + width
+            raise ValueError("unsupported simple value")
+        if info == 31:
+            if major not in (4, 5):
+                raise ValueError("unsupported indefinite item")
+            values = []
+            while data[pos] != 0xFF:
+                value, pos = item(pos)
+                values.append(value)
+            pos += 1
+            return (values if major == 4 else dict(zip(values[::2], values[1::2]))), pos
+        if info < 24:
+            argument = info
+        else:
+            width = 1 << (info - 24)
+            argument = int.from_bytes(data[pos : pos + width], "big")
+            pos += width
+        if major == 0:
+            return argument, pos
+        if major == 1:
+            return -1 - argument, pos
+        if major == 3:
+            return data[pos : pos + argument].decode("utf-8"), pos + argument
+        if major == 4:
+            values = []
+            for _ in range(argument):
+                value, pos = item(pos)
+                values.append(value)
+            return values, pos
+        if major == 5:
+            entries = {}
+            for _ in range(argument):
+                key, pos = item(pos)
+                entries[key], pos = item(pos)
+            return entries, pos
+        raise ValueError("unsupported major type")
+
+    value, end = item(0)
+    if end != len(data):
+        raise ValueError("trailing bytes")
+    return value
+
+
+def _mock_registry_device(index: int, revision: int = 0):
+    return {
+        "id": f"device-{index:05d}",
+        "room_id": "lab" if index % 4 else None,
+        "name": f"Mock device {index}",
+        "kind": "light",
+        "status": "online" if index % 3 else "offline",
+        "state": {"on": index % 2 == 0, "revision": revision},
+    }
+
+
+# Registry change log: entry n - 1 is change n, as (device id, record or None once deleted).
+# POST /device-registry/devices/changes/churn appends to it and DELETE resets it.
+CHANGE_LOG = [(device["id"], device) for device in map(_mock_registry_device, range(MOCK_DEVICE_COUNT))]
+CHANGE_LOCK = threading.Lock()
+
+
+def _apply_scene_request(scene) -> dict:
+    """Applies a SceneRequest with scene-svc's outcome rules; devices named missing-* are not in the registry."""
+    results = []
+    applied = []
+    failed = False
+    for operation in scene["operations"]:
+        device_id = operation["device_id"]
+        if failed:
+            results.append({"device_id": device_id, "status": "skipped", "detail": "skipped due to prior failure"})
+        elif device_id.startswith("missing-"):
+            results.append({"device_id": device_id, "status": "failed", "detail": f"device not found: {device_id}"})
+            failed = True
+        else:
+            results.append({"device_id": device_id, "status": "applied"})
+            applied.append(device_id)
+    if failed:
+        # Devices already changed are put back, newest first.
+        results.extend({"device_id": device_id, "status": "rolled_back", "detail": "rolled back"} for device_id in reversed(applied))
+    status = ("partial_failure" if applied else "failed") if failed else "applied"
+    response = {"status": status, "results": results}
+    if scene.get("scene_id") is not None:
+        response["scene_id"] = scene["scene_id"]
+    return response
 
 
 class SceneServiceHandler(BaseHTTPRequestHandler):
     server_version = "LokanMockScene/0.1"
+    # Keep connections open so SDK connection reuse can be exercised locally.
+    protocol_version = "HTTP/1.1"
+    disable_nagle_algorithm = True
 
     def log_message(self, format, *args):  # noqa: A003 - matching BaseHTTPRequestHandler signature
         # Reduce noise in CI runs.
         return
 
+    def _write_json(self, body: bytes) -> None:
+        """Ends the headers and writes body, gzipped when the client offered gzip."""
+        if len(body) >= GZIP_MIN_BYTES and "gzip" in self.headers.get("Accept-Encoding", ""):
+            body = gzip.compress(body)
+            self.send_header("Content-Encoding", "gzip")
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def _send_json(self, status: int, payload) -> None:
+        self.send_response(status)
+        self._write_json(json.dumps(payload).encode("utf-8"))
+
+    def _send_metrics(self, service: str, query) -> None:
+        """Prometheus text shaped like the services' /metrics; routes=N adds series."""
+        routes = int(query.get("routes", ["4"])[0])
+        lines = [
+            "# HELP http_requests_total Requests handled, by route.",
+            "# TYPE http_requests_total counter",
+        ]
+        for index in range(routes):
+            lines.append(f'http_requests_total{{service="{service}",route="/v1/r{index}"}} {index * 10 + 1}')
+        lines += [
+            "# HELP http_request_duration_seconds Request latency.",
+            "# TYPE http_request_duration_seconds histogram",
+        ]
+        for bound, count in (("0.005", 3), ("0.05", 9), ("0.5", 12), ("+Inf", 13)):
+            lines.append(f'http_request_duration_seconds_bucket{{service="{service}",le="{bound}"}} {count}')
+        lines += [
+            f'http_request_duration_seconds_sum{{service="{service}"}} 1.25',
+            f'http_request_duration_seconds_count{{service="{service}"}} 13',
+            "# TYPE build_info gauge",
+            f'build_info{{service="{service}",version="0.1.0",note="quoted \\"}}\\" brace"}} 1',
+            "process_resident_memory_bytes 2.4576e+07 1760000000000",
+            "queue_depth NaN",
+        ]
+        body = ("\n".join(lines) + "\n").encode("utf-8")
+        self.send_response(200)
+        self.send_header("Content-Type", "text/plain; version=0.0.4")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def _send_json_conditional(self, payload) -> None:
+        """Sends payload with an ETag, or a bare 304 when the client already holds it."""
+        body = json.dumps(payload).encode("utf-8")
+        etag = '"' + hashlib.sha256(body).hexdigest()[:32] + '"'
+        if self.headers.get("If-None-Match") == etag:
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.end_headers()
+            return
+        self.send_response(200)
+        self.send_header("ETag", etag)
+        self._write_json(body)
+
+    def _read_body(self) -> bytes:
+        length = int(self.headers.get("Content-Length", "0"))
+        body = self.rfile.read(length) if length else b""
+        if self.headers.get("Content-Encoding") == "gzip":
+            body = gzip.decompress(body)
+        return body
+
+    def _send_page(self, key: str, items, query) -> None:
+        """Cursor pagination as the services do it; the mock's cursor is just the next offset."""
+        try:
+            start = int(query.get("cursor", ["0"])[0])
+            limit = max(1, min(int(query.get("limit", ["100"])[0]), 1000))
+        except ValueError:
+            self._send_json(400, {"error": {"code": "invalid_cursor", "message": "invalid page cursor"}})
+            return
+        page = {key: items[start : start + limit]}
+        if start + limit < len(items):
+            page["nextCursor"] = str(start + limit)
+        self._send_json(200, page)
+
+    def _send_changes(self, query) -> None:
+        """The latest change per device after since, oldest first, as device-registry answers."""
+        try:
+            since = int(query.get("since", ["0"])[0])
+            limit = max(1, min(int(query.get("limit", ["1000"])[0]), 1000))
+        except ValueError:
+            self._send_json(400, {"error": {"code": "invalid_argument", "message": "invalid since or limit"}})
+            return
+        with CHANGE_LOCK:
+            log = list(CHANGE_LOG)
+        if since > len(log):
+            self._send_json(410, {"error": {"code": "gone", "message": "change sequence is ahead of the registry"}})
+            return
+        latest = {}
+        for seq in range(since + 1, len(log) + 1):
+            device_id, record = log[seq - 1]
+            latest.pop(device_id, None)
+            latest[device_id] = (seq, record)
+        changes = []
+        for device_id, (seq, record) in latest.items():
+            change = {"seq": seq, "id": device_id, "deleted": record is None}
+            if record is not None:
+                change["device"] = record
+            changes.append(change)
+        page = changes[:limit]
+        self._send_json(
+            200,
+            {"changes": page, "latestSeq": page[-1]["seq"] if page else since, "hasMore": len(changes) > limit},
+        )
+
+    def _churn_devices(self, query) -> None:
+        """Updates, deletes and creates mock devices, so a mirror has deltas to apply."""
+        updates = int(query.get("updates", ["0"])[0])
+        deletes = int(query.get("deletes", ["0"])[0])
+        creates = int(query.get("creates", ["0"])[0])
+        with CHANGE_LOCK:
+            alive = {}
+            for device_id, record in CHANGE_LOG:
+                alive[device_id] = record
+            live = sorted(index for index, record in enumerate(alive.values()) if record is not None)
+            records = list(alive.values())
+            for n in range(updates):
+                index = live[n % len(live)]
+                record = dict(records[index])
+                record["state"] = {"on": not record["state"]["on"], "revision": record["state"]["revision"] + 1}
+                records[index] = record
+                CHANGE_LOG.append((record["id"], record))
+            for n in range(min(deletes, len(live))):
+                CHANGE_LOG.append((records[live[-1 - n]]["id"], None))
+            for n in range(creates):
+                CHANGE_LOG.append((f"device-{len(alive) + n:05d}", _mock_registry_device(len(alive) + n)))
+            latest = len(CHANGE_LOG)
+        self._send_json(200, {"latestSeq": latest})
+
+    def _stream_events(self, query) -> None:
+        """SSE feed whose ids continue from Last-Event-ID; it closes every close_after events to exercise resume."""
+        count = int(query.get("count", ["5"])[0])
+        close_after = int(query.get("close_after", [str(count)])[0])
+        interval = int(query.get("interval_ms", ["0"])[0]) / 1000
+        try:
+            last_id = int(self.headers.get("Last-Event-ID", "0"))
+        except ValueError:
+            last_id = 0
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream")
+        self.send_header("Cache-Control", "no-cache")
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.close_connection = True
+        self.wfile.write(b": connected\n\n")
+        for event_id in range(last_id + 1, min(count, last_id + close_after) + 1):
+            payload = json.dumps({"person_id": f"person-{event_id}", "location": "lab"})
+            self.wfile.write(f"id: {event_id}\ndata: {payload}\n\n".encode("utf-8"))
+            self.wfile.flush()
+            if interval:
+                time.sleep(interval)
+
+    def _flaky(self, query) -> None:
+        """Fails the first `fail` requests for a key, then delays the next `slow` ones by delay_ms."""
+        key = query.get("key", [""])[0]
+        fail = int(query.get("fail", ["0"])[0])
+        slow = int(query.get("slow", ["0"])[0])
+        with FLAKY_LOCK:
+            hit = FLAKY_HITS.get(key, 0)
+            FLAKY_HITS[key] = hit + 1
+        if hit < fail:
+            self.send_response(int(query.get("status", ["503"])[0]))
+            if "retry_after" in query:
+                self.send_header("Retry-After", query["retry_after"][0])
+            self._write_json(json.dumps({"error": {"code": "unavailable", "message": "try again"}}).encode("utf-8"))
+            return
+        if hit < fail + slow:
+            time.sleep(int(query.get("delay_ms", ["1000"])[0]) / 1000)
+        self._send_json(200, {"status": "ok", "attempt": hit + 1})
+
+    def _send_bundle_file(self, relative: str, head: bool) -> None:
+        """Serves a file from OTA_BUNDLES, honouring a single bytes=start-end Range as a CDN would."""
+        root = os.path.realpath(OTA_BUNDLES) if OTA_BUNDLES else None
+        target = os.path.realpath(os.path.join(root, relative)) if root else None
+        if not target or not target.startswith(root + os.sep) or not os.path.isfile(target):
+            self.send_error(404, "Not Found")
+            return
+        size = os.path.getsize(target)
+        start, end = 0, size - 1
+        match = re.fullmatch(r"bytes=(\d+)-(\d*)", self.headers.get("Range", ""))
+        if match:
+            start = int(match[1])
+            end = min(int(match[2]) if match[2] else size - 1, size - 1)
+            if start > end:
+                self.send_response(416)
+                self.send_header("Content-Range", f"bytes */{size}")
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+            self.send_response(206)
+            self.send_header("Content-Range", f"bytes {start}-{end}/{size}")
+        else:
+            self.send_response(200)
+        self.send_header("Accept-Ranges", "bytes")
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(end - start + 1))
+        self.end_headers()
+        if head:
+            return
+        with open(target, "rb") as handle:
+            handle.seek(start)
+            remaining = end - start + 1
+            while remaining > 0:
+                chunk = handle.read(min(65536, remaining))
+                if not chunk:
+                    break
+                self.wfile.write(chunk)
+                remaining -= len(chunk)
+
+    def do_HEAD(self):  # noqa: N802 - inherited API
+        path = urlparse(self.path).path
+        if path.startswith(OTA_PREFIX):
+            self._send_bundle_file(path[len(OTA_PREFIX) :], head=True)
+        else:
+            self.send_error(404, "Not Found")
+
     def do_GET(self):  # noqa: N802 - inherited API
         parsed = urlparse(self.path)
-        if parsed.path == "/scene-svc/health":
-            body = json.dumps({"status": "ok"}).encode("utf-8")
-            self.send_response(200)
-            self.send_header("Content-Type", "application/json")
-            self.send_header("Content-Length", str(len(body)))
-            self.end_headers()
-            self.wfile.write(body)
+        if parsed.path.startswith(OTA_PREFIX):
+            self._send_bundle_file(parsed.path[len(OTA_PREFIX) :], head=False)
+        elif parsed.path.count("/") == 2 and parsed.path.endswith("/health"):
+            # Every service's health check; delay_ms, status and health let tests play a sick one.
+            query = parse_qs(parsed.query)
+            time.sleep(int(query.get("delay_ms", ["0"])[0]) / 1000)
+            service = parsed.path.split("/")[1]
+            self._send_json(int(query.get("status", ["200"])[0]), {"status": query.get("health", ["ok"])[0], "service": service})
+        elif parsed.path.count("/") == 2 and parsed.path.endswith("/metrics"):
+            self._send_metrics(parsed.path.split("/")[1], parse_qs(parsed.query))
+        elif parsed.path == "/device-registry/devices":
+            query = parse_qs(parsed.query)
+            count = int(query.get("count", [MOCK_DEVICE_COUNT])[0])
+            devices = [
+                {"id": f"device-{index:05d}", "name": f"Mock device {index}", "room": "lab", "online": index % 3 != 0}
+                for index in range(count)
+            ]
+            if "limit" in query or "cursor" in query:
+                self._send_page("devices", devices, query)
+            else:
+                self._send_json_conditional({"devices": devices})
+        elif parsed.path == "/device-registry/devices/changes":
+            self._send_changes(parse_qs(parsed.query))
+        elif parsed.path == "/audit-log/entries":
+            query = parse_qs(parsed.query)
+            count = int(query.get("count", ["250"])[0])
+            entries = [
+                {"sequence": index, "actor": "mock", "action": "device.update", "outcome": "allowed"}
+                for index in reversed(range(count))
+            ]
+            self._send_page("entries", entries, query)
+        elif parsed.path == "/presence-svc/v1/presence/events":
+            self._stream_events(parse_qs(parsed.query))
+        elif parsed.path == "/scene-svc/flaky":
+            self._flaky(parse_qs(parsed.query))
         else:
             self.send_error(404, "Not Found")
 
+    def _apply_scene(self) -> None:
+        try:
+            result = _apply_scene_request(json.loads(self._read_body()))
+        except (ValueError, KeyError, TypeError, AttributeError):
+            self._send_json(400, {"error": {"code": "invalid_scene", "message": "malformed scene request"}})
+            return
+        self._send_json(200, result)
+
+    def _apply_scenes(self) -> None:
+        try:
+            scenes = json.loads(self._read_body())["scenes"]
+            if not scenes or len(scenes) > 64:
+                raise ValueError("batch size")
+            results = [_apply_scene_request(scene) for scene in scenes]
+        except (ValueError, KeyError, TypeError, AttributeError):
+            self._send_json(400, {"error": {"code": "invalid_batch", "message": "malformed batch"}})
+            return
+        self._send_json(200, {"results": results})
+
     def do_POST(self):  # noqa: N802 - inherited API
         parsed = urlparse(self.path)
-        if parsed.path == "/scene-svc/scenes/apply":
-            length = int(self.headers.get("Content-Length", "0"))
-            if length:
-                _ = self.rfile.read(length)
-            body = json.dumps({"status": "accepted"}).encode("utf-8")
-            self.send_response(202)
-            self.send_header("Content-Type", "application/json")
-            self.send_header("Content-Length", str(len(body)))
+        path = parsed.path
+        if path.startswith(LEGACY_PREFIX + "/"):
+            path = path[len(LEGACY_PREFIX) :]
+            if path == "/scene-svc/v1/scenes:batchApply":
+                self._read_body()
+                self.send_error(404, "Not Found")
+                return
+        if path == "/scene-svc/scenes/apply":
+            self._read_body()
+            self._send_json(202, {"status": "accepted"})
+        elif path == "/scene-svc/v1/scenes:apply":
+            self._apply_scene()
+        elif path == "/scene-svc/v1/scenes:batchApply":
+            self._apply_scenes()
+        elif path == "/scene-svc/flaky":
+            self._read_body()
+            self._flaky(parse_qs(parsed.query))
+        elif path == "/device-registry/devices/changes/churn":
+            self._read_body()
+            self._churn_devices(parse_qs(parsed.query))
+        elif path == "/telemetry-pipe/ingest":
+            self._read_body()
+            self._send_json(202, {"accepted": 1})
+        elif path == "/telemetry-pipe/ingest/batch":
+            body = self._read_body()
+            try:
+                if self.headers.get("Content-Type") == "application/cbor":
+                    envelopes = _cbor_decode(body)["envelopes"]
+                else:
+                    envelopes = json.loads(body)["envelopes"]
+            except (ValueError, KeyError, TypeError, IndexError):
+                self._send_json(400, {"error": {"code": "invalid_batch", "message": "malformed batch"}})
+                return
+            self._send_json(202, {"accepted": len(envelopes)})
+        else:
+            self.send_error(404, "Not Found")
+
+
+    def do_DELETE(self):  # noqa: N802 - inherited API
+        global CHANGE_LOG
+        if urlparse(self.path).path == "/device-registry/devices/changes":
+            # Restarts the change log, as a restored registry database would.
+            with CHANGE_LOCK:
+                CHANGE_LOG = [(device["id"], device) for device in map(_mock_registry_device, range(MOCK_DEVICE_COUNT))]
+            self.send_response(204)
+            self.send_header("Content-Length", "0")
             self.end_headers()
-            self.wfile.write(body)
         else:
             self.send_error(404, "Not Found")
 
 
+class MockServer(ThreadingHTTPServer):
+    # SDK concurrency tests open many connections at once; the default backlog of 5 drops SYNs.
+    request_queue_size = 128
+    daemon_threads = True
+
+
 def require_env(name: str) -> str:
     value = os.environ.get(name)
     if not value:
@@ -63,7 +492,7 @@ def run() -> None:
     context.load_verify_locations(cafile=ca_cert)
     context.verify_mode = ssl.CERT_REQUIRED
 
-    httpd = HTTPServer((host, port), SceneServiceHandler)
+    httpd = MockServer((host, port), SceneServiceHandler)
     httpd.socket = context.wrap_socket(httpd.socket, server_side=True)
 
     print(f"Mock scene service listening on https://{bind}")
@@ -0,0 +1,337 @@
+#include "lokan.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/*
+ * Load generator for the C SDK. Each worker thread owns a client and issues
+ * a weighted mix of lokan_get_health and lokan_apply_scene calls until the
+ * deadline; latencies are merged afterwards for exact percentiles.
+ *
+ * Allocation counts come from interposing malloc and friends, which only
+ * works on glibc; elsewhere they are reported as unavailable.
+ */
+
+#if defined(__GLIBC__)
+#define LOKAN_BENCH_COUNT_ALLOCS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t bench_allocations = 0;
+
+void *malloc(size_t size) {
+    __atomic_fetch_add(&bench_allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    __atomic_fetch_add(&bench_allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_fetch_add(&bench_allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+static uint64_t bench_allocation_count(void) {
+    return __atomic_load_n(&bench_allocations, __ATOMIC_RELAXED);
+}
+#else
+#define LOKAN_BENCH_COUNT_ALLOCS 0
+
+static uint64_t bench_allocation_count(void) {
+    return 0;
+}
+#endif
+
+typedef struct {
+    const char *base_url;
+    const char *client_cert;
+    const char *client_key;
+    const char *ca_cert;
+    int concurrency;
+    double duration_s;
+    double warmup_s;
+    /* Percentage of requests that call lokan_apply_scene; the rest are health checks. */
+    int apply_percent;
+    int enable_http2;
+    int json;
+} bench_options_t;
+
+typedef struct {
+    const bench_options_t *options;
+    lokan_client_t *client;
+    unsigned int seed;
+    int64_t *latencies_ns;
+    size_t count;
+    size_t capacity;
+    uint64_t errors;
+} bench_worker_t;
+
+static pthread_barrier_t bench_start;
+static int64_t bench_measure_from_ns;
+static int64_t bench_deadline_ns;
+
+static const char *env_or_default(const char *name, const char *fallback) {
+    const char *value = getenv(name);
+    if (value && value[0] != '\0') {
+        return value;
+    }
+    return fallback;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double cpu_seconds(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6 +
+           (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+}
+
+static int record_latency(bench_worker_t *worker, int64_t latency_ns) {
+    if (worker->count == worker->capacity) {
+        size_t capacity = worker->capacity ? worker->capacity * 2 : 4096;
+        int64_t *latencies = (int64_t *)realloc(worker->latencies_ns, capacity * sizeof(int64_t));
+        if (!latencies) {
+            return -1;
+        }
+        worker->latencies_ns = latencies;
+        worker->capacity = capacity;
+    }
+    worker->latencies_ns[worker->count++] = latency_ns;
+    return 0;
+}
+
+static lokan_result_t bench_issue(bench_worker_t *worker) {
+    int roll = (int)(rand_r(&worker->seed) % 100);
+    if (roll < worker->options->apply_percent) {
+        return lokan_apply_scene(worker->client, "bench-scene", "{\"brightness\":50}");
+    }
+    lokan_view_t status;
+    return lokan_get_health_view(worker->client, &status);
+}
+
+static void *bench_worker_main(void *arg) {
+    bench_worker_t *worker = (bench_worker_t *)arg;
+    pthread_barrier_wait(&bench_start);
+
+    for (;;) {
+        int64_t started = now_ns();
+        if (started >= bench_deadline_ns) {
+            break;
+        }
+        lokan_result_t result = bench_issue(worker);
+        int64_t finished = now_ns();
+        if (started < bench_measure_from_ns) {
+            continue;
+        }
+        if (result != LOKAN_OK) {
+            worker->errors++;
+        }
+        if (record_latency(worker, finished - started) != 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int compare_i64(const void *a, const void *b) {
+    int64_t lhs = *(const int64_t *)a;
+    int64_t rhs = *(const int64_t *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static double percentile_ms(const int64_t *sorted, size_t count, double quantile) {
+    if (count == 0) {
+        return 0.0;
+    }
+    size_t index = (size_t)(quantile * (double)(count - 1) + 0.5);
+    return (double)sorted[index] / 1e6;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [--url URL] [--concurrency N] [--duration SECONDS] [--warmup SECONDS]\n"
+            "          [--apply-percent 0-100] [--http2] [--json]\n"
+            "TLS material is read from LOKAN_SDK_CLIENT_CERT, LOKAN_SDK_CLIENT_KEY and LOKAN_SDK_CA_CERT.\n",
+            argv0);
+}
+
+static int parse_options(int argc, char **argv, bench_options_t *options) {
+    options->base_url = env_or_default("LOKAN_SDK_BASE_URL", "https://localhost:9443/scene-svc");
+    options->client_cert = getenv("LOKAN_SDK_CLIENT_CERT");
+    options->client_key = getenv("LOKAN_SDK_CLIENT_KEY");
+    options->ca_cert = getenv("LOKAN_SDK_CA_CERT");
+    options->concurrency = 4;
+    options->duration_s = 10.0;
+    options->warmup_s = 1.0;
+    options->apply_percent = 20;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--http2") == 0) {
+            options->enable_http2 = 1;
+        } else if (strcmp(arg, "--json") == 0) {
+            options->json = 1;
+        } else if (value && strcmp(arg, "--url") == 0) {
+            options->base_url = value;
+            i++;
+        } else if (value && strcmp(arg, "--concurrency") == 0) {
+            options->concurrency = atoi(value);
+            i++;
+        } else if (value && strcmp(arg, "--duration") == 0) {
+            options->duration_s = atof(value);
+            i++;
+        } else if (value && strcmp(arg, "--warmup") == 0) {
+            options->warmup_s = atof(value);
+            i++;
+        } else if (value && strcmp(arg, "--apply-percent") == 0) {
+            options->apply_percent = atoi(value);
+            i++;
+        } else {
+            return -1;
+        }
+    }
+
+    if (options->concurrency <= 0 || options->duration_s <= 0 || options->warmup_s < 0 ||
+        options->apply_percent < 0 || options->apply_percent > 100) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    bench_options_t options = {0};
+    if (parse_options(argc, argv, &options) != 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!options.client_cert || !options.client_key || !options.ca_cert) {
+        fprintf(stderr, "Missing TLS configuration. Set LOKAN_SDK_CLIENT_CERT, LOKAN_SDK_CLIENT_KEY, and LOKAN_SDK_CA_CERT.\n");
+        return 1;
+    }
+
+    lokan_client_config_t config = {
+        .base_url = options.base_url,
+        .client_cert_path = options.client_cert,
+        .client_key_path = options.client_key,
+        .ca_cert_path = options.ca_cert,
+        .timeout_ms = 5000,
+        .enable_http2 = options.enable_http2,
+    };
+
+    bench_worker_t *workers = (bench_worker_t *)calloc((size_t)options.concurrency, sizeof(bench_worker_t));
+    pthread_t *threads = (pthread_t *)calloc((size_t)options.concurrency, sizeof(pthread_t));
+    if (!workers || !threads) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < options.concurrency; ++i) {
+        workers[i].options = &options;
+        workers[i].seed = (unsigned int)(i * 2654435761u + 1);
+        lokan_result_t result = lokan_client_init(&workers[i].client, &config);
+        if (result != LOKAN_OK) {
+            fprintf(stderr, "Failed to initialize client: %s\n", lokan_result_string(result));
+            return 1;
+        }
+    }
+
+    pthread_barrier_init(&bench_start, NULL, (unsigned int)options.concurrency + 1);
+    for (int i = 0; i < options.concurrency; ++i) {
+        pthread_create(&threads[i], NULL, bench_worker_main, &workers[i]);
+    }
+
+    int64_t started = now_ns();
+    bench_measure_from_ns = started + (int64_t)(options.warmup_s * 1e9);
+    bench_deadline_ns = bench_measure_from_ns + (int64_t)(options.duration_s * 1e9);
+    pthread_barrier_wait(&bench_start);
+
+    /* Warmup requests open connections and fill caches; only the window after it counts. */
+    struct timespec warmup = {(time_t)options.warmup_s, (long)((options.warmup_s - (double)(time_t)options.warmup_s) * 1e9)};
+    nanosleep(&warmup, NULL);
+    uint64_t allocations_before = bench_allocation_count();
+    double cpu_before = cpu_seconds();
+
+    for (int i = 0; i < options.concurrency; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t allocations_after = bench_allocation_count();
+    double cpu_after = cpu_seconds();
+    double elapsed_s = (double)(now_ns() - bench_measure_from_ns) / 1e9;
+
+    size_t total = 0;
+    uint64_t errors = 0;
+    for (int i = 0; i < options.concurrency; ++i) {
+        total += workers[i].count;
+        errors += workers[i].errors;
+    }
+    int64_t *latencies = (int64_t *)malloc((total > 0 ? total : 1) * sizeof(int64_t));
+    if (!latencies) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    size_t offset = 0;
+    for (int i = 0; i < options.concurrency; ++i) {
+        memcpy(latencies + offset, workers[i].latencies_ns, workers[i].count * sizeof(int64_t));
+        offset += workers[i].count;
+    }
+    qsort(latencies, total, sizeof(int64_t), compare_i64);
+
+    double rps = elapsed_s > 0 ? (double)total / elapsed_s : 0.0;
+    double p50 = percentile_ms(latencies, total, 0.50);
+    double p99 = percentile_ms(latencies, total, 0.99);
+    double p999 = percentile_ms(latencies, total, 0.999);
+    double cpu_us = total > 0 ? (cpu_after - cpu_before) * 1e6 / (double)total : 0.0;
+    /* Includes the harness's own latency array growth, which is amortized to ~0. */
+    double allocs = total > 0 ? (double)(allocations_after - allocations_before) / (double)total : 0.0;
+
+    if (options.json) {
+        printf("{\"requests\":%zu,\"errors\":%llu,\"rps\":%.1f,\"p50_ms\":%.3f,\"p99_ms\":%.3f,"
+               "\"p999_ms\":%.3f,\"cpu_us_per_request\":%.1f,",
+               total, (unsigned long long)errors, rps, p50, p99, p999, cpu_us);
+        if (LOKAN_BENCH_COUNT_ALLOCS) {
+            printf("\"allocs_per_request\":%.2f}\n", allocs);
+        } else {
+            printf("\"allocs_per_request\":null}\n");
+        }
+    } else {
+        printf("target           %s\n", options.base_url);
+        printf("concurrency      %d\n", options.concurrency);
+        printf("mix              %d%% apply_scene, %d%% health\n", options.apply_percent, 100 - options.apply_percent);
+        printf("requests         %zu (%llu errors) in %.2f s\n", total, (unsigned long long)errors, elapsed_s);
+        printf("throughput       %.1f req/s\n", rps);
+        printf("latency p50      %.3f ms\n", p50);
+        printf("latency p99      %.3f ms\n", p99);
+        printf("latency p999     %.3f ms\n", p999);
+        printf("cpu per request  %.1f us\n", cpu_us);
+        if (LOKAN_BENCH_COUNT_ALLOCS) {
+            printf("allocs/request   %.2f\n", allocs);
+        } else {
+            printf("allocs/request   unavailable (requires glibc)\n");
+        }
+    }
+
+    free(latencies);
+    for (int i = 0; i < options.concurrency; ++i) {
+        lokan_client_cleanup(workers[i].client);
+        free(workers[i].latencies_ns);
+    }
+    pthread_barrier_destroy(&bench_start);
+    free(threads);
+    free(workers);
+    return errors > 0 ? 1 : 0;
+}
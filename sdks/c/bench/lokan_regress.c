@@ -0,0 +1,818 @@
+/* RTLD_NEXT, for the syscall counters below. */
+#define _GNU_SOURCE
+
+#include "lokan.h"
+
+#include <dlfcn.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Performance regression suite for the C SDK. It replays a recorded request
+ * mix, one JSON object per line, against a service such as the docker/dev
+ * stub and measures every call: allocations made through the SDK's allocator
+ * hooks, syscalls, and latency percentiles per operation. The results can be
+ * written out as a baseline, and a later run compared against one fails when
+ * any gated metric grew past its threshold.
+ *
+ * Calls are replayed one at a time on one client, so every allocation and
+ * syscall between the start and end of a call belongs to it. The client's
+ * allocator counts the SDK's own memory; libcurl's, and strings returned to
+ * the caller, go through the global allocator, counted separately so a
+ * libcurl upgrade does not read as an SDK regression.
+ *
+ * Syscalls are counted by interposing the socket, read/write and poll
+ * wrappers libcurl calls, which only works on glibc; elsewhere they are
+ * reported as unavailable.
+ */
+
+#if defined(__GLIBC__)
+#define LOKAN_REGRESS_COUNT_SYSCALLS 1
+
+static uint64_t regress_syscalls = 0;
+
+/* Defines name to count the call and forward it to the next definition, libc's. */
+#define REGRESS_WRAP(ret, name, params, args)                       \
+    ret name params {                                               \
+        static void *real;                                          \
+        void *fn = __atomic_load_n(&real, __ATOMIC_RELAXED);        \
+        if (!fn) {                                                  \
+            fn = dlsym(RTLD_NEXT, #name);                           \
+            __atomic_store_n(&real, fn, __ATOMIC_RELAXED);          \
+        }                                                           \
+        __atomic_fetch_add(&regress_syscalls, 1, __ATOMIC_RELAXED); \
+        ret(*call) params;                                          \
+        memcpy(&call, &fn, sizeof(call));                           \
+        return call args;                                           \
+    }
+
+REGRESS_WRAP(int, socket, (int domain, int type, int protocol), (domain, type, protocol))
+REGRESS_WRAP(int, connect, (int fd, __CONST_SOCKADDR_ARG addr, socklen_t len), (fd, addr, len))
+REGRESS_WRAP(int, close, (int fd), (fd))
+REGRESS_WRAP(ssize_t, send, (int fd, const void *buf, size_t len, int flags), (fd, buf, len, flags))
+REGRESS_WRAP(ssize_t, recv, (int fd, void *buf, size_t len, int flags), (fd, buf, len, flags))
+REGRESS_WRAP(
+    ssize_t,
+    sendto,
+    (int fd, const void *buf, size_t len, int flags, __CONST_SOCKADDR_ARG addr, socklen_t addr_len),
+    (fd, buf, len, flags, addr, addr_len))
+REGRESS_WRAP(
+    ssize_t,
+    recvfrom,
+    (int fd, void *buf, size_t len, int flags, __SOCKADDR_ARG addr, socklen_t *addr_len),
+    (fd, buf, len, flags, addr, addr_len))
+REGRESS_WRAP(ssize_t, sendmsg, (int fd, const struct msghdr *msg, int flags), (fd, msg, flags))
+REGRESS_WRAP(ssize_t, recvmsg, (int fd, struct msghdr *msg, int flags), (fd, msg, flags))
+REGRESS_WRAP(ssize_t, read, (int fd, void *buf, size_t len), (fd, buf, len))
+REGRESS_WRAP(ssize_t, write, (int fd, const void *buf, size_t len), (fd, buf, len))
+REGRESS_WRAP(int, poll, (struct pollfd *fds, nfds_t count, int timeout), (fds, count, timeout))
+REGRESS_WRAP(
+    int,
+    setsockopt,
+    (int fd, int level, int name, const void *value, socklen_t len),
+    (fd, level, name, value, len))
+REGRESS_WRAP(
+    int,
+    getsockopt,
+    (int fd, int level, int name, void *value, socklen_t *len),
+    (fd, level, name, value, len))
+REGRESS_WRAP(int, getsockname, (int fd, __SOCKADDR_ARG addr, socklen_t *len), (fd, addr, len))
+REGRESS_WRAP(int, getpeername, (int fd, __SOCKADDR_ARG addr, socklen_t *len), (fd, addr, len))
+
+static uint64_t regress_syscall_count(void) {
+    return __atomic_load_n(&regress_syscalls, __ATOMIC_RELAXED);
+}
+#else
+#define LOKAN_REGRESS_COUNT_SYSCALLS 0
+
+static uint64_t regress_syscall_count(void) {
+    return 0;
+}
+#endif
+
+/* Longest trace or baseline line. */
+#define REGRESS_LINE_MAX 65536
+/* Scenes per apply_scenes entry, the batch endpoint's limit. */
+#define REGRESS_BATCH_MAX 64
+/* Slack on top of each relative threshold, so a metric near zero does not fail on noise. */
+#define REGRESS_ALLOC_SLACK 0.5
+#define REGRESS_BYTES_SLACK 64.0
+#define REGRESS_SYSCALL_SLACK 0.5
+#define REGRESS_LATENCY_SLACK_US 50.0
+
+typedef enum { REGRESS_HEALTH, REGRESS_APPLY_SCENE, REGRESS_APPLY_SCENES, REGRESS_ASYNC, REGRESS_OP_COUNT } regress_op_t;
+
+static const char *const regress_op_names[REGRESS_OP_COUNT] = {"health", "apply_scene", "apply_scenes", "async"};
+
+typedef struct {
+    regress_op_t op;
+    char *scene;
+    /* Body for apply_scene, or NULL for the default envelope. */
+    char *payload;
+    /* Path of the async requests, relative to the base URL. */
+    char *path;
+    /* Scenes for apply_scenes, requests submitted at once for async. */
+    size_t count;
+} regress_entry_t;
+
+typedef struct {
+    uint64_t calls;
+    uint64_t bytes;
+} regress_counter_t;
+
+/* Per-call averages and latency percentiles of one op, as written to and read from a baseline. */
+typedef struct {
+    uint64_t calls;
+    uint64_t errors;
+    double sdk_allocs;
+    double sdk_bytes;
+    double global_allocs;
+    double syscalls;
+    double p50_us;
+    double p99_us;
+    int present;
+} regress_metrics_t;
+
+typedef struct {
+    int64_t *latencies_ns;
+    size_t count;
+    size_t capacity;
+    uint64_t errors;
+    uint64_t sdk_allocs;
+    uint64_t sdk_bytes;
+    uint64_t global_allocs;
+    uint64_t syscalls;
+} regress_samples_t;
+
+typedef struct {
+    const char *base_url;
+    const char *client_cert;
+    const char *client_key;
+    const char *ca_cert;
+    const char *trace_path;
+    const char *output_path;
+    const char *baseline_path;
+    int passes;
+    int warmup_passes;
+    unsigned int seed;
+    size_t arena_bytes;
+    int enable_http2;
+    int gate_allocs;
+    int gate_syscalls;
+    int gate_latency;
+    double alloc_threshold;
+    double syscall_threshold;
+    double latency_threshold;
+} regress_options_t;
+
+static regress_counter_t regress_sdk_memory;
+static regress_counter_t regress_global_memory;
+
+static void *regress_malloc(size_t size, void *ctx) {
+    regress_counter_t *counter = (regress_counter_t *)ctx;
+    __atomic_fetch_add(&counter->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counter->bytes, (uint64_t)size, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+static void *regress_realloc(void *ptr, size_t size, void *ctx) {
+    regress_counter_t *counter = (regress_counter_t *)ctx;
+    __atomic_fetch_add(&counter->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counter->bytes, (uint64_t)size, __ATOMIC_RELAXED);
+    return realloc(ptr, size);
+}
+
+static void regress_free(void *ptr, void *ctx) {
+    (void)ctx;
+    free(ptr);
+}
+
+static const char *env_or_default(const char *name, const char *fallback) {
+    const char *value = getenv(name);
+    if (value && value[0] != '\0') {
+        return value;
+    }
+    return fallback;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static char *regress_strdup(const char *value) {
+    size_t len = strlen(value);
+    char *copy = (char *)malloc(len + 1);
+    if (copy) {
+        memcpy(copy, value, len + 1);
+    }
+    return copy;
+}
+
+/* Top-level members of one JSON line, scalars only, collected by regress_parse_line. */
+#define REGRESS_FIELDS_MAX 16
+
+typedef struct {
+    char *key;
+    char *value;
+} regress_field_t;
+
+typedef struct {
+    regress_field_t fields[REGRESS_FIELDS_MAX];
+    size_t count;
+    char *pending_key;
+} regress_fields_t;
+
+static int regress_on_field(lokan_json_event_t event, const char *text, size_t len, size_t depth, void *user_data) {
+    regress_fields_t *fields = (regress_fields_t *)user_data;
+    if (depth != 1) {
+        return 0;
+    }
+    if (event == LOKAN_JSON_KEY) {
+        free(fields->pending_key);
+        fields->pending_key = (char *)malloc(len + 1);
+        if (!fields->pending_key) {
+            return 1;
+        }
+        memcpy(fields->pending_key, text, len);
+        fields->pending_key[len] = '\0';
+        return 0;
+    }
+    if (!text || !fields->pending_key || fields->count == REGRESS_FIELDS_MAX) {
+        return 0;
+    }
+    char *value = (char *)malloc(len + 1);
+    if (!value) {
+        return 1;
+    }
+    memcpy(value, text, len);
+    value[len] = '\0';
+    fields->fields[fields->count].key = fields->pending_key;
+    fields->fields[fields->count].value = value;
+    fields->count++;
+    fields->pending_key = NULL;
+    return 0;
+}
+
+static void regress_fields_clear(regress_fields_t *fields) {
+    for (size_t i = 0; i < fields->count; ++i) {
+        free(fields->fields[i].key);
+        free(fields->fields[i].value);
+    }
+    free(fields->pending_key);
+    memset(fields, 0, sizeof(*fields));
+}
+
+static const char *regress_field(const regress_fields_t *fields, const char *key) {
+    for (size_t i = 0; i < fields->count; ++i) {
+        if (strcmp(fields->fields[i].key, key) == 0) {
+            return fields->fields[i].value;
+        }
+    }
+    return NULL;
+}
+
+static double regress_field_number(const regress_fields_t *fields, const char *key) {
+    const char *value = regress_field(fields, key);
+    return value ? atof(value) : 0.0;
+}
+
+static lokan_result_t regress_parse_line(lokan_json_parser_t *parser, const char *line, regress_fields_t *fields) {
+    regress_fields_clear(fields);
+    lokan_json_parser_reset(parser);
+    lokan_result_t result = lokan_json_parser_feed(parser, line, strlen(line));
+    return result == LOKAN_OK ? lokan_json_parser_finish(parser) : result;
+}
+
+static int regress_is_blank(const char *line) {
+    while (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n') {
+        line++;
+    }
+    return *line == '\0';
+}
+
+/* Calls on_line with the fields of every non-blank line of path; returns the number of lines read, or -1. */
+static long regress_read_jsonl(
+    const char *path,
+    int (*on_line)(const regress_fields_t *fields, long line_number, void *user_data),
+    void *user_data) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return -1;
+    }
+    regress_fields_t fields;
+    memset(&fields, 0, sizeof(fields));
+    lokan_json_parser_config_t config = {.on_event = regress_on_field, .user_data = &fields};
+    lokan_json_parser_t *parser = NULL;
+    char *line = (char *)malloc(REGRESS_LINE_MAX);
+    long lines = 0;
+    long number = 0;
+    if (!line || lokan_json_parser_create(&parser, &config) != LOKAN_OK) {
+        lines = -1;
+    }
+    while (lines >= 0 && fgets(line, REGRESS_LINE_MAX, file)) {
+        number++;
+        if (regress_is_blank(line)) {
+            continue;
+        }
+        if (regress_parse_line(parser, line, &fields) != LOKAN_OK) {
+            fprintf(stderr, "%s:%ld: not a JSON object\n", path, number);
+            lines = -1;
+        } else if (on_line(&fields, number, user_data) != 0) {
+            lines = -1;
+        } else {
+            lines++;
+        }
+    }
+    regress_fields_clear(&fields);
+    lokan_json_parser_destroy(parser);
+    free(line);
+    fclose(file);
+    return lines;
+}
+
+typedef struct {
+    const char *path;
+    regress_entry_t *entries;
+    size_t count;
+    size_t capacity;
+} regress_trace_t;
+
+static int regress_on_trace_line(const regress_fields_t *fields, long line_number, void *user_data) {
+    regress_trace_t *trace = (regress_trace_t *)user_data;
+    const char *op = regress_field(fields, "op");
+    regress_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.op = REGRESS_OP_COUNT;
+    for (int i = 0; op && i < REGRESS_OP_COUNT; ++i) {
+        if (strcmp(op, regress_op_names[i]) == 0) {
+            entry.op = (regress_op_t)i;
+        }
+    }
+    double count = regress_field_number(fields, "count");
+    entry.count = count > 0 ? (size_t)count : 8;
+    if (entry.op == REGRESS_OP_COUNT || (entry.op == REGRESS_APPLY_SCENES && entry.count > REGRESS_BATCH_MAX)) {
+        fprintf(stderr, "%s:%ld: unknown op or count out of range\n", trace->path, line_number);
+        return 1;
+    }
+    if (trace->count == trace->capacity) {
+        size_t capacity = trace->capacity ? trace->capacity * 2 : 64;
+        regress_entry_t *entries = (regress_entry_t *)realloc(trace->entries, capacity * sizeof(regress_entry_t));
+        if (!entries) {
+            return 1;
+        }
+        trace->entries = entries;
+        trace->capacity = capacity;
+    }
+    const char *scene = regress_field(fields, "scene");
+    const char *payload = regress_field(fields, "payload");
+    const char *path = regress_field(fields, "path");
+    entry.scene = regress_strdup(scene ? scene : "regress-scene");
+    entry.payload = payload ? regress_strdup(payload) : NULL;
+    entry.path = regress_strdup(path ? path : "/health");
+    /* Appended even when a copy failed, so the trace frees what did succeed. */
+    trace->entries[trace->count++] = entry;
+    return !entry.scene || !entry.path || (payload && !entry.payload);
+}
+
+static int regress_on_baseline_line(const regress_fields_t *fields, long line_number, void *user_data) {
+    regress_metrics_t *baseline = (regress_metrics_t *)user_data;
+    (void)line_number;
+    const char *op = regress_field(fields, "op");
+    for (int i = 0; op && i < REGRESS_OP_COUNT; ++i) {
+        if (strcmp(op, regress_op_names[i]) == 0) {
+            regress_metrics_t *metrics = &baseline[i];
+            metrics->calls = (uint64_t)regress_field_number(fields, "calls");
+            metrics->errors = (uint64_t)regress_field_number(fields, "errors");
+            metrics->sdk_allocs = regress_field_number(fields, "sdk_allocs_per_call");
+            metrics->sdk_bytes = regress_field_number(fields, "sdk_bytes_per_call");
+            metrics->global_allocs = regress_field_number(fields, "global_allocs_per_call");
+            metrics->syscalls = regress_field_number(fields, "syscalls_per_call");
+            metrics->p50_us = regress_field_number(fields, "p50_us");
+            metrics->p99_us = regress_field_number(fields, "p99_us");
+            metrics->present = 1;
+        }
+    }
+    /* Ops this build does not know are ignored, so older binaries can read newer baselines. */
+    return 0;
+}
+
+static void regress_trace_free(regress_trace_t *trace) {
+    for (size_t i = 0; i < trace->count; ++i) {
+        free(trace->entries[i].scene);
+        free(trace->entries[i].payload);
+        free(trace->entries[i].path);
+    }
+    free(trace->entries);
+}
+
+static void regress_on_complete(const lokan_response_t *response, void *user_data) {
+    size_t *failed = (size_t *)user_data;
+    if (response->result != LOKAN_OK) {
+        (*failed)++;
+    }
+    failed[1]++;
+}
+
+static lokan_result_t regress_issue(lokan_client_t *client, const regress_entry_t *entry) {
+    switch (entry->op) {
+    case REGRESS_HEALTH: {
+        char *status = NULL;
+        lokan_result_t result = lokan_get_health(client, &status);
+        lokan_string_free(status);
+        return result;
+    }
+    case REGRESS_APPLY_SCENE:
+        return lokan_apply_scene(client, entry->scene, entry->payload);
+    case REGRESS_APPLY_SCENES: {
+        lokan_scene_apply_t scenes[REGRESS_BATCH_MAX];
+        lokan_scene_result_t results[REGRESS_BATCH_MAX];
+        for (size_t i = 0; i < entry->count; ++i) {
+            scenes[i].scene_id = entry->scene;
+            scenes[i].payload_json = entry->payload;
+        }
+        return lokan_apply_scenes(client, scenes, entry->count, results);
+    }
+    case REGRESS_ASYNC: {
+        /* Failed and completed requests. */
+        size_t tally[2] = {0, 0};
+        for (size_t i = 0; i < entry->count; ++i) {
+            lokan_result_t result = lokan_request_submit(client, "GET", entry->path, NULL, 0, regress_on_complete, tally);
+            if (result != LOKAN_OK) {
+                return result;
+            }
+        }
+        while (tally[1] < entry->count) {
+            lokan_result_t result = lokan_client_poll(client, 1000, NULL);
+            if (result != LOKAN_OK) {
+                return result;
+            }
+        }
+        return tally[0] > 0 ? LOKAN_ERROR_HTTP : LOKAN_OK;
+    }
+    default:
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+}
+
+static int regress_record(regress_samples_t *samples, int64_t latency_ns) {
+    if (samples->count == samples->capacity) {
+        size_t capacity = samples->capacity ? samples->capacity * 2 : 1024;
+        int64_t *latencies = (int64_t *)realloc(samples->latencies_ns, capacity * sizeof(int64_t));
+        if (!latencies) {
+            return -1;
+        }
+        samples->latencies_ns = latencies;
+        samples->capacity = capacity;
+    }
+    samples->latencies_ns[samples->count++] = latency_ns;
+    return 0;
+}
+
+/* Runs every entry once, in trace order or, with a seed, in a fresh shuffle; samples is NULL for warmup. */
+static int regress_pass(lokan_client_t *client, const regress_trace_t *trace, size_t *order, unsigned int *seed, regress_samples_t *samples) {
+    if (*seed != 0) {
+        for (size_t i = trace->count; i > 1; --i) {
+            size_t j = (size_t)rand_r(seed) % i;
+            size_t swap = order[i - 1];
+            order[i - 1] = order[j];
+            order[j] = swap;
+        }
+    }
+    for (size_t i = 0; i < trace->count; ++i) {
+        const regress_entry_t *entry = &trace->entries[order[i]];
+        uint64_t sdk_allocs = __atomic_load_n(&regress_sdk_memory.calls, __ATOMIC_RELAXED);
+        uint64_t sdk_bytes = __atomic_load_n(&regress_sdk_memory.bytes, __ATOMIC_RELAXED);
+        uint64_t global_allocs = __atomic_load_n(&regress_global_memory.calls, __ATOMIC_RELAXED);
+        uint64_t syscalls = regress_syscall_count();
+        int64_t started = now_ns();
+        lokan_result_t result = regress_issue(client, entry);
+        int64_t finished = now_ns();
+        if (!samples) {
+            continue;
+        }
+        regress_samples_t *op = &samples[entry->op];
+        op->sdk_allocs += __atomic_load_n(&regress_sdk_memory.calls, __ATOMIC_RELAXED) - sdk_allocs;
+        op->sdk_bytes += __atomic_load_n(&regress_sdk_memory.bytes, __ATOMIC_RELAXED) - sdk_bytes;
+        op->global_allocs += __atomic_load_n(&regress_global_memory.calls, __ATOMIC_RELAXED) - global_allocs;
+        op->syscalls += regress_syscall_count() - syscalls;
+        if (result != LOKAN_OK) {
+            op->errors++;
+        }
+        if (regress_record(op, finished - started) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int compare_i64(const void *a, const void *b) {
+    int64_t lhs = *(const int64_t *)a;
+    int64_t rhs = *(const int64_t *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static double percentile_us(const int64_t *sorted, size_t count, double quantile) {
+    if (count == 0) {
+        return 0.0;
+    }
+    size_t index = (size_t)(quantile * (double)(count - 1) + 0.5);
+    return (double)sorted[index] / 1e3;
+}
+
+static void regress_summarize(regress_samples_t *samples, regress_metrics_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (samples->count == 0) {
+        return;
+    }
+    double calls = (double)samples->count;
+    qsort(samples->latencies_ns, samples->count, sizeof(int64_t), compare_i64);
+    out->calls = samples->count;
+    out->errors = samples->errors;
+    out->sdk_allocs = (double)samples->sdk_allocs / calls;
+    out->sdk_bytes = (double)samples->sdk_bytes / calls;
+    out->global_allocs = (double)samples->global_allocs / calls;
+    out->syscalls = (double)samples->syscalls / calls;
+    out->p50_us = percentile_us(samples->latencies_ns, samples->count, 0.50);
+    out->p99_us = percentile_us(samples->latencies_ns, samples->count, 0.99);
+    out->present = 1;
+}
+
+static void regress_write_metrics(FILE *out, const char *op, const regress_metrics_t *metrics) {
+    fprintf(out,
+            "{\"op\":\"%s\",\"calls\":%llu,\"errors\":%llu,\"sdk_allocs_per_call\":%.2f,\"sdk_bytes_per_call\":%.1f,"
+            "\"global_allocs_per_call\":%.2f,",
+            op, (unsigned long long)metrics->calls, (unsigned long long)metrics->errors, metrics->sdk_allocs,
+            metrics->sdk_bytes, metrics->global_allocs);
+    if (LOKAN_REGRESS_COUNT_SYSCALLS) {
+        fprintf(out, "\"syscalls_per_call\":%.2f,", metrics->syscalls);
+    } else {
+        fprintf(out, "\"syscalls_per_call\":null,");
+    }
+    fprintf(out, "\"p50_us\":%.1f,\"p99_us\":%.1f}\n", metrics->p50_us, metrics->p99_us);
+}
+
+/* Returns 1 and reports it when current exceeds baseline by more than percent, plus slack. */
+static int regress_check(const char *op, const char *metric, double baseline, double current, double percent, double slack) {
+    double limit = baseline * (1.0 + percent / 100.0) + slack;
+    if (current <= limit) {
+        return 0;
+    }
+    double change = baseline > 0 ? (current - baseline) * 100.0 / baseline : 100.0;
+    printf("REGRESSION  %-13s %-14s %10.2f -> %10.2f  (%+.1f%%, limit %.2f)\n", op, metric, baseline, current, change, limit);
+    return 1;
+}
+
+static int regress_compare(const regress_options_t *options, const regress_metrics_t *baseline, const regress_metrics_t *current) {
+    int regressions = 0;
+    for (int i = 0; i < REGRESS_OP_COUNT; ++i) {
+        const char *op = regress_op_names[i];
+        if (!baseline[i].present) {
+            continue;
+        }
+        if (!current[i].present) {
+            printf("REGRESSION  %-13s not in the trace, but in the baseline\n", op);
+            regressions++;
+            continue;
+        }
+        if (options->gate_allocs) {
+            regressions += regress_check(op, "sdk_allocs", baseline[i].sdk_allocs, current[i].sdk_allocs,
+                                         options->alloc_threshold, REGRESS_ALLOC_SLACK);
+            regressions += regress_check(op, "sdk_bytes", baseline[i].sdk_bytes, current[i].sdk_bytes,
+                                         options->alloc_threshold, REGRESS_BYTES_SLACK);
+        }
+        if (options->gate_syscalls && LOKAN_REGRESS_COUNT_SYSCALLS) {
+            regressions += regress_check(op, "syscalls", baseline[i].syscalls, current[i].syscalls,
+                                         options->syscall_threshold, REGRESS_SYSCALL_SLACK);
+        }
+        if (options->gate_latency) {
+            regressions += regress_check(op, "p50_us", baseline[i].p50_us, current[i].p50_us,
+                                         options->latency_threshold, REGRESS_LATENCY_SLACK_US);
+            regressions += regress_check(op, "p99_us", baseline[i].p99_us, current[i].p99_us,
+                                         options->latency_threshold, REGRESS_LATENCY_SLACK_US);
+        }
+    }
+    return regressions;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s --trace TRACE.jsonl [--url URL] [--passes N] [--warmup-passes N] [--seed N]\n"
+            "          [--arena-bytes N] [--http2] [--output BASELINE.jsonl] [--baseline BASELINE.jsonl]\n"
+            "          [--gate allocs,syscalls,latency] [--alloc-threshold PCT] [--syscall-threshold PCT]\n"
+            "          [--latency-threshold PCT]\n"
+            "TLS material is read from LOKAN_SDK_CLIENT_CERT, LOKAN_SDK_CLIENT_KEY and LOKAN_SDK_CA_CERT.\n",
+            argv0);
+}
+
+static int parse_gate(const char *value, regress_options_t *options) {
+    options->gate_allocs = strstr(value, "allocs") != NULL;
+    options->gate_syscalls = strstr(value, "syscalls") != NULL;
+    options->gate_latency = strstr(value, "latency") != NULL;
+    return options->gate_allocs || options->gate_syscalls || options->gate_latency || strcmp(value, "none") == 0 ? 0 : -1;
+}
+
+static int parse_options(int argc, char **argv, regress_options_t *options) {
+    options->base_url = env_or_default("LOKAN_SDK_BASE_URL", "https://localhost:9443/scene-svc");
+    options->client_cert = getenv("LOKAN_SDK_CLIENT_CERT");
+    options->client_key = getenv("LOKAN_SDK_CLIENT_KEY");
+    options->ca_cert = getenv("LOKAN_SDK_CA_CERT");
+    options->passes = 20;
+    options->warmup_passes = 1;
+    options->gate_allocs = 1;
+    options->gate_syscalls = 1;
+    options->gate_latency = 1;
+    options->alloc_threshold = 10.0;
+    options->syscall_threshold = 25.0;
+    options->latency_threshold = 50.0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--http2") == 0) {
+            options->enable_http2 = 1;
+            continue;
+        }
+        if (!value) {
+            return -1;
+        }
+        i++;
+        if (strcmp(arg, "--url") == 0) {
+            options->base_url = value;
+        } else if (strcmp(arg, "--trace") == 0) {
+            options->trace_path = value;
+        } else if (strcmp(arg, "--output") == 0) {
+            options->output_path = value;
+        } else if (strcmp(arg, "--baseline") == 0) {
+            options->baseline_path = value;
+        } else if (strcmp(arg, "--passes") == 0) {
+            options->passes = atoi(value);
+        } else if (strcmp(arg, "--warmup-passes") == 0) {
+            options->warmup_passes = atoi(value);
+        } else if (strcmp(arg, "--seed") == 0) {
+            options->seed = (unsigned int)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--arena-bytes") == 0) {
+            options->arena_bytes = (size_t)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--gate") == 0) {
+            if (parse_gate(value, options) != 0) {
+                return -1;
+            }
+        } else if (strcmp(arg, "--alloc-threshold") == 0) {
+            options->alloc_threshold = atof(value);
+        } else if (strcmp(arg, "--syscall-threshold") == 0) {
+            options->syscall_threshold = atof(value);
+        } else if (strcmp(arg, "--latency-threshold") == 0) {
+            options->latency_threshold = atof(value);
+        } else {
+            return -1;
+        }
+    }
+
+    if (!options->trace_path || options->passes <= 0 || options->warmup_passes < 0 || options->alloc_threshold < 0 ||
+        options->syscall_threshold < 0 || options->latency_threshold < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    regress_options_t options;
+    memset(&options, 0, sizeof(options));
+    if (parse_options(argc, argv, &options) != 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!options.client_cert || !options.client_key || !options.ca_cert) {
+        fprintf(stderr, "Missing TLS configuration. Set LOKAN_SDK_CLIENT_CERT, LOKAN_SDK_CLIENT_KEY, and LOKAN_SDK_CA_CERT.\n");
+        return 1;
+    }
+
+    /* Must precede every other SDK call, so libcurl's memory is counted too. */
+    lokan_allocator_t global_allocator = {regress_malloc, regress_realloc, regress_free, &regress_global_memory};
+    lokan_result_t result = lokan_global_init_allocator(&global_allocator);
+    if (result != LOKAN_OK) {
+        fprintf(stderr, "Failed to initialize the SDK: %s\n", lokan_result_string(result));
+        return 1;
+    }
+
+    regress_trace_t trace;
+    memset(&trace, 0, sizeof(trace));
+    trace.path = options.trace_path;
+    long entries = regress_read_jsonl(options.trace_path, regress_on_trace_line, &trace);
+    if (entries <= 0) {
+        if (entries == 0) {
+            fprintf(stderr, "No requests in %s\n", options.trace_path);
+        }
+        regress_trace_free(&trace);
+        return 2;
+    }
+    regress_metrics_t baseline[REGRESS_OP_COUNT];
+    memset(baseline, 0, sizeof(baseline));
+    if (options.baseline_path && regress_read_jsonl(options.baseline_path, regress_on_baseline_line, baseline) < 0) {
+        regress_trace_free(&trace);
+        return 2;
+    }
+
+    lokan_allocator_t sdk_allocator = {regress_malloc, regress_realloc, regress_free, &regress_sdk_memory};
+    lokan_client_config_t config = {
+        .base_url = options.base_url,
+        .client_cert_path = options.client_cert,
+        .client_key_path = options.client_key,
+        .ca_cert_path = options.ca_cert,
+        .timeout_ms = 5000,
+        .enable_http2 = options.enable_http2,
+        .allocator = &sdk_allocator,
+        .arena_bytes = options.arena_bytes,
+    };
+    lokan_client_t *client = NULL;
+    result = lokan_client_init(&client, &config);
+    if (result != LOKAN_OK) {
+        fprintf(stderr, "Failed to initialize client: %s\n", lokan_result_string(result));
+        regress_trace_free(&trace);
+        return 1;
+    }
+
+    size_t *order = (size_t *)malloc(trace.count * sizeof(size_t));
+    regress_samples_t samples[REGRESS_OP_COUNT];
+    memset(samples, 0, sizeof(samples));
+    if (!order) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < trace.count; ++i) {
+        order[i] = i;
+    }
+    unsigned int seed = options.seed;
+    int failed = 0;
+    /* Warmup passes open connections and grow buffers to size; only the passes after them count. */
+    for (int pass = 0; pass < options.warmup_passes && !failed; ++pass) {
+        failed = regress_pass(client, &trace, order, &seed, NULL) != 0;
+    }
+    for (int pass = 0; pass < options.passes && !failed; ++pass) {
+        failed = regress_pass(client, &trace, order, &seed, samples) != 0;
+    }
+    if (failed) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    regress_metrics_t current[REGRESS_OP_COUNT];
+    uint64_t errors = 0;
+    printf("target %s, trace %s: %zu requests x %d passes\n", options.base_url, options.trace_path, trace.count, options.passes);
+    printf("%-13s %7s %6s %10s %10s %13s %9s %9s %9s\n", "op", "calls", "errors", "sdk allocs", "sdk bytes", "global allocs",
+           "syscalls", "p50 us", "p99 us");
+    for (int i = 0; i < REGRESS_OP_COUNT; ++i) {
+        regress_summarize(&samples[i], &current[i]);
+        if (!current[i].present) {
+            continue;
+        }
+        errors += current[i].errors;
+        printf("%-13s %7llu %6llu %10.2f %10.1f %13.2f ", regress_op_names[i], (unsigned long long)current[i].calls,
+               (unsigned long long)current[i].errors, current[i].sdk_allocs, current[i].sdk_bytes, current[i].global_allocs);
+        if (LOKAN_REGRESS_COUNT_SYSCALLS) {
+            printf("%9.2f ", current[i].syscalls);
+        } else {
+            printf("%9s ", "n/a");
+        }
+        printf("%9.1f %9.1f\n", current[i].p50_us, current[i].p99_us);
+    }
+
+    int status = errors > 0 ? 1 : 0;
+    if (options.output_path) {
+        FILE *out = fopen(options.output_path, "w");
+        if (!out) {
+            fprintf(stderr, "Cannot write %s\n", options.output_path);
+            status = 1;
+        } else {
+            for (int i = 0; i < REGRESS_OP_COUNT; ++i) {
+                if (current[i].present) {
+                    regress_write_metrics(out, regress_op_names[i], &current[i]);
+                }
+            }
+            fclose(out);
+        }
+    }
+    if (options.baseline_path) {
+        int regressions = regress_compare(&options, baseline, current);
+        printf("%d regression%s against %s\n", regressions, regressions == 1 ? "" : "s", options.baseline_path);
+        if (regressions > 0) {
+            status = 1;
+        }
+    }
+
+    lokan_client_cleanup(client);
+    for (int i = 0; i < REGRESS_OP_COUNT; ++i) {
+        free(samples[i].latencies_ns);
+    }
+    free(order);
+    regress_trace_free(&trace);
+    return status;
+}
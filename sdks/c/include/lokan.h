@@ -2,6 +2,8 @@
 #define LOKAN_SDK_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/select.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -13,19 +15,130 @@ typedef enum {
     LOKAN_ERROR_ALLOCATION = 2,
     LOKAN_ERROR_CURL = 3,
     LOKAN_ERROR_HTTP = 4,
-    LOKAN_ERROR_PARSE = 5
+    LOKAN_ERROR_PARSE = 5,
+    LOKAN_ERROR_OVERFLOW = 6,
+    LOKAN_ERROR_CANCELLED = 7,
+    /* The endpoint's circuit is open, so the request was not sent. */
+    LOKAN_ERROR_UNAVAILABLE = 8,
+    /* The client-side rate limiter had no token within its max_wait_ms. */
+    LOKAN_ERROR_RATE_LIMITED = 9,
+    /* A signature or digest did not match, e.g. a tampered OTA bundle. */
+    LOKAN_ERROR_INTEGRITY = 10,
+    /* A batched scene came back failed or partially applied; its body has per-device results. */
+    LOKAN_ERROR_SCENE_FAILED = 11
 } lokan_result_t;
 
+typedef struct lokan_metrics lokan_metrics_t;
+typedef struct lokan_response_cache lokan_response_cache_t;
+typedef struct lokan_circuit_breaker lokan_circuit_breaker_t;
+typedef struct lokan_rate_limiter lokan_rate_limiter_t;
+typedef struct lokan_resolver lokan_resolver_t;
+
+/*
+ * Retries for blocking requests that buffer their response; streamed and
+ * async requests are never retried. A failed attempt is retried after a random
+ * delay of up to base_delay_ms * 2^n, capped at max_delay_ms, or after the
+ * Retry-After a 429 or 503 response asked for. GET, HEAD, PUT, DELETE and
+ * OPTIONS retry on transport errors and on 408, 429, 502, 503 and 504; other
+ * methods only when the request never ran: failed connects and 429.
+ */
+typedef struct {
+    /* Attempts including the first; 0 or 1 never retries. */
+    int max_attempts;
+    /* 0 uses 100 ms. */
+    long base_delay_ms;
+    /* Longest wait between attempts; a longer Retry-After ends the retries. 0 uses 5000 ms. */
+    long max_delay_ms;
+} lokan_retry_policy_t;
+
+/* hedge_after_ms value that hedges after the route's p95 latency in the client's metrics. */
+#define LOKAN_HEDGE_P95 (-1L)
+
+/*
+ * Memory hooks. realloc_fn must behave like realloc, including for NULL. The
+ * default allocator uses malloc, realloc and free.
+ */
+typedef struct {
+    void *(*malloc_fn)(size_t size, void *ctx);
+    void *(*realloc_fn)(void *ptr, size_t size, void *ctx);
+    void (*free_fn)(void *ptr, void *ctx);
+    void *ctx;
+} lokan_allocator_t;
+
 typedef struct {
     const char *base_url;
     const char *client_cert_path;
     const char *client_key_path;
     const char *ca_cert_path;
     long timeout_ms;
+    /* Idle time before TCP keepalive probes start; 0 uses 60000 ms. */
+    long keepalive_idle_ms;
+    /* Pooled connections older than this are not reused; 0 uses libcurl's default. */
+    long max_connection_age_ms;
+    /*
+     * Non-zero negotiates HTTP/2 via ALPN and multiplexes async requests to an
+     * origin over a single connection. Requests beyond the stream limit queue
+     * until a stream frees up; an origin that only speaks HTTP/1.1 therefore
+     * serves async requests one at a time, so enable this only for HTTP/2 origins.
+     */
+    int enable_http2;
+    /* Streams multiplexed per HTTP/2 connection before another is opened; 0 uses 100. */
+    long http2_max_streams;
+    /* Collects per-endpoint latency histograms when set; may be shared by many clients. */
+    lokan_metrics_t *metrics;
+    /* Serves repeated list requests from cache when set; may be shared by many clients. */
+    lokan_response_cache_t *response_cache;
+    /*
+     * Non-zero offers every response encoding libcurl was built with (gzip,
+     * zstd, ...). Responses are decoded as they arrive, so stream parsers and
+     * response views only ever see the decoded bytes.
+     */
+    int accept_compressed;
+    /* Request bodies of at least this many bytes are sent gzip-encoded; 0 never compresses. */
+    size_t compress_min_bytes;
+    lokan_retry_policy_t retry;
+    /*
+     * A blocking GET without a body that is still unanswered after this long
+     * is sent again on a second connection, and the first response wins.
+     * LOKAN_HEDGE_P95 waits for the route's p95, once metrics holds 20
+     * samples of it; 0 never hedges.
+     */
+    long hedge_after_ms;
+    /* Fails requests to unhealthy endpoints fast when set; may be shared by many clients. */
+    lokan_circuit_breaker_t *circuit_breaker;
+    /* Paces requests under the gateway's limit when set; may be shared by many clients. */
+    lokan_rate_limiter_t *rate_limiter;
+    /* Pins hosts to the addresses it holds when set; may be shared by many clients. */
+    lokan_resolver_t *resolver;
+    /* Source of the client's own memory; NULL uses the global allocator. Copied at init. */
+    const lokan_allocator_t *allocator;
+    /*
+     * Size of a scratch arena reserved at init for memory that only lives for
+     * one call, such as request URLs; everything taken from it is released in
+     * bulk when the call returns. 0 allocates that memory per call instead.
+     */
+    size_t arena_bytes;
 } lokan_client_config_t;
 
 typedef struct lokan_client lokan_client_t;
 
+/*
+ * Initializes libcurl once per process. lokan_client_init calls it, and it is
+ * safe from any thread; calling it before spawning threads keeps the one-time
+ * cost off the first request.
+ */
+lokan_result_t lokan_global_init(void);
+
+/*
+ * Like lokan_global_init, but installs allocator as the global allocator and
+ * hands it to libcurl through curl_global_init_mem, so the SDK and libcurl
+ * draw on the same pool. Must be called before any other SDK function;
+ * returns LOKAN_ERROR_INVALID_ARGUMENT once libcurl is already initialized.
+ * Strings returned to the caller, such as from lokan_get_health, come from
+ * the global allocator.
+ */
+lokan_result_t lokan_global_init_allocator(const lokan_allocator_t *allocator);
+
 lokan_result_t lokan_client_init(lokan_client_t **out_client, const lokan_client_config_t *config);
 void lokan_client_cleanup(lokan_client_t *client);
 const char *lokan_result_string(lokan_result_t result);
@@ -36,6 +149,958 @@ lokan_result_t lokan_apply_scene(lokan_client_t *client, const char *scene_id, c
 
 void lokan_string_free(char *value);
 
+/*
+ * Allocation-free response access. A view borrows the client's response
+ * buffer, which is reused (and grown geometrically) across blocking calls;
+ * it stays valid until the next blocking call on the same client. The data
+ * is always NUL-terminated.
+ */
+typedef struct {
+    const char *data;
+    size_t size;
+} lokan_view_t;
+
+/* Performs a blocking request; on LOKAN_ERROR_HTTP the view holds the error body. */
+lokan_result_t lokan_request_view(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    long *out_status,
+    lokan_view_t *out_body);
+
+/*
+ * Performs a blocking request into caller storage. Returns LOKAN_ERROR_OVERFLOW
+ * when the body plus its NUL terminator does not fit in capacity bytes.
+ */
+lokan_result_t lokan_request_into(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    long *out_status,
+    char *buffer,
+    size_t capacity,
+    size_t *out_size);
+
+/* One segment of a scatter/gather request body; the memory is borrowed, not copied. */
+typedef struct {
+    const void *data;
+    size_t len;
+} lokan_iovec_t;
+
+/*
+ * Performs a blocking request whose body is the concatenation of iov, sent
+ * straight from caller memory; the segments must stay valid until this
+ * returns. The response is returned as in lokan_request_view.
+ */
+lokan_result_t lokan_request_iov(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const lokan_iovec_t *iov,
+    size_t iov_count,
+    long *out_status,
+    lokan_view_t *out_body);
+
+/* Applies a scene whose JSON payload is split across segments, e.g. one per device state. */
+lokan_result_t lokan_apply_scene_iov(lokan_client_t *client, const lokan_iovec_t *iov, size_t iov_count);
+
+typedef struct {
+    const char *scene_id;
+    /*
+     * The scene as scene-svc takes it, {"scene_id":...,"operations":[...]}.
+     * NULL sends the id with no operations, or {"sceneId":...} as
+     * lokan_apply_scene does when falling back to single applies.
+     */
+    const char *payload_json;
+} lokan_scene_apply_t;
+
+/* A scene's outcome; body borrows client memory until the next blocking call. */
+typedef struct {
+    lokan_result_t result;
+    long status;
+    lokan_view_t body;
+} lokan_scene_result_t;
+
+/*
+ * Applies count scenes, up to 64 per request on the batch endpoint, and fills
+ * out_results in request order. Against a service without the batch endpoint
+ * it falls back to pipelining single applies to /v1/scenes:apply. A scene
+ * whose status is not "applied" gets LOKAN_ERROR_SCENE_FAILED either way. Returns LOKAN_OK when every
+ * scene succeeded, else the first failing scene's result.
+ */
+lokan_result_t lokan_apply_scenes(
+    lokan_client_t *client,
+    const lokan_scene_apply_t *scenes,
+    size_t count,
+    lokan_scene_result_t *out_results);
+
+/* Like lokan_get_health, but the status borrows client memory until the next blocking call. */
+lokan_result_t lokan_get_health_view(lokan_client_t *client, lokan_view_t *out_status);
+
+/*
+ * Request timing. Phases come from libcurl's transfer timers: dns, connect and
+ * tls are the time spent in each handshake step, first_byte and total are
+ * measured from the start of the request. Handshake phases are zero when the
+ * request reused a pooled connection.
+ */
+typedef struct {
+    int64_t dns_us;
+    int64_t connect_us;
+    int64_t tls_us;
+    int64_t first_byte_us;
+    int64_t total_us;
+    int new_connection;
+    /* Requests sent for the call, counting retries and a hedge; the timing is the last one's. */
+    int attempts;
+} lokan_request_timing_t;
+
+/* Timing of the last blocking request made on this client. */
+lokan_result_t lokan_client_last_timing(lokan_client_t *client, lokan_request_timing_t *out_timing);
+
+/* Longest health status lokan_health_probe_all keeps, including the NUL. */
+#define LOKAN_HEALTH_STATUS_MAX 32
+
+/* One service to probe; path is the input, the rest is filled in. */
+typedef struct {
+    /* Relative to the client's base URL, e.g. "/scene-svc/health" against the hub root. */
+    const char *path;
+    lokan_result_t result;
+    long status;
+    /* The body's "status" member, e.g. "ok"; empty when it could not be read. */
+    char health[LOKAN_HEALTH_STATUS_MAX];
+    lokan_request_timing_t timing;
+} lokan_health_probe_t;
+
+/*
+ * Probes count health endpoints concurrently on the client's async engine, so
+ * they share its connections, and fills probes in place. A probe still
+ * running deadline_ms after it was sent is abandoned with LOKAN_ERROR_CURL;
+ * deadline_ms <= 0 uses the client's timeout_ms. On a client with arena_bytes
+ * set, repeat calls make no SDK allocations: handles, the decoder and buffers
+ * are reused. Returns LOKAN_OK when every probe succeeded, else the first
+ * failing probe's result.
+ */
+lokan_result_t lokan_health_probe_all(lokan_client_t *client, lokan_health_probe_t *probes, size_t count, long deadline_ms);
+
+/*
+ * Latency histograms. A metrics object aggregates timing for every request
+ * made by the clients configured with it, keyed by request path without its
+ * query string. Recording and reading are thread-safe.
+ */
+#define LOKAN_METRICS_BUCKETS 8
+#define LOKAN_METRICS_ROUTE_MAX 64
+/* Routes past this many are counted together under "other". */
+#define LOKAN_METRICS_MAX_ENDPOINTS 64
+
+typedef enum {
+    LOKAN_PHASE_DNS = 0,
+    LOKAN_PHASE_CONNECT = 1,
+    LOKAN_PHASE_TLS = 2,
+    LOKAN_PHASE_FIRST_BYTE = 3,
+    LOKAN_PHASE_TOTAL = 4,
+    LOKAN_PHASE_COUNT = 5
+} lokan_timing_phase_t;
+
+typedef struct {
+    /* counts[i] holds observations in (bound[i-1], bound[i]]; the last entry is +Inf. */
+    uint64_t counts[LOKAN_METRICS_BUCKETS + 1];
+    uint64_t count;
+    double sum_seconds;
+} lokan_histogram_t;
+
+typedef struct {
+    char route[LOKAN_METRICS_ROUTE_MAX];
+    uint64_t requests;
+    /* Transport failures and responses with status >= 400. */
+    uint64_t errors;
+    lokan_histogram_t phases[LOKAN_PHASE_COUNT];
+} lokan_endpoint_stats_t;
+
+lokan_result_t lokan_metrics_create(lokan_metrics_t **out_metrics);
+
+/* Every client configured with the metrics object must be cleaned up first. */
+void lokan_metrics_destroy(lokan_metrics_t *metrics);
+
+/* Upper bounds in seconds of the first LOKAN_METRICS_BUCKETS buckets. */
+const double *lokan_metrics_bucket_bounds(void);
+
+/* Copies up to capacity endpoints and returns how many exist. */
+size_t lokan_metrics_snapshot(lokan_metrics_t *metrics, lokan_endpoint_stats_t *out_endpoints, size_t capacity);
+
+void lokan_metrics_reset(lokan_metrics_t *metrics);
+
+/*
+ * Writes the histograms in Prometheus text format, using the same bucket
+ * bounds as the services' /metrics endpoints. Returns LOKAN_ERROR_OVERFLOW
+ * when the text plus its NUL terminator does not fit; *out_len is then the
+ * length required.
+ */
+lokan_result_t lokan_metrics_dump_prometheus(
+    lokan_metrics_t *metrics,
+    char *buffer,
+    size_t capacity,
+    size_t *out_len);
+
+/*
+ * Scraping a service's Prometheus text, e.g. GET /metrics. Samples are parsed
+ * as the body streams in and stored in a table whose memory the caller
+ * supplies: series is an open-addressed array, indexed by a hash of the
+ * series key, and names holds each key once, so a repeated scrape of the
+ * same target only overwrites values and allocates nothing.
+ */
+typedef struct {
+    /* "name{labels}" as exposed, in the table's names; NULL marks an empty slot. */
+    const char *key;
+    size_t key_len;
+    double value;
+    /* The sample's timestamp in ms, or 0 when the line had none. */
+    int64_t timestamp_ms;
+    /* Scrape that last saw the series; older than the table's scrapes once it disappears. */
+    uint32_t scrape;
+    uint32_t hash;
+} lokan_scrape_series_t;
+
+typedef struct {
+    lokan_scrape_series_t *series;
+    /* A power of two; at most three quarters of the slots are used. */
+    size_t capacity;
+    char *names;
+    size_t names_capacity;
+    /*
+     * Metric names to keep, e.g. "http_requests_total"; a histogram or summary
+     * also keeps its _bucket, _sum and _count series. NULL keeps every sample.
+     */
+    const char *const *match;
+    size_t match_count;
+
+    /* Maintained by the SDK. */
+    size_t count;
+    size_t names_used;
+    uint32_t scrapes;
+    /* Sample lines of the last scrape that were malformed, too long or did not fit. */
+    size_t skipped;
+} lokan_scrape_table_t;
+
+/* Points table at caller memory and empties it; match may be set afterwards. */
+lokan_result_t lokan_scrape_table_init(
+    lokan_scrape_table_t *table,
+    lokan_scrape_series_t *series,
+    size_t capacity,
+    char *names,
+    size_t names_capacity);
+
+/*
+ * GETs path (NULL uses "/metrics") and merges its samples into table in one
+ * pass. Lines that cannot be stored are counted in table->skipped rather
+ * than failing the scrape. An error response is not parsed.
+ */
+lokan_result_t lokan_scrape_metrics(lokan_client_t *client, const char *path, lokan_scrape_table_t *table, long *out_status);
+
+/* The series with key ("name" or "name{labels}" exactly as exposed), or NULL. */
+const lokan_scrape_series_t *lokan_scrape_find(const lokan_scrape_table_t *table, const char *key);
+
+/*
+ * Circuit breaker. Each endpoint of each service, keyed by base URL and path
+ * without its query, has a circuit that opens after failure_threshold
+ * consecutive transport errors or 5xx responses. While open, requests fail
+ * with LOKAN_ERROR_UNAVAILABLE without being sent; after open_ms one request
+ * is let through as a probe, and its outcome closes or reopens the circuit.
+ * 429 responses count as neither success nor failure. Thread-safe.
+ */
+typedef struct {
+    /* 0 uses 5. */
+    uint32_t failure_threshold;
+    /* 0 uses 5000 ms. */
+    long open_ms;
+} lokan_circuit_breaker_config_t;
+
+typedef enum {
+    LOKAN_CIRCUIT_CLOSED = 0,
+    LOKAN_CIRCUIT_OPEN = 1,
+    LOKAN_CIRCUIT_HALF_OPEN = 2
+} lokan_circuit_state_t;
+
+lokan_result_t lokan_circuit_breaker_create(
+    lokan_circuit_breaker_t **out_breaker,
+    const lokan_circuit_breaker_config_t *config);
+
+/* Every client configured with the breaker must be cleaned up first. */
+void lokan_circuit_breaker_destroy(lokan_circuit_breaker_t *breaker);
+
+/* State of path's circuit for this client; CLOSED without a breaker. */
+lokan_result_t lokan_client_circuit_state(lokan_client_t *client, const char *path, lokan_circuit_state_t *out_state);
+
+/*
+ * Client-side rate limiter with the api-gateway's token bucket semantics:
+ * burst requests at once, refilled at requests_per_minute. Clients sharing a
+ * limiter, e.g. a whole pool, take a token before each request sent,
+ * retries and hedges included. Blocking calls wait up to max_wait_ms for one
+ * and otherwise fail with LOKAN_ERROR_RATE_LIMITED, as do async submits that
+ * find the bucket empty. A 429 from the gateway empties the bucket. Lock-free
+ * and thread-safe.
+ */
+typedef struct {
+    /* Match the gateway's rate_limit settings; 0 is treated as 1, as it does. */
+    uint32_t requests_per_minute;
+    uint32_t burst;
+    /* Longest a blocking call waits for a token; 0 never waits. */
+    long max_wait_ms;
+} lokan_rate_limiter_config_t;
+
+lokan_result_t lokan_rate_limiter_create(lokan_rate_limiter_t **out_limiter, const lokan_rate_limiter_config_t *config);
+
+/* Every client configured with the limiter must be cleaned up first. */
+void lokan_rate_limiter_destroy(lokan_rate_limiter_t *limiter);
+
+/*
+ * Takes a token for a request the caller sends itself. Returns
+ * LOKAN_ERROR_RATE_LIMITED when none is free, with *out_wait_ms set to the
+ * time until one is.
+ */
+lokan_result_t lokan_rate_limiter_try_acquire(lokan_rate_limiter_t *limiter, long *out_wait_ms);
+
+/*
+ * Asynchronous requests. Submitted requests run on a curl multi handle owned by
+ * the client and progress only while the caller drives lokan_client_perform,
+ * lokan_client_poll or lokan_client_socket_action. Completion callbacks run on the driving thread; the
+ * response body is only valid for the duration of the callback.
+ */
+typedef struct {
+    lokan_result_t result;
+    long status;
+    const char *body;
+    size_t body_len;
+    lokan_request_timing_t timing;
+} lokan_response_t;
+
+typedef void (*lokan_completion_cb)(const lokan_response_t *response, void *user_data);
+
+/* Queues a request; body is copied, so it may be released once this returns. */
+lokan_result_t lokan_request_submit(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    lokan_completion_cb on_complete,
+    void *user_data);
+
+/* Drives transfers without blocking and dispatches completed callbacks. */
+lokan_result_t lokan_client_perform(lokan_client_t *client, int *out_running);
+
+/* Waits up to timeout_ms for socket activity, then behaves like lokan_client_perform. */
+lokan_result_t lokan_client_poll(lokan_client_t *client, int timeout_ms, int *out_running);
+
+/*
+ * Exports the sockets the engine is waiting on, for callers running their own
+ * select/poll/epoll loop. *out_max_fd is -1 when no socket is ready to watch.
+ */
+lokan_result_t lokan_client_fdset(
+    lokan_client_t *client,
+    fd_set *read_fds,
+    fd_set *write_fds,
+    fd_set *exc_fds,
+    int *out_max_fd);
+
+/* Longest time the caller may wait before calling lokan_client_perform; -1 means no timer. */
+lokan_result_t lokan_client_timeout(lokan_client_t *client, long *out_timeout_ms);
+
+/*
+ * Event-loop integration, for hosts running their own epoll or libuv loop
+ * that must never block in the SDK. Once callbacks are set, the engine tells
+ * the host which sockets to watch and when it next needs a timer, and the
+ * host reports readiness and expiry through lokan_client_socket_action
+ * instead of calling lokan_client_perform or lokan_client_poll. Work only
+ * happens inside that call, on the loop's thread: no helper threads, no
+ * polling. Blocking calls such as lokan_get_health still block; a host loop
+ * issues its requests through lokan_request_submit.
+ */
+typedef enum {
+    LOKAN_POLL_IN = 1,
+    LOKAN_POLL_OUT = 2,
+    LOKAN_POLL_INOUT = 3,
+    /* Stop watching fd and release any socket_data assigned to it. */
+    LOKAN_POLL_REMOVE = 4
+} lokan_poll_t;
+
+/* Readiness reported to lokan_client_socket_action; 0 lets the engine find out itself. */
+#define LOKAN_EVENT_IN 1
+#define LOKAN_EVENT_OUT 2
+#define LOKAN_EVENT_ERROR 4
+
+/* fd for lokan_client_socket_action when the timer, not a socket, fired. */
+#define LOKAN_SOCKET_TIMEOUT (-1)
+
+/*
+ * Called when fd's wanted events change. socket_data is whatever the host
+ * last assigned with lokan_client_assign_socket, NULL for a new socket; a
+ * libuv host keeps its uv_poll_t there.
+ */
+typedef void (*lokan_socket_cb)(int fd, lokan_poll_t what, void *socket_data, void *user_data);
+
+/*
+ * Called when the engine's single timer changes: -1 cancels it, 0 asks for
+ * lokan_client_socket_action(LOKAN_SOCKET_TIMEOUT) as soon as the loop is
+ * back in control, not from inside the callback.
+ */
+typedef void (*lokan_timer_cb)(long timeout_ms, void *user_data);
+
+typedef struct {
+    lokan_socket_cb on_socket;
+    lokan_timer_cb on_timer;
+    void *user_data;
+} lokan_event_loop_t;
+
+/*
+ * Hands the client's sockets and timer to the host loop; NULL goes back to
+ * lokan_client_perform and lokan_client_poll. Fails with
+ * LOKAN_ERROR_INVALID_ARGUMENT while requests are in flight, or unless both
+ * callbacks are set.
+ */
+lokan_result_t lokan_client_set_event_loop(lokan_client_t *client, const lokan_event_loop_t *loop);
+
+/* Stores host data for fd, passed back to every later on_socket call for it. */
+lokan_result_t lokan_client_assign_socket(lokan_client_t *client, int fd, void *socket_data);
+
+/*
+ * Drives the transfers on fd, or every transfer whose time is up when fd is
+ * LOKAN_SOCKET_TIMEOUT, and dispatches completed callbacks. events is a mask
+ * of LOKAN_EVENT_* flags.
+ */
+lokan_result_t lokan_client_socket_action(lokan_client_t *client, int fd, int events, int *out_running);
+
+/*
+ * Batched telemetry ingest. Envelopes are appended to a preallocated buffer
+ * and sent many per request to the telemetry pipeline's batch endpoint.
+ * lokan_telemetry_append may be called from any thread; poll, flush and
+ * destroy use the client and belong to the thread that owns it.
+ */
+typedef enum {
+    /* Reject the envelope being appended with LOKAN_ERROR_OVERFLOW. */
+    LOKAN_TELEMETRY_DROP_NEWEST = 0,
+    /* Discard the oldest buffered envelopes until the new one fits. */
+    LOKAN_TELEMETRY_DROP_OLDEST = 1,
+    /* Wait until the owning thread flushes and frees space. */
+    LOKAN_TELEMETRY_BLOCK = 2
+} lokan_telemetry_overflow_t;
+
+/* Wire encoding of a batch, sent as its Content-Type. */
+typedef enum {
+    LOKAN_TELEMETRY_JSON = 0,
+    /*
+     * application/cbor (RFC 8949): numbers travel as 5- or 9-byte floats
+     * instead of text, and are encoded without any formatting. Envelopes must
+     * be appended with lokan_telemetry_append_fields.
+     */
+    LOKAN_TELEMETRY_CBOR = 1
+} lokan_telemetry_format_t;
+
+typedef struct {
+    /* Batch endpoint relative to the client's base URL; NULL uses "/ingest/batch". */
+    const char *path;
+    /* Capacity of each of the two batch buffers; 0 uses 64 KiB. */
+    size_t max_batch_bytes;
+    /* Envelopes per batch before the overflow policy applies; 0 uses 512, and at most 10000 are allowed. */
+    size_t max_batch_envelopes;
+    /* lokan_telemetry_poll flushes once this many bytes are buffered; 0 uses half the capacity. */
+    size_t flush_threshold_bytes;
+    /* lokan_telemetry_poll flushes once the oldest envelope is this old; 0 uses 1000 ms. */
+    long max_batch_age_ms;
+    lokan_telemetry_overflow_t overflow;
+    lokan_telemetry_format_t format;
+    /*
+     * File backing an offline spool; NULL keeps a batch that failed to send in
+     * memory only. With a spool, a batch that fails for want of a connection
+     * (or a 408, 429 or 5xx answer) is written to it and the buffer freed.
+     */
+    const char *spool_path;
+    /* Size of the spool's ring; 0 uses 4 MiB. A spool recovered from disk keeps its size. */
+    size_t spool_bytes;
+    /* Longest time a spooled batch waits to be synced to disk; 0 uses 1000 ms. */
+    long spool_sync_ms;
+    /* Gap between spooled batches resent by lokan_telemetry_poll; 0 uses 100 ms. */
+    long spool_drain_interval_ms;
+} lokan_telemetry_config_t;
+
+typedef enum {
+    LOKAN_TELEMETRY_NUMBER,
+    LOKAN_TELEMETRY_INTEGER,
+    LOKAN_TELEMETRY_BOOL,
+    LOKAN_TELEMETRY_STRING
+} lokan_telemetry_kind_t;
+
+/* One payload member; only the value matching kind is read. */
+typedef struct {
+    const char *name;
+    lokan_telemetry_kind_t kind;
+    double number;
+    int64_t integer;
+    int boolean;
+    const char *string;
+} lokan_telemetry_field_t;
+
+typedef struct {
+    uint64_t appended;
+    uint64_t dropped;
+    uint64_t batches_sent;
+    uint64_t envelopes_sent;
+    uint64_t failed_flushes;
+    /* Envelopes in batches the server refused outright (a 4xx other than 408 or 429), dropped unsent. */
+    uint64_t rejected;
+    /* Envelopes written to the spool, and those evicted from it unsent to make room or rejected on resend. */
+    uint64_t envelopes_spooled;
+    uint64_t spool_dropped;
+} lokan_telemetry_stats_t;
+
+typedef struct lokan_telemetry lokan_telemetry_t;
+
+lokan_result_t lokan_telemetry_create(
+    lokan_telemetry_t **out_batch,
+    lokan_client_t *client,
+    const lokan_telemetry_config_t *config);
+
+/*
+ * Releases the batch without flushing; buffered envelopes are discarded. A
+ * spool is synced and left on disk, and the next batch opened on it resends
+ * what it holds.
+ */
+void lokan_telemetry_destroy(lokan_telemetry_t *batch);
+
+/*
+ * Appends {"source": source, "payload": payload_json}; payload_json must be a
+ * JSON object. Only for LOKAN_TELEMETRY_JSON batches.
+ */
+lokan_result_t lokan_telemetry_append(lokan_telemetry_t *batch, const char *source, const char *payload_json);
+
+/*
+ * Appends an envelope whose payload object has one member per field, encoded
+ * straight into the batch buffer in the batch's format. JSON rejects NaN and
+ * infinities; CBOR carries them.
+ */
+lokan_result_t lokan_telemetry_append_fields(
+    lokan_telemetry_t *batch,
+    const char *source,
+    const lokan_telemetry_field_t *fields,
+    size_t count);
+
+/*
+ * Flushes if the size or age threshold has been reached; otherwise returns
+ * LOKAN_OK. With a spool it also syncs it when due and resends spooled
+ * batches one at a time on the client's async engine, so poll regularly.
+ */
+lokan_result_t lokan_telemetry_poll(lokan_telemetry_t *batch);
+
+/*
+ * Sends buffered envelopes now. A batch that fails to send is retained and
+ * retried by the next flush while new envelopes keep accumulating, or moved
+ * to the spool when there is one. A batch the server refuses outright is
+ * dropped and counted in rejected, since resending it cannot succeed.
+ */
+lokan_result_t lokan_telemetry_flush(lokan_telemetry_t *batch);
+
+void lokan_telemetry_get_stats(lokan_telemetry_t *batch, lokan_telemetry_stats_t *out_stats);
+
+/*
+ * Server-sent event subscriptions, e.g. /v1/presence/events. A subscription
+ * owns its own client and a network thread that keeps the stream open,
+ * reconnecting with backoff and resuming from the last event id it saw.
+ * Events pass to the consumer through a bounded ring buffer and are handed
+ * out by lokan_subscription_poll on the caller's thread.
+ */
+#define LOKAN_SUBSCRIPTION_ID_MAX 128
+#define LOKAN_SUBSCRIPTION_TYPE_MAX 64
+
+typedef enum {
+    /* Discard the event that does not fit. */
+    LOKAN_SUBSCRIPTION_DROP_NEWEST = 0,
+    /* Discard the oldest queued events until the new one fits. */
+    LOKAN_SUBSCRIPTION_DROP_OLDEST = 1,
+    /* Stop reading the stream until the consumer frees space. */
+    LOKAN_SUBSCRIPTION_BLOCK = 2
+} lokan_subscription_overflow_t;
+
+typedef struct {
+    /* Stream endpoint relative to the client's base URL. */
+    const char *path;
+    /* Resume token from an earlier run, sent as Last-Event-ID on the first connect; NULL starts live. */
+    const char *last_event_id;
+    /* Capacity of the event ring; 0 uses 64 KiB. Larger events are dropped. */
+    size_t ring_bytes;
+    lokan_subscription_overflow_t overflow;
+    /* First reconnect delay, doubled per failed attempt up to the maximum; 0 uses 250 ms. */
+    long reconnect_min_ms;
+    /* 0 uses 30000 ms. */
+    long reconnect_max_ms;
+    /* Reconnect when nothing, not even a keep-alive comment, arrives for this long; 0 uses 60000 ms. */
+    long idle_timeout_ms;
+} lokan_subscription_config_t;
+
+typedef struct {
+    /* The event's "event" field, "message" when the server sent none. */
+    lokan_view_t type;
+    /* The stream's last event id as of this event; empty if the server never sent one. */
+    lokan_view_t id;
+    /* Data lines joined with '\n'. */
+    lokan_view_t data;
+} lokan_event_t;
+
+typedef void (*lokan_event_cb)(const lokan_event_t *event, void *user_data);
+
+typedef struct {
+    uint64_t received;
+    uint64_t delivered;
+    uint64_t dropped;
+    /* Connections that were answered with 200. */
+    uint64_t connects;
+    /* Attempts that failed or ended, each followed by a reconnect. */
+    uint64_t disconnects;
+    /* Status of the latest attempt; 0 when it failed before a response. */
+    long last_status;
+    int connected;
+    /* Id the next reconnect resumes from. */
+    char last_event_id[LOKAN_SUBSCRIPTION_ID_MAX];
+} lokan_subscription_stats_t;
+
+typedef struct lokan_subscription lokan_subscription_t;
+
+/* Creates a client from client_config and starts streaming on a new thread. */
+lokan_result_t lokan_subscription_start(
+    lokan_subscription_t **out_subscription,
+    const lokan_client_config_t *client_config,
+    const lokan_subscription_config_t *config);
+
+/*
+ * Delivers every queued event to on_event, waiting up to timeout_ms for the
+ * first (0 returns at once, negative waits indefinitely). Views are valid
+ * only during the callback. Must not be called from two threads at once.
+ */
+lokan_result_t lokan_subscription_poll(
+    lokan_subscription_t *subscription,
+    int timeout_ms,
+    lokan_event_cb on_event,
+    void *user_data,
+    size_t *out_delivered);
+
+/* Closes the stream and joins the network thread; undelivered events are discarded. */
+void lokan_subscription_stop(lokan_subscription_t *subscription);
+
+void lokan_subscription_get_stats(lokan_subscription_t *subscription, lokan_subscription_stats_t *out_stats);
+
+/*
+ * Client pool for multi-threaded callers. A single client must only be used
+ * by one thread at a time; a pool holds several clients built from one
+ * config that share DNS results, TLS sessions and pooled connections, so a
+ * worker checking out any client finds the caches already warm.
+ */
+typedef struct lokan_client_pool lokan_client_pool_t;
+
+lokan_result_t lokan_client_pool_create(
+    lokan_client_pool_t **out_pool,
+    const lokan_client_config_t *config,
+    size_t size);
+
+/* Every client must have been released; pooled clients are destroyed with the pool. */
+void lokan_client_pool_destroy(lokan_client_pool_t *pool);
+
+/* Checks out a client, waiting for one to be released if all are in use. */
+lokan_result_t lokan_client_pool_acquire(lokan_client_pool_t *pool, lokan_client_t **out_client);
+
+/* Like lokan_client_pool_acquire, but returns LOKAN_ERROR_OVERFLOW instead of waiting. */
+lokan_result_t lokan_client_pool_try_acquire(lokan_client_pool_t *pool, lokan_client_t **out_client);
+
+void lokan_client_pool_release(lokan_client_pool_t *pool, lokan_client_t *client);
+
+/*
+ * Streaming JSON. The parser is fed response bytes as they arrive and fires
+ * SAX-style events per token, so a large list never has to be buffered whole.
+ * In element mode each element of the target array is delivered as its raw
+ * JSON text as soon as its closing byte arrives. A callback returning non-zero
+ * stops parsing with LOKAN_ERROR_CANCELLED.
+ */
+typedef enum {
+    LOKAN_JSON_OBJECT_START,
+    LOKAN_JSON_OBJECT_END,
+    LOKAN_JSON_ARRAY_START,
+    LOKAN_JSON_ARRAY_END,
+    LOKAN_JSON_KEY,
+    LOKAN_JSON_STRING,
+    LOKAN_JSON_NUMBER,
+    LOKAN_JSON_TRUE,
+    LOKAN_JSON_FALSE,
+    LOKAN_JSON_NULL
+} lokan_json_event_t;
+
+/* text is the unescaped key or string, or the number/literal as written; NULL for brackets. */
+typedef int (*lokan_json_event_cb)(
+    lokan_json_event_t event,
+    const char *text,
+    size_t len,
+    size_t depth,
+    void *user_data);
+
+/* element is NUL-terminated and only valid for the duration of the callback. */
+typedef int (*lokan_json_element_cb)(const char *element, size_t len, void *user_data);
+
+typedef struct {
+    lokan_json_event_cb on_event;
+    lokan_json_element_cb on_element;
+    /* Array delivered to on_element: NULL for a root array, else a key of the root object. */
+    const char *array_key;
+    /* Longest single key, string or number; 0 uses 64 KiB. */
+    size_t max_token_bytes;
+    /* Longest array element delivered to on_element; 0 uses 1 MiB. */
+    size_t max_element_bytes;
+    void *user_data;
+} lokan_json_parser_config_t;
+
+typedef struct lokan_json_parser lokan_json_parser_t;
+
+lokan_result_t lokan_json_parser_create(lokan_json_parser_t **out_parser, const lokan_json_parser_config_t *config);
+void lokan_json_parser_destroy(lokan_json_parser_t *parser);
+
+/* Feeds the next chunk; chunks may split tokens anywhere. */
+lokan_result_t lokan_json_parser_feed(lokan_json_parser_t *parser, const char *data, size_t len);
+
+/* Checks the document is complete and, in element mode, that the target array was seen. */
+lokan_result_t lokan_json_parser_finish(lokan_json_parser_t *parser);
+
+/* Readies the parser for a new document, keeping its configuration and buffers. */
+void lokan_json_parser_reset(lokan_json_parser_t *parser);
+
+/*
+ * Performs a blocking request and streams a successful response body through
+ * parser, which is reset first. On LOKAN_ERROR_HTTP nothing is parsed. A
+ * parser or callback error aborts the transfer and is returned as is.
+ */
+lokan_result_t lokan_request_stream(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    lokan_json_parser_t *parser,
+    long *out_status);
+
+/*
+ * GETs a list endpoint and calls on_element for each entry of the array under
+ * array_key, e.g. "/devices" with "devices" or "/entries" with "entries".
+ */
+lokan_result_t lokan_stream_list(
+    lokan_client_t *client,
+    const char *path,
+    const char *array_key,
+    lokan_json_element_cb on_element,
+    void *user_data,
+    long *out_status);
+
+/*
+ * Cursor pagination over list endpoints that take cursor and limit query
+ * parameters and answer {"<array_key>": [...], "nextCursor": "..."}, such as
+ * "/devices" and "/entries". The first page is requested on create, and
+ * whenever the caller moves onto a page the next one is fetched in the
+ * background on the client's async engine, so at most two pages are held
+ * however long the list is. lokan_list_iter_next drives that engine, which
+ * also runs the callbacks of the caller's own submitted requests.
+ */
+typedef struct lokan_list_iter lokan_list_iter_t;
+
+/* page_size is sent as limit; 0 uses 100. The iterator must be destroyed before the client. */
+lokan_result_t lokan_list_iter_create(
+    lokan_list_iter_t **out_iter,
+    lokan_client_t *client,
+    const char *path,
+    const char *array_key,
+    size_t page_size);
+
+/*
+ * Views the next element, valid until the next call on the iterator; *out_done
+ * is set once the list is exhausted. A failed page fetch is returned and the
+ * same page is requested again on the next call.
+ */
+lokan_result_t lokan_list_iter_next(lokan_list_iter_t *iter, lokan_view_t *out_element, int *out_done);
+
+/* Abandons a page still being fetched. */
+void lokan_list_iter_destroy(lokan_list_iter_t *iter);
+
+/*
+ * Local copy of the device registry, kept current from
+ * GET /device-registry/devices/changes: each sync downloads only the devices
+ * changed since the last one, so a controller pays for the whole fleet once
+ * and for its churn after that. Lookups by id go through an open-addressing
+ * index and never touch the network. A mirror is not thread-safe; views into
+ * it stay valid until the next sync.
+ */
+typedef struct lokan_device_mirror lokan_device_mirror_t;
+
+/* Views are NUL-terminated; room_id is empty for a device in no room and state is raw JSON. */
+typedef struct {
+    lokan_view_t id;
+    lokan_view_t name;
+    lokan_view_t room_id;
+    lokan_view_t kind;
+    lokan_view_t status;
+    lokan_view_t state;
+} lokan_mirrored_device_t;
+
+lokan_result_t lokan_device_mirror_create(lokan_device_mirror_t **out_mirror);
+void lokan_device_mirror_destroy(lokan_device_mirror_t *mirror);
+
+/*
+ * Applies every change since the last sync, a page at a time; the first sync
+ * downloads the whole registry. *out_applied, if given, counts the changes
+ * applied, which a failed sync may have started on: the next sync picks up
+ * where the last complete page left off. If the registry answers 410 because
+ * its change log restarted, the mirror is emptied and rebuilt from scratch.
+ */
+lokan_result_t lokan_device_mirror_sync(lokan_device_mirror_t *mirror, lokan_client_t *client, size_t *out_applied);
+
+/* Returns 1 and views the device if id is mirrored, 0 otherwise. */
+int lokan_device_mirror_find(const lokan_device_mirror_t *mirror, const char *id, lokan_mirrored_device_t *out_device);
+
+/* Devices are stored densely: index 0 to count - 1 visits each once, in no particular order. */
+size_t lokan_device_mirror_count(const lokan_device_mirror_t *mirror);
+int lokan_device_mirror_at(const lokan_device_mirror_t *mirror, size_t index, lokan_mirrored_device_t *out_device);
+
+/* Change sequence number the mirror is current to; 0 before the first sync. */
+int64_t lokan_device_mirror_sequence(const lokan_device_mirror_t *mirror);
+
+/*
+ * Response cache for slow-changing list endpoints. lokan_stream_list on a
+ * client configured with a cache keeps the parsed elements of every response
+ * that carries an ETag or has a TTL. A later call for the same path and key
+ * revalidates with If-None-Match, or skips the request while the TTL holds;
+ * either way an unchanged list is replayed to on_element without being
+ * transferred or parsed again, and out_status reports 304. Entries are evicted
+ * least recently used first.
+ */
+typedef struct {
+    /* Memory for all entries together; 0 uses 1 MiB. Larger lists are not cached. */
+    size_t max_bytes;
+    /* 0 uses 64. */
+    size_t max_entries;
+    /* Reuse without revalidating when the response has no max-age; 0 always revalidates. */
+    long ttl_ms;
+} lokan_response_cache_config_t;
+
+lokan_result_t lokan_response_cache_create(lokan_response_cache_t **out_cache, const lokan_response_cache_config_t *config);
+
+/* Every client configured with the cache must be cleaned up first. */
+void lokan_response_cache_destroy(lokan_response_cache_t *cache);
+
+/* Drops every entry, e.g. after the caller changed one of the cached lists. */
+void lokan_response_cache_clear(lokan_response_cache_t *cache);
+
+/*
+ * OTA bundle download. A bundle laid out as scripts/ota/sign.sh writes it is
+ * fetched from bundle_path: sig/sha256sum is checked against its Ed25519
+ * signature first, then one component is downloaded in HTTP Range chunks,
+ * several at once, each written through a mapping of the target so the image
+ * never sits in memory. Chunks are hashed in order as soon as they are
+ * complete, so verification finishes with the last byte. Progress is recorded
+ * in a state file after every chunk; calling again with the same config
+ * resumes where an interrupted download stopped.
+ */
+typedef struct {
+    uint64_t total_bytes;
+    /* Already on the target from an earlier, interrupted call. */
+    uint64_t resumed_bytes;
+    uint64_t downloaded_bytes;
+    /* Hashed so far; equals total_bytes once the download succeeded. */
+    uint64_t verified_bytes;
+    uint32_t chunk_retries;
+} lokan_ota_stats_t;
+
+/* Called after every chunk; returning non-zero stops with LOKAN_ERROR_CANCELLED, keeping progress. */
+typedef int (*lokan_ota_progress_cb)(const lokan_ota_stats_t *stats, void *user_data);
+
+typedef struct {
+    /* Bundle directory relative to the client's base URL, e.g. "/bundles/1.4.2". */
+    const char *bundle_path;
+    /* Component as listed in sig/sha256sum, e.g. "images/rootfs.img". */
+    const char *component;
+    /* File or block device receiving the component. */
+    const char *target_path;
+    /* PEM Ed25519 public key, e.g. security/pki/dev/ota/ota_signing_public.pem. */
+    const char *public_key_path;
+    /*
+     * Progress record; NULL uses target_path with ".lokan-ota" appended, so
+     * a partition target needs one on persistent storage.
+     */
+    const char *state_path;
+    /* Bytes per Range request, rounded up to the page size; 0 uses 4 MiB. */
+    size_t chunk_bytes;
+    /* Chunks in flight at once; 0 uses 4, at most 16. */
+    uint32_t parallel;
+    /* Tries per chunk for connection failures, 408, 429 and 5xx; 0 uses 3. */
+    uint32_t chunk_attempts;
+    lokan_ota_progress_cb on_progress;
+    void *user_data;
+} lokan_ota_config_t;
+
+/*
+ * Downloads and verifies config->component. LOKAN_ERROR_INTEGRITY means the
+ * checksum list's signature or the image's digest did not match; a bad
+ * image's progress is discarded so the next call starts over. The state file
+ * is removed once the image is verified. Blocks until done; out_stats may be
+ * NULL.
+ */
+lokan_result_t lokan_ota_download(lokan_client_t *client, const lokan_ota_config_t *config, lokan_ota_stats_t *out_stats);
+
+/*
+ * Endpoint resolution cache, fed e.g. by mDNS announcements of hub-side
+ * services. Every request on a client configured with a resolver connects
+ * to the addresses held for its host and port, as CURLOPT_RESOLVE would pin
+ * them, so no request waits on a DNS or mDNS lookup. Entries are refreshed
+ * in the background from 80% of their TTL on, and still used for up to
+ * max_stale_ms past it while no answer comes; hosts without an entry
+ * resolve as usual. Thread-safe.
+ */
+#define LOKAN_RESOLVE_PERMANENT (-1L)
+
+/*
+ * Called on the resolver's thread when host's entry is due for a refresh,
+ * e.g. to send an mDNS query; the answer is given to lokan_resolver_update.
+ */
+typedef void (*lokan_resolve_refresh_cb)(const char *host, uint16_t port, void *user_data);
+
+typedef struct {
+    /* Hosts held at once; 0 uses 16. */
+    size_t max_entries;
+    /* TTL of entries updated with ttl_ms 0 and of refreshed ones; 0 uses 120000, mDNS's host record TTL. */
+    long default_ttl_ms;
+    /* How long an expired entry is kept in use while its refresh goes unanswered; 0 uses 30000. */
+    long max_stale_ms;
+    /* NULL refreshes with the system resolver instead, for hosts that DNS knows. */
+    lokan_resolve_refresh_cb on_refresh;
+    void *user_data;
+} lokan_resolver_config_t;
+
+lokan_result_t lokan_resolver_create(lokan_resolver_t **out_resolver, const lokan_resolver_config_t *config);
+
+/* Every client configured with the resolver must be cleaned up first. */
+void lokan_resolver_destroy(lokan_resolver_t *resolver);
+
+/*
+ * Sets host:port's addresses, a comma-separated list of IPv4 and IPv6
+ * literals such as "192.168.1.20,fe80::1", for ttl_ms; 0 uses
+ * default_ttl_ms and LOKAN_RESOLVE_PERMANENT never expires. NULL addresses
+ * queues a background lookup instead. Requests already connected keep their
+ * connection. Returns LOKAN_ERROR_OVERFLOW when max_entries are held.
+ */
+lokan_result_t lokan_resolver_update(
+    lokan_resolver_t *resolver,
+    const char *host,
+    uint16_t port,
+    const char *addresses,
+    long ttl_ms);
+
+/* Drops host:port's entry, e.g. on an mDNS goodbye; later requests resolve it as usual. */
+lokan_result_t lokan_resolver_remove(lokan_resolver_t *resolver, const char *host, uint16_t port);
+
 #ifdef __cplusplus
 }
 #endif
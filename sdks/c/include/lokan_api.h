@@ -0,0 +1,214 @@
+/*
+ * This file is auto-generated by tools/oas2c.ts.
+ * Do not edit this file directly.
+ *
+ * Typed entry points for every operation in openapi/_bundle.json. Paths are
+ * relative to the client's base URL, which names the service, e.g.
+ * https://host/device-registry for the DeviceRegistry functions. Decoded
+ * strings and raw JSON members borrow client memory and stay valid until
+ * the next call on the same client; raw members are not NUL-terminated.
+ * A missing required member or a member of the wrong type fails the call
+ * with LOKAN_ERROR_PARSE.
+ */
+
+#ifndef LOKAN_API_H
+#define LOKAN_API_H
+
+#include "lokan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOKAN_DIAGNOSTIC_INFO_HAS_UPTIME_SECONDS (1u << 0)
+#define LOKAN_DIAGNOSTIC_INFO_HAS_DETAILS (1u << 1)
+
+/* DiagnosticInfo */
+typedef struct {
+    /* LOKAN_DIAGNOSTIC_INFO_HAS_* bits for the members the response carried. */
+    uint32_t present;
+    int64_t uptime_seconds;
+    /* Raw JSON text of the member. */
+    lokan_view_t details;
+} lokan_diagnostic_info_t;
+
+#define LOKAN_HEALTH_STATUS_HAS_STATUS (1u << 0)
+
+/* HealthStatus */
+typedef struct {
+    /* LOKAN_HEALTH_STATUS_HAS_* bits for the members the response carried. */
+    uint32_t present;
+    lokan_view_t status;
+} lokan_health_status_t;
+
+#define LOKAN_DEVICE_REGISTRY_LIST_CHANGES_RESULT_HAS_CHANGES (1u << 0)
+#define LOKAN_DEVICE_REGISTRY_LIST_CHANGES_RESULT_HAS_LATEST_SEQ (1u << 1)
+#define LOKAN_DEVICE_REGISTRY_LIST_CHANGES_RESULT_HAS_HAS_MORE (1u << 2)
+
+/* DeviceRegistryListChanges response */
+typedef struct {
+    /* LOKAN_DEVICE_REGISTRY_LIST_CHANGES_RESULT_HAS_* bits for the members the response carried. */
+    uint32_t present;
+    /* Raw JSON text of the member. */
+    lokan_view_t changes;
+    int64_t latest_seq;
+    int has_more;
+} lokan_device_registry_list_changes_result_t;
+
+#define LOKAN_ENERGY_SERVICE_GET_REPORT_RESULT_HAS_PERIOD (1u << 0)
+#define LOKAN_ENERGY_SERVICE_GET_REPORT_RESULT_HAS_CONSUMPTION_KWH (1u << 1)
+
+/* EnergyServiceGetReport response */
+typedef struct {
+    /* LOKAN_ENERGY_SERVICE_GET_REPORT_RESULT_HAS_* bits for the members the response carried. */
+    uint32_t present;
+    lokan_view_t period;
+    double consumption_kwh;
+} lokan_energy_service_get_report_result_t;
+
+#define LOKAN_TELEMETRY_INGEST_RESULT_HAS_ACCEPTED (1u << 0)
+
+/* TelemetryIngestResult */
+typedef struct {
+    /* LOKAN_TELEMETRY_INGEST_RESULT_HAS_* bits for the members the response carried. */
+    uint32_t present;
+    int64_t accepted;
+} lokan_telemetry_ingest_result_t;
+
+/* GET /api-gateway/diag: Diagnostic snapshot for troubleshooting. */
+lokan_result_t lokan_api_gateway_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status);
+
+/* GET /api-gateway/health: Gateway health check. */
+lokan_result_t lokan_api_gateway_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status);
+
+/* GET /api-gateway/metrics: Prometheus metrics exposition. */
+lokan_result_t lokan_api_gateway_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status);
+
+/* GET /api-gateway/routes: Enumerate configured upstream routes. Streams each entry of "routes" to on_element. */
+lokan_result_t lokan_api_gateway_list_routes(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status);
+
+/* GET /audit-log/diag: Diagnostic snapshot for troubleshooting. */
+lokan_result_t lokan_audit_log_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status);
+
+/* GET /audit-log/entries: Retrieve recent audit log entries. Streams each entry of "entries" to on_element. Optional query parameters are left out when NULL or 0. */
+lokan_result_t lokan_audit_log_list_entries(lokan_client_t *client, const char *cursor, int64_t limit, lokan_json_element_cb on_element, void *user_data, long *out_status);
+
+/* GET /audit-log/entries page by page; see lokan_list_iter_create. */
+lokan_result_t lokan_audit_log_list_entries_iter(lokan_client_t *client, size_t page_size, lokan_list_iter_t **out_iter);
+
+/* GET /audit-log/health: Audit log service health probe. */
+lokan_result_t lokan_audit_log_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status);
+
+/* GET /audit-log/metrics: Prometheus metrics exposition. */
+lokan_result_t lokan_audit_log_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status);
+
+/* GET /device-registry/devices: List registered devices with metadata. Streams each entry of "devices" to on_element. Optional query parameters are left out when NULL or 0. */
+lokan_result_t lokan_device_registry_list_devices(lokan_client_t *client, const char *cursor, int64_t limit, lokan_json_element_cb on_element, void *user_data, long *out_status);
+
+/* GET /device-registry/devices page by page; see lokan_list_iter_create. */
+lokan_result_t lokan_device_registry_list_devices_iter(lokan_client_t *client, size_t page_size, lokan_list_iter_t **out_iter);
+
+/* GET /device-registry/devices/changes: Devices changed since a change sequence number, for keeping a local mirror current. Optional query parameters are left out when NULL or 0. */
+lokan_result_t lokan_device_registry_list_changes(lokan_client_t *client, int64_t since, int64_t limit, lokan_device_registry_list_changes_result_t *out, long *out_status);
+
+/* GET /device-registry/diag: Diagnostic snapshot for troubleshooting. */
+lokan_result_t lokan_device_registry_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status);
+
+/* GET /device-registry/health: Device registry health probe. */
+lokan_result_t lokan_device_registry_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status);
+
+/* GET /device-registry/metrics: Prometheus metrics exposition. */
+lokan_result_t lokan_device_registry_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status);
+
+/* GET /energy-svc/diag: Diagnostic snapshot for troubleshooting. */
+lokan_result_t lokan_energy_service_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status);
+
+/* GET /energy-svc/energy-report: Retrieve aggregated energy usage data. */
+lokan_result_t lokan_energy_service_get_report(lokan_client_t *client, lokan_energy_service_get_report_result_t *out, long *out_status);
+
+/* GET /energy-svc/health: Energy service health probe. */
+lokan_result_t lokan_energy_service_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status);
+
+/* GET /energy-svc/metrics: Prometheus metrics exposition. */
+lokan_result_t lokan_energy_service_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status);
+
+/* GET /presence-svc/diag: Diagnostic snapshot for troubleshooting. */
+lokan_result_t lokan_presence_service_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status);
+
+/* GET /presence-svc/health: Presence service health probe. */
+lokan_result_t lokan_presence_service_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status);
+
+/* GET /presence-svc/metrics: Prometheus metrics exposition. */
+lokan_result_t lokan_presence_service_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status);
+
+/* GET /presence-svc/presence: Retrieve current occupancy state summary. Streams each entry of "zones" to on_element. */
+lokan_result_t lokan_presence_service_get_presence(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status);
+
+/* GET /radio-coord/channels: Inspect allocated RF channels. Streams each entry of "assignments" to on_element. */
+lokan_result_t lokan_radio_coordinator_list_channels(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status);
+
+/* GET /radio-coord/diag: Diagnostic snapshot for troubleshooting. */
+lokan_result_t lokan_radio_coordinator_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status);
+
+/* GET /radio-coord/health: Radio coordinator health probe. */
+lokan_result_t lokan_radio_coordinator_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status);
+
+/* GET /radio-coord/metrics: Prometheus metrics exposition. */
+lokan_result_t lokan_radio_coordinator_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status);
+
+/* GET /rule-engine/diag: Diagnostic snapshot for troubleshooting. */
+lokan_result_t lokan_rule_engine_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status);
+
+/* GET /rule-engine/health: Rule engine health probe. */
+lokan_result_t lokan_rule_engine_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status);
+
+/* GET /rule-engine/metrics: Prometheus metrics exposition. */
+lokan_result_t lokan_rule_engine_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status);
+
+/* GET /rule-engine/rules: List automation rules currently deployed. Streams each entry of "rules" to on_element. */
+lokan_result_t lokan_rule_engine_list_rules(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status);
+
+/* GET /scene-svc/diag: Diagnostic snapshot for troubleshooting. */
+lokan_result_t lokan_scene_service_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status);
+
+/* GET /scene-svc/health: Scene service health probe. */
+lokan_result_t lokan_scene_service_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status);
+
+/* GET /scene-svc/metrics: Prometheus metrics exposition. */
+lokan_result_t lokan_scene_service_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status);
+
+/* GET /scene-svc/scenes: List configured scenes and associated triggers. Streams each entry of "scenes" to on_element. */
+lokan_result_t lokan_scene_service_list_scenes(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status);
+
+/* GET /telemetry-pipe/diag: Diagnostic snapshot for troubleshooting. */
+lokan_result_t lokan_telemetry_pipe_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status);
+
+/* GET /telemetry-pipe/health: Telemetry pipeline health probe. */
+lokan_result_t lokan_telemetry_pipe_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status);
+
+/* POST /telemetry-pipe/ingest: Ingest a telemetry envelope for downstream routing. */
+lokan_result_t lokan_telemetry_pipe_ingest(lokan_client_t *client, const char *body_json, size_t body_len, long *out_status);
+
+/* POST /telemetry-pipe/ingest/batch: Ingest many telemetry envelopes in a single request. */
+lokan_result_t lokan_telemetry_pipe_ingest_batch(lokan_client_t *client, const char *body_json, size_t body_len, lokan_telemetry_ingest_result_t *out, long *out_status);
+
+/* GET /telemetry-pipe/metrics: Prometheus metrics exposition. */
+lokan_result_t lokan_telemetry_pipe_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status);
+
+/* GET /updater/available: Enumerate available software update payloads. Streams each entry of "updates" to on_element. */
+lokan_result_t lokan_updater_service_available(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status);
+
+/* GET /updater/diag: Diagnostic snapshot for troubleshooting. */
+lokan_result_t lokan_updater_service_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status);
+
+/* GET /updater/health: Updater service health probe. */
+lokan_result_t lokan_updater_service_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status);
+
+/* GET /updater/metrics: Prometheus metrics exposition. */
+lokan_result_t lokan_updater_service_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOKAN_API_H */
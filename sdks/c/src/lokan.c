@@ -1,78 +1,105 @@
 #include "lokan.h"
+#include "lokan_internal.h"
 
 #include <curl/curl.h>
-#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
-struct lokan_client {
-    CURL *handle;
-    char *base_url;
-    char *client_cert_path;
-    char *client_key_path;
-    char *ca_cert_path;
-    long timeout_ms;
-};
-
-static lokan_result_t lokan_init_global(void) {
-    static int initialized = 0;
-    if (!initialized) {
-        CURLcode code = curl_global_init(CURL_GLOBAL_DEFAULT);
-        if (code != CURLE_OK) {
-            return LOKAN_ERROR_CURL;
-        }
-        initialized = 1;
-    }
-    return LOKAN_OK;
+uint64_t lokan_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
 }
 
-static char *lokan_strdup(const char *value) {
-    if (!value) {
-        return NULL;
-    }
-    size_t len = strlen(value);
-    char *copy = (char *)malloc(len + 1);
-    if (!copy) {
-        return NULL;
-    }
-    memcpy(copy, value, len);
-    copy[len] = '\0';
-    return copy;
+const lokan_allocator_t *lokan_scratch_allocator(const lokan_client_t *client) {
+    return client->arena ? lokan_arena_allocator(client->arena) : &client->allocator;
 }
 
 lokan_result_t lokan_client_init(lokan_client_t **out_client, const lokan_client_config_t *config) {
+    return lokan_client_create(config, NULL, out_client);
+}
+
+lokan_result_t lokan_client_create(const lokan_client_config_t *config, CURLSH *share, lokan_client_t **out_client) {
     if (!out_client || !config || !config->base_url) {
         return LOKAN_ERROR_INVALID_ARGUMENT;
     }
 
-    lokan_result_t init_result = lokan_init_global();
+    lokan_result_t init_result = lokan_global_init();
     if (init_result != LOKAN_OK) {
         return init_result;
     }
 
-    lokan_client_t *client = (lokan_client_t *)calloc(1, sizeof(lokan_client_t));
+    const lokan_allocator_t *allocator = config->allocator ? config->allocator : lokan_default_allocator();
+    if (!allocator->malloc_fn || !allocator->realloc_fn || !allocator->free_fn) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    lokan_client_t *client = (lokan_client_t *)lokan_calloc(allocator, 1, sizeof(lokan_client_t));
     if (!client) {
         return LOKAN_ERROR_ALLOCATION;
     }
+    client->allocator = *allocator;
+    client->response.allocator = &client->allocator;
+    client->decoded.allocator = &client->allocator;
+    client->replay.allocator = &client->allocator;
+    client->deflated.allocator = &client->allocator;
+    client->hedge_response.allocator = &client->allocator;
 
     client->handle = curl_easy_init();
     if (!client->handle) {
-        free(client);
+        lokan_free(allocator, client);
         return LOKAN_ERROR_CURL;
     }
 
-    client->base_url = lokan_strdup(config->base_url);
-    client->client_cert_path = lokan_strdup(config->client_cert_path);
-    client->client_key_path = lokan_strdup(config->client_key_path);
-    client->ca_cert_path = lokan_strdup(config->ca_cert_path);
+    client->base_url = lokan_strdup(&client->allocator, config->base_url);
+    client->client_cert_path = lokan_strdup(&client->allocator, config->client_cert_path);
+    client->client_key_path = lokan_strdup(&client->allocator, config->client_key_path);
+    client->ca_cert_path = lokan_strdup(&client->allocator, config->ca_cert_path);
     client->timeout_ms = config->timeout_ms > 0 ? config->timeout_ms : 5000;
+    client->keepalive_idle_ms = config->keepalive_idle_ms > 0 ? config->keepalive_idle_ms : 60000;
+    client->max_connection_age_ms = config->max_connection_age_ms > 0 ? config->max_connection_age_ms : 0;
+    client->enable_http2 = config->enable_http2 != 0;
+    client->http2_max_streams = config->http2_max_streams > 0 ? config->http2_max_streams : 100;
+    client->share = share;
+    client->metrics = config->metrics;
+    client->cache = config->response_cache;
+    client->accept_compressed = config->accept_compressed != 0;
+    client->compress_min_bytes = config->compress_min_bytes;
+    client->retry.max_attempts = config->retry.max_attempts > 1 ? config->retry.max_attempts : 1;
+    client->retry.base_delay_ms = config->retry.base_delay_ms > 0 ? config->retry.base_delay_ms : 100;
+    client->retry.max_delay_ms = config->retry.max_delay_ms > 0 ? config->retry.max_delay_ms : 5000;
+    client->retry_seed = (unsigned int)lokan_now_ms() ^ (unsigned int)(uintptr_t)client;
+    client->hedge_after_ms = config->hedge_after_ms;
+    client->circuit_breaker = config->circuit_breaker;
+    client->rate_limiter = config->rate_limiter;
+    client->resolver = config->resolver;
+    if (client->resolver && !client->share) {
+        /*
+         * Pinned addresses live in the DNS cache, which is per handle unless
+         * shared, so the client's handles share one to see them all.
+         */
+        client->share = curl_share_init();
+        if (client->share) {
+            curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            client->owns_share = 1;
+        }
+    }
+
+    if (config->arena_bytes > 0) {
+        client->arena = lokan_arena_create(&client->allocator, config->arena_bytes);
+    }
 
-    if (!client->base_url) {
+    if (!client->base_url || (config->arena_bytes > 0 && !client->arena) ||
+        (client->resolver && (!client->share || lokan_resolve_client_init(client) != LOKAN_OK)) ||
+        lokan_endpoints_init(client) != LOKAN_OK) {
         lokan_client_cleanup(client);
         return LOKAN_ERROR_ALLOCATION;
     }
 
+    lokan_configure_handle(client, client->handle);
+
     *out_client = client;
     return LOKAN_OK;
 }
@@ -81,14 +108,32 @@ void lokan_client_cleanup(lokan_client_t *client) {
     if (!client) {
         return;
     }
+    lokan_async_cleanup(client);
+    lokan_hedge_cleanup(client);
+    lokan_decoder_destroy(client->health_decoder);
     if (client->handle) {
         curl_easy_cleanup(client->handle);
     }
-    free(client->base_url);
-    free(client->client_cert_path);
-    free(client->client_key_path);
-    free(client->ca_cert_path);
-    free(client);
+    /* Every handle has detached from the share by now. */
+    if (client->owns_share) {
+        curl_share_cleanup(client->share);
+    }
+    /* The allocator lives inside the client, so it is copied out before the client goes. */
+    lokan_allocator_t allocator = client->allocator;
+    lokan_endpoints_cleanup(client);
+    lokan_deflate_cleanup(client);
+    lokan_resolve_client_cleanup(client);
+    lokan_arena_destroy(client->arena);
+    lokan_free(&allocator, client->response.data);
+    lokan_free(&allocator, client->decoded.data);
+    lokan_free(&allocator, client->replay.data);
+    lokan_free(&allocator, client->deflated.data);
+    lokan_free(&allocator, client->hedge_response.data);
+    lokan_free(&allocator, client->base_url);
+    lokan_free(&allocator, client->client_cert_path);
+    lokan_free(&allocator, client->client_key_path);
+    lokan_free(&allocator, client->ca_cert_path);
+    lokan_free(&allocator, client);
 }
 
 const char *lokan_result_string(lokan_result_t result) {
@@ -105,31 +150,105 @@ const char *lokan_result_string(lokan_result_t result) {
             return "http error";
         case LOKAN_ERROR_PARSE:
             return "parse error";
+        case LOKAN_ERROR_OVERFLOW:
+            return "buffer full";
+        case LOKAN_ERROR_CANCELLED:
+            return "cancelled by callback";
+        case LOKAN_ERROR_UNAVAILABLE:
+            return "circuit open";
+        case LOKAN_ERROR_RATE_LIMITED:
+            return "rate limited";
+        case LOKAN_ERROR_INTEGRITY:
+            return "verification failed";
+        case LOKAN_ERROR_SCENE_FAILED:
+            return "scene failed";
         default:
             return "unknown error";
     }
 }
 
-struct lokan_memory {
-    char *data;
-    size_t size;
-};
+lokan_result_t lokan_memory_reserve(struct lokan_memory *memory, size_t needed) {
+    if (needed <= memory->capacity) {
+        return LOKAN_OK;
+    }
+    if (memory->fixed) {
+        memory->overflowed = 1;
+        return LOKAN_ERROR_OVERFLOW;
+    }
+    size_t capacity = memory->capacity > 0 ? memory->capacity : LOKAN_MEMORY_MIN_CAPACITY;
+    while (capacity < needed) {
+        if (capacity > ((size_t)-1) / 2) {
+            return LOKAN_ERROR_ALLOCATION;
+        }
+        capacity *= 2;
+    }
+    const lokan_allocator_t *allocator = memory->allocator ? memory->allocator : lokan_default_allocator();
+    char *data = (char *)lokan_realloc(allocator, memory->data, capacity);
+    if (!data) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    memory->data = data;
+    memory->capacity = capacity;
+    return LOKAN_OK;
+}
+
+void lokan_memory_recycle(struct lokan_memory *memory) {
+    memory->size = 0;
+    memory->overflowed = 0;
+    if (!memory->fixed && memory->capacity > LOKAN_MEMORY_RETAIN_MAX) {
+        lokan_free(memory->allocator ? memory->allocator : lokan_default_allocator(), memory->data);
+        memory->data = NULL;
+        memory->capacity = 0;
+    }
+}
 
-static size_t lokan_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+size_t lokan_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
     size_t realsize = size * nmemb;
     struct lokan_memory *mem = (struct lokan_memory *)userp;
-    char *ptr = (char *)realloc(mem->data, mem->size + realsize + 1);
-    if (!ptr) {
+    if (lokan_memory_reserve(mem, mem->size + realsize + 1) != LOKAN_OK) {
         return 0;
     }
-    mem->data = ptr;
     memcpy(&(mem->data[mem->size]), contents, realsize);
     mem->size += realsize;
     mem->data[mem->size] = '\0';
     return realsize;
 }
 
-static char *lokan_join_url(const char *base, const char *path) {
+size_t lokan_json_escaped_len(const char *value) {
+    size_t len = 0;
+    for (const unsigned char *p = (const unsigned char *)value; *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+            len += 2;
+        } else if (*p < 0x20) {
+            len += 6;
+        } else {
+            len += 1;
+        }
+    }
+    return len;
+}
+
+char *lokan_json_escape_into(char *out, const char *value) {
+    static const char hex[] = "0123456789abcdef";
+    for (const unsigned char *p = (const unsigned char *)value; *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+            *out++ = '\\';
+            *out++ = (char)*p;
+        } else if (*p < 0x20) {
+            *out++ = '\\';
+            *out++ = 'u';
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = hex[*p >> 4];
+            *out++ = hex[*p & 0x0f];
+        } else {
+            *out++ = (char)*p;
+        }
+    }
+    return out;
+}
+
+char *lokan_join_url(const lokan_allocator_t *allocator, const char *base, const char *path) {
     size_t base_len = strlen(base);
     size_t path_len = strlen(path);
     int need_slash = 0;
@@ -150,185 +269,565 @@ static char *lokan_join_url(const char *base, const char *path) {
         total -= 1;
     }
 
-    char *result = (char *)malloc(total);
+    char *result = (char *)lokan_alloc(allocator, total);
     if (!result) {
         return NULL;
     }
 
-    if (need_slash == -1 && base_len > 0) {
-        memcpy(result, base, base_len - 1);
-        result[base_len - 1] = '\0';
-    } else if (base_len > 0) {
-        memcpy(result, base, base_len);
-        result[base_len] = '\0';
-    } else {
-        result[0] = '\0';
-    }
-
+    size_t copied = need_slash == -1 ? base_len - 1 : base_len;
+    memcpy(result, base, copied);
     if (need_slash == 1) {
-        strcat(result, "/");
+        result[copied++] = '/';
     }
-    strcat(result, path);
+    memcpy(result + copied, path, path_len);
+    result[copied + path_len] = '\0';
     return result;
 }
 
-static void lokan_apply_tls_options(lokan_client_t *client) {
-    if (!client || !client->handle) {
-        return;
+char *lokan_url_escape_into(char *out, const char *value) {
+    static const char hex[] = "0123456789ABCDEF";
+    for (const unsigned char *p = (const unsigned char *)value; *p; ++p) {
+        if ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z') || (*p >= '0' && *p <= '9') || *p == '-' ||
+            *p == '_' || *p == '.' || *p == '~') {
+            *out++ = (char)*p;
+        } else {
+            *out++ = '%';
+            *out++ = hex[*p >> 4];
+            *out++ = hex[*p & 0x0f];
+        }
+    }
+    *out = '\0';
+    return out;
+}
+
+char *lokan_query_path(
+    const lokan_allocator_t *allocator,
+    char *inline_path,
+    size_t inline_capacity,
+    const char *path,
+    const struct lokan_query_param *params,
+    size_t count) {
+    size_t path_len = strlen(path);
+    /* Per parameter: separator, name, '=', and up to three bytes per value byte or the digits of an int64. */
+    size_t capacity = path_len + 1;
+    for (size_t i = 0; i < count; ++i) {
+        capacity += 2 + strlen(params[i].name) + (params[i].is_string ? 3 * strlen(params[i].string ? params[i].string : "") : 20);
+    }
+    char *out_path = capacity <= inline_capacity ? inline_path : (char *)lokan_alloc(allocator, capacity);
+    if (!out_path) {
+        return NULL;
+    }
+    memcpy(out_path, path, path_len + 1);
+    char *out = out_path + path_len;
+    char separator = strchr(path, '?') ? '&' : '?';
+    for (size_t i = 0; i < count; ++i) {
+        const struct lokan_query_param *param = &params[i];
+        if (!param->required && (param->is_string ? !param->string : param->integer == 0)) {
+            continue;
+        }
+        out += sprintf(out, "%c%s=", separator, param->name);
+        separator = '&';
+        if (param->is_string) {
+            out = lokan_url_escape_into(out, param->string ? param->string : "");
+        } else {
+            out += sprintf(out, "%lld", (long long)param->integer);
+        }
     }
-    curl_easy_setopt(client->handle, CURLOPT_USE_SSL, CURLUSESSL_ALL);
-    curl_easy_setopt(client->handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
-    curl_easy_setopt(client->handle, CURLOPT_SSL_VERIFYPEER, 1L);
-    curl_easy_setopt(client->handle, CURLOPT_SSL_VERIFYHOST, 2L);
+    return out_path;
+}
+
+static long lokan_ms_to_seconds(long ms) {
+    return ms > 0 ? (ms + 999) / 1000 : 0;
+}
+
+static void lokan_apply_tls_options(const lokan_client_t *client, CURL *handle) {
+    curl_easy_setopt(handle, CURLOPT_USE_SSL, CURLUSESSL_ALL);
+    curl_easy_setopt(handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, 2L);
+    curl_easy_setopt(handle, CURLOPT_SSL_SESSIONID_CACHE, 1L);
     if (client->client_cert_path) {
-        curl_easy_setopt(client->handle, CURLOPT_SSLCERT, client->client_cert_path);
+        curl_easy_setopt(handle, CURLOPT_SSLCERT, client->client_cert_path);
     }
     if (client->client_key_path) {
-        curl_easy_setopt(client->handle, CURLOPT_SSLKEY, client->client_key_path);
+        curl_easy_setopt(handle, CURLOPT_SSLKEY, client->client_key_path);
     }
     if (client->ca_cert_path) {
-        curl_easy_setopt(client->handle, CURLOPT_CAINFO, client->ca_cert_path);
+        curl_easy_setopt(handle, CURLOPT_CAINFO, client->ca_cert_path);
     }
 }
 
-static lokan_result_t lokan_perform_request(
+static void lokan_apply_connection_options(const lokan_client_t *client, CURL *handle) {
+    long keepalive_s = lokan_ms_to_seconds(client->keepalive_idle_ms);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPIDLE, keepalive_s);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPINTVL, keepalive_s);
+    if (client->max_connection_age_ms > 0) {
+#if LIBCURL_VERSION_NUM >= 0x075000
+        curl_easy_setopt(handle, CURLOPT_MAXLIFETIME_CONN, lokan_ms_to_seconds(client->max_connection_age_ms));
+#else
+        curl_easy_setopt(handle, CURLOPT_MAXAGE_CONN, lokan_ms_to_seconds(client->max_connection_age_ms));
+#endif
+    }
+    if (client->enable_http2) {
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        /* Wait for an in-progress connection to confirm multiplexing instead of opening another. */
+        curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+    } else {
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1);
+    }
+    if (client->accept_compressed) {
+        /* "" offers every encoding this libcurl can decode; bodies reach the write callback decoded. */
+        curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "");
+    }
+}
+
+/*
+ * Options that stay constant for the life of the client are applied once so
+ * the handle keeps its connection cache and TLS session IDs between calls.
+ * lokan_prepare_request only touches URL, method, body and headers.
+ */
+void lokan_configure_handle(const lokan_client_t *client, CURL *handle) {
+    lokan_apply_tls_options(client, handle);
+    lokan_apply_connection_options(client, handle);
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, client->timeout_ms);
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, "lokan-c-sdk/0.1");
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, lokan_write_callback);
+    if (client->share) {
+        curl_easy_setopt(handle, CURLOPT_SHARE, client->share);
+    }
+}
+
+static size_t lokan_read_callback(char *buffer, size_t size, size_t nitems, void *userp) {
+    struct lokan_body_reader *reader = (struct lokan_body_reader *)userp;
+    size_t capacity = size * nitems;
+    size_t written = 0;
+    while (written < capacity && reader->index < reader->count) {
+        const lokan_iovec_t *segment = &reader->iov[reader->index];
+        size_t remaining = segment->len - reader->offset;
+        size_t take = remaining < capacity - written ? remaining : capacity - written;
+        if (take > 0) {
+            memcpy(buffer + written, (const char *)segment->data + reader->offset, take);
+        }
+        written += take;
+        reader->offset += take;
+        if (reader->offset == segment->len) {
+            reader->index++;
+            reader->offset = 0;
+        }
+    }
+    return written;
+}
+
+/* libcurl rewinds the body when it has to resend it, e.g. on a reused connection that closed. */
+static int lokan_seek_callback(void *userp, curl_off_t offset, int origin) {
+    struct lokan_body_reader *reader = (struct lokan_body_reader *)userp;
+    if (origin != SEEK_SET || offset < 0) {
+        return CURL_SEEKFUNC_CANTSEEK;
+    }
+    reader->index = 0;
+    reader->offset = 0;
+    size_t skip = (size_t)offset;
+    while (reader->index < reader->count && skip >= reader->iov[reader->index].len) {
+        skip -= reader->iov[reader->index].len;
+        reader->index++;
+    }
+    if (reader->index == reader->count && skip > 0) {
+        return CURL_SEEKFUNC_FAIL;
+    }
+    reader->offset = skip;
+    return CURL_SEEKFUNC_OK;
+}
+
+lokan_result_t lokan_set_url(const lokan_client_t *client, CURL *handle, const char *path) {
+    lokan_resolve_apply(client, handle);
+    const struct lokan_endpoint *endpoint = lokan_endpoint_find(client, path);
+#if LIBCURL_VERSION_NUM >= 0x073f00
+    if (endpoint && endpoint->curlu) {
+        curl_easy_setopt(handle, CURLOPT_CURLU, endpoint->curlu);
+        return LOKAN_OK;
+    }
+    /* CURLOPT_CURLU overrides CURLOPT_URL, so drop one left by an earlier request. */
+    curl_easy_setopt(handle, CURLOPT_CURLU, NULL);
+#endif
+    if (endpoint) {
+        curl_easy_setopt(handle, CURLOPT_URL, endpoint->url);
+        return LOKAN_OK;
+    }
+
+    /* libcurl copies the URL, so it only needs to live for the setopt. */
+    const lokan_allocator_t *scratch = lokan_scratch_allocator(client);
+    lokan_arena_mark_t mark = {0, NULL};
+    if (client->arena) {
+        mark = lokan_arena_mark(client->arena);
+    }
+    char *url = lokan_join_url(scratch, client->base_url, path);
+    if (url) {
+        curl_easy_setopt(handle, CURLOPT_URL, url);
+        lokan_free(scratch, url);
+    }
+    if (client->arena) {
+        lokan_arena_release(client->arena, mark);
+    }
+    return url ? LOKAN_OK : LOKAN_ERROR_ALLOCATION;
+}
+
+/*
+ * Every request sends one of a few fixed header sets, so they are built once
+ * as static lists instead of curl_slist_append'ed per request. libcurl only
+ * reads a CURLOPT_HTTPHEADER list, which lets every handle of every client
+ * share them.
+ */
+static char lokan_header_accept[] = "Accept: application/json";
+static char lokan_header_json[] = "Content-Type: application/json";
+static char lokan_header_cbor[] = "Content-Type: application/cbor";
+static char lokan_header_gzip[] = "Content-Encoding: gzip";
+static struct curl_slist lokan_headers_plain = {lokan_header_accept, NULL};
+static struct curl_slist lokan_headers_json = {lokan_header_json, &lokan_headers_plain};
+static struct curl_slist lokan_headers_gzip = {lokan_header_gzip, &lokan_headers_json};
+static struct curl_slist lokan_headers_cbor = {lokan_header_cbor, &lokan_headers_plain};
+static struct curl_slist lokan_headers_cbor_gzip = {lokan_header_gzip, &lokan_headers_cbor};
+
+lokan_result_t lokan_prepare_request(
     lokan_client_t *client,
+    CURL *handle,
     const char *path,
     const char *method,
     const char *body,
     size_t body_len,
-    char **out_body,
-    long *out_status) {
-    if (!client || !client->handle || !path || !method) {
-        return LOKAN_ERROR_INVALID_ARGUMENT;
+    int copy_body,
+    struct lokan_body_reader *reader,
+    struct curl_slist **out_headers) {
+    if (client->circuit_breaker &&
+        lokan_circuit_allow(client->circuit_breaker, lokan_circuit_key(client->base_url, path)) != LOKAN_OK) {
+        return LOKAN_ERROR_UNAVAILABLE;
     }
 
-    curl_easy_reset(client->handle);
-    lokan_apply_tls_options(client);
-    curl_easy_setopt(client->handle, CURLOPT_TIMEOUT_MS, client->timeout_ms);
-    curl_easy_setopt(client->handle, CURLOPT_USERAGENT, "lokan-c-sdk/0.1");
+    lokan_result_t result = lokan_set_url(client, handle, path);
+    if (result != LOKAN_OK) {
+        return result;
+    }
 
-    char *url = lokan_join_url(client->base_url, path);
-    if (!url) {
-        return LOKAN_ERROR_ALLOCATION;
+    struct curl_slist *headers = &lokan_headers_plain;
+
+    /* HTTPGET clears any body left over from the previous request on this handle. */
+    curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, strcmp(method, "GET") == 0 ? NULL : method);
+
+    int cbor = reader && reader->format == LOKAN_BODY_CBOR;
+    if (reader && reader->count == 1) {
+        /* A single segment goes straight to POSTFIELDS, which libcurl sends without a read callback. */
+        body = (const char *)reader->iov[0].data;
+        body_len = reader->iov[0].len;
+        reader = NULL;
+    }
+    int compressed = 0;
+    if (reader) {
+        compressed = lokan_deflate_body(client, reader->iov, reader->count, reader->total);
+    } else if (body && body_len > 0) {
+        lokan_iovec_t segment = {body, body_len};
+        compressed = lokan_deflate_body(client, &segment, 1, body_len);
+    }
+    if (compressed) {
+        /* The gzip form replaces the caller's body, so it goes through POSTFIELDS however it arrived. */
+        body = client->deflated.data;
+        body_len = client->deflated.size;
+        reader = NULL;
+    }
+
+    if (reader) {
+        /* POSTFIELDS NULL makes libcurl pull the body through the read callback. */
+        curl_easy_setopt(handle, CURLOPT_POST, 1L);
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDS, NULL);
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)reader->total);
+        curl_easy_setopt(handle, CURLOPT_READFUNCTION, lokan_read_callback);
+        curl_easy_setopt(handle, CURLOPT_READDATA, (void *)reader);
+        curl_easy_setopt(handle, CURLOPT_SEEKFUNCTION, lokan_seek_callback);
+        curl_easy_setopt(handle, CURLOPT_SEEKDATA, (void *)reader);
+        headers = cbor ? &lokan_headers_cbor : &lokan_headers_json;
+    } else if (body && body_len > 0) {
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body_len);
+        if (copy_body) {
+            curl_easy_setopt(handle, CURLOPT_COPYPOSTFIELDS, body);
+        } else {
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDS, body);
+        }
+        if (cbor) {
+            headers = compressed ? &lokan_headers_cbor_gzip : &lokan_headers_cbor;
+        } else {
+            headers = compressed ? &lokan_headers_gzip : &lokan_headers_json;
+        }
     }
-    curl_easy_setopt(client->handle, CURLOPT_URL, url);
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
 
-    struct lokan_memory memory = {0};
-    curl_easy_setopt(client->handle, CURLOPT_WRITEFUNCTION, lokan_write_callback);
-    curl_easy_setopt(client->handle, CURLOPT_WRITEDATA, (void *)&memory);
+    if (out_headers) {
+        *out_headers = headers;
+    }
+    return LOKAN_OK;
+}
 
-    struct curl_slist *headers = NULL;
+lokan_result_t lokan_finish_request(
+    const lokan_client_t *client,
+    CURL *handle,
+    const char *path,
+    CURLcode code,
+    long *out_status,
+    lokan_request_timing_t *out_timing) {
+    lokan_collect_timing(handle, out_timing);
 
-    if (strcmp(method, "GET") == 0) {
-        curl_easy_setopt(client->handle, CURLOPT_HTTPGET, 1L);
+    lokan_result_t result = LOKAN_OK;
+    long status_code = 0;
+    if (code != CURLE_OK) {
+        result = LOKAN_ERROR_CURL;
     } else {
-        curl_easy_setopt(client->handle, CURLOPT_CUSTOMREQUEST, method);
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status_code);
+        if (out_status) {
+            *out_status = status_code;
+        }
+        if (status_code >= 400) {
+            result = LOKAN_ERROR_HTTP;
+        }
     }
 
-    if (body && body_len > 0) {
-        curl_easy_setopt(client->handle, CURLOPT_POSTFIELDS, body);
-        curl_easy_setopt(client->handle, CURLOPT_POSTFIELDSIZE, (long)body_len);
-        headers = curl_slist_append(headers, "Content-Type: application/json");
+    if (status_code == 429) {
+        lokan_rate_limit_drain(client);
     }
+    if (client->circuit_breaker) {
+        lokan_circuit_record(client->circuit_breaker, lokan_circuit_key(client->base_url, path), code, status_code);
+    }
+    if (client->metrics) {
+        lokan_metrics_record(client->metrics, path, out_timing, result != LOKAN_OK);
+    }
+    return result;
+}
 
-    headers = curl_slist_append(headers, "Accept: application/json");
-    curl_easy_setopt(client->handle, CURLOPT_HTTPHEADER, headers);
-
-    CURLcode res = curl_easy_perform(client->handle);
-    curl_slist_free_all(headers);
-    free(url);
-
-    if (res != CURLE_OK) {
-        free(memory.data);
-        return LOKAN_ERROR_CURL;
+lokan_result_t lokan_client_last_timing(lokan_client_t *client, lokan_request_timing_t *out_timing) {
+    if (!client || !out_timing) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
     }
+    *out_timing = client->last_timing;
+    return LOKAN_OK;
+}
 
-    long status_code = 0;
-    curl_easy_getinfo(client->handle, CURLINFO_RESPONSE_CODE, &status_code);
-    if (out_status) {
-        *out_status = status_code;
+static lokan_result_t lokan_perform(
+    lokan_client_t *client,
+    const char *path,
+    const char *method,
+    const char *body,
+    size_t body_len,
+    struct lokan_body_reader *reader,
+    struct lokan_memory *response,
+    long *out_status) {
+    if (!client || !client->handle || !path || !method) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (!response) {
+        response = &client->response;
     }
 
-    if (status_code >= 400) {
-        free(memory.data);
-        return LOKAN_ERROR_HTTP;
+    /* Only a body-less GET into the client's own buffer can be hedged, since the loser's body is thrown away. */
+    long hedge_ms = 0;
+    if (client->hedge_after_ms != 0 && response == &client->response && !reader && !(body && body_len > 0) &&
+        strcmp(method, "GET") == 0) {
+        hedge_ms = lokan_hedge_deadline_ms(client, path);
     }
 
-    if (out_body) {
-        if (!memory.data) {
-            memory.data = lokan_strdup("");
-            if (!memory.data) {
-                return LOKAN_ERROR_ALLOCATION;
-            }
+    lokan_result_t result = LOKAN_OK;
+    CURLcode res = CURLE_OK;
+    long status = 0;
+    int attempts = 0;
+    for (;;) {
+        lokan_memory_recycle(response);
+        if (reader) {
+            reader->index = 0;
+            reader->offset = 0;
         }
-        *out_body = memory.data;
-    } else {
-        free(memory.data);
-    }
 
-    return LOKAN_OK;
-}
+        result = lokan_rate_limit(client, 1);
+        if (result != LOKAN_OK) {
+            break;
+        }
+        result = lokan_prepare_request(client, client->handle, path, method, body, body_len, 0, reader, NULL);
+        if (result != LOKAN_OK) {
+            /* A circuit that opened between attempts ends the retries. */
+            break;
+        }
 
-static char *lokan_trim_quotes(char *value) {
-    if (!value) {
-        return NULL;
+        curl_easy_setopt(client->handle, CURLOPT_WRITEDATA, (void *)response);
+
+        CURL *winner = client->handle;
+        int sent = 1;
+        if (hedge_ms > 0) {
+            res = lokan_hedged_perform(client, path, hedge_ms, &winner, &sent);
+        } else {
+            res = curl_easy_perform(client->handle);
+        }
+        status = 0;
+        result = lokan_finish_request(client, winner, path, res, &status, &client->last_timing);
+        if (winner != client->handle) {
+            /* The hedge answered first; its body becomes the response. */
+            struct lokan_memory swapped = client->response;
+            client->response = client->hedge_response;
+            client->hedge_response = swapped;
+        }
+        if (reader) {
+            /* The reader lives on the caller's stack; never leave the handle pointing at it. */
+            curl_easy_setopt(client->handle, CURLOPT_READDATA, NULL);
+            curl_easy_setopt(client->handle, CURLOPT_SEEKDATA, NULL);
+        }
+        attempts += sent;
+
+        if (res == CURLE_WRITE_ERROR && response->overflowed) {
+            break;
+        }
+        long delay = lokan_retry_delay(client, winner, method, res, status, attempts);
+        if (delay < 0) {
+            break;
+        }
+        lokan_sleep_ms(delay);
     }
-    size_t len = strlen(value);
-    while (len > 0 && isspace((unsigned char)value[len - 1])) {
-        value[--len] = '\0';
+    client->last_timing.attempts = attempts;
+    if (out_status && attempts > 0 && res == CURLE_OK) {
+        *out_status = status;
     }
-    while (*value && isspace((unsigned char)*value)) {
-        value++;
+    if (result == LOKAN_ERROR_UNAVAILABLE || result == LOKAN_ERROR_RATE_LIMITED || result == LOKAN_ERROR_ALLOCATION) {
+        return result;
     }
-    if (*value == '"') {
-        value++;
-        char *end = strchr(value, '"');
-        if (end) {
-            *end = '\0';
-        }
+
+    if (res == CURLE_WRITE_ERROR && response->overflowed) {
+        return LOKAN_ERROR_OVERFLOW;
+    }
+    if (lokan_memory_reserve(response, response->size + 1) != LOKAN_OK) {
+        return response->fixed ? LOKAN_ERROR_OVERFLOW : LOKAN_ERROR_ALLOCATION;
     }
-    return value;
+    response->data[response->size] = '\0';
+    return result;
 }
 
-lokan_result_t lokan_get_health(lokan_client_t *client, char **out_status) {
-    if (!client || !out_status) {
+lokan_result_t lokan_perform_request(
+    lokan_client_t *client,
+    const char *path,
+    const char *method,
+    const char *body,
+    size_t body_len,
+    struct lokan_memory *response,
+    long *out_status) {
+    return lokan_perform(client, path, method, body, body_len, NULL, response, out_status);
+}
+
+lokan_result_t lokan_perform_reader(
+    lokan_client_t *client,
+    const char *path,
+    const char *method,
+    struct lokan_body_reader *reader,
+    long *out_status) {
+    return lokan_perform(client, path, method, NULL, 0, reader, NULL, out_status);
+}
+
+lokan_result_t lokan_request_iov(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const lokan_iovec_t *iov,
+    size_t iov_count,
+    long *out_status,
+    lokan_view_t *out_body) {
+    if (!out_body || (!iov && iov_count > 0)) {
         return LOKAN_ERROR_INVALID_ARGUMENT;
     }
+    out_body->data = NULL;
+    out_body->size = 0;
 
-    char *response = NULL;
-    lokan_result_t result = lokan_perform_request(client, "/health", "GET", NULL, 0, &response, NULL);
-    if (result != LOKAN_OK) {
-        return result;
+    struct lokan_body_reader reader = {iov, iov_count, 0, 0, 0, LOKAN_BODY_JSON};
+    size_t non_empty = 0;
+    const lokan_iovec_t *single = NULL;
+    for (size_t i = 0; i < iov_count; ++i) {
+        if (iov[i].len > 0) {
+            if (!iov[i].data) {
+                return LOKAN_ERROR_INVALID_ARGUMENT;
+            }
+            reader.total += iov[i].len;
+            single = &iov[i];
+            non_empty++;
+        }
     }
 
-    const char *needle = "\"status\"";
-    char *found = strstr(response, needle);
-    if (!found) {
-        free(response);
-        return LOKAN_ERROR_PARSE;
+    lokan_result_t result;
+    if (non_empty <= 1) {
+        /* A single segment goes straight to POSTFIELDS, which libcurl sends without a read callback. */
+        result = lokan_perform(client, path, method, single ? (const char *)single->data : NULL,
+                               single ? single->len : 0, NULL, NULL, out_status);
+    } else {
+        result = lokan_perform(client, path, method, NULL, 0, &reader, NULL, out_status);
     }
-    found += strlen(needle);
-    found = strchr(found, ':');
-    if (!found) {
-        free(response);
-        return LOKAN_ERROR_PARSE;
+    if (result == LOKAN_OK || result == LOKAN_ERROR_HTTP) {
+        out_body->data = client->response.data;
+        out_body->size = client->response.size;
     }
-    found++;
-    char *status_value = lokan_trim_quotes(found);
-    if (!status_value || *status_value == '\0') {
-        free(response);
-        return LOKAN_ERROR_PARSE;
+    return result;
+}
+
+lokan_result_t lokan_request_view(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    long *out_status,
+    lokan_view_t *out_body) {
+    if (!out_body) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
     }
+    out_body->data = NULL;
+    out_body->size = 0;
 
-    char *status_copy = lokan_strdup(status_value);
-    free(response);
-    if (!status_copy) {
-        return LOKAN_ERROR_ALLOCATION;
+    lokan_result_t result = lokan_perform_request(client, path, method, body, body_len, NULL, out_status);
+    if (result == LOKAN_OK || result == LOKAN_ERROR_HTTP) {
+        out_body->data = client->response.data;
+        out_body->size = client->response.size;
     }
+    return result;
+}
 
-    *out_status = status_copy;
-    return LOKAN_OK;
+lokan_result_t lokan_request_into(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    long *out_status,
+    char *buffer,
+    size_t capacity,
+    size_t *out_size) {
+    if (!buffer || capacity == 0) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    struct lokan_memory response = {0};
+    response.data = buffer;
+    response.capacity = capacity;
+    response.fixed = 1;
+
+    lokan_result_t result = lokan_perform_request(client, path, method, body, body_len, &response, out_status);
+    if (out_size) {
+        *out_size = response.size;
+    }
+    return result;
+}
+
+static const char lokan_envelope_open[] = "{\"sceneId\":\"";
+static const char lokan_envelope_close[] = "\"}";
+
+size_t lokan_scene_envelope_len(const char *scene_id) {
+    return (sizeof(lokan_envelope_open) - 1) + lokan_json_escaped_len(scene_id) + (sizeof(lokan_envelope_close) - 1);
+}
+
+char *lokan_scene_envelope_into(char *out, const char *scene_id) {
+    memcpy(out, lokan_envelope_open, sizeof(lokan_envelope_open) - 1);
+    out = lokan_json_escape_into(out + sizeof(lokan_envelope_open) - 1, scene_id);
+    memcpy(out, lokan_envelope_close, sizeof(lokan_envelope_close) - 1);
+    return out + sizeof(lokan_envelope_close) - 1;
 }
 
 lokan_result_t lokan_apply_scene(lokan_client_t *client, const char *scene_id, const char *payload_json) {
@@ -336,34 +835,46 @@ lokan_result_t lokan_apply_scene(lokan_client_t *client, const char *scene_id, c
         return LOKAN_ERROR_INVALID_ARGUMENT;
     }
 
-    const char *template_body = "{\"sceneId\":\"%s\"}";
-    char *body = NULL;
-    size_t body_len = 0;
-
+    /* A caller payload is sent straight from caller memory. */
     if (payload_json) {
-        body_len = strlen(payload_json);
-        body = lokan_strdup(payload_json);
-        if (!body) {
-            return LOKAN_ERROR_ALLOCATION;
-        }
-    } else {
-        body_len = strlen(template_body) + strlen(scene_id) - 2; /* %s replaced */
-        body = (char *)malloc(body_len + 1);
+        return lokan_perform_request(client, "/scenes/apply", "POST", payload_json, strlen(payload_json), NULL, NULL);
+    }
+
+    /* The default envelope is built on the stack; only outsized IDs need the heap. */
+    size_t body_len = lokan_scene_envelope_len(scene_id);
+    char inline_body[LOKAN_INLINE_BODY_MAX];
+    char *body = inline_body;
+    const lokan_allocator_t *scratch = lokan_scratch_allocator(client);
+    lokan_arena_mark_t mark = {0, NULL};
+    if (client->arena) {
+        mark = lokan_arena_mark(client->arena);
+    }
+    if (body_len > sizeof(inline_body)) {
+        body = (char *)lokan_alloc(scratch, body_len);
         if (!body) {
             return LOKAN_ERROR_ALLOCATION;
         }
-        int written = snprintf(body, body_len + 1, template_body, scene_id);
-        if (written < 0 || (size_t)written != body_len) {
-            free(body);
-            return LOKAN_ERROR_ALLOCATION;
-        }
     }
+    lokan_scene_envelope_into(body, scene_id);
 
     lokan_result_t result = lokan_perform_request(client, "/scenes/apply", "POST", body, body_len, NULL, NULL);
-    free(body);
+    if (body != inline_body) {
+        lokan_free(scratch, body);
+    }
+    if (client->arena) {
+        lokan_arena_release(client->arena, mark);
+    }
     return result;
 }
 
+lokan_result_t lokan_apply_scene_iov(lokan_client_t *client, const lokan_iovec_t *iov, size_t iov_count) {
+    if (!client || !iov || iov_count == 0) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    lokan_view_t response;
+    return lokan_request_iov(client, "POST", "/scenes/apply", iov, iov_count, NULL, &response);
+}
+
 void lokan_string_free(char *value) {
-    free(value);
+    lokan_free(lokan_default_allocator(), value);
 }
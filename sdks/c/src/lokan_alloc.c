@@ -0,0 +1,281 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <curl/curl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Arena allocations are aligned for any scalar type. */
+#define LOKAN_ARENA_ALIGN 16
+
+static void *lokan_std_malloc(size_t size, void *ctx) {
+    (void)ctx;
+    return malloc(size);
+}
+
+static void *lokan_std_realloc(void *ptr, size_t size, void *ctx) {
+    (void)ctx;
+    return realloc(ptr, size);
+}
+
+static void lokan_std_free(void *ptr, void *ctx) {
+    (void)ctx;
+    free(ptr);
+}
+
+/* Written only before libcurl is initialized, so readers need no lock afterwards. */
+static lokan_allocator_t lokan_global_allocator = {lokan_std_malloc, lokan_std_realloc, lokan_std_free, NULL};
+static int lokan_global_custom = 0;
+static int lokan_global_started = 0;
+static pthread_mutex_t lokan_global_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t lokan_global_once = PTHREAD_ONCE_INIT;
+static lokan_result_t lokan_global_result = LOKAN_OK;
+
+/* libcurl's memory callbacks carry no context, so they route through the global allocator. */
+static void *lokan_curl_malloc(size_t size) {
+    return lokan_global_allocator.malloc_fn(size, lokan_global_allocator.ctx);
+}
+
+static void lokan_curl_free(void *ptr) {
+    if (ptr) {
+        lokan_global_allocator.free_fn(ptr, lokan_global_allocator.ctx);
+    }
+}
+
+static void *lokan_curl_realloc(void *ptr, size_t size) {
+    return lokan_global_allocator.realloc_fn(ptr, size, lokan_global_allocator.ctx);
+}
+
+static char *lokan_curl_strdup(const char *value) {
+    return lokan_strdup(&lokan_global_allocator, value);
+}
+
+static void *lokan_curl_calloc(size_t count, size_t size) {
+    return lokan_calloc(&lokan_global_allocator, count, size);
+}
+
+static void lokan_init_global_once(void) {
+    pthread_mutex_lock(&lokan_global_mutex);
+    lokan_global_started = 1;
+    int custom = lokan_global_custom;
+    pthread_mutex_unlock(&lokan_global_mutex);
+
+    CURLcode code;
+    if (custom) {
+        code = curl_global_init_mem(CURL_GLOBAL_DEFAULT, lokan_curl_malloc, lokan_curl_free, lokan_curl_realloc,
+                                    lokan_curl_strdup, lokan_curl_calloc);
+    } else {
+        code = curl_global_init(CURL_GLOBAL_DEFAULT);
+    }
+    if (code != CURLE_OK) {
+        lokan_global_result = LOKAN_ERROR_CURL;
+    }
+}
+
+lokan_result_t lokan_global_init(void) {
+    pthread_once(&lokan_global_once, lokan_init_global_once);
+    return lokan_global_result;
+}
+
+lokan_result_t lokan_global_init_allocator(const lokan_allocator_t *allocator) {
+    if (!allocator || !allocator->malloc_fn || !allocator->realloc_fn || !allocator->free_fn) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    pthread_mutex_lock(&lokan_global_mutex);
+    if (lokan_global_started) {
+        pthread_mutex_unlock(&lokan_global_mutex);
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    lokan_global_allocator = *allocator;
+    lokan_global_custom = 1;
+    pthread_mutex_unlock(&lokan_global_mutex);
+    return lokan_global_init();
+}
+
+const lokan_allocator_t *lokan_default_allocator(void) {
+    return &lokan_global_allocator;
+}
+
+void *lokan_alloc(const lokan_allocator_t *allocator, size_t size) {
+    return allocator->malloc_fn(size, allocator->ctx);
+}
+
+void *lokan_calloc(const lokan_allocator_t *allocator, size_t count, size_t size) {
+    if (size != 0 && count > ((size_t)-1) / size) {
+        return NULL;
+    }
+    void *ptr = allocator->malloc_fn(count * size, allocator->ctx);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *lokan_realloc(const lokan_allocator_t *allocator, void *ptr, size_t size) {
+    return allocator->realloc_fn(ptr, size, allocator->ctx);
+}
+
+void lokan_free(const lokan_allocator_t *allocator, void *ptr) {
+    if (ptr) {
+        allocator->free_fn(ptr, allocator->ctx);
+    }
+}
+
+char *lokan_strdup(const lokan_allocator_t *allocator, const char *value) {
+    if (!value) {
+        return NULL;
+    }
+    size_t len = strlen(value);
+    char *copy = (char *)lokan_alloc(allocator, len + 1);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, value, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/*
+ * Arena: a bump allocator over one block owned by the client. Every
+ * allocation carries a header with its size so realloc can copy, and the
+ * most recent allocation grows in place. Requests that do not fit spill to
+ * the backing allocator and are freed on release, so a full arena degrades
+ * to ordinary allocations rather than failing.
+ */
+struct lokan_arena_header {
+    size_t size;
+    /* Spilled allocations only: the next older spill. */
+    struct lokan_arena_header *spill_next;
+    int spilled;
+    int reserved;
+};
+
+#define LOKAN_ARENA_HEADER \
+    ((sizeof(struct lokan_arena_header) + LOKAN_ARENA_ALIGN - 1) & ~(size_t)(LOKAN_ARENA_ALIGN - 1))
+
+struct lokan_arena {
+    lokan_allocator_t allocator;
+    const lokan_allocator_t *backing;
+    char *block;
+    size_t capacity;
+    size_t used;
+    /* Offset of the newest in-block allocation's header, for in-place growth. */
+    size_t last;
+    struct lokan_arena_header *spills;
+};
+
+static size_t lokan_arena_round(size_t size) {
+    return (size + LOKAN_ARENA_ALIGN - 1) & ~(size_t)(LOKAN_ARENA_ALIGN - 1);
+}
+
+static struct lokan_arena_header *lokan_arena_header_of(void *ptr) {
+    return (struct lokan_arena_header *)((char *)ptr - LOKAN_ARENA_HEADER);
+}
+
+static void *lokan_arena_malloc(size_t size, void *ctx) {
+    struct lokan_arena *arena = (struct lokan_arena *)ctx;
+    size_t needed = LOKAN_ARENA_HEADER + lokan_arena_round(size);
+    if (needed < size) {
+        return NULL;
+    }
+    struct lokan_arena_header *header;
+    if (arena->capacity - arena->used >= needed) {
+        header = (struct lokan_arena_header *)(arena->block + arena->used);
+        header->spilled = 0;
+        header->spill_next = NULL;
+        arena->last = arena->used;
+        arena->used += needed;
+    } else {
+        header = (struct lokan_arena_header *)lokan_alloc(arena->backing, needed);
+        if (!header) {
+            return NULL;
+        }
+        header->spilled = 1;
+        header->spill_next = arena->spills;
+        arena->spills = header;
+    }
+    header->size = size;
+    return (char *)header + LOKAN_ARENA_HEADER;
+}
+
+static void *lokan_arena_realloc(void *ptr, size_t size, void *ctx) {
+    struct lokan_arena *arena = (struct lokan_arena *)ctx;
+    if (!ptr) {
+        return lokan_arena_malloc(size, ctx);
+    }
+    struct lokan_arena_header *header = lokan_arena_header_of(ptr);
+    if (size <= header->size) {
+        return ptr;
+    }
+    if (!header->spilled && (char *)header == arena->block + arena->last) {
+        size_t needed = LOKAN_ARENA_HEADER + lokan_arena_round(size);
+        if (needed >= size && arena->capacity - arena->last >= needed) {
+            arena->used = arena->last + needed;
+            header->size = size;
+            return ptr;
+        }
+    }
+    void *grown = lokan_arena_malloc(size, ctx);
+    if (!grown) {
+        return NULL;
+    }
+    memcpy(grown, ptr, header->size);
+    return grown;
+}
+
+static void lokan_arena_free(void *ptr, void *ctx) {
+    /* Individual frees are no-ops; memory returns in bulk on release. */
+    (void)ptr;
+    (void)ctx;
+}
+
+struct lokan_arena *lokan_arena_create(const lokan_allocator_t *backing, size_t capacity) {
+    struct lokan_arena *arena = (struct lokan_arena *)lokan_calloc(backing, 1, sizeof(struct lokan_arena));
+    if (!arena) {
+        return NULL;
+    }
+    arena->capacity = lokan_arena_round(capacity);
+    arena->block = (char *)lokan_alloc(backing, arena->capacity);
+    if (!arena->block) {
+        lokan_free(backing, arena);
+        return NULL;
+    }
+    arena->backing = backing;
+    arena->allocator.malloc_fn = lokan_arena_malloc;
+    arena->allocator.realloc_fn = lokan_arena_realloc;
+    arena->allocator.free_fn = lokan_arena_free;
+    arena->allocator.ctx = arena;
+    return arena;
+}
+
+void lokan_arena_destroy(struct lokan_arena *arena) {
+    if (!arena) {
+        return;
+    }
+    lokan_arena_mark_t empty = {0, NULL};
+    lokan_arena_release(arena, empty);
+    const lokan_allocator_t *backing = arena->backing;
+    lokan_free(backing, arena->block);
+    lokan_free(backing, arena);
+}
+
+const lokan_allocator_t *lokan_arena_allocator(struct lokan_arena *arena) {
+    return &arena->allocator;
+}
+
+lokan_arena_mark_t lokan_arena_mark(const struct lokan_arena *arena) {
+    lokan_arena_mark_t mark = {arena->used, arena->spills};
+    return mark;
+}
+
+void lokan_arena_release(struct lokan_arena *arena, lokan_arena_mark_t mark) {
+    while (arena->spills && arena->spills != mark.spills) {
+        struct lokan_arena_header *spill = arena->spills;
+        arena->spills = spill->spill_next;
+        lokan_free(arena->backing, spill);
+    }
+    arena->used = mark.used;
+    /* In-place growth is only safe for an allocation made after the mark. */
+    arena->last = mark.used;
+}
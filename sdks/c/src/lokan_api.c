@@ -0,0 +1,297 @@
+/*
+ * This file is auto-generated by tools/oas2c.ts.
+ * Do not edit this file directly.
+ */
+
+#include "lokan_api.h"
+#include "lokan_internal.h"
+
+#include <stddef.h>
+
+static const struct lokan_field lokan_diagnostic_info_fields[] = {
+    {"uptimeSeconds", 13, LOKAN_FIELD_INT64, offsetof(lokan_diagnostic_info_t, uptime_seconds), LOKAN_DIAGNOSTIC_INFO_HAS_UPTIME_SECONDS},
+    {"details", 7, LOKAN_FIELD_RAW, offsetof(lokan_diagnostic_info_t, details), LOKAN_DIAGNOSTIC_INFO_HAS_DETAILS},
+};
+
+static const struct lokan_schema lokan_diagnostic_info_schema = {
+    lokan_diagnostic_info_fields,
+    2,
+    sizeof(lokan_diagnostic_info_t),
+    offsetof(lokan_diagnostic_info_t, present),
+    LOKAN_DIAGNOSTIC_INFO_HAS_UPTIME_SECONDS
+};
+
+static const struct lokan_field lokan_health_status_fields[] = {
+    {"status", 6, LOKAN_FIELD_STRING, offsetof(lokan_health_status_t, status), LOKAN_HEALTH_STATUS_HAS_STATUS},
+};
+
+static const struct lokan_schema lokan_health_status_schema = {
+    lokan_health_status_fields,
+    1,
+    sizeof(lokan_health_status_t),
+    offsetof(lokan_health_status_t, present),
+    LOKAN_HEALTH_STATUS_HAS_STATUS
+};
+
+static const struct lokan_field lokan_device_registry_list_changes_result_fields[] = {
+    {"changes", 7, LOKAN_FIELD_RAW, offsetof(lokan_device_registry_list_changes_result_t, changes), LOKAN_DEVICE_REGISTRY_LIST_CHANGES_RESULT_HAS_CHANGES},
+    {"latestSeq", 9, LOKAN_FIELD_INT64, offsetof(lokan_device_registry_list_changes_result_t, latest_seq), LOKAN_DEVICE_REGISTRY_LIST_CHANGES_RESULT_HAS_LATEST_SEQ},
+    {"hasMore", 7, LOKAN_FIELD_BOOL, offsetof(lokan_device_registry_list_changes_result_t, has_more), LOKAN_DEVICE_REGISTRY_LIST_CHANGES_RESULT_HAS_HAS_MORE},
+};
+
+static const struct lokan_schema lokan_device_registry_list_changes_result_schema = {
+    lokan_device_registry_list_changes_result_fields,
+    3,
+    sizeof(lokan_device_registry_list_changes_result_t),
+    offsetof(lokan_device_registry_list_changes_result_t, present),
+    LOKAN_DEVICE_REGISTRY_LIST_CHANGES_RESULT_HAS_CHANGES | LOKAN_DEVICE_REGISTRY_LIST_CHANGES_RESULT_HAS_LATEST_SEQ | LOKAN_DEVICE_REGISTRY_LIST_CHANGES_RESULT_HAS_HAS_MORE
+};
+
+static const struct lokan_field lokan_energy_service_get_report_result_fields[] = {
+    {"period", 6, LOKAN_FIELD_STRING, offsetof(lokan_energy_service_get_report_result_t, period), LOKAN_ENERGY_SERVICE_GET_REPORT_RESULT_HAS_PERIOD},
+    {"consumptionKwh", 14, LOKAN_FIELD_DOUBLE, offsetof(lokan_energy_service_get_report_result_t, consumption_kwh), LOKAN_ENERGY_SERVICE_GET_REPORT_RESULT_HAS_CONSUMPTION_KWH},
+};
+
+static const struct lokan_schema lokan_energy_service_get_report_result_schema = {
+    lokan_energy_service_get_report_result_fields,
+    2,
+    sizeof(lokan_energy_service_get_report_result_t),
+    offsetof(lokan_energy_service_get_report_result_t, present),
+    LOKAN_ENERGY_SERVICE_GET_REPORT_RESULT_HAS_PERIOD | LOKAN_ENERGY_SERVICE_GET_REPORT_RESULT_HAS_CONSUMPTION_KWH
+};
+
+static const struct lokan_field lokan_telemetry_ingest_result_fields[] = {
+    {"accepted", 8, LOKAN_FIELD_INT64, offsetof(lokan_telemetry_ingest_result_t, accepted), LOKAN_TELEMETRY_INGEST_RESULT_HAS_ACCEPTED},
+};
+
+static const struct lokan_schema lokan_telemetry_ingest_result_schema = {
+    lokan_telemetry_ingest_result_fields,
+    1,
+    sizeof(lokan_telemetry_ingest_result_t),
+    offsetof(lokan_telemetry_ingest_result_t, present),
+    LOKAN_TELEMETRY_INGEST_RESULT_HAS_ACCEPTED
+};
+
+lokan_result_t lokan_api_gateway_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/diag", NULL, 0, &lokan_diagnostic_info_schema, out, out_status);
+}
+
+lokan_result_t lokan_api_gateway_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_status_schema, out, out_status);
+}
+
+lokan_result_t lokan_api_gateway_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status) {
+    return lokan_request_view(client, "GET", "/metrics", NULL, 0, out_status, out_text);
+}
+
+lokan_result_t lokan_api_gateway_list_routes(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status) {
+    return lokan_stream_list(client, "/routes", "routes", on_element, user_data, out_status);
+}
+
+lokan_result_t lokan_audit_log_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/diag", NULL, 0, &lokan_diagnostic_info_schema, out, out_status);
+}
+
+lokan_result_t lokan_audit_log_list_entries(lokan_client_t *client, const char *cursor, int64_t limit, lokan_json_element_cb on_element, void *user_data, long *out_status) {
+    if (!client) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    const struct lokan_query_param query[] = {
+        {"cursor", 1, 0, cursor, 0},
+        {"limit", 0, 0, NULL, limit},
+    };
+    char inline_path[LOKAN_INLINE_BODY_MAX];
+    char *path = lokan_query_path(&client->allocator, inline_path, sizeof(inline_path), "/entries", query, 2);
+    if (!path) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    lokan_result_t result = lokan_stream_list(client, path, "entries", on_element, user_data, out_status);
+    if (path != inline_path) {
+        lokan_free(&client->allocator, path);
+    }
+    return result;
+}
+
+lokan_result_t lokan_audit_log_list_entries_iter(lokan_client_t *client, size_t page_size, lokan_list_iter_t **out_iter) {
+    return lokan_list_iter_create(out_iter, client, "/entries", "entries", page_size);
+}
+
+lokan_result_t lokan_audit_log_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_status_schema, out, out_status);
+}
+
+lokan_result_t lokan_audit_log_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status) {
+    return lokan_request_view(client, "GET", "/metrics", NULL, 0, out_status, out_text);
+}
+
+lokan_result_t lokan_device_registry_list_devices(lokan_client_t *client, const char *cursor, int64_t limit, lokan_json_element_cb on_element, void *user_data, long *out_status) {
+    if (!client) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    const struct lokan_query_param query[] = {
+        {"cursor", 1, 0, cursor, 0},
+        {"limit", 0, 0, NULL, limit},
+    };
+    char inline_path[LOKAN_INLINE_BODY_MAX];
+    char *path = lokan_query_path(&client->allocator, inline_path, sizeof(inline_path), "/devices", query, 2);
+    if (!path) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    lokan_result_t result = lokan_stream_list(client, path, "devices", on_element, user_data, out_status);
+    if (path != inline_path) {
+        lokan_free(&client->allocator, path);
+    }
+    return result;
+}
+
+lokan_result_t lokan_device_registry_list_devices_iter(lokan_client_t *client, size_t page_size, lokan_list_iter_t **out_iter) {
+    return lokan_list_iter_create(out_iter, client, "/devices", "devices", page_size);
+}
+
+lokan_result_t lokan_device_registry_list_changes(lokan_client_t *client, int64_t since, int64_t limit, lokan_device_registry_list_changes_result_t *out, long *out_status) {
+    if (!client) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    const struct lokan_query_param query[] = {
+        {"since", 0, 0, NULL, since},
+        {"limit", 0, 0, NULL, limit},
+    };
+    char inline_path[LOKAN_INLINE_BODY_MAX];
+    char *path = lokan_query_path(&client->allocator, inline_path, sizeof(inline_path), "/devices/changes", query, 2);
+    if (!path) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    lokan_result_t result = lokan_request_decode(client, "GET", path, NULL, 0, &lokan_device_registry_list_changes_result_schema, out, out_status);
+    if (path != inline_path) {
+        lokan_free(&client->allocator, path);
+    }
+    return result;
+}
+
+lokan_result_t lokan_device_registry_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/diag", NULL, 0, &lokan_diagnostic_info_schema, out, out_status);
+}
+
+lokan_result_t lokan_device_registry_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_status_schema, out, out_status);
+}
+
+lokan_result_t lokan_device_registry_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status) {
+    return lokan_request_view(client, "GET", "/metrics", NULL, 0, out_status, out_text);
+}
+
+lokan_result_t lokan_energy_service_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/diag", NULL, 0, &lokan_diagnostic_info_schema, out, out_status);
+}
+
+lokan_result_t lokan_energy_service_get_report(lokan_client_t *client, lokan_energy_service_get_report_result_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/energy-report", NULL, 0, &lokan_energy_service_get_report_result_schema, out, out_status);
+}
+
+lokan_result_t lokan_energy_service_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_status_schema, out, out_status);
+}
+
+lokan_result_t lokan_energy_service_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status) {
+    return lokan_request_view(client, "GET", "/metrics", NULL, 0, out_status, out_text);
+}
+
+lokan_result_t lokan_presence_service_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/diag", NULL, 0, &lokan_diagnostic_info_schema, out, out_status);
+}
+
+lokan_result_t lokan_presence_service_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_status_schema, out, out_status);
+}
+
+lokan_result_t lokan_presence_service_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status) {
+    return lokan_request_view(client, "GET", "/metrics", NULL, 0, out_status, out_text);
+}
+
+lokan_result_t lokan_presence_service_get_presence(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status) {
+    return lokan_stream_list(client, "/presence", "zones", on_element, user_data, out_status);
+}
+
+lokan_result_t lokan_radio_coordinator_list_channels(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status) {
+    return lokan_stream_list(client, "/channels", "assignments", on_element, user_data, out_status);
+}
+
+lokan_result_t lokan_radio_coordinator_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/diag", NULL, 0, &lokan_diagnostic_info_schema, out, out_status);
+}
+
+lokan_result_t lokan_radio_coordinator_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_status_schema, out, out_status);
+}
+
+lokan_result_t lokan_radio_coordinator_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status) {
+    return lokan_request_view(client, "GET", "/metrics", NULL, 0, out_status, out_text);
+}
+
+lokan_result_t lokan_rule_engine_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/diag", NULL, 0, &lokan_diagnostic_info_schema, out, out_status);
+}
+
+lokan_result_t lokan_rule_engine_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_status_schema, out, out_status);
+}
+
+lokan_result_t lokan_rule_engine_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status) {
+    return lokan_request_view(client, "GET", "/metrics", NULL, 0, out_status, out_text);
+}
+
+lokan_result_t lokan_rule_engine_list_rules(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status) {
+    return lokan_stream_list(client, "/rules", "rules", on_element, user_data, out_status);
+}
+
+lokan_result_t lokan_scene_service_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/diag", NULL, 0, &lokan_diagnostic_info_schema, out, out_status);
+}
+
+lokan_result_t lokan_scene_service_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_status_schema, out, out_status);
+}
+
+lokan_result_t lokan_scene_service_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status) {
+    return lokan_request_view(client, "GET", "/metrics", NULL, 0, out_status, out_text);
+}
+
+lokan_result_t lokan_scene_service_list_scenes(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status) {
+    return lokan_stream_list(client, "/scenes", "scenes", on_element, user_data, out_status);
+}
+
+lokan_result_t lokan_telemetry_pipe_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/diag", NULL, 0, &lokan_diagnostic_info_schema, out, out_status);
+}
+
+lokan_result_t lokan_telemetry_pipe_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_status_schema, out, out_status);
+}
+
+lokan_result_t lokan_telemetry_pipe_ingest(lokan_client_t *client, const char *body_json, size_t body_len, long *out_status) {
+    return lokan_perform_request(client, "/ingest", "POST", body_json, body_len, NULL, out_status);
+}
+
+lokan_result_t lokan_telemetry_pipe_ingest_batch(lokan_client_t *client, const char *body_json, size_t body_len, lokan_telemetry_ingest_result_t *out, long *out_status) {
+    return lokan_request_decode(client, "POST", "/ingest/batch", body_json, body_len, &lokan_telemetry_ingest_result_schema, out, out_status);
+}
+
+lokan_result_t lokan_telemetry_pipe_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status) {
+    return lokan_request_view(client, "GET", "/metrics", NULL, 0, out_status, out_text);
+}
+
+lokan_result_t lokan_updater_service_available(lokan_client_t *client, lokan_json_element_cb on_element, void *user_data, long *out_status) {
+    return lokan_stream_list(client, "/available", "updates", on_element, user_data, out_status);
+}
+
+lokan_result_t lokan_updater_service_diagnostics(lokan_client_t *client, lokan_diagnostic_info_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/diag", NULL, 0, &lokan_diagnostic_info_schema, out, out_status);
+}
+
+lokan_result_t lokan_updater_service_health(lokan_client_t *client, lokan_health_status_t *out, long *out_status) {
+    return lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_status_schema, out, out_status);
+}
+
+lokan_result_t lokan_updater_service_metrics(lokan_client_t *client, lokan_view_t *out_text, long *out_status) {
+    return lokan_request_view(client, "GET", "/metrics", NULL, 0, out_status, out_text);
+}
@@ -0,0 +1,391 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <curl/curl.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Finished easy handles kept around for reuse so steady-state submits skip handle setup. */
+#define LOKAN_ASYNC_IDLE_MAX 64
+
+struct lokan_request {
+    lokan_client_t *client;
+    CURL *handle;
+    struct lokan_memory memory;
+    lokan_completion_cb on_complete;
+    void *user_data;
+    /* Metrics key, copied because the caller's path need not outlive submit. */
+    char route[LOKAN_METRICS_ROUTE_MAX];
+    struct lokan_request *prev;
+    struct lokan_request *next;
+};
+
+static void lokan_request_destroy(struct lokan_request *request) {
+    if (!request) {
+        return;
+    }
+    if (request->handle) {
+        curl_easy_cleanup(request->handle);
+    }
+    lokan_free(&request->client->allocator, request->memory.data);
+    lokan_free(&request->client->allocator, request);
+}
+
+static int lokan_async_socket_callback(CURL *handle, curl_socket_t fd, int what, void *userp, void *socketp) {
+    (void)handle;
+    lokan_client_t *client = (lokan_client_t *)userp;
+    /* CURL_POLL_IN, OUT, INOUT and REMOVE share lokan_poll_t's values. */
+    client->event_loop.on_socket((int)fd, (lokan_poll_t)what, socketp, client->event_loop.user_data);
+    return 0;
+}
+
+static int lokan_async_timer_callback(CURLM *multi, long timeout_ms, void *userp) {
+    (void)multi;
+    lokan_client_t *client = (lokan_client_t *)userp;
+    client->event_loop.on_timer(timeout_ms, client->event_loop.user_data);
+    return 0;
+}
+
+/* Routes the multi's socket and timer changes to the host loop, or stops doing so. */
+static void lokan_async_bind_loop(lokan_client_t *client) {
+    int bound = client->event_loop.on_socket != NULL;
+    curl_multi_setopt(client->multi, CURLMOPT_SOCKETFUNCTION, bound ? lokan_async_socket_callback : NULL);
+    curl_multi_setopt(client->multi, CURLMOPT_SOCKETDATA, bound ? (void *)client : NULL);
+    curl_multi_setopt(client->multi, CURLMOPT_TIMERFUNCTION, bound ? lokan_async_timer_callback : NULL);
+    curl_multi_setopt(client->multi, CURLMOPT_TIMERDATA, bound ? (void *)client : NULL);
+}
+
+static lokan_result_t lokan_async_ensure_multi(lokan_client_t *client) {
+    if (client->multi) {
+        return LOKAN_OK;
+    }
+    client->multi = curl_multi_init();
+    if (!client->multi) {
+        return LOKAN_ERROR_CURL;
+    }
+    lokan_async_bind_loop(client);
+    if (client->enable_http2) {
+        curl_multi_setopt(client->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        /* Without a cap libcurl opens a fresh connection for every request past the stream limit. */
+        curl_multi_setopt(client->multi, CURLMOPT_MAX_HOST_CONNECTIONS, 1L);
+#if LIBCURL_VERSION_NUM >= 0x074300
+        curl_multi_setopt(client->multi, CURLMOPT_MAX_CONCURRENT_STREAMS, client->http2_max_streams);
+#endif
+    } else {
+        curl_multi_setopt(client->multi, CURLMOPT_PIPELINING, CURLPIPE_NOTHING);
+    }
+    return LOKAN_OK;
+}
+
+static struct lokan_request *lokan_request_acquire(lokan_client_t *client) {
+    struct lokan_request *request = client->idle;
+    if (request) {
+        client->idle = request->next;
+        client->idle_count--;
+        request->next = NULL;
+        return request;
+    }
+
+    request = (struct lokan_request *)lokan_calloc(&client->allocator, 1, sizeof(struct lokan_request));
+    if (!request) {
+        return NULL;
+    }
+    request->client = client;
+    request->memory.allocator = &client->allocator;
+    request->handle = curl_easy_init();
+    if (!request->handle) {
+        lokan_free(&client->allocator, request);
+        return NULL;
+    }
+    lokan_configure_handle(client, request->handle);
+    curl_easy_setopt(request->handle, CURLOPT_PRIVATE, (void *)request);
+    curl_easy_setopt(request->handle, CURLOPT_WRITEDATA, (void *)&request->memory);
+    return request;
+}
+
+static void lokan_request_release(lokan_client_t *client, struct lokan_request *request) {
+    request->on_complete = NULL;
+    request->user_data = NULL;
+    request->prev = NULL;
+
+    if (client->idle_count >= LOKAN_ASYNC_IDLE_MAX) {
+        lokan_request_destroy(request);
+        return;
+    }
+
+    /* The response buffer is kept so the next transfer can reuse its capacity. */
+    lokan_memory_recycle(&request->memory);
+    request->next = client->idle;
+    client->idle = request;
+    client->idle_count++;
+}
+
+static void lokan_active_link(lokan_client_t *client, struct lokan_request *request) {
+    request->prev = NULL;
+    request->next = client->active;
+    if (client->active) {
+        client->active->prev = request;
+    }
+    client->active = request;
+}
+
+static void lokan_active_unlink(lokan_client_t *client, struct lokan_request *request) {
+    if (request->prev) {
+        request->prev->next = request->next;
+    } else {
+        client->active = request->next;
+    }
+    if (request->next) {
+        request->next->prev = request->prev;
+    }
+    request->prev = NULL;
+    request->next = NULL;
+}
+
+static lokan_result_t lokan_async_submit(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    struct lokan_body_reader *reader,
+    lokan_completion_cb on_complete,
+    void *user_data) {
+
+    lokan_result_t result = lokan_async_ensure_multi(client);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    /* Submitting never blocks, so an empty bucket is reported rather than waited out. */
+    result = lokan_rate_limit(client, 0);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+
+    struct lokan_request *request = lokan_request_acquire(client);
+    if (!request) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+
+    result = lokan_prepare_request(client, request->handle, path, method, body, body_len, 1, reader, NULL);
+    if (result != LOKAN_OK) {
+        lokan_request_release(client, request);
+        return result;
+    }
+
+    request->on_complete = on_complete;
+    request->user_data = user_data;
+    if (client->metrics || client->circuit_breaker) {
+        lokan_metrics_route(path, request->route, sizeof(request->route));
+    }
+
+    if (curl_multi_add_handle(client->multi, request->handle) != CURLM_OK) {
+        lokan_request_release(client, request);
+        return LOKAN_ERROR_CURL;
+    }
+    lokan_active_link(client, request);
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_request_submit(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    lokan_completion_cb on_complete,
+    void *user_data) {
+    if (!client || !method || !path) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    return lokan_async_submit(client, method, path, body, body_len, NULL, on_complete, user_data);
+}
+
+lokan_result_t lokan_request_submit_reader(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    struct lokan_body_reader *reader,
+    lokan_completion_cb on_complete,
+    void *user_data) {
+    /* A streamed body would outlive the call, so only one copied through POSTFIELDS is accepted. */
+    if (!client || !method || !path || !reader || reader->count != 1) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    return lokan_async_submit(client, method, path, NULL, 0, reader, on_complete, user_data);
+}
+
+static void lokan_async_dispatch(lokan_client_t *client) {
+    CURLMsg *message = NULL;
+    int queued = 0;
+    while ((message = curl_multi_info_read(client->multi, &queued)) != NULL) {
+        if (message->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        CURL *handle = message->easy_handle;
+        CURLcode code = message->data.result;
+        struct lokan_request *request = NULL;
+        curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char **)&request);
+        curl_multi_remove_handle(client->multi, handle);
+        lokan_active_unlink(client, request);
+
+        lokan_response_t response = {0};
+        response.result = lokan_finish_request(client, handle, request->route, code, &response.status, &response.timing);
+        response.body = request->memory.data ? request->memory.data : "";
+        response.body_len = request->memory.size;
+
+        if (request->on_complete) {
+            request->on_complete(&response, request->user_data);
+        }
+        lokan_request_release(client, request);
+    }
+}
+
+lokan_result_t lokan_client_perform(lokan_client_t *client, int *out_running) {
+    if (!client) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    int running = 0;
+    if (client->multi) {
+        if (curl_multi_perform(client->multi, &running) != CURLM_OK) {
+            return LOKAN_ERROR_CURL;
+        }
+        lokan_async_dispatch(client);
+    }
+    if (out_running) {
+        *out_running = running;
+    }
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_client_poll(lokan_client_t *client, int timeout_ms, int *out_running) {
+    if (!client || timeout_ms < 0) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (client->multi && client->active) {
+#if LIBCURL_VERSION_NUM >= 0x074200
+        CURLMcode code = curl_multi_poll(client->multi, NULL, 0, timeout_ms, NULL);
+#else
+        CURLMcode code = curl_multi_wait(client->multi, NULL, 0, timeout_ms, NULL);
+#endif
+        if (code != CURLM_OK) {
+            return LOKAN_ERROR_CURL;
+        }
+    }
+    return lokan_client_perform(client, out_running);
+}
+
+lokan_result_t lokan_client_fdset(
+    lokan_client_t *client,
+    fd_set *read_fds,
+    fd_set *write_fds,
+    fd_set *exc_fds,
+    int *out_max_fd) {
+    if (!client || !read_fds || !write_fds || !exc_fds || !out_max_fd) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    *out_max_fd = -1;
+    if (!client->multi) {
+        return LOKAN_OK;
+    }
+    if (curl_multi_fdset(client->multi, read_fds, write_fds, exc_fds, out_max_fd) != CURLM_OK) {
+        return LOKAN_ERROR_CURL;
+    }
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_client_timeout(lokan_client_t *client, long *out_timeout_ms) {
+    if (!client || !out_timeout_ms) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    *out_timeout_ms = -1;
+    if (!client->multi) {
+        return LOKAN_OK;
+    }
+    if (curl_multi_timeout(client->multi, out_timeout_ms) != CURLM_OK) {
+        return LOKAN_ERROR_CURL;
+    }
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_client_set_event_loop(lokan_client_t *client, const lokan_event_loop_t *loop) {
+    if (!client || (loop && (!loop->on_socket || !loop->on_timer))) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    /* Sockets already handed to one driver are never seen by the other. */
+    if (client->active) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (loop) {
+        client->event_loop = *loop;
+    } else {
+        memset(&client->event_loop, 0, sizeof(client->event_loop));
+    }
+    if (client->multi) {
+        lokan_async_bind_loop(client);
+    }
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_client_assign_socket(lokan_client_t *client, int fd, void *socket_data) {
+    if (!client || fd < 0 || !client->multi) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (curl_multi_assign(client->multi, (curl_socket_t)fd, socket_data) != CURLM_OK) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_client_socket_action(lokan_client_t *client, int fd, int events, int *out_running) {
+    if (!client || fd < LOKAN_SOCKET_TIMEOUT) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    int running = 0;
+    if (client->multi) {
+        /* LOKAN_EVENT_* match CURL_CSELECT_*, and LOKAN_SOCKET_TIMEOUT is CURL_SOCKET_TIMEOUT on POSIX. */
+        curl_socket_t socket = fd == LOKAN_SOCKET_TIMEOUT ? CURL_SOCKET_TIMEOUT : (curl_socket_t)fd;
+        if (curl_multi_socket_action(client->multi, socket, events, &running) != CURLM_OK) {
+            return LOKAN_ERROR_CURL;
+        }
+        lokan_async_dispatch(client);
+    }
+    if (out_running) {
+        *out_running = running;
+    }
+    return LOKAN_OK;
+}
+
+void lokan_request_abandon(lokan_client_t *client, void *user_data) {
+    struct lokan_request *request = client->active;
+    while (request) {
+        struct lokan_request *next = request->next;
+        if (request->user_data == user_data) {
+            lokan_active_unlink(client, request);
+            curl_multi_remove_handle(client->multi, request->handle);
+            lokan_request_release(client, request);
+        }
+        request = next;
+    }
+}
+
+void lokan_async_cleanup(lokan_client_t *client) {
+    /* In-flight requests are abandoned without invoking their callbacks. */
+    while (client->active) {
+        struct lokan_request *request = client->active;
+        lokan_active_unlink(client, request);
+        curl_multi_remove_handle(client->multi, request->handle);
+        lokan_request_destroy(request);
+    }
+    while (client->idle) {
+        struct lokan_request *request = client->idle;
+        client->idle = request->next;
+        lokan_request_destroy(request);
+    }
+    client->idle_count = 0;
+    if (client->multi) {
+        curl_multi_cleanup(client->multi);
+        client->multi = NULL;
+    }
+}
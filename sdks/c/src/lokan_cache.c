@@ -0,0 +1,323 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOKAN_CACHE_DEFAULT_BYTES (1024 * 1024)
+#define LOKAN_CACHE_DEFAULT_ENTRIES 64
+
+/*
+ * Entries live in one allocation each (header, key, then elements) on a
+ * doubly linked list kept in recency order. Caches hold tens of entries, so
+ * lookup is a scan comparing a hash before the key.
+ */
+struct lokan_cache_entry {
+    struct lokan_cache_entry *prev;
+    struct lokan_cache_entry *next;
+    uint64_t hash;
+    char *key;
+    char etag[LOKAN_CACHE_ETAG_MAX];
+    /* Served without revalidation until then; 0 always revalidates. */
+    uint64_t fresh_until_ms;
+    char *elements;
+    size_t size;
+    size_t footprint;
+};
+
+struct lokan_response_cache {
+    pthread_mutex_t mutex;
+    size_t max_bytes;
+    size_t max_entries;
+    long ttl_ms;
+    size_t bytes;
+    size_t count;
+    /* Most recently used first. */
+    struct lokan_cache_entry *head;
+    struct lokan_cache_entry *tail;
+};
+
+lokan_result_t lokan_response_cache_create(lokan_response_cache_t **out_cache, const lokan_response_cache_config_t *config) {
+    if (!out_cache) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    lokan_response_cache_config_t defaults = {0};
+    if (!config) {
+        config = &defaults;
+    }
+    lokan_response_cache_t *cache =
+        (lokan_response_cache_t *)lokan_calloc(lokan_default_allocator(), 1, sizeof(lokan_response_cache_t));
+    if (!cache) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    cache->max_bytes = config->max_bytes > 0 ? config->max_bytes : LOKAN_CACHE_DEFAULT_BYTES;
+    cache->max_entries = config->max_entries > 0 ? config->max_entries : LOKAN_CACHE_DEFAULT_ENTRIES;
+    cache->ttl_ms = config->ttl_ms > 0 ? config->ttl_ms : 0;
+    pthread_mutex_init(&cache->mutex, NULL);
+    *out_cache = cache;
+    return LOKAN_OK;
+}
+
+static void lokan_cache_unlink(lokan_response_cache_t *cache, struct lokan_cache_entry *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void lokan_cache_push_front(lokan_response_cache_t *cache, struct lokan_cache_entry *entry) {
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = entry;
+    } else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+static void lokan_cache_remove(lokan_response_cache_t *cache, struct lokan_cache_entry *entry) {
+    lokan_cache_unlink(cache, entry);
+    cache->bytes -= entry->footprint;
+    cache->count--;
+    lokan_free(lokan_default_allocator(), entry);
+}
+
+static void lokan_cache_remove_all(lokan_response_cache_t *cache) {
+    while (cache->head) {
+        lokan_cache_remove(cache, cache->head);
+    }
+}
+
+void lokan_response_cache_destroy(lokan_response_cache_t *cache) {
+    if (!cache) {
+        return;
+    }
+    lokan_cache_remove_all(cache);
+    pthread_mutex_destroy(&cache->mutex);
+    lokan_free(lokan_default_allocator(), cache);
+}
+
+void lokan_response_cache_clear(lokan_response_cache_t *cache) {
+    if (!cache) {
+        return;
+    }
+    pthread_mutex_lock(&cache->mutex);
+    lokan_cache_remove_all(cache);
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+size_t lokan_cache_entry_limit(const lokan_response_cache_t *cache) {
+    return cache->max_bytes;
+}
+
+/* FNV-1a. */
+static uint64_t lokan_cache_hash(const char *key) {
+    uint64_t hash = 1469598103934665603ull;
+    for (const unsigned char *p = (const unsigned char *)key; *p; ++p) {
+        hash ^= *p;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static struct lokan_cache_entry *lokan_cache_find(lokan_response_cache_t *cache, const char *key, uint64_t hash) {
+    for (struct lokan_cache_entry *entry = cache->head; entry; entry = entry->next) {
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static int lokan_cache_copy_out(const struct lokan_cache_entry *entry, struct lokan_memory *out) {
+    out->size = 0;
+    if (lokan_memory_reserve(out, entry->size + 1) != LOKAN_OK) {
+        return 0;
+    }
+    memcpy(out->data, entry->elements, entry->size);
+    out->size = entry->size;
+    return 1;
+}
+
+/* The server's max-age wins over the configured TTL. */
+static uint64_t lokan_cache_fresh_until(const lokan_response_cache_t *cache, const struct lokan_cache_headers *headers) {
+    long ttl_ms = headers->max_age_ms >= 0 ? headers->max_age_ms : cache->ttl_ms;
+    return ttl_ms > 0 ? lokan_now_ms() + (uint64_t)ttl_ms : 0;
+}
+
+lokan_cache_state_t lokan_cache_lookup(
+    lokan_response_cache_t *cache,
+    const char *key,
+    struct lokan_memory *out_elements,
+    char *out_etag) {
+    uint64_t hash = lokan_cache_hash(key);
+    lokan_cache_state_t state = LOKAN_CACHE_MISS;
+    out_etag[0] = '\0';
+
+    pthread_mutex_lock(&cache->mutex);
+    struct lokan_cache_entry *entry = lokan_cache_find(cache, key, hash);
+    if (entry) {
+        lokan_cache_unlink(cache, entry);
+        lokan_cache_push_front(cache, entry);
+        if (entry->fresh_until_ms > lokan_now_ms() && lokan_cache_copy_out(entry, out_elements)) {
+            state = LOKAN_CACHE_HIT;
+        } else if (entry->etag[0]) {
+            memcpy(out_etag, entry->etag, sizeof(entry->etag));
+            state = LOKAN_CACHE_STALE;
+        }
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    return state;
+}
+
+int lokan_cache_revalidated(
+    lokan_response_cache_t *cache,
+    const char *key,
+    const struct lokan_cache_headers *headers,
+    struct lokan_memory *out_elements) {
+    uint64_t hash = lokan_cache_hash(key);
+    int copied = 0;
+
+    pthread_mutex_lock(&cache->mutex);
+    struct lokan_cache_entry *entry = lokan_cache_find(cache, key, hash);
+    if (entry) {
+        entry->fresh_until_ms = lokan_cache_fresh_until(cache, headers);
+        copied = lokan_cache_copy_out(entry, out_elements);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    return copied;
+}
+
+void lokan_cache_store(
+    lokan_response_cache_t *cache,
+    const char *key,
+    const struct lokan_cache_headers *headers,
+    const char *elements,
+    size_t size) {
+    uint64_t fresh_until_ms = lokan_cache_fresh_until(cache, headers);
+    if (headers->no_store || (!headers->etag[0] && fresh_until_ms == 0)) {
+        /* Nothing would ever let this entry be reused. */
+        return;
+    }
+    size_t key_len = strlen(key);
+    size_t footprint = sizeof(struct lokan_cache_entry) + key_len + 1 + size;
+    if (footprint > cache->max_bytes) {
+        return;
+    }
+
+    struct lokan_cache_entry *entry = (struct lokan_cache_entry *)lokan_alloc(lokan_default_allocator(), footprint);
+    if (!entry) {
+        return;
+    }
+    memset(entry, 0, sizeof(*entry));
+    entry->hash = lokan_cache_hash(key);
+    entry->key = (char *)(entry + 1);
+    memcpy(entry->key, key, key_len + 1);
+    entry->elements = entry->key + key_len + 1;
+    if (size > 0) {
+        memcpy(entry->elements, elements, size);
+    }
+    entry->size = size;
+    entry->footprint = footprint;
+    memcpy(entry->etag, headers->etag, sizeof(entry->etag));
+    entry->fresh_until_ms = fresh_until_ms;
+
+    pthread_mutex_lock(&cache->mutex);
+    struct lokan_cache_entry *previous = lokan_cache_find(cache, key, entry->hash);
+    if (previous) {
+        lokan_cache_remove(cache, previous);
+    }
+    while (cache->tail && (cache->count >= cache->max_entries || cache->bytes + footprint > cache->max_bytes)) {
+        lokan_cache_remove(cache, cache->tail);
+    }
+    lokan_cache_push_front(cache, entry);
+    cache->bytes += footprint;
+    cache->count++;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+/* Case-insensitive match of a header line's name; returns the trimmed value. */
+static const char *lokan_cache_header_value(const char *line, size_t len, const char *name, size_t *out_len) {
+    size_t name_len = strlen(name);
+    if (len <= name_len || line[name_len] != ':') {
+        return NULL;
+    }
+    for (size_t i = 0; i < name_len; ++i) {
+        if (tolower((unsigned char)line[i]) != name[i]) {
+            return NULL;
+        }
+    }
+    const char *value = line + name_len + 1;
+    const char *end = line + len;
+    while (value < end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ' || end[-1] == '\t')) {
+        end--;
+    }
+    *out_len = (size_t)(end - value);
+    return value;
+}
+
+static void lokan_cache_parse_cache_control(struct lokan_cache_headers *headers, const char *value, size_t len) {
+    const char *end = value + len;
+    const char *p = value;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == ',')) {
+            p++;
+        }
+        const char *token = p;
+        while (p < end && *p != ',') {
+            p++;
+        }
+        size_t token_len = (size_t)(p - token);
+        if (token_len == 8 && strncmp(token, "no-store", 8) == 0) {
+            headers->no_store = 1;
+        } else if (token_len > 8 && strncmp(token, "max-age=", 8) == 0) {
+            long seconds = 0;
+            for (const char *d = token + 8; d < token + token_len && *d >= '0' && *d <= '9'; ++d) {
+                if (seconds < 86400L * 365) {
+                    seconds = seconds * 10 + (*d - '0');
+                }
+            }
+            headers->max_age_ms = seconds * 1000;
+        }
+    }
+}
+
+size_t lokan_cache_header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
+    size_t len = size * nitems;
+    struct lokan_cache_headers *headers = (struct lokan_cache_headers *)userdata;
+    if (len >= 5 && memcmp(buffer, "HTTP/", 5) == 0) {
+        /* A new status line: anything seen so far belonged to an interim response. */
+        headers->etag[0] = '\0';
+        headers->max_age_ms = -1;
+        headers->no_store = 0;
+        return len;
+    }
+    size_t value_len = 0;
+    const char *value = lokan_cache_header_value(buffer, len, "etag", &value_len);
+    if (value) {
+        if (value_len < sizeof(headers->etag)) {
+            memcpy(headers->etag, value, value_len);
+            headers->etag[value_len] = '\0';
+        }
+        return len;
+    }
+    value = lokan_cache_header_value(buffer, len, "cache-control", &value_len);
+    if (value) {
+        lokan_cache_parse_cache_control(headers, value, value_len);
+    }
+    return len;
+}
@@ -0,0 +1,90 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <zlib.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/* windowBits above 15 selects the gzip wrapper, the one Content-Encoding: gzip names. */
+#define LOKAN_DEFLATE_GZIP_WINDOW (15 + 16)
+#define LOKAN_DEFLATE_MEM_LEVEL 8
+
+/* zlib's own state comes from the client's allocator like everything else it holds. */
+static voidpf lokan_deflate_alloc(voidpf opaque, uInt items, uInt size) {
+    if (size != 0 && items > SIZE_MAX / size) {
+        return Z_NULL;
+    }
+    return lokan_alloc((const lokan_allocator_t *)opaque, (size_t)items * size);
+}
+
+static void lokan_deflate_free(voidpf opaque, voidpf address) {
+    lokan_free((const lokan_allocator_t *)opaque, address);
+}
+
+/* The stream is created on first use and reset between bodies, keeping its ~256 KiB of state. */
+static z_stream *lokan_deflate_stream(lokan_client_t *client) {
+    if (client->deflate) {
+        if (deflateReset(client->deflate) == Z_OK) {
+            return client->deflate;
+        }
+        lokan_deflate_cleanup(client);
+    }
+    z_stream *stream = (z_stream *)lokan_calloc(&client->allocator, 1, sizeof(z_stream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->zalloc = lokan_deflate_alloc;
+    stream->zfree = lokan_deflate_free;
+    stream->opaque = (voidpf)&client->allocator;
+    if (deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, LOKAN_DEFLATE_GZIP_WINDOW, LOKAN_DEFLATE_MEM_LEVEL,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        lokan_free(&client->allocator, stream);
+        return NULL;
+    }
+    client->deflate = stream;
+    return stream;
+}
+
+void lokan_deflate_cleanup(lokan_client_t *client) {
+    if (!client->deflate) {
+        return;
+    }
+    deflateEnd(client->deflate);
+    lokan_free(&client->allocator, client->deflate);
+    client->deflate = NULL;
+}
+
+int lokan_deflate_body(lokan_client_t *client, const lokan_iovec_t *iov, size_t count, size_t total) {
+    if (client->compress_min_bytes == 0 || total < client->compress_min_bytes || total > UINT32_MAX) {
+        return 0;
+    }
+    z_stream *stream = lokan_deflate_stream(client);
+    if (!stream) {
+        return 0;
+    }
+    /* Compressing only pays off if it shrinks the body, so the output never needs to exceed it. */
+    struct lokan_memory *out = &client->deflated;
+    lokan_memory_recycle(out);
+    if (lokan_memory_reserve(out, total) != LOKAN_OK) {
+        return 0;
+    }
+    stream->next_out = (Bytef *)out->data;
+    stream->avail_out = (uInt)total;
+
+    int status = Z_OK;
+    for (size_t i = 0; i < count && status == Z_OK; ++i) {
+        stream->next_in = (Bytef *)(uintptr_t)iov[i].data;
+        stream->avail_in = (uInt)iov[i].len;
+        status = deflate(stream, i + 1 == count ? Z_FINISH : Z_NO_FLUSH);
+        if (status == Z_OK && stream->avail_out == 0) {
+            /* Full output with input left: the body does not shrink. */
+            return 0;
+        }
+    }
+    if (status != Z_STREAM_END) {
+        return 0;
+    }
+    out->size = total - stream->avail_out;
+    return 1;
+}
@@ -0,0 +1,318 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Longest dotted member path tracked; members below a longer path are skipped. */
+#define LOKAN_DECODE_PATH_MAX 128
+/* Matches the parser's nesting limit, which fails deeper documents first. */
+#define LOKAN_DECODE_MAX_DEPTH 64
+#define LOKAN_DECODE_NO_PATH ((size_t)-1)
+
+/*
+ * Schema-driven SAX consumer for the generated API. It keeps only the dotted
+ * path of the member being parsed, writes matching scalars straight into the
+ * output struct and records RAW members as spans of the response body, so
+ * nothing resembling a DOM is ever built.
+ */
+struct lokan_decoder {
+    const lokan_allocator_t *allocator;
+    lokan_json_parser_t *parser;
+
+    /* Everything from schema on is reset for each document. */
+    const struct lokan_schema *schema;
+    char *out;
+    const char *body;
+    struct lokan_memory *strings;
+    uint32_t present;
+
+    char path[LOKAN_DECODE_PATH_MAX];
+    /* Length of path for the current key at each depth, or LOKAN_DECODE_NO_PATH. */
+    size_t path_len[LOKAN_DECODE_MAX_DEPTH + 1];
+    char containers[LOKAN_DECODE_MAX_DEPTH + 1];
+
+    /* Depth of a value being captured (raw) or skipped whole, 0 otherwise. */
+    size_t hold_depth;
+    const struct lokan_field *raw;
+    size_t raw_start;
+    lokan_result_t error;
+};
+
+static const struct lokan_field *lokan_decode_match(const struct lokan_decoder *decoder, size_t depth) {
+    if (depth == 0 || decoder->containers[depth] != '{') {
+        return NULL;
+    }
+    size_t len = decoder->path_len[depth];
+    if (len == LOKAN_DECODE_NO_PATH) {
+        return NULL;
+    }
+    for (size_t i = 0; i < decoder->schema->count; ++i) {
+        const struct lokan_field *field = &decoder->schema->fields[i];
+        if (field->path_len == len && memcmp(field->path, decoder->path, len) == 0) {
+            return field;
+        }
+    }
+    return NULL;
+}
+
+static void lokan_decode_key(struct lokan_decoder *decoder, const char *text, size_t len, size_t depth) {
+    size_t base = 0;
+    if (depth > 1) {
+        /* Members of objects inside arrays have no stable path. */
+        base = decoder->containers[depth - 1] == '{' ? decoder->path_len[depth - 1] : LOKAN_DECODE_NO_PATH;
+    }
+    size_t needed = base + (depth > 1 ? 1 : 0) + len;
+    if (base == LOKAN_DECODE_NO_PATH || needed > sizeof(decoder->path)) {
+        decoder->path_len[depth] = LOKAN_DECODE_NO_PATH;
+        return;
+    }
+    if (depth > 1) {
+        decoder->path[base++] = '.';
+    }
+    memcpy(decoder->path + base, text, len);
+    decoder->path_len[depth] = needed;
+}
+
+static void *lokan_decode_slot(const struct lokan_decoder *decoder, const struct lokan_field *field) {
+    return decoder->out + field->offset;
+}
+
+static int lokan_decode_fail(struct lokan_decoder *decoder, lokan_result_t error) {
+    decoder->error = error;
+    return 1;
+}
+
+static int lokan_decode_string(struct lokan_decoder *decoder, const struct lokan_field *field, const char *text, size_t len) {
+    struct lokan_memory *strings = decoder->strings;
+    /* Reserved up front from the body size, so stored views never move. */
+    if (strings->size + len + 1 > strings->capacity) {
+        return lokan_decode_fail(decoder, LOKAN_ERROR_OVERFLOW);
+    }
+    char *copy = strings->data + strings->size;
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    strings->size += len + 1;
+    lokan_view_t *view = (lokan_view_t *)lokan_decode_slot(decoder, field);
+    view->data = copy;
+    view->size = len;
+    return 0;
+}
+
+static int lokan_decode_number(struct lokan_decoder *decoder, const struct lokan_field *field, const char *text, size_t len) {
+    /* The parser NUL-terminates every token. */
+    char *end = NULL;
+    errno = 0;
+    if (field->kind == LOKAN_FIELD_INT64) {
+        long long value = strtoll(text, &end, 10);
+        if (errno != 0 || end != text + len) {
+            return lokan_decode_fail(decoder, LOKAN_ERROR_PARSE);
+        }
+        *(int64_t *)lokan_decode_slot(decoder, field) = (int64_t)value;
+    } else {
+        double value = strtod(text, &end);
+        if (errno != 0 || end != text + len) {
+            return lokan_decode_fail(decoder, LOKAN_ERROR_PARSE);
+        }
+        *(double *)lokan_decode_slot(decoder, field) = value;
+    }
+    return 0;
+}
+
+static int lokan_decode_scalar(
+    struct lokan_decoder *decoder,
+    const struct lokan_field *field,
+    lokan_json_event_t event,
+    const char *text,
+    size_t len) {
+    if (event == LOKAN_JSON_NULL) {
+        /* Nullable members stay absent; the required check catches the rest. */
+        return 0;
+    }
+    int matched = 0;
+    int result = 0;
+    switch (field->kind) {
+        case LOKAN_FIELD_STRING:
+            matched = event == LOKAN_JSON_STRING;
+            result = matched ? lokan_decode_string(decoder, field, text, len) : 0;
+            break;
+        case LOKAN_FIELD_INT64:
+        case LOKAN_FIELD_DOUBLE:
+            matched = event == LOKAN_JSON_NUMBER;
+            result = matched ? lokan_decode_number(decoder, field, text, len) : 0;
+            break;
+        case LOKAN_FIELD_BOOL:
+            matched = event == LOKAN_JSON_TRUE || event == LOKAN_JSON_FALSE;
+            if (matched) {
+                *(int *)lokan_decode_slot(decoder, field) = event == LOKAN_JSON_TRUE;
+            }
+            break;
+        case LOKAN_FIELD_RAW:
+            /* Free-form members are documented as objects or arrays. */
+            break;
+    }
+    if (!matched && field->kind != LOKAN_FIELD_RAW) {
+        return lokan_decode_fail(decoder, LOKAN_ERROR_PARSE);
+    }
+    if (matched && result == 0) {
+        decoder->present |= field->bit;
+    }
+    return result;
+}
+
+static int lokan_decode_event(lokan_json_event_t event, const char *text, size_t len, size_t depth, void *user_data) {
+    struct lokan_decoder *decoder = (struct lokan_decoder *)user_data;
+
+    if (decoder->hold_depth > 0) {
+        if ((event == LOKAN_JSON_OBJECT_END || event == LOKAN_JSON_ARRAY_END) && depth == decoder->hold_depth) {
+            if (decoder->raw) {
+                lokan_view_t *view = (lokan_view_t *)lokan_decode_slot(decoder, decoder->raw);
+                view->data = decoder->body + decoder->raw_start;
+                view->size = lokan_json_parser_offset(decoder->parser) + 1 - decoder->raw_start;
+                decoder->present |= decoder->raw->bit;
+                decoder->raw = NULL;
+            }
+            decoder->hold_depth = 0;
+        }
+        return 0;
+    }
+
+    switch (event) {
+        case LOKAN_JSON_OBJECT_START:
+        case LOKAN_JSON_ARRAY_START: {
+            if (depth == 1) {
+                if (event != LOKAN_JSON_OBJECT_START) {
+                    return lokan_decode_fail(decoder, LOKAN_ERROR_PARSE);
+                }
+                decoder->containers[1] = '{';
+                return 0;
+            }
+            const struct lokan_field *field = lokan_decode_match(decoder, depth - 1);
+            if (field && field->kind == LOKAN_FIELD_RAW) {
+                decoder->raw = field;
+                decoder->raw_start = lokan_json_parser_offset(decoder->parser);
+                decoder->hold_depth = depth;
+            } else if (field) {
+                return lokan_decode_fail(decoder, LOKAN_ERROR_PARSE);
+            } else if (event == LOKAN_JSON_ARRAY_START) {
+                decoder->hold_depth = depth;
+            } else {
+                /* Descend: nested objects can hold dotted members such as error.code. */
+                decoder->containers[depth] = '{';
+                decoder->path_len[depth] = LOKAN_DECODE_NO_PATH;
+            }
+            return 0;
+        }
+        case LOKAN_JSON_OBJECT_END:
+        case LOKAN_JSON_ARRAY_END:
+            return 0;
+        case LOKAN_JSON_KEY:
+            lokan_decode_key(decoder, text, len, depth);
+            return 0;
+        default: {
+            if (depth == 0) {
+                return lokan_decode_fail(decoder, LOKAN_ERROR_PARSE);
+            }
+            const struct lokan_field *field = lokan_decode_match(decoder, depth);
+            return field ? lokan_decode_scalar(decoder, field, event, text, len) : 0;
+        }
+    }
+}
+
+lokan_result_t lokan_decoder_create(struct lokan_decoder **out_decoder, const lokan_allocator_t *allocator) {
+    struct lokan_decoder *decoder = (struct lokan_decoder *)lokan_calloc(allocator, 1, sizeof(struct lokan_decoder));
+    if (!decoder) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    decoder->allocator = allocator;
+    lokan_json_parser_config_t config = {0};
+    config.on_event = lokan_decode_event;
+    config.user_data = decoder;
+    if (lokan_json_parser_create_with(&decoder->parser, &config, allocator) != LOKAN_OK) {
+        lokan_free(allocator, decoder);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    *out_decoder = decoder;
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_decoder_run(
+    struct lokan_decoder *decoder,
+    const struct lokan_schema *schema,
+    const char *json,
+    size_t len,
+    void *out,
+    struct lokan_memory *strings) {
+    memset(out, 0, schema->size);
+    /* Unescaping never grows a string, so the document size bounds every copy. */
+    if (lokan_memory_reserve(strings, strings->size + len + 1) != LOKAN_OK) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+
+    size_t keep = offsetof(struct lokan_decoder, schema);
+    memset((char *)decoder + keep, 0, sizeof(*decoder) - keep);
+    decoder->schema = schema;
+    decoder->out = (char *)out;
+    decoder->body = json;
+    decoder->strings = strings;
+
+    lokan_json_parser_reset(decoder->parser);
+    lokan_result_t result = lokan_json_parser_feed(decoder->parser, json, len);
+    if (result == LOKAN_OK) {
+        result = lokan_json_parser_finish(decoder->parser);
+    }
+    if (decoder->error != LOKAN_OK) {
+        result = decoder->error;
+    }
+    if (result == LOKAN_OK && (decoder->present & schema->required) != schema->required) {
+        result = LOKAN_ERROR_PARSE;
+    }
+    *(uint32_t *)((char *)out + schema->present_offset) = decoder->present;
+    return result;
+}
+
+void lokan_decoder_destroy(struct lokan_decoder *decoder) {
+    if (!decoder) {
+        return;
+    }
+    lokan_json_parser_destroy(decoder->parser);
+    lokan_free(decoder->allocator, decoder);
+}
+
+lokan_result_t lokan_request_decode(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    const struct lokan_schema *schema,
+    void *out,
+    long *out_status) {
+    if (!client || !method || !path || !schema || !out) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    memset(out, 0, schema->size);
+
+    lokan_result_t result = lokan_perform_request(client, path, method, body, body_len, NULL, out_status);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+
+    lokan_memory_recycle(&client->decoded);
+    lokan_arena_mark_t mark = {0, NULL};
+    if (client->arena) {
+        mark = lokan_arena_mark(client->arena);
+    }
+    struct lokan_decoder *decoder = NULL;
+    result = lokan_decoder_create(&decoder, lokan_scratch_allocator(client));
+    if (result == LOKAN_OK) {
+        result = lokan_decoder_run(decoder, schema, client->response.data, client->response.size, out, &client->decoded);
+        lokan_decoder_destroy(decoder);
+    }
+    if (client->arena) {
+        lokan_arena_release(client->arena, mark);
+    }
+    return result;
+}
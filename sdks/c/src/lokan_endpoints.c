@@ -0,0 +1,61 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <curl/curl.h>
+#include <string.h>
+
+/*
+ * Paths every service in openapi/_bundle.yaml exposes under its own prefix,
+ * plus the ones the SDK calls itself. A client's base URL already carries the
+ * service prefix, so these are resolved against it once at init and the hot
+ * path only has to recognise them.
+ */
+static const struct {
+    const char *path;
+    size_t len;
+} lokan_endpoint_paths[LOKAN_ENDPOINT_COUNT] = {
+#define LOKAN_ENDPOINT_PATH(name, path) {path, sizeof(path) - 1},
+    LOKAN_ENDPOINTS(LOKAN_ENDPOINT_PATH)
+#undef LOKAN_ENDPOINT_PATH
+};
+
+lokan_result_t lokan_endpoints_init(lokan_client_t *client) {
+    for (int i = 0; i < LOKAN_ENDPOINT_COUNT; ++i) {
+        struct lokan_endpoint *endpoint = &client->endpoints[i];
+        endpoint->url = lokan_join_url(&client->allocator, client->base_url, lokan_endpoint_paths[i].path);
+        if (!endpoint->url) {
+            return LOKAN_ERROR_ALLOCATION;
+        }
+#if LIBCURL_VERSION_NUM >= 0x073f00
+        /* A URL libcurl cannot parse keeps working through CURLOPT_URL, which reports the error per call. */
+        endpoint->curlu = curl_url();
+        if (endpoint->curlu && curl_url_set(endpoint->curlu, CURLUPART_URL, endpoint->url, 0) != CURLUE_OK) {
+            curl_url_cleanup(endpoint->curlu);
+            endpoint->curlu = NULL;
+        }
+#endif
+    }
+    return LOKAN_OK;
+}
+
+void lokan_endpoints_cleanup(lokan_client_t *client) {
+    for (int i = 0; i < LOKAN_ENDPOINT_COUNT; ++i) {
+        struct lokan_endpoint *endpoint = &client->endpoints[i];
+#if LIBCURL_VERSION_NUM >= 0x073f00
+        if (endpoint->curlu) {
+            curl_url_cleanup(endpoint->curlu);
+        }
+#endif
+        lokan_free(&client->allocator, endpoint->url);
+    }
+}
+
+const struct lokan_endpoint *lokan_endpoint_find(const lokan_client_t *client, const char *path) {
+    size_t len = strlen(path);
+    for (int i = 0; i < LOKAN_ENDPOINT_COUNT; ++i) {
+        if (lokan_endpoint_paths[i].len == len && memcmp(lokan_endpoint_paths[i].path, path, len) == 0) {
+            return client->endpoints[i].url ? &client->endpoints[i] : NULL;
+        }
+    }
+    return NULL;
+}
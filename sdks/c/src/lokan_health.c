@@ -0,0 +1,212 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/* Probes kept in flight at once; larger fleets are probed through a sliding window. */
+#define LOKAN_HEALTH_IN_FLIGHT_MAX 16
+
+/* The only member of a health body the SDK reads, {"status":"ok",...}. */
+struct lokan_health_body {
+    uint32_t present;
+    lokan_view_t status;
+};
+
+static const struct lokan_field lokan_health_fields[] = {
+    {"status", 6, LOKAN_FIELD_STRING, offsetof(struct lokan_health_body, status), 1u},
+};
+
+static const struct lokan_schema lokan_health_schema = {
+    lokan_health_fields,
+    sizeof(lokan_health_fields) / sizeof(lokan_health_fields[0]),
+    sizeof(struct lokan_health_body),
+    offsetof(struct lokan_health_body, present),
+    1u,
+};
+
+lokan_result_t lokan_get_health_view(lokan_client_t *client, lokan_view_t *out_status) {
+    if (!client || !out_status) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    struct lokan_health_body body;
+    lokan_result_t result = lokan_request_decode(client, "GET", "/health", NULL, 0, &lokan_health_schema, &body, NULL);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    if (body.status.size == 0) {
+        return LOKAN_ERROR_PARSE;
+    }
+    *out_status = body.status;
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_get_health(lokan_client_t *client, char **out_status) {
+    if (!client || !out_status) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    lokan_view_t status = {0};
+    lokan_result_t result = lokan_get_health_view(client, &status);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+
+    /* Caller-owned, so it comes from the global allocator that lokan_string_free uses. */
+    char *status_copy = lokan_strdup(lokan_default_allocator(), status.data);
+    if (!status_copy) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+
+    *out_status = status_copy;
+    return LOKAN_OK;
+}
+
+struct lokan_health_run;
+
+/* An in-flight probe; its address is the request's user_data, so it can be abandoned at the deadline. */
+struct lokan_health_slot {
+    struct lokan_health_run *run;
+    lokan_health_probe_t *probe;
+    uint64_t started_ms;
+};
+
+struct lokan_health_run {
+    lokan_client_t *client;
+    size_t in_flight;
+};
+
+/* Copies the status member into probe->health, decoding with the client's cached decoder. */
+static lokan_result_t lokan_health_parse(lokan_client_t *client, const char *json, size_t len, lokan_health_probe_t *probe) {
+    if (!client->health_decoder) {
+        lokan_result_t created = lokan_decoder_create(&client->health_decoder, &client->allocator);
+        if (created != LOKAN_OK) {
+            return created;
+        }
+    }
+    lokan_memory_recycle(&client->decoded);
+    struct lokan_health_body body;
+    lokan_result_t result =
+        lokan_decoder_run(client->health_decoder, &lokan_health_schema, json, len, &body, &client->decoded);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    if (body.status.size == 0) {
+        return LOKAN_ERROR_PARSE;
+    }
+    if (body.status.size >= sizeof(probe->health)) {
+        return LOKAN_ERROR_OVERFLOW;
+    }
+    memcpy(probe->health, body.status.data, body.status.size + 1);
+    return LOKAN_OK;
+}
+
+static void lokan_health_completed(const lokan_response_t *response, void *user_data) {
+    struct lokan_health_slot *slot = (struct lokan_health_slot *)user_data;
+    lokan_health_probe_t *probe = slot->probe;
+    slot->probe = NULL;
+    slot->run->in_flight--;
+
+    probe->result = response->result;
+    probe->status = response->status;
+    probe->timing = response->timing;
+    /* An unhealthy service usually still says why, e.g. 503 with {"status":"degraded"}. */
+    if (response->body_len > 0) {
+        lokan_result_t parsed = lokan_health_parse(slot->run->client, response->body, response->body_len, probe);
+        if (probe->result == LOKAN_OK) {
+            probe->result = parsed;
+        }
+    } else if (probe->result == LOKAN_OK) {
+        probe->result = LOKAN_ERROR_PARSE;
+    }
+}
+
+/* Abandons probes past their deadline and returns how long the next one may still wait, capped at 1 s. */
+static long lokan_health_expire(lokan_client_t *client, struct lokan_health_slot *slots, struct lokan_health_run *run, long deadline_ms) {
+    long wait_ms = 1000;
+    if (deadline_ms <= 0) {
+        return wait_ms;
+    }
+    uint64_t now = lokan_now_ms();
+    for (size_t i = 0; i < LOKAN_HEALTH_IN_FLIGHT_MAX; ++i) {
+        struct lokan_health_slot *slot = &slots[i];
+        if (!slot->probe) {
+            continue;
+        }
+        uint64_t due = slot->started_ms + (uint64_t)deadline_ms;
+        if (now < due) {
+            if ((long)(due - now) < wait_ms) {
+                wait_ms = (long)(due - now);
+            }
+            continue;
+        }
+        lokan_request_abandon(client, slot);
+        /* Reported like a libcurl timeout, with the time the probe was given. */
+        slot->probe->result = LOKAN_ERROR_CURL;
+        slot->probe->timing.total_us = (int64_t)(now - slot->started_ms) * 1000;
+        slot->probe->timing.attempts = 1;
+        slot->probe = NULL;
+        run->in_flight--;
+    }
+    return wait_ms;
+}
+
+lokan_result_t lokan_health_probe_all(lokan_client_t *client, lokan_health_probe_t *probes, size_t count, long deadline_ms) {
+    if (!client || (!probes && count > 0)) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (!probes[i].path) {
+            return LOKAN_ERROR_INVALID_ARGUMENT;
+        }
+        probes[i].result = LOKAN_OK;
+        probes[i].status = 0;
+        probes[i].health[0] = '\0';
+        memset(&probes[i].timing, 0, sizeof(probes[i].timing));
+    }
+    if (deadline_ms <= 0) {
+        deadline_ms = client->timeout_ms;
+    }
+
+    struct lokan_health_slot slots[LOKAN_HEALTH_IN_FLIGHT_MAX];
+    memset(slots, 0, sizeof(slots));
+    struct lokan_health_run run = {client, 0};
+    size_t next = 0;
+    while (next < count || run.in_flight > 0) {
+        for (size_t i = 0; i < LOKAN_HEALTH_IN_FLIGHT_MAX && next < count; ++i) {
+            struct lokan_health_slot *slot = &slots[i];
+            if (slot->probe) {
+                continue;
+            }
+            lokan_health_probe_t *probe = &probes[next++];
+            slot->run = &run;
+            slot->started_ms = lokan_now_ms();
+            lokan_result_t submitted =
+                lokan_request_submit(client, "GET", probe->path, NULL, 0, lokan_health_completed, slot);
+            if (submitted != LOKAN_OK) {
+                probe->result = submitted;
+                continue;
+            }
+            slot->probe = probe;
+            run.in_flight++;
+        }
+
+        long wait_ms = lokan_health_expire(client, slots, &run, deadline_ms);
+        if (run.in_flight == 0) {
+            continue;
+        }
+        /* Completions point into this frame, so every probe is finished or abandoned before returning. */
+        if (lokan_client_poll(client, (int)wait_ms, NULL) != LOKAN_OK) {
+            lokan_sleep_ms(wait_ms < 10 ? wait_ms : 10);
+            lokan_client_perform(client, NULL);
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (probes[i].result != LOKAN_OK) {
+            return probes[i].result;
+        }
+    }
+    return LOKAN_OK;
+}
@@ -0,0 +1,539 @@
+#ifndef LOKAN_INTERNAL_H
+#define LOKAN_INTERNAL_H
+
+#include "lokan.h"
+
+#include <curl/curl.h>
+
+#if defined(__GNUC__)
+#define LOKAN_INTERNAL __attribute__((visibility("hidden")))
+#else
+#define LOKAN_INTERNAL
+#endif
+
+/* Smallest allocation for a growable response buffer; growth doubles from here. */
+#define LOKAN_MEMORY_MIN_CAPACITY 1024
+/* Buffers that grew past this are released after use instead of being kept. */
+#define LOKAN_MEMORY_RETAIN_MAX (256 * 1024)
+
+/* Stack space for small request bodies such as the default scene envelope. */
+#define LOKAN_INLINE_BODY_MAX 256
+
+struct lokan_request;
+struct lokan_arena;
+struct lokan_arena_header;
+
+/* Position in an arena to roll back to; everything allocated after it is released. */
+typedef struct {
+    size_t used;
+    struct lokan_arena_header *spills;
+} lokan_arena_mark_t;
+
+/* Encodings a request body is labelled with; JSON unless a reader says otherwise. */
+typedef enum {
+    LOKAN_BODY_JSON = 0,
+    LOKAN_BODY_CBOR
+} lokan_body_format_t;
+
+/* Streams a scatter/gather body to libcurl without joining it first. */
+struct lokan_body_reader {
+    const lokan_iovec_t *iov;
+    size_t count;
+    size_t index;
+    size_t offset;
+    size_t total;
+    lokan_body_format_t format;
+};
+
+struct lokan_memory {
+    /* NULL uses the global allocator. */
+    const lokan_allocator_t *allocator;
+    char *data;
+    size_t size;
+    size_t capacity;
+    /* Caller-supplied storage: never reallocated, overflow aborts the transfer. */
+    int fixed;
+    int overflowed;
+};
+
+/* Well-known endpoints, resolved against the base URL once per client. */
+#define LOKAN_ENDPOINTS(X) \
+    X(HEALTH, "/health") \
+    X(METRICS, "/metrics") \
+    X(DIAG, "/diag") \
+    X(SCENES_APPLY, "/scenes/apply") \
+    X(SCENES_APPLY_V1, "/v1/scenes:apply") \
+    X(SCENES_APPLY_BATCH, "/v1/scenes:batchApply") \
+    X(INGEST, "/ingest") \
+    X(INGEST_BATCH, "/ingest/batch")
+
+enum {
+#define LOKAN_ENDPOINT_ID(name, path) LOKAN_ENDPOINT_##name,
+    LOKAN_ENDPOINTS(LOKAN_ENDPOINT_ID)
+#undef LOKAN_ENDPOINT_ID
+    LOKAN_ENDPOINT_COUNT
+};
+
+struct lokan_endpoint {
+    char *url;
+    /* Parsed form handed to CURLOPT_CURLU; NULL when libcurl lacks it or rejected url. */
+    CURLU *curlu;
+};
+
+struct lokan_client {
+    CURL *handle;
+    char *base_url;
+    struct lokan_endpoint endpoints[LOKAN_ENDPOINT_COUNT];
+    char *client_cert_path;
+    char *client_key_path;
+    char *ca_cert_path;
+    long timeout_ms;
+    long keepalive_idle_ms;
+    long max_connection_age_ms;
+    int enable_http2;
+    long http2_max_streams;
+    /* DNS, TLS session and connection caches shared with a pool; not owned. */
+    CURLSH *share;
+    /* Latency histograms shared with other clients; not owned. */
+    lokan_metrics_t *metrics;
+    /* List response cache shared with other clients; not owned. */
+    lokan_response_cache_t *cache;
+    lokan_request_timing_t last_timing;
+    /* Free-list link while the client sits idle in a pool. */
+    lokan_client_t *pool_next;
+
+    /* Async engine state, created on the first lokan_request_submit. */
+    CURLM *multi;
+    struct lokan_request *active;
+    struct lokan_request *idle;
+    size_t idle_count;
+    /* Host loop driving the multi through its socket and timer callbacks; on_socket is NULL otherwise. */
+    lokan_event_loop_t event_loop;
+
+    lokan_allocator_t allocator;
+    /* Per-call scratch memory, or NULL when arena_bytes was 0. */
+    struct lokan_arena *arena;
+
+    /* Response buffer for blocking calls; views stay valid until the next call. */
+    struct lokan_memory response;
+    /* Unescaped strings of the last decoded response, or the per-scene bodies of lokan_apply_scenes, under the same rule. */
+    struct lokan_memory decoded;
+    /* NUL-separated elements of a cached list, captured on a miss and replayed on a hit. */
+    struct lokan_memory replay;
+
+    int accept_compressed;
+    size_t compress_min_bytes;
+    /* gzip stream reused for request bodies, created on the first one compressed. */
+    struct z_stream_s *deflate;
+    /* Compressed form of the body being sent; libcurl copies it for async requests. */
+    struct lokan_memory deflated;
+
+    lokan_retry_policy_t retry;
+    unsigned int retry_seed;
+    long hedge_after_ms;
+    /* Circuits shared with other clients; not owned. */
+    lokan_circuit_breaker_t *circuit_breaker;
+    /* Token bucket shared with other clients; not owned. */
+    lokan_rate_limiter_t *rate_limiter;
+    /* Pinned addresses shared with other clients; not owned. */
+    lokan_resolver_t *resolver;
+    /* CURLOPT_RESOLVE lines last loaded from resolver, or NULL without one. */
+    struct lokan_resolve_list *resolve_list;
+    /* Set when share was created for the resolver rather than passed in by a pool. */
+    int owns_share;
+    /* Set once the service answered the scene batch endpoint with 404 or 405. */
+    int scene_batch_unsupported;
+    /* Second handle and private multi for hedged GETs, created on the first hedge. */
+    CURL *hedge_handle;
+    CURLM *hedge_multi;
+    /* Body of the hedge; swapped with response when the hedge answers first. */
+    struct lokan_memory hedge_response;
+    /* Decoder for probe bodies, created on the first lokan_health_probe_all. */
+    struct lokan_decoder *health_decoder;
+};
+
+/* lokan_client_init with an optional share attached to every handle the client creates. */
+LOKAN_INTERNAL lokan_result_t lokan_client_create(
+    const lokan_client_config_t *config,
+    CURLSH *share,
+    lokan_client_t **out_client);
+
+/* The global allocator: malloc-based unless lokan_global_init_allocator replaced it. */
+LOKAN_INTERNAL const lokan_allocator_t *lokan_default_allocator(void);
+LOKAN_INTERNAL void *lokan_alloc(const lokan_allocator_t *allocator, size_t size);
+LOKAN_INTERNAL void *lokan_calloc(const lokan_allocator_t *allocator, size_t count, size_t size);
+LOKAN_INTERNAL void *lokan_realloc(const lokan_allocator_t *allocator, void *ptr, size_t size);
+LOKAN_INTERNAL void lokan_free(const lokan_allocator_t *allocator, void *ptr);
+LOKAN_INTERNAL char *lokan_strdup(const lokan_allocator_t *allocator, const char *value);
+
+LOKAN_INTERNAL struct lokan_arena *lokan_arena_create(const lokan_allocator_t *backing, size_t capacity);
+LOKAN_INTERNAL void lokan_arena_destroy(struct lokan_arena *arena);
+/* Allocator view of the arena; its free is a no-op. */
+LOKAN_INTERNAL const lokan_allocator_t *lokan_arena_allocator(struct lokan_arena *arena);
+LOKAN_INTERNAL lokan_arena_mark_t lokan_arena_mark(const struct lokan_arena *arena);
+LOKAN_INTERNAL void lokan_arena_release(struct lokan_arena *arena, lokan_arena_mark_t mark);
+
+/* Monotonic clock in milliseconds. */
+LOKAN_INTERNAL uint64_t lokan_now_ms(void);
+
+/* Allocator for memory that only lives for the current call: the arena if any, else the client's. */
+LOKAN_INTERNAL const lokan_allocator_t *lokan_scratch_allocator(const lokan_client_t *client);
+
+LOKAN_INTERNAL lokan_result_t lokan_endpoints_init(lokan_client_t *client);
+LOKAN_INTERNAL void lokan_endpoints_cleanup(lokan_client_t *client);
+/* The cached endpoint whose path is exactly path, or NULL to build the URL per call. */
+LOKAN_INTERNAL const struct lokan_endpoint *lokan_endpoint_find(const lokan_client_t *client, const char *path);
+
+LOKAN_INTERNAL char *lokan_join_url(const lokan_allocator_t *allocator, const char *base, const char *path);
+/* Appends value to out, percent-encoding everything outside RFC 3986's unreserved set; returns the end. */
+LOKAN_INTERNAL char *lokan_url_escape_into(char *out, const char *value);
+
+/* Query parameter of a generated entry point; an optional one is left out when NULL or 0. */
+struct lokan_query_param {
+    const char *name;
+    int is_string;
+    int required;
+    const char *string;
+    int64_t integer;
+};
+
+/*
+ * path with params appended as its query string. Written to inline_path
+ * when it fits, else allocated from allocator; the caller frees a result
+ * other than inline_path.
+ */
+LOKAN_INTERNAL char *lokan_query_path(
+    const lokan_allocator_t *allocator,
+    char *inline_path,
+    size_t inline_capacity,
+    const char *path,
+    const struct lokan_query_param *params,
+    size_t count);
+/* Length of value once escaped as JSON string contents, and the escaping itself. */
+LOKAN_INTERNAL size_t lokan_json_escaped_len(const char *value);
+LOKAN_INTERNAL char *lokan_json_escape_into(char *out, const char *value);
+/* Length of the {"sceneId":...} body lokan_apply_scene sends without a payload, and the body itself. */
+LOKAN_INTERNAL size_t lokan_scene_envelope_len(const char *scene_id);
+LOKAN_INTERNAL char *lokan_scene_envelope_into(char *out, const char *scene_id);
+LOKAN_INTERNAL size_t lokan_write_callback(void *contents, size_t size, size_t nmemb, void *userp);
+
+/* Ensures capacity for needed bytes, growing geometrically unless the buffer is fixed. */
+LOKAN_INTERNAL lokan_result_t lokan_memory_reserve(struct lokan_memory *memory, size_t needed);
+/* Empties a buffer for reuse, releasing it if an outsized response inflated it. */
+LOKAN_INTERNAL void lokan_memory_recycle(struct lokan_memory *memory);
+
+/*
+ * Gzips a body of total bytes into client->deflated when it reaches
+ * compress_min_bytes and compressing shrinks it. Returns 0 to send the body
+ * as is, including when compression fails.
+ */
+LOKAN_INTERNAL int lokan_deflate_body(lokan_client_t *client, const lokan_iovec_t *iov, size_t count, size_t total);
+LOKAN_INTERNAL void lokan_deflate_cleanup(lokan_client_t *client);
+
+/*
+ * Append-only ring of request bodies in a memory-mapped file, for telemetry
+ * batches that could not be sent. Appends evict the oldest records when the
+ * ring is full; nothing reaches the disk until lokan_spool_sync, so callers
+ * sync in groups. Used only by the thread that owns the telemetry batch.
+ */
+struct lokan_spool;
+
+struct lokan_spool_record {
+    /* Logical offsets of this record and the one after it. */
+    uint64_t offset;
+    uint64_t next;
+    /* Borrows the mapping until the next append. */
+    const char *data;
+    size_t len;
+    uint32_t envelopes;
+    lokan_body_format_t format;
+};
+
+/* Opens or creates the spool at path; an intact existing spool is recovered with its own capacity. */
+LOKAN_INTERNAL lokan_result_t lokan_spool_open(
+    struct lokan_spool **out_spool,
+    const lokan_allocator_t *allocator,
+    const char *path,
+    size_t capacity);
+/* Syncs and unmaps the spool; what it holds stays on disk for the next open. */
+LOKAN_INTERNAL void lokan_spool_close(struct lokan_spool *spool);
+/* Appends one body; *out_evicted counts the envelopes of older records dropped to fit it. */
+LOKAN_INTERNAL lokan_result_t lokan_spool_append(
+    struct lokan_spool *spool,
+    lokan_body_format_t format,
+    const char *data,
+    size_t len,
+    uint32_t envelopes,
+    uint64_t *out_evicted);
+/* Points out at the oldest record; returns 0 when the spool is empty. */
+LOKAN_INTERNAL int lokan_spool_peek(struct lokan_spool *spool, struct lokan_spool_record *out);
+/* Drops record, which must have come from lokan_spool_peek, once it has been delivered. */
+LOKAN_INTERNAL void lokan_spool_release(struct lokan_spool *spool, const struct lokan_spool_record *record);
+LOKAN_INTERNAL int lokan_spool_dirty(const struct lokan_spool *spool);
+LOKAN_INTERNAL lokan_result_t lokan_spool_sync(struct lokan_spool *spool);
+
+/* Applies the options shared by every easy handle a client owns. */
+LOKAN_INTERNAL void lokan_configure_handle(const lokan_client_t *client, CURL *handle);
+
+/* Points handle at path, using the client's cached endpoint URLs when path is one of them. */
+LOKAN_INTERNAL lokan_result_t lokan_set_url(const lokan_client_t *client, CURL *handle, const char *path);
+
+/*
+ * Sets URL, method, body and headers on an already configured handle. The
+ * body is either body/body_len or, when reader is set, pulled from its
+ * segments; reader must outlive the transfer. The headers are a shared static
+ * list, optionally returned in *out_headers so a caller can chain per-request
+ * headers in front of it; it must never be freed or appended to.
+ */
+
+LOKAN_INTERNAL lokan_result_t lokan_prepare_request(
+    lokan_client_t *client,
+    CURL *handle,
+    const char *path,
+    const char *method,
+    const char *body,
+    size_t body_len,
+    int copy_body,
+    struct lokan_body_reader *reader,
+    struct curl_slist **out_headers);
+
+/*
+ * Maps a finished transfer to a lokan_result_t and reports the status code.
+ * Fills *out_timing and records it against path when the client has metrics.
+ */
+LOKAN_INTERNAL lokan_result_t lokan_finish_request(
+    const lokan_client_t *client,
+    CURL *handle,
+    const char *path,
+    CURLcode code,
+    long *out_status,
+    lokan_request_timing_t *out_timing);
+
+/* Reads libcurl's transfer timers into per-phase durations. */
+LOKAN_INTERNAL void lokan_collect_timing(CURL *handle, lokan_request_timing_t *out_timing);
+LOKAN_INTERNAL void lokan_metrics_record(
+    lokan_metrics_t *metrics,
+    const char *path,
+    const lokan_request_timing_t *timing,
+    int failed);
+/* Copies path without its query string, truncated to capacity - 1 bytes. */
+LOKAN_INTERNAL size_t lokan_metrics_route(const char *path, char *out, size_t capacity);
+/*
+ * Quantile q of path's total latency in seconds, interpolated within its
+ * histogram bucket as histogram_quantile does; -1 with fewer than min_count samples.
+ */
+LOKAN_INTERNAL double lokan_metrics_quantile(lokan_metrics_t *metrics, const char *path, double q, uint64_t min_count);
+
+/* Identifies the circuit for path on a client with base_url. */
+LOKAN_INTERNAL uint64_t lokan_circuit_key(const char *base_url, const char *path);
+/* LOKAN_ERROR_UNAVAILABLE while the circuit is open or its half-open probe is in flight. */
+LOKAN_INTERNAL lokan_result_t lokan_circuit_allow(lokan_circuit_breaker_t *breaker, uint64_t key);
+/* Counts a finished transfer: transport errors and 5xx are failures, 429 and SDK aborts neither. */
+LOKAN_INTERNAL void lokan_circuit_record(lokan_circuit_breaker_t *breaker, uint64_t key, CURLcode code, long status);
+
+/*
+ * Delay in milliseconds before retrying an attempt that ended with code and
+ * status, or -1 when it is final. attempts counts those made so far.
+ */
+LOKAN_INTERNAL long lokan_retry_delay(
+    lokan_client_t *client,
+    CURL *handle,
+    const char *method,
+    CURLcode code,
+    long status,
+    int attempts);
+LOKAN_INTERNAL void lokan_sleep_ms(long ms);
+
+/*
+ * Takes a token from the client's rate limiter, if any. With may_wait it
+ * sleeps up to the limiter's max_wait_ms for one; otherwise, or when the wait
+ * would be longer, it returns LOKAN_ERROR_RATE_LIMITED.
+ */
+LOKAN_INTERNAL lokan_result_t lokan_rate_limit(const lokan_client_t *client, int may_wait);
+/* Empties the client's bucket after the gateway answered 429. */
+LOKAN_INTERNAL void lokan_rate_limit_drain(const lokan_client_t *client);
+
+/* Allocates the client's resolve list; resolver must be set. */
+LOKAN_INTERNAL lokan_result_t lokan_resolve_client_init(lokan_client_t *client);
+LOKAN_INTERNAL void lokan_resolve_client_cleanup(lokan_client_t *client);
+/*
+ * Loads the resolver's addresses into the DNS cache behind handle when they
+ * changed since the client last did; a no-op without a resolver.
+ */
+LOKAN_INTERNAL void lokan_resolve_apply(const lokan_client_t *client, CURL *handle);
+
+/* Milliseconds after which a GET to path is hedged, or 0 not to hedge it. */
+LOKAN_INTERNAL long lokan_hedge_deadline_ms(const lokan_client_t *client, const char *path);
+/*
+ * Runs the GET prepared on client->handle, sending the same request on
+ * client->hedge_handle if no response arrived within deadline_ms. Returns the
+ * result of the handle that answered first, which *out_winner names; a
+ * winning hedge's body is in client->hedge_response. *out_sent is 1 or 2.
+ */
+LOKAN_INTERNAL CURLcode lokan_hedged_perform(
+    lokan_client_t *client,
+    const char *path,
+    long deadline_ms,
+    CURL **out_winner,
+    int *out_sent);
+LOKAN_INTERNAL void lokan_hedge_cleanup(lokan_client_t *client);
+
+/*
+ * Blocking request on the client's primary handle. The body lands in
+ * response, or in the client's own buffer when response is NULL.
+ */
+LOKAN_INTERNAL lokan_result_t lokan_perform_request(
+    lokan_client_t *client,
+    const char *path,
+    const char *method,
+    const char *body,
+    size_t body_len,
+    struct lokan_memory *response,
+    long *out_status);
+
+/* lokan_perform_request with the body supplied, and labelled, by reader. */
+LOKAN_INTERNAL lokan_result_t lokan_perform_reader(
+    lokan_client_t *client,
+    const char *path,
+    const char *method,
+    struct lokan_body_reader *reader,
+    long *out_status);
+
+/*
+ * lokan_request_submit with the body labelled by reader, which must have a
+ * single segment; the body is copied, so it only has to live for the call.
+ */
+LOKAN_INTERNAL lokan_result_t lokan_request_submit_reader(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    struct lokan_body_reader *reader,
+    lokan_completion_cb on_complete,
+    void *user_data);
+
+LOKAN_INTERNAL void lokan_async_cleanup(lokan_client_t *client);
+
+/* Drops in-flight requests submitted with user_data without invoking their callbacks. */
+LOKAN_INTERNAL void lokan_request_abandon(lokan_client_t *client, void *user_data);
+
+/* lokan_json_parser_create drawing on allocator instead of the global one. */
+LOKAN_INTERNAL lokan_result_t lokan_json_parser_create_with(
+    lokan_json_parser_t **out_parser,
+    const lokan_json_parser_config_t *config,
+    const lokan_allocator_t *allocator);
+
+/*
+ * Document offset of the byte that fired the event being delivered. Exact for
+ * bracket events, which fire on the bracket itself.
+ */
+LOKAN_INTERNAL size_t lokan_json_parser_offset(const lokan_json_parser_t *parser);
+
+/* Field kinds the generated API decodes; RAW keeps a value's JSON text as is. */
+typedef enum {
+    LOKAN_FIELD_STRING,
+    LOKAN_FIELD_INT64,
+    LOKAN_FIELD_DOUBLE,
+    LOKAN_FIELD_BOOL,
+    LOKAN_FIELD_RAW
+} lokan_field_kind_t;
+
+/*
+ * One decoded member. path is the member's key, dotted for members of nested
+ * objects ("error.code"); offset locates the destination in the output struct
+ * and bit is the member's flag in its uint32_t present mask.
+ */
+struct lokan_field {
+    const char *path;
+    size_t path_len;
+    lokan_field_kind_t kind;
+    size_t offset;
+    uint32_t bit;
+};
+
+struct lokan_schema {
+    const struct lokan_field *fields;
+    size_t count;
+    /* sizeof the output struct, which is zeroed before decoding. */
+    size_t size;
+    /* Offset of the present mask in the output struct. */
+    size_t present_offset;
+    uint32_t required;
+};
+
+/*
+ * Schema decoder for complete JSON documents, reusable so a caller decoding
+ * many small documents (list elements, change feeds) builds its parser once.
+ */
+struct lokan_decoder;
+
+LOKAN_INTERNAL lokan_result_t lokan_decoder_create(struct lokan_decoder **out_decoder, const lokan_allocator_t *allocator);
+/*
+ * Decodes the object in json into out. Strings are appended to strings, which
+ * grows first by up to len + 1 bytes and then stays put for the whole call;
+ * RAW members point into json.
+ */
+LOKAN_INTERNAL lokan_result_t lokan_decoder_run(
+    struct lokan_decoder *decoder,
+    const struct lokan_schema *schema,
+    const char *json,
+    size_t len,
+    void *out,
+    struct lokan_memory *strings);
+LOKAN_INTERNAL void lokan_decoder_destroy(struct lokan_decoder *decoder);
+
+/*
+ * Performs a blocking request and decodes a JSON object response into out in
+ * one pass over the body. Strings land in client->decoded and RAW members
+ * borrow client->response, so both stay valid until the next call.
+ */
+LOKAN_INTERNAL lokan_result_t lokan_request_decode(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    const struct lokan_schema *schema,
+    void *out,
+    long *out_status);
+
+/* Longest ETag kept; responses with longer ones are not cached. */
+#define LOKAN_CACHE_ETAG_MAX 128
+
+/* Caching directives collected from response headers by lokan_cache_header_callback. */
+struct lokan_cache_headers {
+    char etag[LOKAN_CACHE_ETAG_MAX];
+    /* -1 when the response had no max-age. */
+    long max_age_ms;
+    int no_store;
+};
+
+typedef enum {
+    LOKAN_CACHE_MISS,
+    /* Present but due for revalidation; its ETag was copied out. */
+    LOKAN_CACHE_STALE,
+    /* Fresh; its elements were copied out. */
+    LOKAN_CACHE_HIT
+} lokan_cache_state_t;
+
+LOKAN_INTERNAL size_t lokan_cache_header_callback(char *buffer, size_t size, size_t nitems, void *userdata);
+/* Largest element blob an entry may hold. */
+LOKAN_INTERNAL size_t lokan_cache_entry_limit(const lokan_response_cache_t *cache);
+LOKAN_INTERNAL lokan_cache_state_t lokan_cache_lookup(
+    lokan_response_cache_t *cache,
+    const char *key,
+    struct lokan_memory *out_elements,
+    char *out_etag);
+/* After a 304: copies the entry out and renews its TTL. Returns 0 if it was evicted meanwhile. */
+LOKAN_INTERNAL int lokan_cache_revalidated(
+    lokan_response_cache_t *cache,
+    const char *key,
+    const struct lokan_cache_headers *headers,
+    struct lokan_memory *out_elements);
+LOKAN_INTERNAL void lokan_cache_store(
+    lokan_response_cache_t *cache,
+    const char *key,
+    const struct lokan_cache_headers *headers,
+    const char *elements,
+    size_t size);
+
+#endif /* LOKAN_INTERNAL_H */
@@ -0,0 +1,880 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <curl/curl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LOKAN_JSON_MAX_DEPTH 64
+#define LOKAN_JSON_DEFAULT_MAX_TOKEN (64 * 1024)
+#define LOKAN_JSON_DEFAULT_MAX_ELEMENT (1024 * 1024)
+
+typedef enum {
+    LOKAN_JSON_STATE_VALUE,
+    LOKAN_JSON_STATE_ARRAY_FIRST,
+    LOKAN_JSON_STATE_OBJECT_FIRST,
+    LOKAN_JSON_STATE_OBJECT_KEY,
+    LOKAN_JSON_STATE_COLON,
+    LOKAN_JSON_STATE_AFTER_VALUE,
+    LOKAN_JSON_STATE_STRING,
+    LOKAN_JSON_STATE_ESCAPE,
+    LOKAN_JSON_STATE_UNICODE,
+    LOKAN_JSON_STATE_NUMBER,
+    LOKAN_JSON_STATE_LITERAL,
+    LOKAN_JSON_STATE_DONE,
+    LOKAN_JSON_STATE_FAILED
+} lokan_json_state_t;
+
+/*
+ * Push tokenizer: bytes are fed in arbitrary chunks and events fire as soon as
+ * a token completes. Only the token in progress (scratch) and, in element
+ * mode, the array element in progress (element) are ever buffered.
+ */
+struct lokan_json_parser {
+    const lokan_allocator_t *allocator;
+    lokan_json_parser_config_t config;
+    char *array_key;
+
+    lokan_json_state_t state;
+    char stack[LOKAN_JSON_MAX_DEPTH];
+    size_t depth;
+    int string_is_key;
+    unsigned int unicode_value;
+    int unicode_digits;
+    unsigned int pending_surrogate;
+
+    struct lokan_memory scratch;
+
+    /* Element mode: depth of the target array once found, 0 before. */
+    size_t target_depth;
+    int key_matched;
+    int capturing;
+    struct lokan_memory element;
+    lokan_result_t error;
+
+    /* Bytes fed before the current chunk, and the document offset of the byte being processed. */
+    size_t consumed;
+    size_t offset;
+};
+
+static lokan_result_t lokan_json_fail(lokan_json_parser_t *parser, lokan_result_t error) {
+    parser->state = LOKAN_JSON_STATE_FAILED;
+    parser->error = error;
+    return error;
+}
+
+static lokan_result_t lokan_json_scratch_push(lokan_json_parser_t *parser, const char *bytes, size_t len) {
+    if (parser->scratch.size + len > parser->config.max_token_bytes) {
+        return lokan_json_fail(parser, LOKAN_ERROR_OVERFLOW);
+    }
+    if (lokan_memory_reserve(&parser->scratch, parser->scratch.size + len + 1) != LOKAN_OK) {
+        return lokan_json_fail(parser, LOKAN_ERROR_ALLOCATION);
+    }
+    memcpy(parser->scratch.data + parser->scratch.size, bytes, len);
+    parser->scratch.size += len;
+    parser->scratch.data[parser->scratch.size] = '\0';
+    return LOKAN_OK;
+}
+
+static lokan_result_t lokan_json_capture(lokan_json_parser_t *parser, const char *bytes, size_t len) {
+    if (len == 0) {
+        return LOKAN_OK;
+    }
+    if (parser->element.size + len > parser->config.max_element_bytes) {
+        return lokan_json_fail(parser, LOKAN_ERROR_OVERFLOW);
+    }
+    if (lokan_memory_reserve(&parser->element, parser->element.size + len + 1) != LOKAN_OK) {
+        return lokan_json_fail(parser, LOKAN_ERROR_ALLOCATION);
+    }
+    memcpy(parser->element.data + parser->element.size, bytes, len);
+    parser->element.size += len;
+    parser->element.data[parser->element.size] = '\0';
+    return LOKAN_OK;
+}
+
+static lokan_result_t lokan_json_emit(lokan_json_parser_t *parser, lokan_json_event_t event, const char *text, size_t len) {
+    if (!parser->config.on_event) {
+        return LOKAN_OK;
+    }
+    if (parser->config.on_event(event, text, len, parser->depth, parser->config.user_data) != 0) {
+        return lokan_json_fail(parser, LOKAN_ERROR_CANCELLED);
+    }
+    return LOKAN_OK;
+}
+
+static int lokan_json_in_target(const lokan_json_parser_t *parser) {
+    return parser->target_depth > 0 && parser->depth == parser->target_depth;
+}
+
+/* Called at the first byte of any value; starts capture for target array elements. */
+static void lokan_json_value_begin(lokan_json_parser_t *parser, const char *chunk, size_t index, size_t *capture_from) {
+    (void)chunk;
+    if (parser->config.on_element && lokan_json_in_target(parser)) {
+        parser->capturing = 1;
+        parser->element.size = 0;
+        *capture_from = index;
+    }
+}
+
+/* Called once a value is complete and depth is back at its container. */
+static lokan_result_t lokan_json_value_end(lokan_json_parser_t *parser, const char *chunk, size_t end, size_t *capture_from) {
+    parser->key_matched = 0;
+    if (parser->depth == 0) {
+        parser->state = LOKAN_JSON_STATE_DONE;
+    } else {
+        parser->state = LOKAN_JSON_STATE_AFTER_VALUE;
+    }
+    if (!parser->capturing || !lokan_json_in_target(parser)) {
+        return LOKAN_OK;
+    }
+    parser->capturing = 0;
+    lokan_result_t result = lokan_json_capture(parser, chunk + *capture_from, end - *capture_from);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    if (parser->config.on_element(parser->element.data, parser->element.size, parser->config.user_data) != 0) {
+        return lokan_json_fail(parser, LOKAN_ERROR_CANCELLED);
+    }
+    return LOKAN_OK;
+}
+
+static lokan_result_t lokan_json_open(lokan_json_parser_t *parser, char kind) {
+    if (parser->depth >= LOKAN_JSON_MAX_DEPTH) {
+        return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+    }
+    /* The root array, or the array under array_key in the root object, is the target. */
+    if (kind == '[' && parser->target_depth == 0 &&
+        ((!parser->array_key && parser->depth == 0) || (parser->key_matched && parser->depth == 1))) {
+        parser->target_depth = parser->depth + 1;
+    }
+    parser->key_matched = 0;
+    parser->stack[parser->depth++] = kind;
+    return lokan_json_emit(parser, kind == '{' ? LOKAN_JSON_OBJECT_START : LOKAN_JSON_ARRAY_START, NULL, 0);
+}
+
+static lokan_result_t lokan_json_close(lokan_json_parser_t *parser, char kind) {
+    if (parser->depth == 0 || parser->stack[parser->depth - 1] != kind) {
+        return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+    }
+    lokan_result_t result = lokan_json_emit(parser, kind == '{' ? LOKAN_JSON_OBJECT_END : LOKAN_JSON_ARRAY_END, NULL, 0);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    if (parser->depth == parser->target_depth) {
+        /* Leaving the target array: later arrays are never targets. */
+        parser->target_depth = (size_t)-1;
+    }
+    parser->depth--;
+    return LOKAN_OK;
+}
+
+static lokan_result_t lokan_json_append_utf8(lokan_json_parser_t *parser, unsigned int cp) {
+    char out[4];
+    size_t len = 0;
+    if (cp < 0x80) {
+        out[len++] = (char)cp;
+    } else if (cp < 0x800) {
+        out[len++] = (char)(0xC0 | (cp >> 6));
+        out[len++] = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out[len++] = (char)(0xE0 | (cp >> 12));
+        out[len++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[len++] = (char)(0x80 | (cp & 0x3F));
+    } else {
+        out[len++] = (char)(0xF0 | (cp >> 18));
+        out[len++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        out[len++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[len++] = (char)(0x80 | (cp & 0x3F));
+    }
+    return lokan_json_scratch_push(parser, out, len);
+}
+
+static lokan_result_t lokan_json_finish_unicode(lokan_json_parser_t *parser) {
+    unsigned int cp = parser->unicode_value;
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        if (parser->pending_surrogate) {
+            return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+        }
+        parser->pending_surrogate = cp;
+        return LOKAN_OK;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        if (!parser->pending_surrogate) {
+            return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+        }
+        cp = 0x10000 + ((parser->pending_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+        parser->pending_surrogate = 0;
+    } else if (parser->pending_surrogate) {
+        return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+    }
+    return lokan_json_append_utf8(parser, cp);
+}
+
+static int lokan_json_is_number_char(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static lokan_result_t lokan_json_finish_number(lokan_json_parser_t *parser) {
+    const char *text = parser->scratch.data;
+    size_t len = parser->scratch.size;
+    /* Light validation: a digit must be present and the first char must start a number. */
+    int has_digit = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (text[i] >= '0' && text[i] <= '9') {
+            has_digit = 1;
+            break;
+        }
+    }
+    if (!has_digit || (text[0] != '-' && (text[0] < '0' || text[0] > '9'))) {
+        return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+    }
+    return lokan_json_emit(parser, LOKAN_JSON_NUMBER, text, len);
+}
+
+static lokan_result_t lokan_json_finish_literal(lokan_json_parser_t *parser) {
+    const char *text = parser->scratch.data;
+    if (strcmp(text, "true") == 0) {
+        return lokan_json_emit(parser, LOKAN_JSON_TRUE, text, 4);
+    }
+    if (strcmp(text, "false") == 0) {
+        return lokan_json_emit(parser, LOKAN_JSON_FALSE, text, 5);
+    }
+    if (strcmp(text, "null") == 0) {
+        return lokan_json_emit(parser, LOKAN_JSON_NULL, text, 4);
+    }
+    return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+}
+
+static int lokan_json_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static lokan_result_t lokan_json_begin_value(lokan_json_parser_t *parser, const char *chunk, size_t i, size_t *capture_from) {
+    char c = chunk[i];
+    lokan_json_value_begin(parser, chunk, i, capture_from);
+    parser->scratch.size = 0;
+    if (c == '{') {
+        lokan_result_t result = lokan_json_open(parser, '{');
+        parser->state = LOKAN_JSON_STATE_OBJECT_FIRST;
+        return result;
+    }
+    if (c == '[') {
+        lokan_result_t result = lokan_json_open(parser, '[');
+        parser->state = LOKAN_JSON_STATE_ARRAY_FIRST;
+        return result;
+    }
+    if (c == '"') {
+        parser->string_is_key = 0;
+        parser->state = LOKAN_JSON_STATE_STRING;
+        return LOKAN_OK;
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        parser->state = LOKAN_JSON_STATE_NUMBER;
+        return lokan_json_scratch_push(parser, &c, 1);
+    }
+    if (c == 't' || c == 'f' || c == 'n') {
+        parser->state = LOKAN_JSON_STATE_LITERAL;
+        return lokan_json_scratch_push(parser, &c, 1);
+    }
+    return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+}
+
+static lokan_result_t lokan_json_finish_string(lokan_json_parser_t *parser, const char *chunk, size_t end, size_t *capture_from) {
+    if (parser->pending_surrogate) {
+        return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+    }
+    /* Guarantees NUL termination, including for an empty string. */
+    lokan_result_t terminated = lokan_json_scratch_push(parser, "", 0);
+    if (terminated != LOKAN_OK) {
+        return terminated;
+    }
+    if (parser->string_is_key) {
+        parser->key_matched = parser->depth == 1 && parser->array_key &&
+                              strcmp(parser->scratch.data, parser->array_key) == 0;
+        parser->state = LOKAN_JSON_STATE_COLON;
+        return lokan_json_emit(parser, LOKAN_JSON_KEY, parser->scratch.data, parser->scratch.size);
+    }
+    lokan_result_t result = lokan_json_emit(parser, LOKAN_JSON_STRING, parser->scratch.data, parser->scratch.size);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    return lokan_json_value_end(parser, chunk, end, capture_from);
+}
+
+lokan_result_t lokan_json_parser_feed(lokan_json_parser_t *parser, const char *data, size_t len) {
+    if (!parser || (!data && len > 0)) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (parser->state == LOKAN_JSON_STATE_FAILED) {
+        return parser->error;
+    }
+
+    size_t capture_from = 0;
+    lokan_result_t result = LOKAN_OK;
+    size_t i = 0;
+    while (i < len && result == LOKAN_OK) {
+        char c = data[i];
+        parser->offset = parser->consumed + i;
+        switch (parser->state) {
+            case LOKAN_JSON_STATE_VALUE:
+                if (!lokan_json_is_space(c)) {
+                    result = lokan_json_begin_value(parser, data, i, &capture_from);
+                }
+                i++;
+                break;
+            case LOKAN_JSON_STATE_ARRAY_FIRST:
+                if (c == ']') {
+                    result = lokan_json_close(parser, '[');
+                    if (result == LOKAN_OK) {
+                        result = lokan_json_value_end(parser, data, i + 1, &capture_from);
+                    }
+                } else if (!lokan_json_is_space(c)) {
+                    result = lokan_json_begin_value(parser, data, i, &capture_from);
+                }
+                i++;
+                break;
+            case LOKAN_JSON_STATE_OBJECT_FIRST:
+            case LOKAN_JSON_STATE_OBJECT_KEY:
+                if (c == '}' && parser->state == LOKAN_JSON_STATE_OBJECT_FIRST) {
+                    result = lokan_json_close(parser, '{');
+                    if (result == LOKAN_OK) {
+                        result = lokan_json_value_end(parser, data, i + 1, &capture_from);
+                    }
+                } else if (c == '"') {
+                    parser->scratch.size = 0;
+                    parser->string_is_key = 1;
+                    parser->state = LOKAN_JSON_STATE_STRING;
+                } else if (!lokan_json_is_space(c)) {
+                    result = lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+                }
+                i++;
+                break;
+            case LOKAN_JSON_STATE_COLON:
+                if (c == ':') {
+                    parser->state = LOKAN_JSON_STATE_VALUE;
+                } else if (!lokan_json_is_space(c)) {
+                    result = lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+                }
+                i++;
+                break;
+            case LOKAN_JSON_STATE_AFTER_VALUE: {
+                char top = parser->stack[parser->depth - 1];
+                if (c == ',') {
+                    parser->state = top == '{' ? LOKAN_JSON_STATE_OBJECT_KEY : LOKAN_JSON_STATE_VALUE;
+                } else if ((c == '}' && top == '{') || (c == ']' && top == '[')) {
+                    result = lokan_json_close(parser, top);
+                    if (result == LOKAN_OK) {
+                        result = lokan_json_value_end(parser, data, i + 1, &capture_from);
+                    }
+                } else if (!lokan_json_is_space(c)) {
+                    result = lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+                }
+                i++;
+                break;
+            }
+            case LOKAN_JSON_STATE_STRING: {
+                /* Copy the run of plain characters in one go. */
+                size_t start = i;
+                while (i < len && data[i] != '"' && data[i] != '\\' && (unsigned char)data[i] >= 0x20) {
+                    i++;
+                }
+                if (i > start) {
+                    if (parser->pending_surrogate) {
+                        result = lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+                        break;
+                    }
+                    result = lokan_json_scratch_push(parser, data + start, i - start);
+                }
+                if (result != LOKAN_OK || i >= len) {
+                    break;
+                }
+                c = data[i];
+                if (c == '"') {
+                    result = lokan_json_finish_string(parser, data, i + 1, &capture_from);
+                } else if (c == '\\') {
+                    parser->state = LOKAN_JSON_STATE_ESCAPE;
+                } else {
+                    result = lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+                }
+                i++;
+                break;
+            }
+            case LOKAN_JSON_STATE_ESCAPE: {
+                char out = 0;
+                switch (c) {
+                    case '"': out = '"'; break;
+                    case '\\': out = '\\'; break;
+                    case '/': out = '/'; break;
+                    case 'b': out = '\b'; break;
+                    case 'f': out = '\f'; break;
+                    case 'n': out = '\n'; break;
+                    case 'r': out = '\r'; break;
+                    case 't': out = '\t'; break;
+                    case 'u':
+                        parser->unicode_value = 0;
+                        parser->unicode_digits = 0;
+                        parser->state = LOKAN_JSON_STATE_UNICODE;
+                        break;
+                    default:
+                        result = lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+                        break;
+                }
+                if (out) {
+                    if (parser->pending_surrogate) {
+                        result = lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+                    } else {
+                        result = lokan_json_scratch_push(parser, &out, 1);
+                        parser->state = LOKAN_JSON_STATE_STRING;
+                    }
+                }
+                i++;
+                break;
+            }
+            case LOKAN_JSON_STATE_UNICODE: {
+                unsigned int digit;
+                if (c >= '0' && c <= '9') {
+                    digit = (unsigned int)(c - '0');
+                } else if (c >= 'a' && c <= 'f') {
+                    digit = (unsigned int)(c - 'a' + 10);
+                } else if (c >= 'A' && c <= 'F') {
+                    digit = (unsigned int)(c - 'A' + 10);
+                } else {
+                    result = lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+                    break;
+                }
+                parser->unicode_value = (parser->unicode_value << 4) | digit;
+                if (++parser->unicode_digits == 4) {
+                    result = lokan_json_finish_unicode(parser);
+                    parser->state = LOKAN_JSON_STATE_STRING;
+                }
+                i++;
+                break;
+            }
+            case LOKAN_JSON_STATE_NUMBER:
+                if (lokan_json_is_number_char(c)) {
+                    result = lokan_json_scratch_push(parser, &c, 1);
+                    i++;
+                } else {
+                    /* The delimiter is reprocessed in the after-value state. */
+                    result = lokan_json_finish_number(parser);
+                    if (result == LOKAN_OK) {
+                        result = lokan_json_value_end(parser, data, i, &capture_from);
+                    }
+                }
+                break;
+            case LOKAN_JSON_STATE_LITERAL:
+                if (c >= 'a' && c <= 'z') {
+                    result = lokan_json_scratch_push(parser, &c, 1);
+                    i++;
+                } else {
+                    result = lokan_json_finish_literal(parser);
+                    if (result == LOKAN_OK) {
+                        result = lokan_json_value_end(parser, data, i, &capture_from);
+                    }
+                }
+                break;
+            case LOKAN_JSON_STATE_DONE:
+                if (!lokan_json_is_space(c)) {
+                    result = lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+                }
+                i++;
+                break;
+            case LOKAN_JSON_STATE_FAILED:
+                return parser->error;
+        }
+    }
+
+    if (result == LOKAN_OK && parser->capturing) {
+        result = lokan_json_capture(parser, data + capture_from, len - capture_from);
+    }
+    parser->consumed += len;
+    return result;
+}
+
+size_t lokan_json_parser_offset(const lokan_json_parser_t *parser) {
+    return parser->offset;
+}
+
+lokan_result_t lokan_json_parser_finish(lokan_json_parser_t *parser) {
+    if (!parser) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (parser->state == LOKAN_JSON_STATE_FAILED) {
+        return parser->error;
+    }
+    /* A bare top-level scalar has no delimiter to end it; end of input does. */
+    size_t capture_from = 0;
+    lokan_result_t result = LOKAN_OK;
+    if (parser->state == LOKAN_JSON_STATE_NUMBER && parser->depth == 0) {
+        result = lokan_json_finish_number(parser);
+        if (result == LOKAN_OK) {
+            result = lokan_json_value_end(parser, "", 0, &capture_from);
+        }
+    } else if (parser->state == LOKAN_JSON_STATE_LITERAL && parser->depth == 0) {
+        result = lokan_json_finish_literal(parser);
+        if (result == LOKAN_OK) {
+            result = lokan_json_value_end(parser, "", 0, &capture_from);
+        }
+    }
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    if (parser->state != LOKAN_JSON_STATE_DONE) {
+        return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+    }
+    if (parser->config.on_element && parser->target_depth == 0) {
+        /* The requested array never appeared. */
+        return lokan_json_fail(parser, LOKAN_ERROR_PARSE);
+    }
+    return LOKAN_OK;
+}
+
+void lokan_json_parser_reset(lokan_json_parser_t *parser) {
+    if (!parser) {
+        return;
+    }
+    parser->state = LOKAN_JSON_STATE_VALUE;
+    parser->depth = 0;
+    parser->string_is_key = 0;
+    parser->unicode_value = 0;
+    parser->unicode_digits = 0;
+    parser->pending_surrogate = 0;
+    parser->target_depth = 0;
+    parser->key_matched = 0;
+    parser->capturing = 0;
+    parser->error = LOKAN_OK;
+    parser->consumed = 0;
+    parser->offset = 0;
+    lokan_memory_recycle(&parser->scratch);
+    lokan_memory_recycle(&parser->element);
+}
+
+lokan_result_t lokan_json_parser_create_with(
+    lokan_json_parser_t **out_parser,
+    const lokan_json_parser_config_t *config,
+    const lokan_allocator_t *allocator) {
+    if (!out_parser || !config || (!config->on_event && !config->on_element)) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    lokan_json_parser_t *parser = (lokan_json_parser_t *)lokan_calloc(allocator, 1, sizeof(lokan_json_parser_t));
+    if (!parser) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    parser->allocator = allocator;
+    parser->scratch.allocator = allocator;
+    parser->element.allocator = allocator;
+    parser->config = *config;
+    if (parser->config.max_token_bytes == 0) {
+        parser->config.max_token_bytes = LOKAN_JSON_DEFAULT_MAX_TOKEN;
+    }
+    if (parser->config.max_element_bytes == 0) {
+        parser->config.max_element_bytes = LOKAN_JSON_DEFAULT_MAX_ELEMENT;
+    }
+    if (config->array_key) {
+        parser->array_key = lokan_strdup(allocator, config->array_key);
+        if (!parser->array_key) {
+            lokan_free(allocator, parser);
+            return LOKAN_ERROR_ALLOCATION;
+        }
+    }
+    parser->config.array_key = parser->array_key;
+    lokan_json_parser_reset(parser);
+    *out_parser = parser;
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_json_parser_create(lokan_json_parser_t **out_parser, const lokan_json_parser_config_t *config) {
+    return lokan_json_parser_create_with(out_parser, config, lokan_default_allocator());
+}
+
+void lokan_json_parser_destroy(lokan_json_parser_t *parser) {
+    if (!parser) {
+        return;
+    }
+    const lokan_allocator_t *allocator = parser->allocator;
+    lokan_free(allocator, parser->scratch.data);
+    lokan_free(allocator, parser->element.data);
+    lokan_free(allocator, parser->array_key);
+    lokan_free(allocator, parser);
+}
+
+struct lokan_json_sink {
+    CURL *handle;
+    lokan_json_parser_t *parser;
+    int status_checked;
+    int discard;
+    lokan_result_t error;
+};
+
+static size_t lokan_json_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    struct lokan_json_sink *sink = (struct lokan_json_sink *)userp;
+    if (!sink->status_checked) {
+        /* Headers are complete by the first body byte, so the status is final here. */
+        long status = 0;
+        curl_easy_getinfo(sink->handle, CURLINFO_RESPONSE_CODE, &status);
+        sink->discard = status >= 400;
+        sink->status_checked = 1;
+    }
+    if (sink->discard) {
+        return realsize;
+    }
+    lokan_result_t result = lokan_json_parser_feed(sink->parser, (const char *)contents, realsize);
+    if (result != LOKAN_OK) {
+        sink->error = result;
+        return 0;
+    }
+    return realsize;
+}
+
+/*
+ * lokan_request_stream plus the conditional-request plumbing the response
+ * cache needs: an optional extra request header and header capture. A 304 is
+ * reported through out_status without the parser being finished.
+ */
+static lokan_result_t lokan_stream_perform(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    lokan_json_parser_t *parser,
+    const char *extra_header,
+    struct lokan_cache_headers *capture,
+    long *out_status) {
+    lokan_json_parser_reset(parser);
+
+    lokan_result_t result = lokan_rate_limit(client, 1);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    struct curl_slist *headers = NULL;
+    result = lokan_prepare_request(client, client->handle, path, method, body, body_len, 0, NULL, &headers);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    /* The extra header is chained in front of the shared list from this frame, and unset before returning. */
+    struct curl_slist extra = {(char *)extra_header, headers};
+    if (extra_header) {
+        curl_easy_setopt(client->handle, CURLOPT_HTTPHEADER, &extra);
+    }
+    if (capture) {
+        capture->etag[0] = '\0';
+        capture->max_age_ms = -1;
+        capture->no_store = 0;
+        curl_easy_setopt(client->handle, CURLOPT_HEADERFUNCTION, lokan_cache_header_callback);
+        curl_easy_setopt(client->handle, CURLOPT_HEADERDATA, (void *)capture);
+    }
+
+    struct lokan_json_sink sink = {0};
+    sink.handle = client->handle;
+    sink.parser = parser;
+    curl_easy_setopt(client->handle, CURLOPT_WRITEFUNCTION, lokan_json_write_callback);
+    curl_easy_setopt(client->handle, CURLOPT_WRITEDATA, (void *)&sink);
+
+    long status = 0;
+    CURLcode res = curl_easy_perform(client->handle);
+    result = lokan_finish_request(client, client->handle, path, res, &status, &client->last_timing);
+    if (extra_header) {
+        curl_easy_setopt(client->handle, CURLOPT_HTTPHEADER, headers);
+    }
+    if (out_status) {
+        *out_status = status;
+    }
+
+    /* Every other blocking call expects the buffering sink configured once at init. */
+    curl_easy_setopt(client->handle, CURLOPT_WRITEFUNCTION, lokan_write_callback);
+    curl_easy_setopt(client->handle, CURLOPT_WRITEDATA, (void *)&client->response);
+    if (capture) {
+        curl_easy_setopt(client->handle, CURLOPT_HEADERFUNCTION, NULL);
+        curl_easy_setopt(client->handle, CURLOPT_HEADERDATA, NULL);
+    }
+
+    if (res == CURLE_WRITE_ERROR && sink.error != LOKAN_OK) {
+        return sink.error;
+    }
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    if (extra_header && status == 304) {
+        return LOKAN_OK;
+    }
+    return lokan_json_parser_finish(parser);
+}
+
+lokan_result_t lokan_request_stream(
+    lokan_client_t *client,
+    const char *method,
+    const char *path,
+    const char *body,
+    size_t body_len,
+    lokan_json_parser_t *parser,
+    long *out_status) {
+    if (!client || !client->handle || !method || !path || !parser) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    return lokan_stream_perform(client, method, path, body, body_len, parser, NULL, NULL, out_status);
+}
+
+/* Longest base URL, path and array key a cache entry can be keyed by. */
+#define LOKAN_CACHE_KEY_MAX 512
+
+/* Forwards elements to the caller while keeping a copy for the cache. */
+struct lokan_cache_capture {
+    lokan_json_element_cb on_element;
+    void *user_data;
+    struct lokan_memory *elements;
+    size_t limit;
+    int dropped;
+};
+
+static int lokan_cache_capture_element(const char *element, size_t len, void *user_data) {
+    struct lokan_cache_capture *capture = (struct lokan_cache_capture *)user_data;
+    int stop = capture->on_element(element, len, capture->user_data);
+    if (stop || capture->dropped) {
+        return stop;
+    }
+    /* Raw JSON never contains a NUL byte, so NULs can separate elements. */
+    struct lokan_memory *elements = capture->elements;
+    if (elements->size + len + 1 > capture->limit ||
+        lokan_memory_reserve(elements, elements->size + len + 1) != LOKAN_OK) {
+        capture->dropped = 1;
+        return 0;
+    }
+    memcpy(elements->data + elements->size, element, len + 1);
+    elements->size += len + 1;
+    return 0;
+}
+
+static lokan_result_t lokan_cache_replay(const struct lokan_memory *elements, lokan_json_element_cb on_element, void *user_data) {
+    size_t offset = 0;
+    while (offset < elements->size) {
+        const char *element = elements->data + offset;
+        size_t len = strlen(element);
+        if (on_element(element, len, user_data) != 0) {
+            return LOKAN_ERROR_CANCELLED;
+        }
+        offset += len + 1;
+    }
+    return LOKAN_OK;
+}
+
+static lokan_result_t lokan_stream_list_cached(
+    lokan_client_t *client,
+    const char *path,
+    const char *array_key,
+    const char *key,
+    lokan_json_element_cb on_element,
+    void *user_data,
+    long *out_status) {
+    lokan_response_cache_t *cache = client->cache;
+    struct lokan_memory *elements = &client->replay;
+    lokan_memory_recycle(elements);
+
+    char etag[LOKAN_CACHE_ETAG_MAX];
+    lokan_cache_state_t state = lokan_cache_lookup(cache, key, elements, etag);
+    if (state == LOKAN_CACHE_HIT) {
+        if (out_status) {
+            *out_status = 304;
+        }
+        return lokan_cache_replay(elements, on_element, user_data);
+    }
+
+    struct lokan_cache_capture capture = {0};
+    capture.on_element = on_element;
+    capture.user_data = user_data;
+    capture.elements = elements;
+    capture.limit = lokan_cache_entry_limit(cache);
+
+    lokan_json_parser_config_t config = {0};
+    config.on_element = lokan_cache_capture_element;
+    config.array_key = array_key;
+    config.user_data = &capture;
+
+    lokan_arena_mark_t mark = {0, NULL};
+    if (client->arena) {
+        mark = lokan_arena_mark(client->arena);
+    }
+    lokan_json_parser_t *parser = NULL;
+    lokan_result_t result = lokan_json_parser_create_with(&parser, &config, lokan_scratch_allocator(client));
+    /* "If-None-Match: " plus the ETag, which is already bounded. */
+    char condition[LOKAN_CACHE_ETAG_MAX + 16];
+    struct lokan_cache_headers headers;
+    long status = 0;
+    for (int attempt = 0; result == LOKAN_OK && attempt < 2; ++attempt) {
+        const char *extra_header = NULL;
+        if (state == LOKAN_CACHE_STALE) {
+            snprintf(condition, sizeof(condition), "If-None-Match: %s", etag);
+            extra_header = condition;
+        }
+        elements->size = 0;
+        capture.dropped = 0;
+        result = lokan_stream_perform(client, "GET", path, NULL, 0, parser, extra_header, &headers, &status);
+        if (result != LOKAN_OK) {
+            break;
+        }
+        if (extra_header && status == 304) {
+            if (lokan_cache_revalidated(cache, key, &headers, elements)) {
+                result = lokan_cache_replay(elements, on_element, user_data);
+                break;
+            }
+            /* Evicted by another client since the lookup: fetch it in full. */
+            state = LOKAN_CACHE_MISS;
+            continue;
+        }
+        if (!capture.dropped) {
+            lokan_cache_store(cache, key, &headers, elements->data, elements->size);
+        }
+        break;
+    }
+    lokan_json_parser_destroy(parser);
+    if (client->arena) {
+        lokan_arena_release(client->arena, mark);
+    }
+    if (out_status) {
+        *out_status = status;
+    }
+    return result;
+}
+
+lokan_result_t lokan_stream_list(
+    lokan_client_t *client,
+    const char *path,
+    const char *array_key,
+    lokan_json_element_cb on_element,
+    void *user_data,
+    long *out_status) {
+    if (!client || !path || !on_element) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (client->cache) {
+        /* The cache may be shared by clients of different services, so the base URL is part of the key. */
+        char key[LOKAN_CACHE_KEY_MAX];
+        int key_len = snprintf(key, sizeof(key), "%s\n%s\n%s", client->base_url, path, array_key ? array_key : "");
+        if (key_len > 0 && (size_t)key_len < sizeof(key)) {
+            return lokan_stream_list_cached(client, path, array_key, key, on_element, user_data, out_status);
+        }
+    }
+
+    lokan_json_parser_config_t config = {0};
+    config.on_element = on_element;
+    config.array_key = array_key;
+    config.user_data = user_data;
+
+    /* The parser only lives for this call, so it comes from the client's scratch memory. */
+    lokan_arena_mark_t mark = {0, NULL};
+    if (client->arena) {
+        mark = lokan_arena_mark(client->arena);
+    }
+    lokan_json_parser_t *parser = NULL;
+    lokan_result_t result = lokan_json_parser_create_with(&parser, &config, lokan_scratch_allocator(client));
+    if (result == LOKAN_OK) {
+        result = lokan_request_stream(client, "GET", path, NULL, 0, parser, out_status);
+        lokan_json_parser_destroy(parser);
+    }
+    if (client->arena) {
+        lokan_arena_release(client->arena, mark);
+    }
+    return result;
+}
@@ -0,0 +1,336 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <curl/curl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Same bounds as the services' DEFAULT_BUCKETS so client and server quantiles line up. */
+static const double lokan_metrics_bounds[LOKAN_METRICS_BUCKETS] = {0.01, 0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 5.0};
+
+static const char *const lokan_phase_names[LOKAN_PHASE_COUNT] = {"dns", "connect", "tls", "first_byte", "total"};
+
+struct lokan_metrics {
+    pthread_mutex_t mutex;
+    lokan_endpoint_stats_t endpoints[LOKAN_METRICS_MAX_ENDPOINTS];
+    size_t endpoint_count;
+};
+
+lokan_result_t lokan_metrics_create(lokan_metrics_t **out_metrics) {
+    if (!out_metrics) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    lokan_metrics_t *metrics = (lokan_metrics_t *)lokan_calloc(lokan_default_allocator(), 1, sizeof(lokan_metrics_t));
+    if (!metrics) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    pthread_mutex_init(&metrics->mutex, NULL);
+    *out_metrics = metrics;
+    return LOKAN_OK;
+}
+
+void lokan_metrics_destroy(lokan_metrics_t *metrics) {
+    if (!metrics) {
+        return;
+    }
+    pthread_mutex_destroy(&metrics->mutex);
+    lokan_free(lokan_default_allocator(), metrics);
+}
+
+const double *lokan_metrics_bucket_bounds(void) {
+    return lokan_metrics_bounds;
+}
+
+size_t lokan_metrics_route(const char *path, char *out, size_t capacity) {
+    /* Query strings would explode the label set, so routes stop at '?'. */
+    size_t len = strcspn(path, "?");
+    if (len >= capacity) {
+        len = capacity - 1;
+    }
+    memcpy(out, path, len);
+    out[len] = '\0';
+    return len;
+}
+
+static curl_off_t lokan_timing_info(CURL *handle, CURLINFO info) {
+#if LIBCURL_VERSION_NUM >= 0x073d00
+    curl_off_t value = 0;
+    curl_easy_getinfo(handle, info, &value);
+    return value;
+#else
+    double value = 0;
+    curl_easy_getinfo(handle, info, &value);
+    return (curl_off_t)(value * 1000000.0);
+#endif
+}
+
+#if LIBCURL_VERSION_NUM >= 0x073d00
+#define LOKAN_INFO_NAMELOOKUP CURLINFO_NAMELOOKUP_TIME_T
+#define LOKAN_INFO_CONNECT CURLINFO_CONNECT_TIME_T
+#define LOKAN_INFO_APPCONNECT CURLINFO_APPCONNECT_TIME_T
+#define LOKAN_INFO_STARTTRANSFER CURLINFO_STARTTRANSFER_TIME_T
+#define LOKAN_INFO_TOTAL CURLINFO_TOTAL_TIME_T
+#else
+#define LOKAN_INFO_NAMELOOKUP CURLINFO_NAMELOOKUP_TIME
+#define LOKAN_INFO_CONNECT CURLINFO_CONNECT_TIME
+#define LOKAN_INFO_APPCONNECT CURLINFO_APPCONNECT_TIME
+#define LOKAN_INFO_STARTTRANSFER CURLINFO_STARTTRANSFER_TIME
+#define LOKAN_INFO_TOTAL CURLINFO_TOTAL_TIME
+#endif
+
+void lokan_collect_timing(CURL *handle, lokan_request_timing_t *out_timing) {
+    /* libcurl reports cumulative times from the start; phases are the deltas. */
+    curl_off_t namelookup = lokan_timing_info(handle, LOKAN_INFO_NAMELOOKUP);
+    curl_off_t connect = lokan_timing_info(handle, LOKAN_INFO_CONNECT);
+    curl_off_t appconnect = lokan_timing_info(handle, LOKAN_INFO_APPCONNECT);
+    long connects = 0;
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+
+    out_timing->new_connection = connects > 0;
+    out_timing->attempts = 1;
+    out_timing->dns_us = (int64_t)namelookup;
+    out_timing->connect_us = connect > namelookup ? (int64_t)(connect - namelookup) : 0;
+    out_timing->tls_us = appconnect > connect ? (int64_t)(appconnect - connect) : 0;
+    out_timing->first_byte_us = (int64_t)lokan_timing_info(handle, LOKAN_INFO_STARTTRANSFER);
+    out_timing->total_us = (int64_t)lokan_timing_info(handle, LOKAN_INFO_TOTAL);
+}
+
+static void lokan_histogram_observe(lokan_histogram_t *histogram, int64_t micros) {
+    double seconds = (double)micros / 1000000.0;
+    size_t bucket = 0;
+    while (bucket < LOKAN_METRICS_BUCKETS && seconds > lokan_metrics_bounds[bucket]) {
+        bucket++;
+    }
+    histogram->counts[bucket]++;
+    histogram->count++;
+    histogram->sum_seconds += seconds;
+}
+
+static lokan_endpoint_stats_t *lokan_metrics_endpoint(lokan_metrics_t *metrics, const char *path) {
+    size_t len = strcspn(path, "?");
+    if (len >= LOKAN_METRICS_ROUTE_MAX) {
+        len = LOKAN_METRICS_ROUTE_MAX - 1;
+    }
+    if (metrics->endpoint_count == LOKAN_METRICS_MAX_ENDPOINTS) {
+        path = "other";
+        len = strlen(path);
+    }
+    for (size_t i = 0; i < metrics->endpoint_count; ++i) {
+        lokan_endpoint_stats_t *endpoint = &metrics->endpoints[i];
+        if (strncmp(endpoint->route, path, len) == 0 && endpoint->route[len] == '\0') {
+            return endpoint;
+        }
+    }
+    lokan_endpoint_stats_t *endpoint = &metrics->endpoints[metrics->endpoint_count++];
+    if (metrics->endpoint_count == LOKAN_METRICS_MAX_ENDPOINTS) {
+        /* The last slot collects every route seen after the table filled up. */
+        strcpy(endpoint->route, "other");
+    } else {
+        lokan_metrics_route(path, endpoint->route, sizeof(endpoint->route));
+    }
+    return endpoint;
+}
+
+void lokan_metrics_record(lokan_metrics_t *metrics, const char *path, const lokan_request_timing_t *timing, int failed) {
+    pthread_mutex_lock(&metrics->mutex);
+    lokan_endpoint_stats_t *endpoint = lokan_metrics_endpoint(metrics, path);
+    endpoint->requests++;
+    if (failed) {
+        endpoint->errors++;
+    }
+    /* Reused connections skip DNS, connect and TLS; recording zeros would mask real handshakes. */
+    if (timing->new_connection) {
+        lokan_histogram_observe(&endpoint->phases[LOKAN_PHASE_DNS], timing->dns_us);
+        lokan_histogram_observe(&endpoint->phases[LOKAN_PHASE_CONNECT], timing->connect_us);
+        lokan_histogram_observe(&endpoint->phases[LOKAN_PHASE_TLS], timing->tls_us);
+    }
+    if (timing->first_byte_us > 0) {
+        lokan_histogram_observe(&endpoint->phases[LOKAN_PHASE_FIRST_BYTE], timing->first_byte_us);
+    }
+    lokan_histogram_observe(&endpoint->phases[LOKAN_PHASE_TOTAL], timing->total_us);
+    pthread_mutex_unlock(&metrics->mutex);
+}
+
+double lokan_metrics_quantile(lokan_metrics_t *metrics, const char *path, double q, uint64_t min_count) {
+    double value = -1;
+    size_t len = strcspn(path, "?");
+    pthread_mutex_lock(&metrics->mutex);
+    for (size_t i = 0; i < metrics->endpoint_count; ++i) {
+        const lokan_endpoint_stats_t *endpoint = &metrics->endpoints[i];
+        if (strncmp(endpoint->route, path, len) != 0 || endpoint->route[len] != '\0') {
+            continue;
+        }
+        const lokan_histogram_t *histogram = &endpoint->phases[LOKAN_PHASE_TOTAL];
+        if (histogram->count < min_count || histogram->count == 0) {
+            break;
+        }
+        double rank = q * (double)histogram->count;
+        uint64_t below = 0;
+        size_t bucket = 0;
+        while (bucket < LOKAN_METRICS_BUCKETS && (double)(below + histogram->counts[bucket]) < rank) {
+            below += histogram->counts[bucket];
+            bucket++;
+        }
+        if (bucket == LOKAN_METRICS_BUCKETS) {
+            /* Like histogram_quantile, a rank in the +Inf bucket reports the highest finite bound. */
+            value = lokan_metrics_bounds[LOKAN_METRICS_BUCKETS - 1];
+        } else {
+            double lower = bucket > 0 ? lokan_metrics_bounds[bucket - 1] : 0.0;
+            double upper = lokan_metrics_bounds[bucket];
+            double in_bucket = (double)histogram->counts[bucket];
+            value = lower + (upper - lower) * (in_bucket > 0 ? (rank - (double)below) / in_bucket : 1.0);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&metrics->mutex);
+    return value;
+}
+
+size_t lokan_metrics_snapshot(lokan_metrics_t *metrics, lokan_endpoint_stats_t *out_endpoints, size_t capacity) {
+    if (!metrics) {
+        return 0;
+    }
+    pthread_mutex_lock(&metrics->mutex);
+    size_t count = metrics->endpoint_count;
+    size_t copied = count < capacity ? count : capacity;
+    if (out_endpoints && copied > 0) {
+        memcpy(out_endpoints, metrics->endpoints, copied * sizeof(lokan_endpoint_stats_t));
+    }
+    pthread_mutex_unlock(&metrics->mutex);
+    return count;
+}
+
+void lokan_metrics_reset(lokan_metrics_t *metrics) {
+    if (!metrics) {
+        return;
+    }
+    pthread_mutex_lock(&metrics->mutex);
+    memset(metrics->endpoints, 0, sizeof(metrics->endpoints));
+    metrics->endpoint_count = 0;
+    pthread_mutex_unlock(&metrics->mutex);
+}
+
+/* Appends to a bounded buffer, tracking the length the full output would need. */
+struct lokan_text {
+    char *data;
+    size_t capacity;
+    size_t length;
+};
+
+static void lokan_text_append(struct lokan_text *text, const char *format, ...) {
+    size_t available = text->length < text->capacity ? text->capacity - text->length : 0;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(available > 0 ? text->data + text->length : NULL, available, format, args);
+    va_end(args);
+    if (written > 0) {
+        text->length += (size_t)written;
+    }
+}
+
+/* Matches the services' format_float: six decimals with trailing zeros trimmed. */
+static const char *lokan_format_float(double value, char *out, size_t capacity) {
+    snprintf(out, capacity, "%.6f", value);
+    size_t len = strlen(out);
+    while (len > 0 && out[len - 1] == '0') {
+        out[--len] = '\0';
+    }
+    if (len > 0 && out[len - 1] == '.') {
+        out[len++] = '0';
+        out[len] = '\0';
+    }
+    if (strcmp(out, "-0.0") == 0) {
+        snprintf(out, capacity, "0.0");
+    }
+    return out;
+}
+
+static const char *lokan_escape_label(const char *value, char *out, size_t capacity) {
+    size_t len = 0;
+    for (; *value && len + 3 < capacity; ++value) {
+        if (*value == '\\' || *value == '"') {
+            out[len++] = '\\';
+            out[len++] = *value;
+        } else if (*value == '\n') {
+            out[len++] = '\\';
+            out[len++] = 'n';
+        } else {
+            out[len++] = *value;
+        }
+    }
+    out[len] = '\0';
+    return out;
+}
+
+lokan_result_t lokan_metrics_dump_prometheus(
+    lokan_metrics_t *metrics,
+    char *buffer,
+    size_t capacity,
+    size_t *out_len) {
+    if (!metrics || (!buffer && capacity > 0)) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    struct lokan_text text = {buffer, capacity, 0};
+    char route[LOKAN_METRICS_ROUTE_MAX * 2];
+    char number[64];
+
+    pthread_mutex_lock(&metrics->mutex);
+
+    lokan_text_append(&text, "# HELP lokan_client_requests_total Requests issued by the C SDK\n");
+    lokan_text_append(&text, "# TYPE lokan_client_requests_total counter\n");
+    for (size_t i = 0; i < metrics->endpoint_count; ++i) {
+        const lokan_endpoint_stats_t *endpoint = &metrics->endpoints[i];
+        lokan_text_append(&text, "lokan_client_requests_total{route=\"%s\"} %llu\n",
+                          lokan_escape_label(endpoint->route, route, sizeof(route)),
+                          (unsigned long long)endpoint->requests);
+    }
+
+    lokan_text_append(&text, "# HELP lokan_client_request_errors_total Requests that failed or returned an error status\n");
+    lokan_text_append(&text, "# TYPE lokan_client_request_errors_total counter\n");
+    for (size_t i = 0; i < metrics->endpoint_count; ++i) {
+        const lokan_endpoint_stats_t *endpoint = &metrics->endpoints[i];
+        lokan_text_append(&text, "lokan_client_request_errors_total{route=\"%s\"} %llu\n",
+                          lokan_escape_label(endpoint->route, route, sizeof(route)),
+                          (unsigned long long)endpoint->errors);
+    }
+
+    lokan_text_append(&text, "# HELP lokan_client_request_duration_seconds Client-side request latency by phase\n");
+    lokan_text_append(&text, "# TYPE lokan_client_request_duration_seconds histogram\n");
+    for (size_t i = 0; i < metrics->endpoint_count; ++i) {
+        const lokan_endpoint_stats_t *endpoint = &metrics->endpoints[i];
+        lokan_escape_label(endpoint->route, route, sizeof(route));
+        for (int phase = 0; phase < LOKAN_PHASE_COUNT; ++phase) {
+            const lokan_histogram_t *histogram = &endpoint->phases[phase];
+            const char *name = lokan_phase_names[phase];
+            uint64_t cumulative = 0;
+            for (size_t bucket = 0; bucket < LOKAN_METRICS_BUCKETS; ++bucket) {
+                cumulative += histogram->counts[bucket];
+                lokan_text_append(&text,
+                                  "lokan_client_request_duration_seconds_bucket{route=\"%s\",phase=\"%s\",le=\"%s\"} %llu\n",
+                                  route, name,
+                                  lokan_format_float(lokan_metrics_bounds[bucket], number, sizeof(number)),
+                                  (unsigned long long)cumulative);
+            }
+            lokan_text_append(&text,
+                              "lokan_client_request_duration_seconds_bucket{route=\"%s\",phase=\"%s\",le=\"+Inf\"} %llu\n",
+                              route, name, (unsigned long long)histogram->count);
+            lokan_text_append(&text, "lokan_client_request_duration_seconds_sum{route=\"%s\",phase=\"%s\"} %s\n",
+                              route, name, lokan_format_float(histogram->sum_seconds, number, sizeof(number)));
+            lokan_text_append(&text, "lokan_client_request_duration_seconds_count{route=\"%s\",phase=\"%s\"} %llu\n",
+                              route, name, (unsigned long long)histogram->count);
+        }
+    }
+
+    pthread_mutex_unlock(&metrics->mutex);
+
+    if (out_len) {
+        *out_len = text.length;
+    }
+    if (text.length >= capacity) {
+        return LOKAN_ERROR_OVERFLOW;
+    }
+    return LOKAN_OK;
+}
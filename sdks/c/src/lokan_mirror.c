@@ -0,0 +1,524 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Changes requested per call; the registry's largest page. */
+#define LOKAN_MIRROR_PAGE 1000
+#define LOKAN_MIRROR_MIN_SLOTS 16
+/* Records are compacted once garbage passes half of them and this many bytes. */
+#define LOKAN_MIRROR_COMPACT_MIN 4096
+
+/* Attributes of a device, stored in this order as consecutive NUL-terminated strings. */
+enum {
+    LOKAN_MIRROR_ID,
+    LOKAN_MIRROR_NAME,
+    LOKAN_MIRROR_ROOM_ID,
+    LOKAN_MIRROR_KIND,
+    LOKAN_MIRROR_STATUS,
+    LOKAN_MIRROR_STATE,
+    LOKAN_MIRROR_FIELDS
+};
+
+/* 32 bytes: a device's attributes live at offset in records, so entries stay small and dense. */
+struct lokan_mirror_entry {
+    uint32_t offset;
+    uint32_t len[LOKAN_MIRROR_FIELDS];
+    uint32_t hash;
+};
+
+/* Open-addressing index slot; entry is the entry's index plus one, 0 when the slot is empty. */
+struct lokan_mirror_slot {
+    uint32_t hash;
+    uint32_t entry;
+};
+
+/*
+ * Devices sit in one flat entry array, densely packed so iteration walks
+ * memory in order; a deleted device is swapped with the last one. The index
+ * maps id hashes to entries with linear probing at a load of at most one half,
+ * and deletes shift later slots back rather than leaving tombstones, so
+ * lookups stay short however much the fleet churns.
+ */
+struct lokan_device_mirror {
+    struct lokan_mirror_entry *entries;
+    size_t count;
+    size_t capacity;
+    struct lokan_mirror_slot *slots;
+    /* Power of two. */
+    size_t slot_count;
+    struct lokan_memory records;
+    /* Bytes of records no entry refers to any more. */
+    size_t garbage;
+    int64_t sequence;
+
+    lokan_json_parser_t *parser;
+    struct lokan_decoder *decoder;
+    struct lokan_memory strings;
+    /* State of the page being parsed. */
+    int64_t page_sequence;
+    int page_more;
+    int page_key;
+    size_t applied;
+    lokan_result_t error;
+};
+
+enum { LOKAN_MIRROR_KEY_OTHER, LOKAN_MIRROR_KEY_LATEST_SEQ, LOKAN_MIRROR_KEY_HAS_MORE };
+
+/* One element of "changes". */
+struct lokan_mirror_change {
+    uint32_t present;
+    int64_t seq;
+    int deleted;
+    lokan_view_t attributes[LOKAN_MIRROR_FIELDS];
+};
+
+#define LOKAN_MIRROR_HAS_SEQ (1u << 0)
+#define LOKAN_MIRROR_HAS_DELETED (1u << 1)
+#define LOKAN_MIRROR_HAS_ID (1u << 2)
+#define LOKAN_MIRROR_HAS_NAME (1u << 3)
+#define LOKAN_MIRROR_HAS_ROOM_ID (1u << 4)
+#define LOKAN_MIRROR_HAS_KIND (1u << 5)
+#define LOKAN_MIRROR_HAS_STATUS (1u << 6)
+#define LOKAN_MIRROR_HAS_STATE (1u << 7)
+
+#define LOKAN_MIRROR_ATTRIBUTE(index) \
+    (offsetof(struct lokan_mirror_change, attributes) + (index) * sizeof(lokan_view_t))
+
+static const struct lokan_field lokan_mirror_change_fields[] = {
+    {"seq", 3, LOKAN_FIELD_INT64, offsetof(struct lokan_mirror_change, seq), LOKAN_MIRROR_HAS_SEQ},
+    {"deleted", 7, LOKAN_FIELD_BOOL, offsetof(struct lokan_mirror_change, deleted), LOKAN_MIRROR_HAS_DELETED},
+    {"id", 2, LOKAN_FIELD_STRING, LOKAN_MIRROR_ATTRIBUTE(LOKAN_MIRROR_ID), LOKAN_MIRROR_HAS_ID},
+    {"device.name", 11, LOKAN_FIELD_STRING, LOKAN_MIRROR_ATTRIBUTE(LOKAN_MIRROR_NAME), LOKAN_MIRROR_HAS_NAME},
+    {"device.room_id", 14, LOKAN_FIELD_STRING, LOKAN_MIRROR_ATTRIBUTE(LOKAN_MIRROR_ROOM_ID), LOKAN_MIRROR_HAS_ROOM_ID},
+    {"device.kind", 11, LOKAN_FIELD_STRING, LOKAN_MIRROR_ATTRIBUTE(LOKAN_MIRROR_KIND), LOKAN_MIRROR_HAS_KIND},
+    {"device.status", 13, LOKAN_FIELD_STRING, LOKAN_MIRROR_ATTRIBUTE(LOKAN_MIRROR_STATUS), LOKAN_MIRROR_HAS_STATUS},
+    {"device.state", 12, LOKAN_FIELD_RAW, LOKAN_MIRROR_ATTRIBUTE(LOKAN_MIRROR_STATE), LOKAN_MIRROR_HAS_STATE},
+};
+
+static const struct lokan_schema lokan_mirror_change_schema = {
+    lokan_mirror_change_fields,
+    sizeof(lokan_mirror_change_fields) / sizeof(lokan_mirror_change_fields[0]),
+    sizeof(struct lokan_mirror_change),
+    offsetof(struct lokan_mirror_change, present),
+    LOKAN_MIRROR_HAS_SEQ | LOKAN_MIRROR_HAS_DELETED | LOKAN_MIRROR_HAS_ID};
+
+/* Members a change to a device that still exists must carry. */
+#define LOKAN_MIRROR_DEVICE_REQUIRED (LOKAN_MIRROR_HAS_NAME | LOKAN_MIRROR_HAS_KIND | LOKAN_MIRROR_HAS_STATUS)
+
+/* FNV-1a, 32-bit: the index keeps hashes of that width. */
+static uint32_t lokan_mirror_hash(const char *id, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)id[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t lokan_mirror_footprint(const struct lokan_mirror_entry *entry) {
+    size_t bytes = LOKAN_MIRROR_FIELDS;
+    for (int i = 0; i < LOKAN_MIRROR_FIELDS; ++i) {
+        bytes += entry->len[i];
+    }
+    return bytes;
+}
+
+/*
+ * Slot holding id, or the empty slot ending its probe sequence; *out_index is
+ * the entry's index, or SIZE_MAX when id is not mirrored.
+ */
+static size_t lokan_mirror_probe(
+    const lokan_device_mirror_t *mirror,
+    const char *id,
+    size_t len,
+    uint32_t hash,
+    size_t *out_index) {
+    size_t mask = mirror->slot_count - 1;
+    size_t slot = hash & mask;
+    for (;;) {
+        const struct lokan_mirror_slot *candidate = &mirror->slots[slot];
+        if (candidate->entry == 0) {
+            *out_index = SIZE_MAX;
+            return slot;
+        }
+        if (candidate->hash == hash) {
+            const struct lokan_mirror_entry *entry = &mirror->entries[candidate->entry - 1];
+            if (entry->len[LOKAN_MIRROR_ID] == len && memcmp(mirror->records.data + entry->offset, id, len) == 0) {
+                *out_index = candidate->entry - 1;
+                return slot;
+            }
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/* Doubles the index and reinserts every entry. */
+static lokan_result_t lokan_mirror_grow_index(lokan_device_mirror_t *mirror) {
+    size_t slot_count = mirror->slot_count > 0 ? mirror->slot_count * 2 : LOKAN_MIRROR_MIN_SLOTS;
+    struct lokan_mirror_slot *slots =
+        (struct lokan_mirror_slot *)lokan_calloc(lokan_default_allocator(), slot_count, sizeof(struct lokan_mirror_slot));
+    if (!slots) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    size_t mask = slot_count - 1;
+    for (size_t i = 0; i < mirror->count; ++i) {
+        size_t slot = mirror->entries[i].hash & mask;
+        while (slots[slot].entry != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot].hash = mirror->entries[i].hash;
+        slots[slot].entry = (uint32_t)(i + 1);
+    }
+    lokan_free(lokan_default_allocator(), mirror->slots);
+    mirror->slots = slots;
+    mirror->slot_count = slot_count;
+    return LOKAN_OK;
+}
+
+/* Empties slot and shifts back the slots after it that probed past it. */
+static void lokan_mirror_unslot(lokan_device_mirror_t *mirror, size_t slot) {
+    size_t mask = mirror->slot_count - 1;
+    size_t hole = slot;
+    size_t next = slot;
+    for (;;) {
+        next = (next + 1) & mask;
+        if (mirror->slots[next].entry == 0) {
+            break;
+        }
+        size_t home = mirror->slots[next].hash & mask;
+        /* The slot may fill the hole unless its home lies after the hole. */
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            mirror->slots[hole] = mirror->slots[next];
+            hole = next;
+        }
+    }
+    mirror->slots[hole].entry = 0;
+    mirror->slots[hole].hash = 0;
+}
+
+static void lokan_mirror_remove(lokan_device_mirror_t *mirror, size_t index, size_t slot) {
+    mirror->garbage += lokan_mirror_footprint(&mirror->entries[index]);
+    lokan_mirror_unslot(mirror, slot);
+    size_t last = mirror->count - 1;
+    if (index != last) {
+        mirror->entries[index] = mirror->entries[last];
+        size_t mask = mirror->slot_count - 1;
+        size_t moved = mirror->entries[index].hash & mask;
+        while (mirror->slots[moved].entry != last + 1) {
+            moved = (moved + 1) & mask;
+        }
+        mirror->slots[moved].entry = (uint32_t)(index + 1);
+    }
+    mirror->count--;
+}
+
+/* Appends a device's attributes to records and points entry at them. */
+static lokan_result_t lokan_mirror_store(
+    lokan_device_mirror_t *mirror,
+    struct lokan_mirror_entry *entry,
+    const struct lokan_mirror_change *change) {
+    size_t bytes = LOKAN_MIRROR_FIELDS;
+    for (int i = 0; i < LOKAN_MIRROR_FIELDS; ++i) {
+        bytes += change->attributes[i].size;
+    }
+    struct lokan_memory *records = &mirror->records;
+    if (records->size + bytes > UINT32_MAX) {
+        return LOKAN_ERROR_OVERFLOW;
+    }
+    if (lokan_memory_reserve(records, records->size + bytes) != LOKAN_OK) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    entry->offset = (uint32_t)records->size;
+    char *out = records->data + records->size;
+    for (int i = 0; i < LOKAN_MIRROR_FIELDS; ++i) {
+        size_t len = change->attributes[i].size;
+        if (len > 0) {
+            memcpy(out, change->attributes[i].data, len);
+        }
+        out[len] = '\0';
+        out += len + 1;
+        entry->len[i] = (uint32_t)len;
+    }
+    records->size += bytes;
+    return LOKAN_OK;
+}
+
+static lokan_result_t lokan_mirror_apply(lokan_device_mirror_t *mirror, const struct lokan_mirror_change *change) {
+    const lokan_view_t *id = &change->attributes[LOKAN_MIRROR_ID];
+    uint32_t hash = lokan_mirror_hash(id->data, id->size);
+    size_t index = SIZE_MAX;
+    size_t slot = 0;
+    if (mirror->slot_count > 0) {
+        slot = lokan_mirror_probe(mirror, id->data, id->size, hash, &index);
+    }
+    if (change->deleted) {
+        if (index != SIZE_MAX) {
+            lokan_mirror_remove(mirror, index, slot);
+        }
+        return LOKAN_OK;
+    }
+    if ((change->present & LOKAN_MIRROR_DEVICE_REQUIRED) != LOKAN_MIRROR_DEVICE_REQUIRED) {
+        return LOKAN_ERROR_PARSE;
+    }
+    if (index != SIZE_MAX) {
+        /* The old attributes stay behind as garbage until the next compaction. */
+        struct lokan_mirror_entry *entry = &mirror->entries[index];
+        size_t footprint = lokan_mirror_footprint(entry);
+        lokan_result_t result = lokan_mirror_store(mirror, entry, change);
+        if (result == LOKAN_OK) {
+            mirror->garbage += footprint;
+        }
+        return result;
+    }
+
+    if (mirror->count >= UINT32_MAX - 1) {
+        return LOKAN_ERROR_OVERFLOW;
+    }
+    if ((mirror->count + 1) * 2 > mirror->slot_count) {
+        if (lokan_mirror_grow_index(mirror) != LOKAN_OK) {
+            return LOKAN_ERROR_ALLOCATION;
+        }
+        slot = lokan_mirror_probe(mirror, id->data, id->size, hash, &index);
+    }
+    if (mirror->count == mirror->capacity) {
+        size_t capacity = mirror->capacity > 0 ? mirror->capacity * 2 : LOKAN_MIRROR_MIN_SLOTS;
+        struct lokan_mirror_entry *entries = (struct lokan_mirror_entry *)lokan_realloc(
+            lokan_default_allocator(), mirror->entries, capacity * sizeof(struct lokan_mirror_entry));
+        if (!entries) {
+            return LOKAN_ERROR_ALLOCATION;
+        }
+        mirror->entries = entries;
+        mirror->capacity = capacity;
+    }
+    struct lokan_mirror_entry *entry = &mirror->entries[mirror->count];
+    lokan_result_t result = lokan_mirror_store(mirror, entry, change);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    entry->hash = hash;
+    mirror->slots[slot].hash = hash;
+    mirror->slots[slot].entry = (uint32_t)(mirror->count + 1);
+    mirror->count++;
+    return LOKAN_OK;
+}
+
+/* Rewrites records without the garbage, in entry order. */
+static void lokan_mirror_compact(lokan_device_mirror_t *mirror) {
+    struct lokan_memory compacted = {0};
+    if (lokan_memory_reserve(&compacted, mirror->records.size - mirror->garbage) != LOKAN_OK) {
+        /* Keeps the garbage; the next sync tries again. */
+        return;
+    }
+    for (size_t i = 0; i < mirror->count; ++i) {
+        struct lokan_mirror_entry *entry = &mirror->entries[i];
+        size_t bytes = lokan_mirror_footprint(entry);
+        memcpy(compacted.data + compacted.size, mirror->records.data + entry->offset, bytes);
+        entry->offset = (uint32_t)compacted.size;
+        compacted.size += bytes;
+    }
+    lokan_free(lokan_default_allocator(), mirror->records.data);
+    mirror->records = compacted;
+    mirror->garbage = 0;
+}
+
+static int lokan_mirror_element(const char *element, size_t len, void *user_data) {
+    lokan_device_mirror_t *mirror = (lokan_device_mirror_t *)user_data;
+    struct lokan_mirror_change change;
+    lokan_memory_recycle(&mirror->strings);
+    lokan_result_t result =
+        lokan_decoder_run(mirror->decoder, &lokan_mirror_change_schema, element, len, &change, &mirror->strings);
+    if (result == LOKAN_OK) {
+        result = lokan_mirror_apply(mirror, &change);
+    }
+    if (result != LOKAN_OK) {
+        mirror->error = result;
+        return 1;
+    }
+    mirror->applied++;
+    return 0;
+}
+
+static int lokan_mirror_event(lokan_json_event_t event, const char *text, size_t len, size_t depth, void *user_data) {
+    lokan_device_mirror_t *mirror = (lokan_device_mirror_t *)user_data;
+    if (depth != 1) {
+        return 0;
+    }
+    switch (event) {
+        case LOKAN_JSON_KEY:
+            if (len == sizeof("latestSeq") - 1 && memcmp(text, "latestSeq", len) == 0) {
+                mirror->page_key = LOKAN_MIRROR_KEY_LATEST_SEQ;
+            } else if (len == sizeof("hasMore") - 1 && memcmp(text, "hasMore", len) == 0) {
+                mirror->page_key = LOKAN_MIRROR_KEY_HAS_MORE;
+            } else {
+                mirror->page_key = LOKAN_MIRROR_KEY_OTHER;
+            }
+            break;
+        case LOKAN_JSON_NUMBER:
+            if (mirror->page_key == LOKAN_MIRROR_KEY_LATEST_SEQ) {
+                /* The parser NUL-terminates every token. */
+                char *end = NULL;
+                long long value = strtoll(text, &end, 10);
+                if (end != text + len || value < 0) {
+                    mirror->error = LOKAN_ERROR_PARSE;
+                    return 1;
+                }
+                mirror->page_sequence = (int64_t)value;
+            }
+            break;
+        case LOKAN_JSON_TRUE:
+            mirror->page_more = mirror->page_key == LOKAN_MIRROR_KEY_HAS_MORE ? 1 : mirror->page_more;
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+lokan_result_t lokan_device_mirror_create(lokan_device_mirror_t **out_mirror) {
+    if (!out_mirror) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    const lokan_allocator_t *allocator = lokan_default_allocator();
+    lokan_device_mirror_t *mirror = (lokan_device_mirror_t *)lokan_calloc(allocator, 1, sizeof(lokan_device_mirror_t));
+    if (!mirror) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    lokan_json_parser_config_t config = {0};
+    config.on_event = lokan_mirror_event;
+    config.on_element = lokan_mirror_element;
+    config.array_key = "changes";
+    config.user_data = mirror;
+    if (lokan_json_parser_create_with(&mirror->parser, &config, allocator) != LOKAN_OK ||
+        lokan_decoder_create(&mirror->decoder, allocator) != LOKAN_OK) {
+        lokan_device_mirror_destroy(mirror);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    *out_mirror = mirror;
+    return LOKAN_OK;
+}
+
+void lokan_device_mirror_destroy(lokan_device_mirror_t *mirror) {
+    if (!mirror) {
+        return;
+    }
+    const lokan_allocator_t *allocator = lokan_default_allocator();
+    lokan_json_parser_destroy(mirror->parser);
+    lokan_decoder_destroy(mirror->decoder);
+    lokan_free(allocator, mirror->strings.data);
+    lokan_free(allocator, mirror->records.data);
+    lokan_free(allocator, mirror->slots);
+    lokan_free(allocator, mirror->entries);
+    lokan_free(allocator, mirror);
+}
+
+static void lokan_mirror_clear(lokan_device_mirror_t *mirror) {
+    mirror->count = 0;
+    if (mirror->slots) {
+        memset(mirror->slots, 0, mirror->slot_count * sizeof(struct lokan_mirror_slot));
+    }
+    lokan_memory_recycle(&mirror->records);
+    mirror->garbage = 0;
+    mirror->sequence = 0;
+}
+
+lokan_result_t lokan_device_mirror_sync(lokan_device_mirror_t *mirror, lokan_client_t *client, size_t *out_applied) {
+    if (!mirror || !client) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    mirror->applied = 0;
+    int resynced = 0;
+    lokan_result_t result = LOKAN_OK;
+    for (;;) {
+        char path[96];
+        snprintf(path, sizeof(path), "/devices/changes?since=%lld&limit=%d", (long long)mirror->sequence,
+                 LOKAN_MIRROR_PAGE);
+        mirror->page_sequence = -1;
+        mirror->page_more = 0;
+        mirror->page_key = LOKAN_MIRROR_KEY_OTHER;
+        mirror->error = LOKAN_OK;
+
+        long status = 0;
+        result = lokan_request_stream(client, "GET", path, NULL, 0, mirror->parser, &status);
+        if (mirror->error != LOKAN_OK) {
+            result = mirror->error;
+        }
+        if (result == LOKAN_ERROR_HTTP && status == 410 && !resynced) {
+            /* The registry's log restarted behind us; start over from an empty mirror. */
+            lokan_mirror_clear(mirror);
+            resynced = 1;
+            continue;
+        }
+        if (result != LOKAN_OK) {
+            break;
+        }
+        /*
+         * The sequence only moves once a whole page applied. Re-applying a
+         * change is harmless, so a page that failed halfway is simply
+         * requested again by the next sync.
+         */
+        if (mirror->page_sequence < mirror->sequence || (mirror->page_more && mirror->page_sequence == mirror->sequence)) {
+            result = LOKAN_ERROR_PARSE;
+            break;
+        }
+        mirror->sequence = mirror->page_sequence;
+        if (!mirror->page_more) {
+            break;
+        }
+    }
+
+    if (mirror->garbage > LOKAN_MIRROR_COMPACT_MIN && mirror->garbage > mirror->records.size / 2) {
+        lokan_mirror_compact(mirror);
+    }
+    if (out_applied) {
+        *out_applied = mirror->applied;
+    }
+    return result;
+}
+
+static void lokan_mirror_view(const lokan_device_mirror_t *mirror, size_t index, lokan_mirrored_device_t *out) {
+    const struct lokan_mirror_entry *entry = &mirror->entries[index];
+    lokan_view_t *views[LOKAN_MIRROR_FIELDS] = {&out->id, &out->name, &out->room_id, &out->kind, &out->status, &out->state};
+    const char *data = mirror->records.data + entry->offset;
+    for (int i = 0; i < LOKAN_MIRROR_FIELDS; ++i) {
+        views[i]->data = data;
+        views[i]->size = entry->len[i];
+        data += entry->len[i] + 1;
+    }
+}
+
+int lokan_device_mirror_find(const lokan_device_mirror_t *mirror, const char *id, lokan_mirrored_device_t *out_device) {
+    if (!mirror || !id || mirror->count == 0) {
+        return 0;
+    }
+    size_t len = strlen(id);
+    size_t index = SIZE_MAX;
+    lokan_mirror_probe(mirror, id, len, lokan_mirror_hash(id, len), &index);
+    if (index == SIZE_MAX) {
+        return 0;
+    }
+    if (out_device) {
+        lokan_mirror_view(mirror, index, out_device);
+    }
+    return 1;
+}
+
+size_t lokan_device_mirror_count(const lokan_device_mirror_t *mirror) {
+    return mirror ? mirror->count : 0;
+}
+
+int lokan_device_mirror_at(const lokan_device_mirror_t *mirror, size_t index, lokan_mirrored_device_t *out_device) {
+    if (!mirror || !out_device || index >= mirror->count) {
+        return 0;
+    }
+    lokan_mirror_view(mirror, index, out_device);
+    return 1;
+}
+
+int64_t lokan_device_mirror_sequence(const lokan_device_mirror_t *mirror) {
+    return mirror ? mirror->sequence : 0;
+}
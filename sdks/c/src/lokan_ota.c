@@ -0,0 +1,847 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <curl/curl.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOKAN_OTA_DEFAULT_CHUNK_BYTES ((size_t)4 * 1024 * 1024)
+#define LOKAN_OTA_DEFAULT_PARALLEL 4
+#define LOKAN_OTA_PARALLEL_MAX 16
+#define LOKAN_OTA_DEFAULT_ATTEMPTS 3
+#define LOKAN_OTA_PATH_MAX 1024
+#define LOKAN_OTA_STATE_SUFFIX ".lokan-ota"
+#define LOKAN_OTA_STATE_MAGIC "LOKOTA01"
+#define LOKAN_OTA_CHECKSUMS "/sig/sha256sum"
+#define LOKAN_OTA_SIGNATURE "/sig/signature.pem"
+#define LOKAN_OTA_SIGNATURE_BEGIN "-----BEGIN ED25519 SIGNATURE-----"
+#define LOKAN_OTA_SIGNATURE_END "-----END ED25519 SIGNATURE-----"
+#define LOKAN_OTA_SIGNATURE_BYTES 64
+#define LOKAN_OTA_DIGEST_BYTES 32
+
+/*
+ * SHA-256 kept here rather than taken from libcrypto because its running
+ * state is written to the state file: a resumed download carries on hashing
+ * instead of reading back everything already on the target.
+ */
+struct lokan_sha256 {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    uint32_t used;
+    uint32_t reserved;
+};
+
+static const uint32_t lokan_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define LOKAN_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void lokan_sha256_compress(uint32_t state[8], const unsigned char *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 |
+               (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; ++i) {
+        uint32_t s0 = LOKAN_ROTR(w[i - 15], 7) ^ LOKAN_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = LOKAN_ROTR(w[i - 2], 17) ^ LOKAN_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t t1 = h + (LOKAN_ROTR(e, 6) ^ LOKAN_ROTR(e, 11) ^ LOKAN_ROTR(e, 25)) + ((e & f) ^ (~e & g)) +
+                      lokan_sha256_k[i] + w[i];
+        uint32_t t2 = (LOKAN_ROTR(a, 2) ^ LOKAN_ROTR(a, 13) ^ LOKAN_ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static void lokan_sha256_init(struct lokan_sha256 *hash) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memset(hash, 0, sizeof(*hash));
+    memcpy(hash->state, initial, sizeof(initial));
+}
+
+static void lokan_sha256_update(struct lokan_sha256 *hash, const unsigned char *data, size_t len) {
+    hash->length += len;
+    if (hash->used > 0) {
+        size_t take = sizeof(hash->block) - hash->used < len ? sizeof(hash->block) - hash->used : len;
+        memcpy(hash->block + hash->used, data, take);
+        hash->used += (uint32_t)take;
+        data += take;
+        len -= take;
+        if (hash->used < sizeof(hash->block)) {
+            return;
+        }
+        lokan_sha256_compress(hash->state, hash->block);
+        hash->used = 0;
+    }
+    /* Whole blocks are hashed where they lie, straight out of the target's mapping. */
+    for (; len >= sizeof(hash->block); data += sizeof(hash->block), len -= sizeof(hash->block)) {
+        lokan_sha256_compress(hash->state, data);
+    }
+    memcpy(hash->block, data, len);
+    hash->used = (uint32_t)len;
+}
+
+static void lokan_sha256_final(struct lokan_sha256 hash, unsigned char out[LOKAN_OTA_DIGEST_BYTES]) {
+    uint64_t bits = hash.length * 8;
+    hash.block[hash.used++] = 0x80;
+    if (hash.used > sizeof(hash.block) - 8) {
+        memset(hash.block + hash.used, 0, sizeof(hash.block) - hash.used);
+        lokan_sha256_compress(hash.state, hash.block);
+        hash.used = 0;
+    }
+    memset(hash.block + hash.used, 0, sizeof(hash.block) - 8 - hash.used);
+    for (int i = 0; i < 8; ++i) {
+        hash.block[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    lokan_sha256_compress(hash.state, hash.block);
+    for (int i = 0; i < 8; ++i) {
+        out[i * 4] = (unsigned char)(hash.state[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(hash.state[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(hash.state[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)hash.state[i];
+    }
+}
+
+/*
+ * Start of the state file, followed by one byte per chunk set once that
+ * chunk is synced to the target. Chunks are hashed strictly in order, so
+ * hash covers exactly the first verified_chunks of them.
+ */
+struct lokan_ota_state {
+    char magic[8];
+    uint64_t total;
+    uint64_t chunk_bytes;
+    unsigned char digest[LOKAN_OTA_DIGEST_BYTES];
+    uint64_t verified_chunks;
+    struct lokan_sha256 hash;
+};
+
+struct lokan_ota_download;
+
+/* One Range request in flight, written through its own mapping of the chunk. */
+struct lokan_ota_slot {
+    struct lokan_ota_download *download;
+    CURL *handle;
+    uint64_t index;
+    unsigned char *map;
+    size_t len;
+    size_t received;
+    uint32_t attempts;
+    /* lokan_now_ms time at which a failed chunk is started again; 0 when not backing off. */
+    uint64_t retry_at_ms;
+    int busy;
+    int status_checked;
+    int accepted;
+    char range[48];
+};
+
+struct lokan_ota_download {
+    lokan_client_t *client;
+    const lokan_ota_config_t *config;
+    char path[LOKAN_OTA_PATH_MAX];
+    char state_path[LOKAN_OTA_PATH_MAX];
+    CURLM *multi;
+    int target_fd;
+    int state_fd;
+    uint64_t total;
+    uint64_t chunk_bytes;
+    uint64_t chunk_count;
+    /* Next chunk to consider starting; every one before it is done or in flight. */
+    uint64_t next;
+    struct lokan_ota_state state;
+    unsigned char *done;
+    lokan_ota_stats_t stats;
+    struct lokan_ota_slot slots[LOKAN_OTA_PARALLEL_MAX];
+    uint32_t parallel;
+    uint32_t max_attempts;
+};
+
+static size_t lokan_ota_chunk_len(const struct lokan_ota_download *download, uint64_t index) {
+    uint64_t offset = index * download->chunk_bytes;
+    uint64_t left = download->total - offset;
+    return (size_t)(left < download->chunk_bytes ? left : download->chunk_bytes);
+}
+
+static int lokan_ota_retryable(lokan_result_t result, long status) {
+    if (result == LOKAN_ERROR_HTTP) {
+        return status == 408 || status == 429 || status >= 500;
+    }
+    return result == LOKAN_ERROR_CURL || result == LOKAN_ERROR_UNAVAILABLE || result == LOKAN_ERROR_RATE_LIMITED;
+}
+
+static int lokan_ota_hex(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Finds component's "<hex digest>  <path>" line, as sha256sum writes it. */
+static lokan_result_t lokan_ota_find_digest(
+    const char *checksums,
+    size_t len,
+    const char *component,
+    unsigned char out[LOKAN_OTA_DIGEST_BYTES]) {
+    size_t component_len = strlen(component);
+    const char *end = checksums + len;
+    for (const char *line = checksums; line < end;) {
+        const char *newline = (const char *)memchr(line, '\n', (size_t)(end - line));
+        const char *stop = newline ? newline : end;
+        if (stop > line && stop[-1] == '\r') {
+            stop--;
+        }
+        const char *name = line + LOKAN_OTA_DIGEST_BYTES * 2;
+        if (name > stop) {
+            line = newline ? newline + 1 : end;
+            continue;
+        }
+        /* Two spaces, or a space and '*' for sha256sum's binary mode. */
+        while (name < stop && (*name == ' ' || *name == '*')) {
+            name++;
+        }
+        if ((size_t)(stop - name) == component_len && memcmp(name, component, component_len) == 0) {
+            for (size_t i = 0; i < LOKAN_OTA_DIGEST_BYTES; ++i) {
+                int high = lokan_ota_hex(line[i * 2]);
+                int low = lokan_ota_hex(line[i * 2 + 1]);
+                if (high < 0 || low < 0) {
+                    return LOKAN_ERROR_PARSE;
+                }
+                out[i] = (unsigned char)(high << 4 | low);
+            }
+            return LOKAN_OK;
+        }
+        line = newline ? newline + 1 : end;
+    }
+    /* A component missing from the signed list is as untrustworthy as a bad digest. */
+    return LOKAN_ERROR_INTEGRITY;
+}
+
+/* Decodes the base64 between the PEM armour lines of sig/signature.pem. */
+static lokan_result_t lokan_ota_decode_signature(const char *pem, size_t len, unsigned char out[LOKAN_OTA_SIGNATURE_BYTES]) {
+    const char *end = pem + len;
+    const char *begin = strstr(pem, LOKAN_OTA_SIGNATURE_BEGIN);
+    const char *finish = begin ? strstr(begin, LOKAN_OTA_SIGNATURE_END) : NULL;
+    if (!begin || !finish || finish > end) {
+        return LOKAN_ERROR_PARSE;
+    }
+    begin += sizeof(LOKAN_OTA_SIGNATURE_BEGIN) - 1;
+
+    unsigned char decoded[LOKAN_OTA_SIGNATURE_BYTES * 2];
+    if ((size_t)(finish - begin) > sizeof(decoded)) {
+        return LOKAN_ERROR_PARSE;
+    }
+    EVP_ENCODE_CTX *context = EVP_ENCODE_CTX_new();
+    if (!context) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    int written = 0;
+    int tail = 0;
+    EVP_DecodeInit(context);
+    int ok = EVP_DecodeUpdate(context, decoded, &written, (const unsigned char *)begin, (int)(finish - begin)) >= 0 &&
+             EVP_DecodeFinal(context, decoded + written, &tail) == 1;
+    EVP_ENCODE_CTX_free(context);
+    if (!ok || written + tail != LOKAN_OTA_SIGNATURE_BYTES) {
+        return LOKAN_ERROR_PARSE;
+    }
+    memcpy(out, decoded, LOKAN_OTA_SIGNATURE_BYTES);
+    return LOKAN_OK;
+}
+
+static lokan_result_t lokan_ota_verify_signature(
+    const char *public_key_path,
+    const char *checksums,
+    size_t len,
+    const unsigned char signature[LOKAN_OTA_SIGNATURE_BYTES]) {
+    FILE *file = fopen(public_key_path, "r");
+    if (!file) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    EVP_PKEY *key = PEM_read_PUBKEY(file, NULL, NULL, NULL);
+    fclose(file);
+    if (!key) {
+        return LOKAN_ERROR_PARSE;
+    }
+    if (EVP_PKEY_id(key) != EVP_PKEY_ED25519) {
+        EVP_PKEY_free(key);
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    EVP_MD_CTX *context = EVP_MD_CTX_new();
+    if (!context) {
+        EVP_PKEY_free(key);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    /* Ed25519 signs the message itself, so there is no digest to pick and no streaming form. */
+    int verified = EVP_DigestVerifyInit(context, NULL, NULL, NULL, key) == 1 &&
+                   EVP_DigestVerify(context, signature, LOKAN_OTA_SIGNATURE_BYTES, (const unsigned char *)checksums, len) == 1;
+    EVP_MD_CTX_free(context);
+    EVP_PKEY_free(key);
+    return verified ? LOKAN_OK : LOKAN_ERROR_INTEGRITY;
+}
+
+/* Fetches and verifies the signed checksum list, then takes component's digest from it. */
+static lokan_result_t lokan_ota_expected_digest(
+    lokan_client_t *client,
+    const lokan_ota_config_t *config,
+    unsigned char out[LOKAN_OTA_DIGEST_BYTES]) {
+    char path[LOKAN_OTA_PATH_MAX];
+    int written = snprintf(path, sizeof(path), "%s%s", config->bundle_path, LOKAN_OTA_SIGNATURE);
+    if (written < 0 || (size_t)written >= sizeof(path)) {
+        return LOKAN_ERROR_OVERFLOW;
+    }
+    lokan_view_t body = {0};
+    lokan_result_t result = lokan_request_view(client, "GET", path, NULL, 0, NULL, &body);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    unsigned char signature[LOKAN_OTA_SIGNATURE_BYTES];
+    result = lokan_ota_decode_signature(body.data, body.size, signature);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+
+    written = snprintf(path, sizeof(path), "%s%s", config->bundle_path, LOKAN_OTA_CHECKSUMS);
+    if (written < 0 || (size_t)written >= sizeof(path)) {
+        return LOKAN_ERROR_OVERFLOW;
+    }
+    result = lokan_request_view(client, "GET", path, NULL, 0, NULL, &body);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    /* The view stays valid until the client's next call, which is long enough for both checks. */
+    result = lokan_ota_verify_signature(config->public_key_path, body.data, body.size, signature);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    return lokan_ota_find_digest(body.data, body.size, config->component, out);
+}
+
+/* HEADs the component for its size; the stub and any static file server answer with Content-Length. */
+static lokan_result_t lokan_ota_size(struct lokan_ota_download *download, CURL *handle) {
+    lokan_result_t result = lokan_prepare_request(download->client, handle, download->path, "GET", NULL, 0, 0, NULL, NULL);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+    long status = 0;
+    lokan_request_timing_t timing;
+    CURLcode code = curl_easy_perform(handle);
+    result = lokan_finish_request(download->client, handle, download->path, code, &status, &timing);
+    curl_easy_setopt(handle, CURLOPT_NOBODY, 0L);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    curl_off_t length = -1;
+    curl_easy_getinfo(handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    if (length < 0) {
+        return LOKAN_ERROR_PARSE;
+    }
+    download->total = (uint64_t)length;
+    return LOKAN_OK;
+}
+
+static lokan_result_t lokan_ota_save(struct lokan_ota_download *download) {
+    if (pwrite(download->state_fd, &download->state, sizeof(download->state), 0) != (ssize_t)sizeof(download->state) ||
+        pwrite(download->state_fd, download->done, (size_t)download->chunk_count, sizeof(download->state)) !=
+            (ssize_t)download->chunk_count ||
+        fdatasync(download->state_fd) != 0) {
+        return LOKAN_ERROR_UNAVAILABLE;
+    }
+    return LOKAN_OK;
+}
+
+/* Picks up an earlier run's progress when it was for this very image and chunking. */
+static int lokan_ota_resume(struct lokan_ota_download *download, const unsigned char digest[LOKAN_OTA_DIGEST_BYTES]) {
+    struct lokan_ota_state saved;
+    if (pread(download->state_fd, &saved, sizeof(saved), 0) != (ssize_t)sizeof(saved) ||
+        memcmp(saved.magic, LOKAN_OTA_STATE_MAGIC, sizeof(saved.magic)) != 0 || saved.total != download->total ||
+        saved.chunk_bytes != download->chunk_bytes || memcmp(saved.digest, digest, LOKAN_OTA_DIGEST_BYTES) != 0 ||
+        saved.verified_chunks > download->chunk_count || saved.hash.used >= sizeof(saved.hash.block) ||
+        saved.hash.length != (saved.verified_chunks == download->chunk_count ? download->total
+                                                                              : saved.verified_chunks * download->chunk_bytes)) {
+        return 0;
+    }
+    if (pread(download->state_fd, download->done, (size_t)download->chunk_count, sizeof(saved)) !=
+        (ssize_t)download->chunk_count) {
+        return 0;
+    }
+    for (uint64_t i = 0; i < download->chunk_count; ++i) {
+        if (download->done[i] > 1 || (i < saved.verified_chunks && !download->done[i])) {
+            return 0;
+        }
+        if (download->done[i]) {
+            download->stats.resumed_bytes += lokan_ota_chunk_len(download, i);
+        }
+    }
+    download->state = saved;
+    download->stats.verified_bytes = saved.hash.length;
+    return 1;
+}
+
+/*
+ * Opens the target and state file, resuming when both still describe the
+ * same download. A regular file target is sized up front; a block device
+ * must already be large enough.
+ */
+static lokan_result_t lokan_ota_open(struct lokan_ota_download *download, const unsigned char digest[LOKAN_OTA_DIGEST_BYTES]) {
+    download->target_fd = open(download->config->target_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    download->state_fd = open(download->state_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (download->target_fd < 0 || download->state_fd < 0) {
+        return LOKAN_ERROR_UNAVAILABLE;
+    }
+
+    struct stat info;
+    if (fstat(download->target_fd, &info) != 0) {
+        return LOKAN_ERROR_UNAVAILABLE;
+    }
+    int regular = S_ISREG(info.st_mode);
+    int resumed = (!regular || (uint64_t)info.st_size == download->total) && lokan_ota_resume(download, digest);
+    if (!resumed) {
+        memset(download->done, 0, (size_t)download->chunk_count);
+        memset(&download->state, 0, sizeof(download->state));
+        memcpy(download->state.magic, LOKAN_OTA_STATE_MAGIC, sizeof(download->state.magic));
+        download->state.total = download->total;
+        download->state.chunk_bytes = download->chunk_bytes;
+        memcpy(download->state.digest, digest, LOKAN_OTA_DIGEST_BYTES);
+        lokan_sha256_init(&download->state.hash);
+        download->stats.resumed_bytes = 0;
+        download->stats.verified_bytes = 0;
+        if (ftruncate(download->state_fd, 0) != 0) {
+            return LOKAN_ERROR_UNAVAILABLE;
+        }
+    }
+    if (regular) {
+        if (!resumed && ftruncate(download->target_fd, (off_t)download->total) != 0) {
+            return LOKAN_ERROR_UNAVAILABLE;
+        }
+    } else {
+        off_t capacity = lseek(download->target_fd, 0, SEEK_END);
+        if (capacity < 0 || (uint64_t)capacity < download->total) {
+            return LOKAN_ERROR_OVERFLOW;
+        }
+    }
+    return resumed ? LOKAN_OK : lokan_ota_save(download);
+}
+
+/*
+ * Hashes every finished chunk now at the front of the line. The chunk that
+ * just arrived is hashed from its own mapping while still hot; ones that
+ * finished out of order are mapped again read-only. Hashed pages are synced,
+ * so they are dropped from the page cache rather than left filling it.
+ */
+static lokan_result_t lokan_ota_advance(struct lokan_ota_download *download, const struct lokan_ota_slot *arrived) {
+    while (download->state.verified_chunks < download->chunk_count && download->done[download->state.verified_chunks]) {
+        uint64_t index = download->state.verified_chunks;
+        size_t len = lokan_ota_chunk_len(download, index);
+        off_t offset = (off_t)(index * download->chunk_bytes);
+        const unsigned char *data = NULL;
+        void *mapped = NULL;
+        if (arrived && arrived->index == index) {
+            data = arrived->map;
+        } else {
+            mapped = mmap(NULL, len, PROT_READ, MAP_SHARED, download->target_fd, offset);
+            if (mapped == MAP_FAILED) {
+                return LOKAN_ERROR_UNAVAILABLE;
+            }
+            posix_madvise(mapped, len, POSIX_MADV_SEQUENTIAL);
+            data = (const unsigned char *)mapped;
+        }
+        lokan_sha256_update(&download->state.hash, data, len);
+        if (mapped) {
+            munmap(mapped, len);
+        }
+        posix_fadvise(download->target_fd, offset, (off_t)len, POSIX_FADV_DONTNEED);
+        download->state.verified_chunks++;
+        download->stats.verified_bytes += len;
+    }
+    return LOKAN_OK;
+}
+
+/*
+ * Copies a chunk's bytes into its mapping as they arrive; only a 206 for the
+ * range asked for is kept. Anything else aborts the transfer at its first
+ * byte rather than downloading a body that will be thrown away.
+ */
+static size_t lokan_ota_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    struct lokan_ota_slot *slot = (struct lokan_ota_slot *)userp;
+    if (!slot->status_checked) {
+        long status = 0;
+        curl_easy_getinfo(slot->handle, CURLINFO_RESPONSE_CODE, &status);
+        /* A server ignoring Range answers 200 with the whole file, which is only right for a single chunk. */
+        slot->accepted = status == 206 || (status == 200 && slot->download->chunk_count == 1);
+        slot->status_checked = 1;
+    }
+    if (!slot->accepted) {
+        return 0;
+    }
+    if (realsize > slot->len - slot->received) {
+        /* More than the range asked for: aborting beats writing past the mapping. */
+        return 0;
+    }
+    memcpy(slot->map + slot->received, contents, realsize);
+    slot->received += realsize;
+    return realsize;
+}
+
+static lokan_result_t lokan_ota_start(struct lokan_ota_download *download, struct lokan_ota_slot *slot, uint64_t index) {
+    lokan_result_t result = lokan_rate_limit(download->client, 1);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    uint64_t offset = index * download->chunk_bytes;
+    size_t len = lokan_ota_chunk_len(download, index);
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, download->target_fd, (off_t)offset);
+    if (map == MAP_FAILED) {
+        return LOKAN_ERROR_UNAVAILABLE;
+    }
+    result = lokan_prepare_request(download->client, slot->handle, download->path, "GET", NULL, 0, 0, NULL, NULL);
+    if (result != LOKAN_OK) {
+        munmap(map, len);
+        return result;
+    }
+    snprintf(slot->range, sizeof(slot->range), "%llu-%llu", (unsigned long long)offset,
+             (unsigned long long)(offset + len - 1));
+    curl_easy_setopt(slot->handle, CURLOPT_RANGE, slot->range);
+
+    slot->index = index;
+    slot->map = (unsigned char *)map;
+    slot->len = len;
+    slot->received = 0;
+    slot->status_checked = 0;
+    slot->accepted = 0;
+    if (curl_multi_add_handle(download->multi, slot->handle) != CURLM_OK) {
+        munmap(map, len);
+        return LOKAN_ERROR_CURL;
+    }
+    slot->busy = 1;
+    return LOKAN_OK;
+}
+
+static void lokan_ota_stop(struct lokan_ota_download *download, struct lokan_ota_slot *slot) {
+    curl_multi_remove_handle(download->multi, slot->handle);
+    munmap(slot->map, slot->len);
+    slot->map = NULL;
+    slot->busy = 0;
+}
+
+/* Starts the next chunks not yet on the target in every free slot. */
+static lokan_result_t lokan_ota_fill(struct lokan_ota_download *download) {
+    for (uint32_t i = 0; i < download->parallel; ++i) {
+        struct lokan_ota_slot *slot = &download->slots[i];
+        while (!slot->busy && !slot->retry_at_ms && download->next < download->chunk_count) {
+            uint64_t index = download->next++;
+            if (download->done[index]) {
+                continue;
+            }
+            slot->attempts = 0;
+            lokan_result_t result = lokan_ota_start(download, slot, index);
+            if (result != LOKAN_OK) {
+                return result;
+            }
+        }
+    }
+    return LOKAN_OK;
+}
+
+/* Settles a finished chunk: records it, retries it, or fails the download. */
+static lokan_result_t lokan_ota_complete(struct lokan_ota_download *download, struct lokan_ota_slot *slot, CURLcode code) {
+    if (code == CURLE_WRITE_ERROR && slot->status_checked && !slot->accepted) {
+        /* The write callback turned the response away; its status says whether to retry. */
+        code = CURLE_OK;
+    }
+    long status = 0;
+    lokan_request_timing_t timing;
+    lokan_result_t result = lokan_finish_request(download->client, slot->handle, download->path, code, &status, &timing);
+    if (result == LOKAN_OK && (!slot->accepted || slot->received != slot->len)) {
+        result = LOKAN_ERROR_HTTP;
+    }
+    /* Synced before it is recorded, so a resumed download never trusts pages lost in a power cut. */
+    if (result == LOKAN_OK && msync(slot->map, slot->len, MS_SYNC) != 0) {
+        result = LOKAN_ERROR_UNAVAILABLE;
+    }
+    if (result == LOKAN_OK) {
+        download->done[slot->index] = 1;
+        download->stats.downloaded_bytes += slot->len;
+        result = lokan_ota_advance(download, slot);
+        lokan_ota_stop(download, slot);
+        return result == LOKAN_OK ? lokan_ota_save(download) : result;
+    }
+
+    lokan_ota_stop(download, slot);
+    if (!lokan_ota_retryable(result, status) || ++slot->attempts >= download->max_attempts) {
+        return result;
+    }
+    download->stats.chunk_retries++;
+    /* Backs off on a deadline the run loop waits for, so the other chunks keep flowing meanwhile. */
+    slot->retry_at_ms = lokan_now_ms() + 100u * slot->attempts;
+    return LOKAN_OK;
+}
+
+/* Restarts chunks whose backoff is over and sets how long the next may still wait, capped at 1 s. */
+static lokan_result_t lokan_ota_retry_due(struct lokan_ota_download *download, long *out_wait_ms) {
+    long wait_ms = 1000;
+    uint64_t now = lokan_now_ms();
+    for (uint32_t i = 0; i < download->parallel; ++i) {
+        struct lokan_ota_slot *slot = &download->slots[i];
+        if (!slot->retry_at_ms) {
+            continue;
+        }
+        if (now < slot->retry_at_ms) {
+            if ((long)(slot->retry_at_ms - now) < wait_ms) {
+                wait_ms = (long)(slot->retry_at_ms - now);
+            }
+            continue;
+        }
+        slot->retry_at_ms = 0;
+        lokan_result_t result = lokan_ota_start(download, slot, slot->index);
+        if (result != LOKAN_OK) {
+            return result;
+        }
+        /* Its request goes out on the next perform, so do not wait first. */
+        wait_ms = 0;
+    }
+    *out_wait_ms = wait_ms;
+    return LOKAN_OK;
+}
+
+static lokan_result_t lokan_ota_run(struct lokan_ota_download *download) {
+    const lokan_ota_config_t *config = download->config;
+    lokan_result_t result = lokan_ota_fill(download);
+    while (result == LOKAN_OK) {
+        int running = 0;
+        if (curl_multi_perform(download->multi, &running) != CURLM_OK) {
+            return LOKAN_ERROR_CURL;
+        }
+        CURLMsg *message = NULL;
+        int queued = 0;
+        int settled = 0;
+        while (result == LOKAN_OK && (message = curl_multi_info_read(download->multi, &queued)) != NULL) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+            struct lokan_ota_slot *slot = NULL;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, (char **)&slot);
+            result = lokan_ota_complete(download, slot, message->data.result);
+            settled = 1;
+        }
+        if (result == LOKAN_OK && settled) {
+            if (config->on_progress && config->on_progress(&download->stats, config->user_data) != 0) {
+                return LOKAN_ERROR_CANCELLED;
+            }
+            result = lokan_ota_fill(download);
+        }
+        if (result != LOKAN_OK) {
+            return result;
+        }
+
+        long wait_ms = 1000;
+        result = lokan_ota_retry_due(download, &wait_ms);
+        if (result != LOKAN_OK) {
+            return result;
+        }
+        int busy = 0;
+        int backing_off = 0;
+        for (uint32_t i = 0; i < download->parallel; ++i) {
+            busy |= download->slots[i].busy;
+            backing_off |= download->slots[i].retry_at_ms != 0;
+        }
+        if (!busy) {
+            if (!backing_off) {
+                return LOKAN_OK;
+            }
+            /* Every chunk left is backing off, so there is no transfer for libcurl to wait on. */
+            lokan_sleep_ms(wait_ms);
+            continue;
+        }
+#if LIBCURL_VERSION_NUM >= 0x074200
+        CURLMcode waited = curl_multi_poll(download->multi, NULL, 0, (int)wait_ms, NULL);
+#else
+        CURLMcode waited = curl_multi_wait(download->multi, NULL, 0, (int)wait_ms, NULL);
+#endif
+        if (waited != CURLM_OK) {
+            return LOKAN_ERROR_CURL;
+        }
+    }
+    return result;
+}
+
+/* Finishes the digest and compares it with the signed one. */
+static lokan_result_t lokan_ota_finish(struct lokan_ota_download *download) {
+    if (download->state.verified_chunks != download->chunk_count) {
+        return LOKAN_ERROR_INTEGRITY;
+    }
+    unsigned char digest[LOKAN_OTA_DIGEST_BYTES];
+    lokan_sha256_final(download->state.hash, digest);
+    if (memcmp(digest, download->state.digest, sizeof(digest)) != 0) {
+        return LOKAN_ERROR_INTEGRITY;
+    }
+    return fsync(download->target_fd) == 0 ? LOKAN_OK : LOKAN_ERROR_UNAVAILABLE;
+}
+
+static void lokan_ota_close(struct lokan_ota_download *download) {
+    for (uint32_t i = 0; i < LOKAN_OTA_PARALLEL_MAX; ++i) {
+        struct lokan_ota_slot *slot = &download->slots[i];
+        if (slot->busy) {
+            lokan_ota_stop(download, slot);
+        }
+        if (slot->handle) {
+            curl_easy_cleanup(slot->handle);
+        }
+    }
+    if (download->multi) {
+        curl_multi_cleanup(download->multi);
+    }
+    if (download->target_fd >= 0) {
+        close(download->target_fd);
+    }
+    if (download->state_fd >= 0) {
+        close(download->state_fd);
+    }
+    lokan_free(&download->client->allocator, download->done);
+}
+
+lokan_result_t lokan_ota_download(lokan_client_t *client, const lokan_ota_config_t *config, lokan_ota_stats_t *out_stats) {
+    if (out_stats) {
+        memset(out_stats, 0, sizeof(*out_stats));
+    }
+    if (!client || !config || !config->bundle_path || !config->component || !config->target_path ||
+        !config->public_key_path) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    unsigned char digest[LOKAN_OTA_DIGEST_BYTES];
+    lokan_result_t result = lokan_ota_expected_digest(client, config, digest);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+
+    /* Too large for the stack with its slot table, and only one runs at a time. */
+    struct lokan_ota_download *download =
+        (struct lokan_ota_download *)lokan_calloc(&client->allocator, 1, sizeof(struct lokan_ota_download));
+    if (!download) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    download->client = client;
+    download->config = config;
+    download->target_fd = -1;
+    download->state_fd = -1;
+    download->parallel = config->parallel ? config->parallel : LOKAN_OTA_DEFAULT_PARALLEL;
+    if (download->parallel > LOKAN_OTA_PARALLEL_MAX) {
+        download->parallel = LOKAN_OTA_PARALLEL_MAX;
+    }
+    download->max_attempts = config->chunk_attempts ? config->chunk_attempts : LOKAN_OTA_DEFAULT_ATTEMPTS;
+    /* Chunk offsets double as mmap offsets, which must be page aligned. */
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t chunk = config->chunk_bytes ? config->chunk_bytes : LOKAN_OTA_DEFAULT_CHUNK_BYTES;
+    download->chunk_bytes = (chunk + page - 1) / page * page;
+
+    int written = snprintf(download->path, sizeof(download->path), "%s/%s", config->bundle_path, config->component);
+    int state_written = config->state_path
+                            ? snprintf(download->state_path, sizeof(download->state_path), "%s", config->state_path)
+                            : snprintf(download->state_path, sizeof(download->state_path), "%s%s", config->target_path,
+                                       LOKAN_OTA_STATE_SUFFIX);
+    if (written < 0 || (size_t)written >= sizeof(download->path) || state_written < 0 ||
+        (size_t)state_written >= sizeof(download->state_path)) {
+        result = LOKAN_ERROR_OVERFLOW;
+        goto done;
+    }
+
+    download->multi = curl_multi_init();
+    if (!download->multi) {
+        result = LOKAN_ERROR_CURL;
+        goto done;
+    }
+    for (uint32_t i = 0; i < download->parallel; ++i) {
+        struct lokan_ota_slot *slot = &download->slots[i];
+        slot->download = download;
+        slot->handle = curl_easy_init();
+        if (!slot->handle) {
+            result = LOKAN_ERROR_CURL;
+            goto done;
+        }
+        lokan_configure_handle(client, slot->handle);
+        /* A chunk takes as long as the link needs; only a stalled one is given up on. */
+        curl_easy_setopt(slot->handle, CURLOPT_TIMEOUT_MS, 0L);
+        curl_easy_setopt(slot->handle, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(slot->handle, CURLOPT_LOW_SPEED_TIME, client->timeout_ms > 1000 ? client->timeout_ms / 1000 : 1L);
+        /* Ranges are byte offsets into the image itself, never into an encoded form of it. */
+        curl_easy_setopt(slot->handle, CURLOPT_ACCEPT_ENCODING, NULL);
+        curl_easy_setopt(slot->handle, CURLOPT_WRITEFUNCTION, lokan_ota_write_callback);
+        curl_easy_setopt(slot->handle, CURLOPT_WRITEDATA, (void *)slot);
+        curl_easy_setopt(slot->handle, CURLOPT_PRIVATE, (void *)slot);
+    }
+
+    result = lokan_ota_size(download, download->slots[0].handle);
+    if (result != LOKAN_OK) {
+        goto done;
+    }
+    download->chunk_count = (download->total + download->chunk_bytes - 1) / download->chunk_bytes;
+    download->stats.total_bytes = download->total;
+    /* At least one byte, so an empty image still gets a valid allocation. */
+    download->done = (unsigned char *)lokan_calloc(&client->allocator, (size_t)download->chunk_count + 1, 1);
+    if (!download->done) {
+        result = LOKAN_ERROR_ALLOCATION;
+        goto done;
+    }
+    result = lokan_ota_open(download, digest);
+    if (result == LOKAN_OK) {
+        result = lokan_ota_run(download);
+    }
+    if (result == LOKAN_OK) {
+        result = lokan_ota_finish(download);
+        if (result == LOKAN_OK || result == LOKAN_ERROR_INTEGRITY) {
+            /* A verified image needs no record, and a corrupt one must not be resumed. */
+            unlink(download->state_path);
+        }
+    }
+
+done:
+    if (out_stats) {
+        *out_stats = download->stats;
+    }
+    lokan_ota_close(download);
+    lokan_free(&client->allocator, download);
+    return result;
+}
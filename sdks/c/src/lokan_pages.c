@@ -0,0 +1,276 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LOKAN_LIST_DEFAULT_PAGE 100
+/* Longest nextCursor accepted from a server. */
+#define LOKAN_LIST_CURSOR_MAX 512
+
+/* One page's elements, NUL-separated, and the cursor of the page after it. */
+struct lokan_list_page {
+    struct lokan_memory elements;
+    char cursor[LOKAN_LIST_CURSOR_MAX];
+    /* Non-zero while a page follows this one. */
+    int more;
+    lokan_result_t result;
+};
+
+enum lokan_list_prefetch {
+    LOKAN_LIST_PREFETCH_NONE,
+    LOKAN_LIST_PREFETCH_IN_FLIGHT,
+    LOKAN_LIST_PREFETCH_DONE
+};
+
+/*
+ * Two pages at a time: the caller walks current while the page after it
+ * downloads into ahead on the client's async engine, so memory is bounded by
+ * the page size however long the list is.
+ */
+struct lokan_list_iter {
+    lokan_client_t *client;
+    char *path;
+    char *array_key;
+    size_t page_size;
+    lokan_json_parser_t *parser;
+    struct lokan_list_page pages[2];
+    struct lokan_list_page *current;
+    struct lokan_list_page *ahead;
+    /* Read position in current->elements. */
+    size_t offset;
+    enum lokan_list_prefetch prefetch;
+    /* Page the parser is filling, and whether the last root key was nextCursor. */
+    struct lokan_list_page *filling;
+    int cursor_key;
+};
+
+static int lokan_list_element(const char *element, size_t len, void *user_data) {
+    struct lokan_list_iter *iter = (struct lokan_list_iter *)user_data;
+    struct lokan_memory *elements = &iter->filling->elements;
+    if (lokan_memory_reserve(elements, elements->size + len + 1) != LOKAN_OK) {
+        iter->filling->result = LOKAN_ERROR_ALLOCATION;
+        return 1;
+    }
+    memcpy(elements->data + elements->size, element, len + 1);
+    elements->size += len + 1;
+    return 0;
+}
+
+static int lokan_list_event(lokan_json_event_t event, const char *text, size_t len, size_t depth, void *user_data) {
+    struct lokan_list_iter *iter = (struct lokan_list_iter *)user_data;
+    if (depth != 1) {
+        return 0;
+    }
+    if (event == LOKAN_JSON_KEY) {
+        iter->cursor_key = len == sizeof("nextCursor") - 1 && memcmp(text, "nextCursor", len) == 0;
+    } else if (event == LOKAN_JSON_STRING && iter->cursor_key && len > 0) {
+        if (len >= sizeof(iter->filling->cursor)) {
+            iter->filling->result = LOKAN_ERROR_OVERFLOW;
+            return 1;
+        }
+        memcpy(iter->filling->cursor, text, len);
+        iter->filling->cursor[len] = '\0';
+        iter->filling->more = 1;
+    }
+    return 0;
+}
+
+static lokan_result_t lokan_list_parse(struct lokan_list_iter *iter, struct lokan_list_page *page, const char *body, size_t len) {
+    lokan_memory_recycle(&page->elements);
+    page->cursor[0] = '\0';
+    page->more = 0;
+    page->result = LOKAN_OK;
+    iter->filling = page;
+    iter->cursor_key = 0;
+
+    lokan_json_parser_reset(iter->parser);
+    lokan_result_t result = lokan_json_parser_feed(iter->parser, body, len);
+    if (result == LOKAN_OK) {
+        result = lokan_json_parser_finish(iter->parser);
+    }
+    if (page->result != LOKAN_OK) {
+        result = page->result;
+    }
+    page->result = result;
+    return result;
+}
+
+/* Path of the page following after, e.g. /devices?limit=100&cursor=...; from the scratch allocator. */
+static char *lokan_list_page_path(const struct lokan_list_iter *iter, const struct lokan_list_page *after) {
+    size_t path_len = strlen(iter->path);
+    size_t cursor_len = strlen(after->cursor);
+    /* "?limit=" + digits + "&cursor=" + up to three bytes per cursor byte + NUL. */
+    size_t capacity = path_len + 7 + 20 + 8 + 3 * cursor_len + 1;
+    char *path = (char *)lokan_alloc(lokan_scratch_allocator(iter->client), capacity);
+    if (!path) {
+        return NULL;
+    }
+    memcpy(path, iter->path, path_len);
+    char *out = path + path_len;
+    out += sprintf(out, "%climit=%lu", strchr(iter->path, '?') ? '&' : '?', (unsigned long)iter->page_size);
+    if (cursor_len > 0) {
+        memcpy(out, "&cursor=", 8);
+        lokan_url_escape_into(out + 8, after->cursor);
+    }
+    return path;
+}
+
+static void lokan_list_prefetched(const lokan_response_t *response, void *user_data) {
+    struct lokan_list_iter *iter = (struct lokan_list_iter *)user_data;
+    iter->prefetch = LOKAN_LIST_PREFETCH_DONE;
+    if (response->result != LOKAN_OK) {
+        iter->ahead->result = response->result;
+        return;
+    }
+    lokan_list_parse(iter, iter->ahead, response->body, response->body_len);
+}
+
+/* Starts downloading the page after current; a failed submit is retried as a blocking fetch when it is needed. */
+static void lokan_list_prefetch(struct lokan_list_iter *iter) {
+    lokan_client_t *client = iter->client;
+    lokan_arena_mark_t mark = {0, NULL};
+    if (client->arena) {
+        mark = lokan_arena_mark(client->arena);
+    }
+    char *path = lokan_list_page_path(iter, iter->current);
+    if (path && lokan_request_submit(client, "GET", path, NULL, 0, lokan_list_prefetched, iter) == LOKAN_OK) {
+        iter->prefetch = LOKAN_LIST_PREFETCH_IN_FLIGHT;
+    }
+    lokan_free(lokan_scratch_allocator(client), path);
+    if (client->arena) {
+        lokan_arena_release(client->arena, mark);
+    }
+}
+
+/* Fetches the page after current into ahead on the blocking path, with its retries and rate limiting. */
+static lokan_result_t lokan_list_fetch(struct lokan_list_iter *iter) {
+    lokan_client_t *client = iter->client;
+    lokan_arena_mark_t mark = {0, NULL};
+    if (client->arena) {
+        mark = lokan_arena_mark(client->arena);
+    }
+    char *path = lokan_list_page_path(iter, iter->current);
+    lokan_result_t result = LOKAN_ERROR_ALLOCATION;
+    lokan_view_t body = {NULL, 0};
+    if (path) {
+        result = lokan_request_view(client, "GET", path, NULL, 0, NULL, &body);
+    }
+    lokan_free(lokan_scratch_allocator(client), path);
+    if (client->arena) {
+        lokan_arena_release(client->arena, mark);
+    }
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    return lokan_list_parse(iter, iter->ahead, body.data, body.size);
+}
+
+lokan_result_t lokan_list_iter_create(
+    lokan_list_iter_t **out_iter,
+    lokan_client_t *client,
+    const char *path,
+    const char *array_key,
+    size_t page_size) {
+    if (!out_iter || !client || !path || !array_key) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    lokan_list_iter_t *iter = (lokan_list_iter_t *)lokan_calloc(&client->allocator, 1, sizeof(lokan_list_iter_t));
+    if (!iter) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    iter->client = client;
+    iter->page_size = page_size > 0 ? page_size : LOKAN_LIST_DEFAULT_PAGE;
+    iter->path = lokan_strdup(&client->allocator, path);
+    iter->array_key = lokan_strdup(&client->allocator, array_key);
+    for (int i = 0; i < 2; ++i) {
+        iter->pages[i].elements.allocator = &client->allocator;
+    }
+    lokan_json_parser_config_t config = {0};
+    config.on_event = lokan_list_event;
+    config.on_element = lokan_list_element;
+    config.array_key = iter->array_key;
+    config.user_data = iter;
+    if (!iter->path || !iter->array_key ||
+        lokan_json_parser_create_with(&iter->parser, &config, &client->allocator) != LOKAN_OK) {
+        lokan_list_iter_destroy(iter);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+
+    /* An empty page with no cursor stands before the first one, so the first fetch starts right away. */
+    iter->current = &iter->pages[0];
+    iter->ahead = &iter->pages[1];
+    iter->current->more = 1;
+    lokan_list_prefetch(iter);
+    *out_iter = iter;
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_list_iter_next(lokan_list_iter_t *iter, lokan_view_t *out_element, int *out_done) {
+    if (!iter || !out_element || !out_done) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    lokan_client_t *client = iter->client;
+    *out_done = 0;
+    for (;;) {
+        if (iter->prefetch == LOKAN_LIST_PREFETCH_IN_FLIGHT) {
+            /* Moves the download along between elements without waiting on it. */
+            lokan_client_perform(client, NULL);
+        }
+        if (iter->offset < iter->current->elements.size) {
+            const char *element = iter->current->elements.data + iter->offset;
+            size_t len = strlen(element);
+            out_element->data = element;
+            out_element->size = len;
+            iter->offset += len + 1;
+            return LOKAN_OK;
+        }
+        if (!iter->current->more) {
+            out_element->data = "";
+            out_element->size = 0;
+            *out_done = 1;
+            return LOKAN_OK;
+        }
+
+        while (iter->prefetch == LOKAN_LIST_PREFETCH_IN_FLIGHT) {
+            if (lokan_client_poll(client, 1000, NULL) != LOKAN_OK) {
+                lokan_sleep_ms(10);
+                lokan_client_perform(client, NULL);
+            }
+        }
+        if (iter->prefetch != LOKAN_LIST_PREFETCH_DONE || iter->ahead->result != LOKAN_OK) {
+            /* The prefetch never started or failed; fetch in place so the call gets retries. */
+            iter->prefetch = LOKAN_LIST_PREFETCH_NONE;
+            lokan_result_t result = lokan_list_fetch(iter);
+            if (result != LOKAN_OK) {
+                return result;
+            }
+        }
+
+        struct lokan_list_page *finished = iter->current;
+        iter->current = iter->ahead;
+        iter->ahead = finished;
+        iter->offset = 0;
+        iter->prefetch = LOKAN_LIST_PREFETCH_NONE;
+        if (iter->current->more) {
+            lokan_list_prefetch(iter);
+        }
+    }
+}
+
+void lokan_list_iter_destroy(lokan_list_iter_t *iter) {
+    if (!iter) {
+        return;
+    }
+    lokan_client_t *client = iter->client;
+    if (iter->prefetch == LOKAN_LIST_PREFETCH_IN_FLIGHT) {
+        lokan_request_abandon(client, iter);
+    }
+    lokan_json_parser_destroy(iter->parser);
+    for (int i = 0; i < 2; ++i) {
+        lokan_free(&client->allocator, iter->pages[i].elements.data);
+    }
+    lokan_free(&client->allocator, iter->array_key);
+    lokan_free(&client->allocator, iter->path);
+    lokan_free(&client->allocator, iter);
+}
@@ -0,0 +1,170 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <curl/curl.h>
+#include <pthread.h>
+
+/*
+ * Idle clients sit on a LIFO stack so the most recently used one, whose
+ * connection is least likely to have gone stale, is handed out first. The
+ * mutex only guards a pointer swap; threads sleep on the condvar solely when
+ * every client is checked out.
+ */
+struct lokan_client_pool {
+    lokan_allocator_t allocator;
+    CURLSH *share;
+    pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+    lokan_client_t **clients;
+    size_t size;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t released;
+    lokan_client_t *idle;
+};
+
+static void lokan_pool_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    (void)handle;
+    (void)access;
+    lokan_client_pool_t *pool = (lokan_client_pool_t *)userptr;
+    pthread_mutex_lock(&pool->share_locks[data]);
+}
+
+static void lokan_pool_share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+    (void)handle;
+    lokan_client_pool_t *pool = (lokan_client_pool_t *)userptr;
+    pthread_mutex_unlock(&pool->share_locks[data]);
+}
+
+static lokan_result_t lokan_pool_share_init(lokan_client_pool_t *pool) {
+    pool->share = curl_share_init();
+    if (!pool->share) {
+        return LOKAN_ERROR_CURL;
+    }
+    curl_share_setopt(pool->share, CURLSHOPT_LOCKFUNC, lokan_pool_share_lock);
+    curl_share_setopt(pool->share, CURLSHOPT_UNLOCKFUNC, lokan_pool_share_unlock);
+    curl_share_setopt(pool->share, CURLSHOPT_USERDATA, (void *)pool);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_client_pool_create(
+    lokan_client_pool_t **out_pool,
+    const lokan_client_config_t *config,
+    size_t size) {
+    if (!out_pool || !config || size == 0) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    /* The share must exist before any client, so libcurl has to be up first. */
+    lokan_result_t result = lokan_global_init();
+    if (result != LOKAN_OK) {
+        return result;
+    }
+
+    const lokan_allocator_t *allocator = config->allocator ? config->allocator : lokan_default_allocator();
+    lokan_client_pool_t *pool = (lokan_client_pool_t *)lokan_calloc(allocator, 1, sizeof(lokan_client_pool_t));
+    if (!pool) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    pool->allocator = *allocator;
+    pool->clients = (lokan_client_t **)lokan_calloc(allocator, size, sizeof(lokan_client_t *));
+    if (!pool->clients) {
+        lokan_free(allocator, pool);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; ++i) {
+        pthread_mutex_init(&pool->share_locks[i], NULL);
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->released, NULL);
+
+    result = lokan_pool_share_init(pool);
+    for (size_t i = 0; i < size && result == LOKAN_OK; ++i) {
+        result = lokan_client_create(config, pool->share, &pool->clients[i]);
+        if (result == LOKAN_OK) {
+            pool->size++;
+            pool->clients[i]->pool_next = pool->idle;
+            pool->idle = pool->clients[i];
+        }
+    }
+    if (result != LOKAN_OK) {
+        lokan_client_pool_destroy(pool);
+        return result;
+    }
+
+    *out_pool = pool;
+    return LOKAN_OK;
+}
+
+void lokan_client_pool_destroy(lokan_client_pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+    /* Handles detach from the share on cleanup, so clients go before it. */
+    for (size_t i = 0; i < pool->size; ++i) {
+        lokan_client_cleanup(pool->clients[i]);
+    }
+    if (pool->share) {
+        curl_share_cleanup(pool->share);
+    }
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; ++i) {
+        pthread_mutex_destroy(&pool->share_locks[i]);
+    }
+    pthread_cond_destroy(&pool->released);
+    pthread_mutex_destroy(&pool->mutex);
+    lokan_allocator_t allocator = pool->allocator;
+    lokan_free(&allocator, pool->clients);
+    lokan_free(&allocator, pool);
+}
+
+static lokan_client_t *lokan_pool_pop(lokan_client_pool_t *pool) {
+    lokan_client_t *client = pool->idle;
+    if (client) {
+        pool->idle = client->pool_next;
+        client->pool_next = NULL;
+    }
+    return client;
+}
+
+lokan_result_t lokan_client_pool_acquire(lokan_client_pool_t *pool, lokan_client_t **out_client) {
+    if (!pool || !out_client) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    lokan_client_t *client = NULL;
+    while ((client = lokan_pool_pop(pool)) == NULL) {
+        pthread_cond_wait(&pool->released, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    *out_client = client;
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_client_pool_try_acquire(lokan_client_pool_t *pool, lokan_client_t **out_client) {
+    if (!pool || !out_client) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    lokan_client_t *client = lokan_pool_pop(pool);
+    pthread_mutex_unlock(&pool->mutex);
+    if (!client) {
+        return LOKAN_ERROR_OVERFLOW;
+    }
+    *out_client = client;
+    return LOKAN_OK;
+}
+
+void lokan_client_pool_release(lokan_client_pool_t *pool, lokan_client_t *client) {
+    if (!pool || !client) {
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    client->pool_next = pool->idle;
+    pool->idle = client;
+    pthread_cond_signal(&pool->released);
+    pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,118 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <time.h>
+
+/*
+ * The gateway's token bucket expressed as GCRA: instead of a token count and
+ * a refill time under a lock, one atomic "theoretical arrival time" records
+ * when the bucket would be full again. A request fits while that time is at
+ * most burst - 1 intervals ahead of now, and taking a token pushes it one
+ * interval further. The two are equivalent, but GCRA updates with one CAS.
+ */
+struct lokan_rate_limiter {
+    /* Nanoseconds on lokan_rate_clock_ns; never behind the last accepted request. */
+    uint64_t tat_ns;
+    uint64_t interval_ns;
+    /* How far tat_ns may run ahead of now: (burst - 1) intervals. */
+    uint64_t tolerance_ns;
+    long max_wait_ms;
+};
+
+static uint64_t lokan_rate_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+lokan_result_t lokan_rate_limiter_create(lokan_rate_limiter_t **out_limiter, const lokan_rate_limiter_config_t *config) {
+    if (!out_limiter || !config) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    lokan_rate_limiter_t *limiter =
+        (lokan_rate_limiter_t *)lokan_calloc(lokan_default_allocator(), 1, sizeof(lokan_rate_limiter_t));
+    if (!limiter) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    /* Same clamping as RateLimiter::new: at least one request per minute and a burst of one. */
+    uint64_t per_minute = config->requests_per_minute > 0 ? config->requests_per_minute : 1;
+    uint64_t burst = config->burst > 0 ? config->burst : 1;
+    limiter->interval_ns = 60000000000ull / per_minute;
+    limiter->tolerance_ns = (burst - 1) * limiter->interval_ns;
+    limiter->max_wait_ms = config->max_wait_ms > 0 ? config->max_wait_ms : 0;
+    /* A theoretical arrival time in the past is a full bucket, as the gateway starts. */
+    limiter->tat_ns = 0;
+    *out_limiter = limiter;
+    return LOKAN_OK;
+}
+
+void lokan_rate_limiter_destroy(lokan_rate_limiter_t *limiter) {
+    lokan_free(lokan_default_allocator(), limiter);
+}
+
+/* Takes a token if one is free within max_wait_ns; returns the wait in ns, or -1 without taking one. */
+static int64_t lokan_rate_reserve(lokan_rate_limiter_t *limiter, uint64_t max_wait_ns) {
+    uint64_t tat = __atomic_load_n(&limiter->tat_ns, __ATOMIC_RELAXED);
+    for (;;) {
+        uint64_t now = lokan_rate_clock_ns();
+        uint64_t ahead = tat > now ? tat - now : 0;
+        uint64_t wait = ahead > limiter->tolerance_ns ? ahead - limiter->tolerance_ns : 0;
+        if (wait > max_wait_ns) {
+            return -1;
+        }
+        /* A waiter reserves its slot up front, so concurrent waiters queue instead of racing. */
+        uint64_t next = now + ahead + limiter->interval_ns;
+        if (__atomic_compare_exchange_n(&limiter->tat_ns, &tat, next, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            return (int64_t)wait;
+        }
+    }
+}
+
+lokan_result_t lokan_rate_limiter_try_acquire(lokan_rate_limiter_t *limiter, long *out_wait_ms) {
+    if (!limiter) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (lokan_rate_reserve(limiter, 0) >= 0) {
+        if (out_wait_ms) {
+            *out_wait_ms = 0;
+        }
+        return LOKAN_OK;
+    }
+    if (out_wait_ms) {
+        uint64_t now = lokan_rate_clock_ns();
+        uint64_t tat = __atomic_load_n(&limiter->tat_ns, __ATOMIC_RELAXED);
+        uint64_t ahead = tat > now ? tat - now : 0;
+        uint64_t wait = ahead > limiter->tolerance_ns ? ahead - limiter->tolerance_ns : 0;
+        *out_wait_ms = (long)((wait + 999999u) / 1000000u);
+    }
+    return LOKAN_ERROR_RATE_LIMITED;
+}
+
+lokan_result_t lokan_rate_limit(const lokan_client_t *client, int may_wait) {
+    lokan_rate_limiter_t *limiter = client->rate_limiter;
+    if (!limiter) {
+        return LOKAN_OK;
+    }
+    uint64_t max_wait_ns = may_wait ? (uint64_t)limiter->max_wait_ms * 1000000u : 0;
+    int64_t wait = lokan_rate_reserve(limiter, max_wait_ns);
+    if (wait < 0) {
+        return LOKAN_ERROR_RATE_LIMITED;
+    }
+    if (wait > 0) {
+        lokan_sleep_ms((long)((wait + 999999) / 1000000));
+    }
+    return LOKAN_OK;
+}
+
+void lokan_rate_limit_drain(const lokan_client_t *client) {
+    lokan_rate_limiter_t *limiter = client->rate_limiter;
+    if (!limiter) {
+        return;
+    }
+    /* The gateway said its bucket is empty; empty ours too so other threads stop sending. */
+    uint64_t empty = lokan_rate_clock_ns() + limiter->tolerance_ns + limiter->interval_ns;
+    uint64_t tat = __atomic_load_n(&limiter->tat_ns, __ATOMIC_RELAXED);
+    while (tat < empty &&
+           !__atomic_compare_exchange_n(&limiter->tat_ns, &tat, empty, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    }
+}
@@ -0,0 +1,467 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#define LOKAN_RESOLVE_DEFAULT_ENTRIES 16
+/* mDNS's TTL for host address records (RFC 6762, section 10). */
+#define LOKAN_RESOLVE_DEFAULT_TTL_MS 120000
+#define LOKAN_RESOLVE_DEFAULT_STALE_MS 30000
+#define LOKAN_RESOLVE_HOST_MAX 128
+#define LOKAN_RESOLVE_ADDRESSES_MAX 128
+/* "host:port", and "host:port:addresses" as CURLOPT_RESOLVE takes it. */
+#define LOKAN_RESOLVE_KEY_MAX (LOKAN_RESOLVE_HOST_MAX + 7)
+#define LOKAN_RESOLVE_LINE_MAX (LOKAN_RESOLVE_KEY_MAX + 1 + LOKAN_RESOLVE_ADDRESSES_MAX)
+/* Longest the refresh thread sleeps with nothing due, and the least it waits to retry a refresh. */
+#define LOKAN_RESOLVE_IDLE_MS 60000
+#define LOKAN_RESOLVE_RETRY_MIN_MS 1000
+
+struct lokan_resolve_entry {
+    char host[LOKAN_RESOLVE_HOST_MAX];
+    /* Comma-separated, IPv6 in brackets; empty while the first lookup is outstanding. */
+    char addresses[LOKAN_RESOLVE_ADDRESSES_MAX];
+    uint16_t port;
+    int used;
+    long ttl_ms;
+    /* lokan_now_ms times; 0 for a permanent entry. */
+    uint64_t refresh_at_ms;
+    uint64_t expires_ms;
+    /* Bumped by every update, so a lookup that raced one is discarded. */
+    uint64_t version;
+};
+
+struct lokan_resolver {
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_t thread;
+    int stopping;
+    struct lokan_resolve_entry *entries;
+    size_t capacity;
+    /* Changes whenever the addresses clients should pin do; read without the lock. */
+    uint64_t generation;
+    long default_ttl_ms;
+    long max_stale_ms;
+    lokan_resolve_refresh_cb on_refresh;
+    void *user_data;
+};
+
+/*
+ * A client's CURLOPT_RESOLVE list, rebuilt in place when the resolver's
+ * generation moves. libcurl reads the list when a transfer starts, which for
+ * an async request can be after a later rebuild, so nodes[0] stays the head
+ * and every line stays valid for the life of the client.
+ */
+struct lokan_resolve_list {
+    uint64_t generation;
+    size_t capacity;
+    /* Keys pinned by the last rebuild, so the next can unpin those that went away. */
+    size_t pinned;
+    char (*keys)[LOKAN_RESOLVE_KEY_MAX];
+    /* Up to capacity removals and capacity entries. */
+    char (*lines)[LOKAN_RESOLVE_LINE_MAX];
+    struct curl_slist *nodes;
+};
+
+static void lokan_resolve_entry_clear(struct lokan_resolve_entry *entry) {
+    memset(entry, 0, sizeof(*entry));
+}
+
+/* Sets refresh and expiry times for ttl_ms from now; 80% in is when mDNS queriers refresh. */
+static void lokan_resolve_entry_arm(struct lokan_resolve_entry *entry, long ttl_ms, uint64_t now) {
+    entry->ttl_ms = ttl_ms;
+    if (ttl_ms == LOKAN_RESOLVE_PERMANENT) {
+        entry->refresh_at_ms = 0;
+        entry->expires_ms = 0;
+        return;
+    }
+    entry->refresh_at_ms = now + (uint64_t)ttl_ms * 8 / 10;
+    entry->expires_ms = now + (uint64_t)ttl_ms;
+}
+
+static struct lokan_resolve_entry *lokan_resolve_find(lokan_resolver_t *resolver, const char *host, uint16_t port) {
+    for (size_t i = 0; i < resolver->capacity; ++i) {
+        struct lokan_resolve_entry *entry = &resolver->entries[i];
+        if (entry->used && entry->port == port && strcmp(entry->host, host) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Copies a comma-separated list of IP literals into out in CURLOPT_RESOLVE's form. */
+static lokan_result_t lokan_resolve_format(const char *addresses, char *out, size_t capacity) {
+    size_t used = 0;
+    out[0] = '\0';
+    for (const char *p = addresses; *p;) {
+        const char *comma = strchr(p, ',');
+        size_t len = comma ? (size_t)(comma - p) : strlen(p);
+        if (len > 1 && p[0] == '[' && p[len - 1] == ']') {
+            p++;
+            len -= 2;
+        }
+        char literal[INET6_ADDRSTRLEN];
+        unsigned char parsed[sizeof(struct in6_addr)];
+        if (len == 0 || len >= sizeof(literal)) {
+            return LOKAN_ERROR_INVALID_ARGUMENT;
+        }
+        memcpy(literal, p, len);
+        literal[len] = '\0';
+        int v6 = inet_pton(AF_INET6, literal, parsed) == 1;
+        if (!v6 && inet_pton(AF_INET, literal, parsed) != 1) {
+            return LOKAN_ERROR_INVALID_ARGUMENT;
+        }
+        int written = snprintf(out + used, capacity - used, v6 ? "%s[%s]" : "%s%s", used ? "," : "", literal);
+        if (written < 0 || (size_t)written >= capacity - used) {
+            return LOKAN_ERROR_OVERFLOW;
+        }
+        used += (size_t)written;
+        p = comma ? comma + 1 : p + len;
+    }
+    return used > 0 ? LOKAN_OK : LOKAN_ERROR_INVALID_ARGUMENT;
+}
+
+/* Looks host up with the system resolver, on the refresh thread only. */
+static lokan_result_t lokan_resolve_lookup(const char *host, char *out, size_t capacity) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *found = NULL;
+    if (getaddrinfo(host, NULL, &hints, &found) != 0) {
+        return LOKAN_ERROR_UNAVAILABLE;
+    }
+    size_t used = 0;
+    out[0] = '\0';
+    for (struct addrinfo *info = found; info; info = info->ai_next) {
+        char literal[INET6_ADDRSTRLEN];
+        const void *address = info->ai_family == AF_INET6
+                                  ? (const void *)&((const struct sockaddr_in6 *)info->ai_addr)->sin6_addr
+                                  : (const void *)&((const struct sockaddr_in *)info->ai_addr)->sin_addr;
+        if ((info->ai_family != AF_INET && info->ai_family != AF_INET6) ||
+            !inet_ntop(info->ai_family, address, literal, sizeof(literal))) {
+            continue;
+        }
+        int written = snprintf(out + used, capacity - used, info->ai_family == AF_INET6 ? "%s[%s]" : "%s%s",
+                               used ? "," : "", literal);
+        if (written < 0 || (size_t)written >= capacity - used) {
+            /* Keep the addresses that fit rather than none. */
+            out[used] = '\0';
+            break;
+        }
+        used += (size_t)written;
+    }
+    freeaddrinfo(found);
+    return used > 0 ? LOKAN_OK : LOKAN_ERROR_UNAVAILABLE;
+}
+
+/*
+ * Drops entries past their stale window and refreshes the first one due,
+ * with the lock released around the refresh. Returns how long to sleep.
+ */
+static long lokan_resolve_tick(lokan_resolver_t *resolver) {
+    uint64_t now = lokan_now_ms();
+    uint64_t wake = now + LOKAN_RESOLVE_IDLE_MS;
+    struct lokan_resolve_entry *due = NULL;
+    for (size_t i = 0; i < resolver->capacity; ++i) {
+        struct lokan_resolve_entry *entry = &resolver->entries[i];
+        if (!entry->used || entry->ttl_ms == LOKAN_RESOLVE_PERMANENT) {
+            continue;
+        }
+        uint64_t stale_until = entry->expires_ms + (uint64_t)resolver->max_stale_ms;
+        if (now >= stale_until) {
+            if (entry->addresses[0]) {
+                __atomic_add_fetch(&resolver->generation, 1, __ATOMIC_RELEASE);
+            }
+            lokan_resolve_entry_clear(entry);
+            continue;
+        }
+        if (now >= entry->refresh_at_ms) {
+            if (!due) {
+                due = entry;
+            }
+            continue;
+        }
+        wake = entry->refresh_at_ms < wake ? entry->refresh_at_ms : wake;
+        wake = stale_until < wake ? stale_until : wake;
+    }
+    if (!due) {
+        return (long)(wake - now);
+    }
+
+    /* Retried at least every twentieth of the TTL until an answer re-arms it. */
+    uint64_t retry = (uint64_t)due->ttl_ms / 20;
+    due->refresh_at_ms = now + (retry > LOKAN_RESOLVE_RETRY_MIN_MS ? retry : LOKAN_RESOLVE_RETRY_MIN_MS);
+    char host[LOKAN_RESOLVE_HOST_MAX];
+    memcpy(host, due->host, sizeof(host));
+    uint16_t port = due->port;
+    uint64_t version = due->version;
+    char addresses[LOKAN_RESOLVE_ADDRESSES_MAX];
+    lokan_result_t found = LOKAN_ERROR_UNAVAILABLE;
+
+    pthread_mutex_unlock(&resolver->mutex);
+    if (resolver->on_refresh) {
+        /* The answer, e.g. to a fresh mDNS query, arrives later through lokan_resolver_update. */
+        resolver->on_refresh(host, port, resolver->user_data);
+    } else {
+        found = lokan_resolve_lookup(host, addresses, sizeof(addresses));
+    }
+    pthread_mutex_lock(&resolver->mutex);
+
+    struct lokan_resolve_entry *entry = lokan_resolve_find(resolver, host, port);
+    if (found == LOKAN_OK && entry && entry->version == version) {
+        if (strcmp(entry->addresses, addresses) != 0) {
+            memcpy(entry->addresses, addresses, sizeof(entry->addresses));
+            __atomic_add_fetch(&resolver->generation, 1, __ATOMIC_RELEASE);
+        }
+        lokan_resolve_entry_arm(entry, resolver->default_ttl_ms, lokan_now_ms());
+        entry->version++;
+    }
+    return 0;
+}
+
+static void *lokan_resolve_run(void *arg) {
+    lokan_resolver_t *resolver = (lokan_resolver_t *)arg;
+    pthread_mutex_lock(&resolver->mutex);
+    while (!resolver->stopping) {
+        long wait_ms = lokan_resolve_tick(resolver);
+        if (wait_ms <= 0 || resolver->stopping) {
+            continue;
+        }
+        struct timespec until;
+        clock_gettime(CLOCK_MONOTONIC, &until);
+        until.tv_sec += wait_ms / 1000;
+        until.tv_nsec += (wait_ms % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&resolver->wake, &resolver->mutex, &until);
+    }
+    pthread_mutex_unlock(&resolver->mutex);
+    return NULL;
+}
+
+lokan_result_t lokan_resolver_create(lokan_resolver_t **out_resolver, const lokan_resolver_config_t *config) {
+    if (!out_resolver || !config) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    const lokan_allocator_t *allocator = lokan_default_allocator();
+    lokan_resolver_t *resolver = (lokan_resolver_t *)lokan_calloc(allocator, 1, sizeof(lokan_resolver_t));
+    if (!resolver) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    resolver->capacity = config->max_entries > 0 ? config->max_entries : LOKAN_RESOLVE_DEFAULT_ENTRIES;
+    resolver->entries =
+        (struct lokan_resolve_entry *)lokan_calloc(allocator, resolver->capacity, sizeof(struct lokan_resolve_entry));
+    if (!resolver->entries) {
+        lokan_free(allocator, resolver);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    resolver->default_ttl_ms = config->default_ttl_ms > 0 ? config->default_ttl_ms : LOKAN_RESOLVE_DEFAULT_TTL_MS;
+    resolver->max_stale_ms = config->max_stale_ms > 0 ? config->max_stale_ms : LOKAN_RESOLVE_DEFAULT_STALE_MS;
+    resolver->on_refresh = config->on_refresh;
+    resolver->user_data = config->user_data;
+    /* Clients start at generation 0, so the first request on each builds its list. */
+    resolver->generation = 1;
+
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&resolver->wake, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_mutex_init(&resolver->mutex, NULL);
+    if (pthread_create(&resolver->thread, NULL, lokan_resolve_run, resolver) != 0) {
+        pthread_cond_destroy(&resolver->wake);
+        pthread_mutex_destroy(&resolver->mutex);
+        lokan_free(allocator, resolver->entries);
+        lokan_free(allocator, resolver);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    *out_resolver = resolver;
+    return LOKAN_OK;
+}
+
+void lokan_resolver_destroy(lokan_resolver_t *resolver) {
+    if (!resolver) {
+        return;
+    }
+    pthread_mutex_lock(&resolver->mutex);
+    resolver->stopping = 1;
+    pthread_cond_signal(&resolver->wake);
+    pthread_mutex_unlock(&resolver->mutex);
+    pthread_join(resolver->thread, NULL);
+    pthread_cond_destroy(&resolver->wake);
+    pthread_mutex_destroy(&resolver->mutex);
+    lokan_free(lokan_default_allocator(), resolver->entries);
+    lokan_free(lokan_default_allocator(), resolver);
+}
+
+lokan_result_t lokan_resolver_update(
+    lokan_resolver_t *resolver,
+    const char *host,
+    uint16_t port,
+    const char *addresses,
+    long ttl_ms) {
+    if (!resolver || !host || !host[0] || strlen(host) >= LOKAN_RESOLVE_HOST_MAX || strchr(host, ':') || port == 0 ||
+        (ttl_ms < 0 && ttl_ms != LOKAN_RESOLVE_PERMANENT)) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    char formatted[LOKAN_RESOLVE_ADDRESSES_MAX] = "";
+    if (addresses) {
+        lokan_result_t result = lokan_resolve_format(addresses, formatted, sizeof(formatted));
+        if (result != LOKAN_OK) {
+            return result;
+        }
+    }
+    if (ttl_ms == 0) {
+        ttl_ms = resolver->default_ttl_ms;
+    }
+
+    pthread_mutex_lock(&resolver->mutex);
+    struct lokan_resolve_entry *entry = lokan_resolve_find(resolver, host, port);
+    if (!entry) {
+        for (size_t i = 0; i < resolver->capacity && !entry; ++i) {
+            if (!resolver->entries[i].used) {
+                entry = &resolver->entries[i];
+            }
+        }
+        if (!entry) {
+            pthread_mutex_unlock(&resolver->mutex);
+            return LOKAN_ERROR_OVERFLOW;
+        }
+        memcpy(entry->host, host, strlen(host) + 1);
+        entry->port = port;
+        entry->used = 1;
+    }
+    uint64_t now = lokan_now_ms();
+    if (addresses) {
+        if (strcmp(entry->addresses, formatted) != 0) {
+            memcpy(entry->addresses, formatted, sizeof(entry->addresses));
+            __atomic_add_fetch(&resolver->generation, 1, __ATOMIC_RELEASE);
+        }
+        lokan_resolve_entry_arm(entry, ttl_ms, now);
+    } else {
+        /* Looked up right away; until then requests resolve the host as they would without an entry. */
+        if (!entry->addresses[0]) {
+            entry->ttl_ms = ttl_ms == LOKAN_RESOLVE_PERMANENT ? resolver->default_ttl_ms : ttl_ms;
+            entry->expires_ms = now + (uint64_t)entry->ttl_ms;
+        }
+        entry->refresh_at_ms = now;
+    }
+    entry->version++;
+    pthread_cond_signal(&resolver->wake);
+    pthread_mutex_unlock(&resolver->mutex);
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_resolver_remove(lokan_resolver_t *resolver, const char *host, uint16_t port) {
+    if (!resolver || !host) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    pthread_mutex_lock(&resolver->mutex);
+    struct lokan_resolve_entry *entry = lokan_resolve_find(resolver, host, port);
+    if (entry) {
+        if (entry->addresses[0]) {
+            __atomic_add_fetch(&resolver->generation, 1, __ATOMIC_RELEASE);
+        }
+        lokan_resolve_entry_clear(entry);
+    }
+    pthread_mutex_unlock(&resolver->mutex);
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_resolve_client_init(lokan_client_t *client) {
+    size_t capacity = client->resolver->capacity;
+    struct lokan_resolve_list *list =
+        (struct lokan_resolve_list *)lokan_calloc(&client->allocator, 1, sizeof(struct lokan_resolve_list));
+    if (!list) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    list->capacity = capacity;
+    list->keys = (char (*)[LOKAN_RESOLVE_KEY_MAX])lokan_calloc(&client->allocator, capacity, LOKAN_RESOLVE_KEY_MAX);
+    list->lines =
+        (char (*)[LOKAN_RESOLVE_LINE_MAX])lokan_calloc(&client->allocator, capacity * 2, LOKAN_RESOLVE_LINE_MAX);
+    list->nodes = (struct curl_slist *)lokan_calloc(&client->allocator, capacity * 2, sizeof(struct curl_slist));
+    client->resolve_list = list;
+    if (!list->keys || !list->lines || !list->nodes) {
+        lokan_resolve_client_cleanup(client);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    return LOKAN_OK;
+}
+
+void lokan_resolve_client_cleanup(lokan_client_t *client) {
+    struct lokan_resolve_list *list = client->resolve_list;
+    if (!list) {
+        return;
+    }
+    lokan_free(&client->allocator, list->keys);
+    lokan_free(&client->allocator, list->lines);
+    lokan_free(&client->allocator, list->nodes);
+    lokan_free(&client->allocator, list);
+    client->resolve_list = NULL;
+}
+
+/*
+ * Rebuilds the list from the resolver: "-host:port" for keys pinned last
+ * time that are gone, then "host:port:addresses" for every resolved entry.
+ * Returns the number of lines.
+ */
+static size_t lokan_resolve_rebuild(lokan_resolver_t *resolver, struct lokan_resolve_list *list) {
+    size_t lines = 0;
+    pthread_mutex_lock(&resolver->mutex);
+    for (size_t k = 0; k < list->pinned; ++k) {
+        int kept = 0;
+        for (size_t i = 0; i < resolver->capacity && !kept; ++i) {
+            const struct lokan_resolve_entry *entry = &resolver->entries[i];
+            char key[LOKAN_RESOLVE_KEY_MAX];
+            snprintf(key, sizeof(key), "%s:%u", entry->host, (unsigned)entry->port);
+            kept = entry->used && entry->addresses[0] && strcmp(key, list->keys[k]) == 0;
+        }
+        if (!kept) {
+            snprintf(list->lines[lines++], LOKAN_RESOLVE_LINE_MAX, "-%s", list->keys[k]);
+        }
+    }
+    list->pinned = 0;
+    for (size_t i = 0; i < resolver->capacity; ++i) {
+        const struct lokan_resolve_entry *entry = &resolver->entries[i];
+        if (!entry->used || !entry->addresses[0]) {
+            continue;
+        }
+        char *key = list->keys[list->pinned++];
+        snprintf(key, LOKAN_RESOLVE_KEY_MAX, "%s:%u", entry->host, (unsigned)entry->port);
+        snprintf(list->lines[lines++], LOKAN_RESOLVE_LINE_MAX, "%s:%s", key, entry->addresses);
+    }
+    list->generation = resolver->generation;
+    pthread_mutex_unlock(&resolver->mutex);
+
+    for (size_t i = 0; i < lines; ++i) {
+        list->nodes[i].data = list->lines[i];
+        list->nodes[i].next = i + 1 < lines ? &list->nodes[i + 1] : NULL;
+    }
+    return lines;
+}
+
+void lokan_resolve_apply(const lokan_client_t *client, CURL *handle) {
+    struct lokan_resolve_list *list = client->resolve_list;
+    if (!list) {
+        return;
+    }
+    /* The common case, nothing changed, costs one atomic load. */
+    if (__atomic_load_n(&client->resolver->generation, __ATOMIC_ACQUIRE) == list->generation) {
+        return;
+    }
+    /*
+     * Every handle of the client shares one DNS cache, so loading the lines
+     * through whichever handle runs next updates them all.
+     */
+    if (lokan_resolve_rebuild(client->resolver, list) > 0) {
+        curl_easy_setopt(handle, CURLOPT_RESOLVE, list->nodes);
+    }
+}
@@ -0,0 +1,397 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <curl/curl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Routes past this many are not tracked, so requests to them are never refused. */
+#define LOKAN_CIRCUIT_MAX_ENDPOINTS 64
+/* Samples a route needs before LOKAN_HEDGE_P95 trusts its histogram. */
+#define LOKAN_HEDGE_MIN_SAMPLES 20
+
+struct lokan_circuit {
+    /* lokan_circuit_key of the client's base URL and the route; 0 marks a free slot. */
+    uint64_t key;
+    lokan_circuit_state_t state;
+    uint32_t failures;
+    /* When the circuit opened, or when the half-open probe was let through. */
+    uint64_t since_ms;
+    int probing;
+};
+
+struct lokan_circuit_breaker {
+    pthread_mutex_t mutex;
+    uint32_t failure_threshold;
+    long open_ms;
+    struct lokan_circuit circuits[LOKAN_CIRCUIT_MAX_ENDPOINTS];
+};
+
+lokan_result_t lokan_circuit_breaker_create(
+    lokan_circuit_breaker_t **out_breaker,
+    const lokan_circuit_breaker_config_t *config) {
+    if (!out_breaker) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    lokan_circuit_breaker_t *breaker =
+        (lokan_circuit_breaker_t *)lokan_calloc(lokan_default_allocator(), 1, sizeof(lokan_circuit_breaker_t));
+    if (!breaker) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    breaker->failure_threshold = config && config->failure_threshold > 0 ? config->failure_threshold : 5;
+    breaker->open_ms = config && config->open_ms > 0 ? config->open_ms : 5000;
+    pthread_mutex_init(&breaker->mutex, NULL);
+    *out_breaker = breaker;
+    return LOKAN_OK;
+}
+
+void lokan_circuit_breaker_destroy(lokan_circuit_breaker_t *breaker) {
+    if (!breaker) {
+        return;
+    }
+    pthread_mutex_destroy(&breaker->mutex);
+    lokan_free(lokan_default_allocator(), breaker);
+}
+
+/* FNV-1a over the base URL and the path up to its query, so clients of different services never share a circuit. */
+uint64_t lokan_circuit_key(const char *base_url, const char *path) {
+    uint64_t hash = 1469598103934665603ull;
+    for (const unsigned char *p = (const unsigned char *)base_url; *p; ++p) {
+        hash = (hash ^ *p) * 1099511628211ull;
+    }
+    hash = (hash ^ ' ') * 1099511628211ull;
+    for (const unsigned char *p = (const unsigned char *)path; *p && *p != '?'; ++p) {
+        hash = (hash ^ *p) * 1099511628211ull;
+    }
+    return hash ? hash : 1;
+}
+
+static struct lokan_circuit *lokan_circuit_find(lokan_circuit_breaker_t *breaker, uint64_t key, int create) {
+    struct lokan_circuit *vacant = NULL;
+    for (size_t i = 0; i < LOKAN_CIRCUIT_MAX_ENDPOINTS; ++i) {
+        struct lokan_circuit *circuit = &breaker->circuits[i];
+        if (circuit->key == key) {
+            return circuit;
+        }
+        /* A healthy circuit carries no state worth keeping, so its slot can be reused. */
+        if (!vacant && (circuit->key == 0 || (circuit->state == LOKAN_CIRCUIT_CLOSED && circuit->failures == 0))) {
+            vacant = circuit;
+        }
+    }
+    if (!create || !vacant) {
+        return NULL;
+    }
+    memset(vacant, 0, sizeof(*vacant));
+    vacant->key = key;
+    return vacant;
+}
+
+lokan_result_t lokan_circuit_allow(lokan_circuit_breaker_t *breaker, uint64_t key) {
+    lokan_result_t result = LOKAN_OK;
+    pthread_mutex_lock(&breaker->mutex);
+    struct lokan_circuit *circuit = lokan_circuit_find(breaker, key, 0);
+    if (circuit && circuit->state != LOKAN_CIRCUIT_CLOSED) {
+        uint64_t now = lokan_now_ms();
+        /* One probe at a time; a probe that never reported back is replaced after open_ms. */
+        int waited = now - circuit->since_ms >= (uint64_t)breaker->open_ms;
+        if (circuit->state == LOKAN_CIRCUIT_OPEN ? waited : (!circuit->probing || waited)) {
+            circuit->state = LOKAN_CIRCUIT_HALF_OPEN;
+            circuit->probing = 1;
+            circuit->since_ms = now;
+        } else {
+            result = LOKAN_ERROR_UNAVAILABLE;
+        }
+    }
+    pthread_mutex_unlock(&breaker->mutex);
+    return result;
+}
+
+void lokan_circuit_record(lokan_circuit_breaker_t *breaker, uint64_t key, CURLcode code, long status) {
+    int failed;
+    if (code == CURLE_WRITE_ERROR || code == CURLE_ABORTED_BY_CALLBACK) {
+        /* Aborted by the SDK or the caller: says nothing about the service. */
+        failed = -1;
+    } else if (code != CURLE_OK) {
+        failed = 1;
+    } else if (status == 429) {
+        /* Rate limited: the service is up but the caller should slow down, which retries handle. */
+        failed = -1;
+    } else {
+        failed = status >= 500;
+    }
+
+    pthread_mutex_lock(&breaker->mutex);
+    struct lokan_circuit *circuit = lokan_circuit_find(breaker, key, failed == 1);
+    if (circuit) {
+        if (failed == -1) {
+            circuit->probing = 0;
+        } else if (!failed) {
+            circuit->state = LOKAN_CIRCUIT_CLOSED;
+            circuit->failures = 0;
+            circuit->probing = 0;
+        } else if (circuit->state == LOKAN_CIRCUIT_HALF_OPEN ||
+                   (circuit->state == LOKAN_CIRCUIT_CLOSED && ++circuit->failures >= breaker->failure_threshold)) {
+            circuit->state = LOKAN_CIRCUIT_OPEN;
+            circuit->probing = 0;
+            circuit->since_ms = lokan_now_ms();
+        }
+    }
+    pthread_mutex_unlock(&breaker->mutex);
+}
+
+lokan_result_t lokan_client_circuit_state(lokan_client_t *client, const char *path, lokan_circuit_state_t *out_state) {
+    if (!client || !path || !out_state) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    *out_state = LOKAN_CIRCUIT_CLOSED;
+    lokan_circuit_breaker_t *breaker = client->circuit_breaker;
+    if (!breaker) {
+        return LOKAN_OK;
+    }
+    pthread_mutex_lock(&breaker->mutex);
+    const struct lokan_circuit *circuit = lokan_circuit_find(breaker, lokan_circuit_key(client->base_url, path), 0);
+    if (circuit) {
+        *out_state = circuit->state;
+        /* An open circuit whose wait is over admits the next request as a probe. */
+        if (circuit->state == LOKAN_CIRCUIT_OPEN && lokan_now_ms() - circuit->since_ms >= (uint64_t)breaker->open_ms) {
+            *out_state = LOKAN_CIRCUIT_HALF_OPEN;
+        }
+    }
+    pthread_mutex_unlock(&breaker->mutex);
+    return LOKAN_OK;
+}
+
+static int lokan_method_idempotent(const char *method) {
+    static const char *const methods[] = {"GET", "HEAD", "PUT", "DELETE", "OPTIONS"};
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); ++i) {
+        if (strcmp(method, methods[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Failures after which the request may have reached the service, so only idempotent methods retry them. */
+static int lokan_transport_transient(CURLcode code) {
+    switch (code) {
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static long lokan_retry_after_ms(CURL *handle) {
+#if LIBCURL_VERSION_NUM >= 0x074200
+    curl_off_t seconds = 0;
+    if (curl_easy_getinfo(handle, CURLINFO_RETRY_AFTER, &seconds) == CURLE_OK && seconds > 0) {
+        return seconds > 86400 ? 86400L * 1000 : (long)seconds * 1000;
+    }
+#else
+    (void)handle;
+#endif
+    return -1;
+}
+
+long lokan_retry_delay(
+    lokan_client_t *client,
+    CURL *handle,
+    const char *method,
+    CURLcode code,
+    long status,
+    int attempts) {
+    const lokan_retry_policy_t *policy = &client->retry;
+    if (attempts >= policy->max_attempts) {
+        return -1;
+    }
+
+    int idempotent = lokan_method_idempotent(method);
+    int retryable;
+    if (code == CURLE_COULDNT_RESOLVE_HOST || code == CURLE_COULDNT_CONNECT) {
+        /* Nothing was sent, so even a POST is safe to repeat. */
+        retryable = 1;
+    } else if (code != CURLE_OK) {
+        retryable = idempotent && lokan_transport_transient(code);
+    } else if (status == 429) {
+        /* The gateway's rate limiter rejects before forwarding, so the request never ran. */
+        retryable = 1;
+    } else {
+        retryable = idempotent && (status == 408 || status == 502 || status == 503 || status == 504);
+    }
+    if (!retryable) {
+        return -1;
+    }
+
+    long jitter_cap = policy->base_delay_ms;
+    if (code == CURLE_OK && (status == 429 || status == 503)) {
+        long retry_after = lokan_retry_after_ms(handle);
+        if (retry_after > policy->max_delay_ms) {
+            /* Waiting that long in a blocking call is worse than failing now. */
+            return -1;
+        }
+        if (retry_after >= 0) {
+            /* Spread clients told the same Retry-After so they do not return together. */
+            return retry_after + (long)(rand_r(&client->retry_seed) % (unsigned long)(jitter_cap + 1));
+        }
+    }
+
+    /* Full jitter: a random delay up to base * 2^(attempts - 1), capped at max_delay_ms. */
+    long cap = policy->base_delay_ms;
+    for (int i = 1; i < attempts && cap < policy->max_delay_ms; ++i) {
+        cap *= 2;
+    }
+    if (cap > policy->max_delay_ms) {
+        cap = policy->max_delay_ms;
+    }
+    return (long)(rand_r(&client->retry_seed) % (unsigned long)(cap + 1));
+}
+
+void lokan_sleep_ms(long ms) {
+    struct timespec remaining = {ms / 1000, (ms % 1000) * 1000000L};
+    while (nanosleep(&remaining, &remaining) != 0 && errno == EINTR) {
+    }
+}
+
+long lokan_hedge_deadline_ms(const lokan_client_t *client, const char *path) {
+    if (client->hedge_after_ms != LOKAN_HEDGE_P95) {
+        return client->hedge_after_ms > 0 ? client->hedge_after_ms : 0;
+    }
+    if (!client->metrics) {
+        return 0;
+    }
+    double seconds = lokan_metrics_quantile(client->metrics, path, 0.95, LOKAN_HEDGE_MIN_SAMPLES);
+    if (seconds < 0) {
+        return 0;
+    }
+    long ms = (long)(seconds * 1000.0 + 0.5);
+    return ms > 0 ? ms : 1;
+}
+
+static lokan_result_t lokan_hedge_ensure(lokan_client_t *client) {
+    if (!client->hedge_multi) {
+        client->hedge_multi = curl_multi_init();
+        if (!client->hedge_multi) {
+            return LOKAN_ERROR_CURL;
+        }
+    }
+    if (!client->hedge_handle) {
+        client->hedge_handle = curl_easy_init();
+        if (!client->hedge_handle) {
+            return LOKAN_ERROR_CURL;
+        }
+        lokan_configure_handle(client, client->hedge_handle);
+        curl_easy_setopt(client->hedge_handle, CURLOPT_WRITEDATA, (void *)&client->hedge_response);
+    }
+    return LOKAN_OK;
+}
+
+CURLcode lokan_hedged_perform(
+    lokan_client_t *client,
+    const char *path,
+    long deadline_ms,
+    CURL **out_winner,
+    int *out_sent) {
+    *out_winner = client->handle;
+    *out_sent = 1;
+    if (lokan_hedge_ensure(client) != LOKAN_OK) {
+        return curl_easy_perform(client->handle);
+    }
+
+    CURLM *multi = client->hedge_multi;
+    if (curl_multi_add_handle(multi, client->handle) != CURLM_OK) {
+        return curl_easy_perform(client->handle);
+    }
+
+    lokan_memory_recycle(&client->hedge_response);
+    /* 0 before the hedge is due, 1 while it runs, -1 once it can no longer start. */
+    int hedge = 0;
+    int running = 1;
+    CURL *winner = NULL;
+    CURLcode result = CURLE_OK;
+    CURLcode first_failure = CURLE_OK;
+    uint64_t started = lokan_now_ms();
+
+    while (!winner) {
+        if (curl_multi_perform(multi, &running) != CURLM_OK) {
+            result = CURLE_RECV_ERROR;
+            break;
+        }
+
+        CURLMsg *message = NULL;
+        int queued = 0;
+        while (!winner && (message = curl_multi_info_read(multi, &queued)) != NULL) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+            CURL *done = message->easy_handle;
+            CURLcode code = message->data.result;
+            curl_multi_remove_handle(multi, done);
+            /* The first success wins; a failure only counts once the other copy cannot answer either. */
+            if (code == CURLE_OK || hedge != 1 || first_failure != CURLE_OK) {
+                winner = done;
+                result = code;
+            } else {
+                first_failure = code;
+                hedge = -1;
+            }
+        }
+        if (winner) {
+            break;
+        }
+
+        uint64_t elapsed = lokan_now_ms() - started;
+        if (hedge == 0 && elapsed >= (uint64_t)deadline_ms) {
+            hedge = -1;
+            /* Preparing on the same path re-checks the circuit; a half-open probe is never doubled. */
+            if (lokan_rate_limit(client, 0) == LOKAN_OK &&
+                lokan_prepare_request(client, client->hedge_handle, path, "GET", NULL, 0, 0, NULL, NULL) == LOKAN_OK &&
+                curl_multi_add_handle(multi, client->hedge_handle) == CURLM_OK) {
+                hedge = 1;
+                *out_sent = 2;
+                continue;
+            }
+        }
+
+        int wait_ms = 1000;
+        if (hedge == 0) {
+            uint64_t remaining = (uint64_t)deadline_ms - elapsed;
+            wait_ms = remaining < (uint64_t)wait_ms ? (int)remaining : wait_ms;
+        }
+#if LIBCURL_VERSION_NUM >= 0x074200
+        curl_multi_poll(multi, NULL, 0, wait_ms, NULL);
+#else
+        curl_multi_wait(multi, NULL, 0, wait_ms, NULL);
+#endif
+    }
+
+    /* Whatever is still running lost the race. */
+    curl_multi_remove_handle(multi, client->handle);
+    if (*out_sent == 2) {
+        curl_multi_remove_handle(multi, client->hedge_handle);
+    }
+    if (winner) {
+        *out_winner = winner;
+    }
+    return result;
+}
+
+void lokan_hedge_cleanup(lokan_client_t *client) {
+    if (client->hedge_handle) {
+        curl_easy_cleanup(client->hedge_handle);
+        client->hedge_handle = NULL;
+    }
+    if (client->hedge_multi) {
+        curl_multi_cleanup(client->hedge_multi);
+        client->hedge_multi = NULL;
+    }
+}
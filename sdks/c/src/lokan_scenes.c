@@ -0,0 +1,390 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Scenes per batch request; scene-svc rejects larger batches. */
+#define LOKAN_SCENE_BATCH_MAX 64
+/* Scene requests kept in flight when pipelining single applies without the batch endpoint. */
+#define LOKAN_SCENE_PIPELINE_MAX 8
+/* Offset of a scene whose response body was not kept. */
+#define LOKAN_SCENE_NO_BODY SIZE_MAX
+
+static const char lokan_batch_open[] = "{\"scenes\":[";
+static const char lokan_batch_close[] = "]}";
+/* A scene without a payload goes out as a SceneRequest naming it, with nothing to apply. */
+static const char lokan_scene_request_open[] = "{\"scene_id\":\"";
+static const char lokan_scene_request_close[] = "\",\"operations\":[]}";
+
+/* The member of a batched scene result the SDK reads, {"status":"applied",...}. */
+struct lokan_scene_outcome {
+    uint32_t present;
+    lokan_view_t status;
+};
+
+static const struct lokan_field lokan_scene_outcome_fields[] = {
+    {"status", 6, LOKAN_FIELD_STRING, offsetof(struct lokan_scene_outcome, status), 1u},
+};
+
+static const struct lokan_schema lokan_scene_outcome_schema = {
+    lokan_scene_outcome_fields,
+    sizeof(lokan_scene_outcome_fields) / sizeof(lokan_scene_outcome_fields[0]),
+    sizeof(struct lokan_scene_outcome),
+    offsetof(struct lokan_scene_outcome, present),
+    1u,
+};
+
+static size_t lokan_scene_request_len(const char *scene_id) {
+    return (sizeof(lokan_scene_request_open) - 1) + lokan_json_escaped_len(scene_id) +
+           (sizeof(lokan_scene_request_close) - 1);
+}
+
+static char *lokan_scene_request_into(char *out, const char *scene_id) {
+    memcpy(out, lokan_scene_request_open, sizeof(lokan_scene_request_open) - 1);
+    out = lokan_json_escape_into(out + sizeof(lokan_scene_request_open) - 1, scene_id);
+    memcpy(out, lokan_scene_request_close, sizeof(lokan_scene_request_close) - 1);
+    return out + sizeof(lokan_scene_request_close) - 1;
+}
+
+/* Copies a scene's body into client->decoded; views are pointed at it once every scene is done. */
+static lokan_result_t lokan_scene_keep(lokan_client_t *client, const char *data, size_t len, size_t *out_offset) {
+    struct lokan_memory *kept = &client->decoded;
+    if (lokan_memory_reserve(kept, kept->size + len + 1) != LOKAN_OK) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    *out_offset = kept->size;
+    if (len > 0) {
+        memcpy(kept->data + kept->size, data, len);
+    }
+    kept->size += len;
+    kept->data[kept->size++] = '\0';
+    return LOKAN_OK;
+}
+
+/* LOKAN_OK for a scene result whose status is "applied", LOKAN_ERROR_SCENE_FAILED for any other. */
+static lokan_result_t lokan_scene_outcome(
+    struct lokan_decoder *decoder,
+    struct lokan_memory *strings,
+    const char *data,
+    size_t len) {
+    struct lokan_scene_outcome outcome;
+    lokan_memory_recycle(strings);
+    lokan_result_t result = LOKAN_ERROR_ALLOCATION;
+    if (lokan_memory_reserve(strings, len + 1) == LOKAN_OK) {
+        result = lokan_decoder_run(decoder, &lokan_scene_outcome_schema, data, len, &outcome, strings);
+    }
+    if (result == LOKAN_OK && !(outcome.status.size == 7 && memcmp(outcome.status.data, "applied", 7) == 0)) {
+        result = LOKAN_ERROR_SCENE_FAILED;
+    }
+    return result;
+}
+
+static void lokan_scene_fail(lokan_scene_result_t *result, lokan_result_t code, long status) {
+    result->result = code;
+    result->status = status;
+    result->body.data = "";
+    result->body.size = 0;
+}
+
+struct lokan_scene_batch {
+    lokan_client_t *client;
+    lokan_scene_result_t *results;
+    size_t *offsets;
+    size_t count;
+    size_t seen;
+    long status;
+    lokan_result_t error;
+    struct lokan_decoder *decoder;
+    struct lokan_memory strings;
+};
+
+static int lokan_scene_batch_element(const char *element, size_t len, void *user_data) {
+    struct lokan_scene_batch *batch = (struct lokan_scene_batch *)user_data;
+    if (batch->seen == batch->count) {
+        return 0;
+    }
+    size_t index = batch->seen++;
+    if (lokan_scene_keep(batch->client, element, len, &batch->offsets[index]) != LOKAN_OK) {
+        batch->error = LOKAN_ERROR_ALLOCATION;
+        return 1;
+    }
+    /* The batch answers 200 as a whole; whether this scene applied is in its own status. */
+    batch->results[index].result = lokan_scene_outcome(batch->decoder, &batch->strings, element, len);
+    batch->results[index].status = batch->status;
+    batch->results[index].body.size = len;
+    return 0;
+}
+
+/*
+ * Sends up to LOKAN_SCENE_BATCH_MAX scenes in one request, their payloads
+ * gathered straight from caller memory. Returns LOKAN_ERROR_HTTP with
+ * *out_status 404 or 405 when the service has no batch endpoint.
+ */
+static lokan_result_t lokan_scene_batch_send(
+    lokan_client_t *client,
+    const lokan_scene_apply_t *scenes,
+    size_t count,
+    lokan_scene_result_t *results,
+    size_t *offsets,
+    long *out_status) {
+    const lokan_allocator_t *scratch = lokan_scratch_allocator(client);
+    *out_status = 0;
+
+    size_t envelope_bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!scenes[i].payload_json) {
+            envelope_bytes += lokan_scene_request_len(scenes[i].scene_id);
+        }
+    }
+    lokan_iovec_t *iov = (lokan_iovec_t *)lokan_alloc(scratch, (2 * count + 1) * sizeof(lokan_iovec_t));
+    char *envelopes = envelope_bytes > 0 ? (char *)lokan_alloc(scratch, envelope_bytes) : NULL;
+    lokan_json_parser_t *parser = NULL;
+    struct lokan_scene_batch batch = {client, results, offsets, count, 0, 0, LOKAN_OK, NULL, {0}};
+    batch.strings.allocator = scratch;
+    lokan_json_parser_config_t config = {0};
+    config.on_element = lokan_scene_batch_element;
+    config.array_key = "results";
+    config.user_data = &batch;
+    lokan_result_t result = LOKAN_ERROR_ALLOCATION;
+    if (!iov || (envelope_bytes > 0 && !envelopes) ||
+        lokan_json_parser_create_with(&parser, &config, scratch) != LOKAN_OK ||
+        lokan_decoder_create(&batch.decoder, scratch) != LOKAN_OK) {
+        goto done;
+    }
+
+    size_t segments = 0;
+    char *envelope = envelopes;
+    iov[segments].data = lokan_batch_open;
+    iov[segments++].len = sizeof(lokan_batch_open) - 1;
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            iov[segments].data = ",";
+            iov[segments++].len = 1;
+        }
+        if (scenes[i].payload_json) {
+            iov[segments].data = scenes[i].payload_json;
+            iov[segments++].len = strlen(scenes[i].payload_json);
+        } else {
+            char *end = lokan_scene_request_into(envelope, scenes[i].scene_id);
+            iov[segments].data = envelope;
+            iov[segments++].len = (size_t)(end - envelope);
+            envelope = end;
+        }
+    }
+    iov[segments].data = lokan_batch_close;
+    iov[segments++].len = sizeof(lokan_batch_close) - 1;
+
+    long status = 0;
+    lokan_view_t body = {NULL, 0};
+    result = lokan_request_iov(client, "POST", "/v1/scenes:batchApply", iov, segments, &status, &body);
+    *out_status = status;
+    if (result != LOKAN_OK) {
+        goto done;
+    }
+
+    batch.status = status;
+    result = lokan_json_parser_feed(parser, body.data, body.size);
+    if (result == LOKAN_OK) {
+        result = lokan_json_parser_finish(parser);
+    }
+    if (batch.error != LOKAN_OK) {
+        result = batch.error;
+    }
+    if (result == LOKAN_OK && batch.seen < count) {
+        result = LOKAN_ERROR_PARSE;
+    }
+
+done:
+    /* Scenes the response did not account for carry the batch's failure. */
+    for (size_t i = batch.seen; i < count; ++i) {
+        lokan_scene_fail(&results[i], result == LOKAN_OK ? LOKAN_ERROR_PARSE : result, *out_status);
+    }
+    lokan_json_parser_destroy(parser);
+    lokan_decoder_destroy(batch.decoder);
+    lokan_free(scratch, batch.strings.data);
+    lokan_free(scratch, envelopes);
+    lokan_free(scratch, iov);
+    return result;
+}
+
+struct lokan_scene_pipeline;
+
+struct lokan_scene_call {
+    struct lokan_scene_pipeline *pipeline;
+    size_t index;
+};
+
+struct lokan_scene_pipeline {
+    lokan_client_t *client;
+    lokan_scene_result_t *results;
+    size_t *offsets;
+    size_t in_flight;
+    struct lokan_decoder *decoder;
+    struct lokan_memory strings;
+};
+
+static void lokan_scene_completed(const lokan_response_t *response, void *user_data) {
+    struct lokan_scene_call *call = (struct lokan_scene_call *)user_data;
+    struct lokan_scene_pipeline *pipeline = call->pipeline;
+    lokan_scene_result_t *result = &pipeline->results[call->index];
+    pipeline->in_flight--;
+    result->result = response->result;
+    result->status = response->status;
+    result->body.size = response->body_len;
+    if (lokan_scene_keep(pipeline->client, response->body, response->body_len, &pipeline->offsets[call->index]) !=
+        LOKAN_OK) {
+        lokan_scene_fail(result, LOKAN_ERROR_ALLOCATION, response->status);
+        return;
+    }
+    /* Like a batch element, a 200 only says the scene ran; its status says whether it applied. */
+    if (response->result == LOKAN_OK) {
+        result->result = lokan_scene_outcome(pipeline->decoder, &pipeline->strings, response->body, response->body_len);
+    }
+}
+
+/*
+ * Falls back to one POST /v1/scenes:apply per scene, with the same scene
+ * request the batch would have carried, LOKAN_SCENE_PIPELINE_MAX at a time on
+ * the async engine.
+ */
+static void lokan_scene_pipeline_send(
+    lokan_client_t *client,
+    const lokan_scene_apply_t *scenes,
+    size_t count,
+    lokan_scene_result_t *results,
+    size_t *offsets) {
+    const lokan_allocator_t *scratch = lokan_scratch_allocator(client);
+    struct lokan_scene_call *calls =
+        (struct lokan_scene_call *)lokan_alloc(scratch, count * sizeof(struct lokan_scene_call));
+    struct lokan_scene_pipeline pipeline = {client, results, offsets, 0, NULL, {0}};
+    pipeline.strings.allocator = scratch;
+    if (!calls || lokan_decoder_create(&pipeline.decoder, scratch) != LOKAN_OK) {
+        for (size_t i = 0; i < count; ++i) {
+            lokan_scene_fail(&results[i], LOKAN_ERROR_ALLOCATION, 0);
+        }
+        lokan_free(scratch, calls);
+        return;
+    }
+
+    size_t next = 0;
+    while (next < count || pipeline.in_flight > 0) {
+        while (next < count && pipeline.in_flight < LOKAN_SCENE_PIPELINE_MAX) {
+            const lokan_scene_apply_t *scene = &scenes[next];
+            calls[next].pipeline = &pipeline;
+            calls[next].index = next;
+
+            /* Submit copies the body, so a default envelope only needs to outlive the call. */
+            char inline_body[LOKAN_INLINE_BODY_MAX];
+            const char *body = scene->payload_json;
+            char *built = NULL;
+            size_t body_len = 0;
+            if (body) {
+                body_len = strlen(body);
+            } else {
+                body_len = lokan_scene_request_len(scene->scene_id);
+                built = body_len > sizeof(inline_body) ? (char *)lokan_alloc(scratch, body_len) : inline_body;
+                if (built) {
+                    lokan_scene_request_into(built, scene->scene_id);
+                }
+                body = built;
+            }
+
+            lokan_result_t submitted = LOKAN_ERROR_ALLOCATION;
+            if (body) {
+                submitted = lokan_request_submit(client, "POST", "/v1/scenes:apply", body, body_len,
+                                                 lokan_scene_completed, &calls[next]);
+            }
+            if (built && built != inline_body) {
+                lokan_free(scratch, built);
+            }
+            if (submitted == LOKAN_OK) {
+                pipeline.in_flight++;
+            } else {
+                lokan_scene_fail(&results[next], submitted, 0);
+            }
+            next++;
+        }
+        if (pipeline.in_flight == 0) {
+            continue;
+        }
+        /* Completions point into this frame, so every request is driven to the end before returning. */
+        if (lokan_client_poll(client, 1000, NULL) != LOKAN_OK) {
+            lokan_sleep_ms(10);
+            lokan_client_perform(client, NULL);
+        }
+    }
+    lokan_decoder_destroy(pipeline.decoder);
+    lokan_free(scratch, pipeline.strings.data);
+    lokan_free(scratch, calls);
+}
+
+lokan_result_t lokan_apply_scenes(
+    lokan_client_t *client,
+    const lokan_scene_apply_t *scenes,
+    size_t count,
+    lokan_scene_result_t *out_results) {
+    if (!client || (!scenes && count > 0) || (!out_results && count > 0)) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (!scenes[i].scene_id) {
+            return LOKAN_ERROR_INVALID_ARGUMENT;
+        }
+    }
+    if (count == 0) {
+        return LOKAN_OK;
+    }
+
+    lokan_arena_mark_t mark = {0, NULL};
+    if (client->arena) {
+        mark = lokan_arena_mark(client->arena);
+    }
+    const lokan_allocator_t *scratch = lokan_scratch_allocator(client);
+    size_t *offsets = (size_t *)lokan_alloc(scratch, count * sizeof(size_t));
+    if (!offsets) {
+        if (client->arena) {
+            lokan_arena_release(client->arena, mark);
+        }
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        offsets[i] = LOKAN_SCENE_NO_BODY;
+    }
+    lokan_memory_recycle(&client->decoded);
+
+    size_t done = 0;
+    while (done < count && !client->scene_batch_unsupported) {
+        size_t chunk = count - done < LOKAN_SCENE_BATCH_MAX ? count - done : LOKAN_SCENE_BATCH_MAX;
+        long status = 0;
+        lokan_result_t result =
+            lokan_scene_batch_send(client, scenes + done, chunk, out_results + done, offsets + done, &status);
+        if (result == LOKAN_ERROR_HTTP && (status == 404 || status == 405)) {
+            /* An older scene service: remember, and pipeline single applies from here on. */
+            client->scene_batch_unsupported = 1;
+            break;
+        }
+        done += chunk;
+    }
+    if (done < count) {
+        lokan_scene_pipeline_send(client, scenes + done, count - done, out_results + done, offsets + done);
+    }
+
+    /* client->decoded only stops growing now, so views can point into it. */
+    lokan_result_t first_failure = LOKAN_OK;
+    for (size_t i = 0; i < count; ++i) {
+        if (offsets[i] != LOKAN_SCENE_NO_BODY) {
+            out_results[i].body.data = client->decoded.data + offsets[i];
+        }
+        if (first_failure == LOKAN_OK && out_results[i].result != LOKAN_OK) {
+            first_failure = out_results[i].result;
+        }
+    }
+
+    lokan_free(scratch, offsets);
+    if (client->arena) {
+        lokan_arena_release(client->arena, mark);
+    }
+    return first_failure;
+}
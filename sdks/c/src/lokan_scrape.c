@@ -0,0 +1,309 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <curl/curl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOKAN_SCRAPE_DEFAULT_PATH "/metrics"
+/* Longest exposition line kept whole across chunk boundaries; longer ones are skipped. */
+#define LOKAN_SCRAPE_LINE_MAX 1024
+/* Longest value or timestamp token, e.g. -1.7976931348623157e+308. */
+#define LOKAN_SCRAPE_TOKEN_MAX 64
+
+struct lokan_scrape_sink {
+    CURL *handle;
+    lokan_scrape_table_t *table;
+    int status_checked;
+    int discard;
+    /* Start of a line split across chunks, and whether it outgrew line and is being skipped. */
+    char line[LOKAN_SCRAPE_LINE_MAX];
+    size_t line_len;
+    int overlong;
+};
+
+/* FNV-1a, 32-bit, as the series slots store it. */
+static uint32_t lokan_scrape_hash(const char *data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+lokan_result_t lokan_scrape_table_init(
+    lokan_scrape_table_t *table,
+    lokan_scrape_series_t *series,
+    size_t capacity,
+    char *names,
+    size_t names_capacity) {
+    if (!table || !series || !names || capacity < 2 || (capacity & (capacity - 1)) != 0) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    memset(table, 0, sizeof(*table));
+    memset(series, 0, capacity * sizeof(*series));
+    table->series = series;
+    table->capacity = capacity;
+    table->names = names;
+    table->names_capacity = names_capacity;
+    return LOKAN_OK;
+}
+
+/* Slot holding key, or the empty slot it would go in. */
+static lokan_scrape_series_t *lokan_scrape_slot(const lokan_scrape_table_t *table, const char *key, size_t len, uint32_t hash) {
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        lokan_scrape_series_t *slot = &table->series[i];
+        if (!slot->key ||
+            (slot->hash == hash && slot->key_len == len && memcmp(slot->key, key, len) == 0)) {
+            return slot;
+        }
+    }
+}
+
+const lokan_scrape_series_t *lokan_scrape_find(const lokan_scrape_table_t *table, const char *key) {
+    if (!table || !key || !table->series) {
+        return NULL;
+    }
+    size_t len = strlen(key);
+    const lokan_scrape_series_t *slot = lokan_scrape_slot(table, key, len, lokan_scrape_hash(key, len));
+    return slot->key ? slot : NULL;
+}
+
+/* Whether a sample of metric name should be kept under table->match. */
+static int lokan_scrape_wanted(const lokan_scrape_table_t *table, const char *name, size_t len) {
+    if (!table->match) {
+        return 1;
+    }
+    static const struct {
+        const char *text;
+        size_t len;
+    } suffixes[] = {{"", 0}, {"_bucket", 7}, {"_sum", 4}, {"_count", 6}};
+    for (size_t i = 0; i < table->match_count; ++i) {
+        const char *wanted = table->match[i];
+        size_t wanted_len = strlen(wanted);
+        if (len < wanted_len || memcmp(name, wanted, wanted_len) != 0) {
+            continue;
+        }
+        for (size_t s = 0; s < sizeof(suffixes) / sizeof(suffixes[0]); ++s) {
+            if (len == wanted_len + suffixes[s].len && memcmp(name + wanted_len, suffixes[s].text, suffixes[s].len) == 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int lokan_scrape_name_char(char c, int first) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':' || (!first && c >= '0' && c <= '9');
+}
+
+static const char *lokan_scrape_skip_blanks(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+/* Copies the token at p into out, NUL-terminated, and returns its end; NULL when it is empty or too long. */
+static const char *lokan_scrape_token(const char *p, const char *end, char *out) {
+    const char *start = p;
+    while (p < end && *p != ' ' && *p != '\t') {
+        p++;
+    }
+    size_t len = (size_t)(p - start);
+    if (len == 0 || len >= LOKAN_SCRAPE_TOKEN_MAX) {
+        return NULL;
+    }
+    memcpy(out, start, len);
+    out[len] = '\0';
+    return p;
+}
+
+/*
+ * Parses one line, name{labels} value [timestamp], into the table. Returns 0
+ * for a stored sample or a line without one (blank, # HELP, # TYPE, or a
+ * metric not matched), 1 for one that is malformed or does not fit.
+ */
+static int lokan_scrape_line(lokan_scrape_table_t *table, const char *p, const char *end) {
+    if (end > p && end[-1] == '\r') {
+        end--;
+    }
+    p = lokan_scrape_skip_blanks(p, end);
+    if (p == end || *p == '#') {
+        return 0;
+    }
+
+    const char *key = p;
+    if (!lokan_scrape_name_char(*p, 1)) {
+        return 1;
+    }
+    while (p < end && lokan_scrape_name_char(*p, 0)) {
+        p++;
+    }
+    size_t name_len = (size_t)(p - key);
+    if (p < end && *p == '{') {
+        /* Label values are quoted and may escape quotes, so only a brace outside quotes closes the set. */
+        int quoted = 0;
+        for (p++; p < end; ++p) {
+            if (quoted && *p == '\\' && p + 1 < end) {
+                p++;
+            } else if (*p == '"') {
+                quoted = !quoted;
+            } else if (!quoted && *p == '}') {
+                break;
+            }
+        }
+        if (p == end) {
+            return 1;
+        }
+        p++;
+    }
+    size_t key_len = (size_t)(p - key);
+    if (!lokan_scrape_wanted(table, key, name_len)) {
+        return 0;
+    }
+
+    char token[LOKAN_SCRAPE_TOKEN_MAX];
+    char *parsed = NULL;
+    p = lokan_scrape_token(lokan_scrape_skip_blanks(p, end), end, token);
+    if (!p) {
+        return 1;
+    }
+    /* strtod also reads NaN, +Inf and -Inf, the exposition format's spellings of the special values. */
+    double value = strtod(token, &parsed);
+    if (*parsed != '\0') {
+        return 1;
+    }
+    int64_t timestamp_ms = 0;
+    p = lokan_scrape_skip_blanks(p, end);
+    if (p < end) {
+        p = lokan_scrape_token(p, end, token);
+        if (!p) {
+            return 1;
+        }
+        timestamp_ms = (int64_t)strtoll(token, &parsed, 10);
+        if (*parsed != '\0' || lokan_scrape_skip_blanks(p, end) != end) {
+            return 1;
+        }
+    }
+
+    uint32_t hash = lokan_scrape_hash(key, key_len);
+    lokan_scrape_series_t *slot = lokan_scrape_slot(table, key, key_len, hash);
+    if (!slot->key) {
+        /* A new series: its key is interned once and reused by every later scrape. */
+        if ((table->count + 1) * 4 > table->capacity * 3 || table->names_used + key_len + 1 > table->names_capacity) {
+            return 1;
+        }
+        char *interned = table->names + table->names_used;
+        memcpy(interned, key, key_len);
+        interned[key_len] = '\0';
+        table->names_used += key_len + 1;
+        table->count++;
+        slot->key = interned;
+        slot->key_len = key_len;
+        slot->hash = hash;
+    }
+    slot->value = value;
+    slot->timestamp_ms = timestamp_ms;
+    slot->scrape = table->scrapes;
+    return 0;
+}
+
+/* Splits the body into lines as it arrives; only a line cut by a chunk boundary is copied. */
+static size_t lokan_scrape_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    struct lokan_scrape_sink *sink = (struct lokan_scrape_sink *)userp;
+    if (!sink->status_checked) {
+        /* Headers are complete by the first body byte, so the status is final here. */
+        long status = 0;
+        curl_easy_getinfo(sink->handle, CURLINFO_RESPONSE_CODE, &status);
+        sink->discard = status >= 400;
+        sink->status_checked = 1;
+    }
+    if (sink->discard) {
+        return realsize;
+    }
+
+    const char *p = (const char *)contents;
+    const char *end = p + realsize;
+    while (p < end) {
+        /* memchr does the byte scan, vectorised by glibc on x86-64 and AArch64. */
+        const char *newline = (const char *)memchr(p, '\n', (size_t)(end - p));
+        const char *stop = newline ? newline : end;
+        size_t len = (size_t)(stop - p);
+        if (sink->line_len == 0 && !sink->overlong && newline) {
+            sink->table->skipped += (size_t)lokan_scrape_line(sink->table, p, newline);
+        } else if (!sink->overlong) {
+            if (sink->line_len + len > sizeof(sink->line)) {
+                sink->overlong = 1;
+            } else {
+                memcpy(sink->line + sink->line_len, p, len);
+                sink->line_len += len;
+                if (newline) {
+                    sink->table->skipped += (size_t)lokan_scrape_line(sink->table, sink->line, sink->line + sink->line_len);
+                    sink->line_len = 0;
+                }
+            }
+        }
+        if (newline && sink->overlong) {
+            sink->table->skipped++;
+            sink->overlong = 0;
+            sink->line_len = 0;
+        }
+        p = newline ? newline + 1 : end;
+    }
+    return realsize;
+}
+
+lokan_result_t lokan_scrape_metrics(lokan_client_t *client, const char *path, lokan_scrape_table_t *table, long *out_status) {
+    if (!client || !client->handle || !table || !table->series) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (!path) {
+        path = LOKAN_SCRAPE_DEFAULT_PATH;
+    }
+    lokan_result_t result = lokan_rate_limit(client, 1);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    result = lokan_prepare_request(client, client->handle, path, "GET", NULL, 0, 0, NULL, NULL);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+
+    table->scrapes++;
+    table->skipped = 0;
+    struct lokan_scrape_sink sink;
+    sink.handle = client->handle;
+    sink.table = table;
+    sink.status_checked = 0;
+    sink.discard = 0;
+    sink.line_len = 0;
+    sink.overlong = 0;
+    curl_easy_setopt(client->handle, CURLOPT_WRITEFUNCTION, lokan_scrape_write_callback);
+    curl_easy_setopt(client->handle, CURLOPT_WRITEDATA, (void *)&sink);
+
+    long status = 0;
+    CURLcode res = curl_easy_perform(client->handle);
+    result = lokan_finish_request(client, client->handle, path, res, &status, &client->last_timing);
+    if (out_status) {
+        *out_status = status;
+    }
+
+    /* Every other blocking call expects the buffering sink configured once at init. */
+    curl_easy_setopt(client->handle, CURLOPT_WRITEFUNCTION, lokan_write_callback);
+    curl_easy_setopt(client->handle, CURLOPT_WRITEDATA, (void *)&client->response);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+
+    /* The body may end without a newline after its last sample. */
+    if (sink.overlong) {
+        table->skipped++;
+    } else if (sink.line_len > 0) {
+        table->skipped += (size_t)lokan_scrape_line(table, sink.line, sink.line + sink.line_len);
+    }
+    return LOKAN_OK;
+}
@@ -0,0 +1,244 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOKAN_SPOOL_MAGIC "LOKSPL01"
+/* The data area starts right after the header; records stay 8-byte aligned within it. */
+#define LOKAN_SPOOL_HEADER_BYTES 64
+#define LOKAN_SPOOL_ALIGN 8
+/* Record length marking the rest of the area as unused, so the next record starts at its beginning. */
+#define LOKAN_SPOOL_WRAP UINT32_MAX
+
+/*
+ * Fixed header at the start of the file. head and tail are logical offsets
+ * that only ever grow; a record at logical offset o sits at o % capacity.
+ * Recovery is reading this header: nothing is scanned until it is drained.
+ */
+struct lokan_spool_header {
+    char magic[8];
+    uint64_t capacity;
+    uint64_t head;
+    uint64_t tail;
+};
+
+struct lokan_spool_record_header {
+    uint32_t len;
+    uint32_t envelopes;
+    uint32_t crc;
+    uint32_t format;
+};
+
+struct lokan_spool {
+    const lokan_allocator_t *allocator;
+    int fd;
+    char *map;
+    size_t map_len;
+    struct lokan_spool_header *header;
+    char *data;
+    uint64_t capacity;
+    /* Set by anything that changes the mapping, cleared by lokan_spool_sync. */
+    int dirty;
+};
+
+static uint64_t lokan_spool_align(uint64_t value) {
+    return (value + LOKAN_SPOOL_ALIGN - 1) & ~(uint64_t)(LOKAN_SPOOL_ALIGN - 1);
+}
+
+/* Bytes from offset to the end of the data area. */
+static uint64_t lokan_spool_room(const struct lokan_spool *spool, uint64_t offset) {
+    return spool->capacity - offset % spool->capacity;
+}
+
+static uint64_t lokan_spool_next_lap(const struct lokan_spool *spool, uint64_t offset) {
+    return offset + lokan_spool_room(spool, offset);
+}
+
+static int lokan_spool_header_valid(const struct lokan_spool_header *header, size_t file_len) {
+    return memcmp(header->magic, LOKAN_SPOOL_MAGIC, sizeof(header->magic)) == 0 && header->capacity > 0 &&
+           header->capacity % LOKAN_SPOOL_ALIGN == 0 && header->capacity == file_len - LOKAN_SPOOL_HEADER_BYTES &&
+           header->head <= header->tail && header->tail - header->head <= header->capacity;
+}
+
+lokan_result_t lokan_spool_open(struct lokan_spool **out_spool, const lokan_allocator_t *allocator, const char *path, size_t capacity) {
+    capacity = (size_t)lokan_spool_align(capacity);
+    if (!out_spool || !path || capacity < LOKAN_SPOOL_HEADER_BYTES) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    struct lokan_spool *spool = (struct lokan_spool *)lokan_calloc(allocator, 1, sizeof(struct lokan_spool));
+    if (!spool) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    spool->allocator = allocator;
+    spool->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (spool->fd < 0) {
+        lokan_free(allocator, spool);
+        return LOKAN_ERROR_UNAVAILABLE;
+    }
+
+    /* An intact spool from an earlier run is kept as it is, including its size. */
+    struct stat info;
+    struct lokan_spool_header existing;
+    int recovered = fstat(spool->fd, &info) == 0 && (size_t)info.st_size > LOKAN_SPOOL_HEADER_BYTES &&
+                    pread(spool->fd, &existing, sizeof(existing), 0) == (ssize_t)sizeof(existing) &&
+                    lokan_spool_header_valid(&existing, (size_t)info.st_size);
+    spool->map_len = recovered ? (size_t)info.st_size : LOKAN_SPOOL_HEADER_BYTES + capacity;
+    if (!recovered && ftruncate(spool->fd, (off_t)spool->map_len) != 0) {
+        lokan_spool_close(spool);
+        return LOKAN_ERROR_UNAVAILABLE;
+    }
+    void *map = mmap(NULL, spool->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, spool->fd, 0);
+    if (map == MAP_FAILED) {
+        lokan_spool_close(spool);
+        return LOKAN_ERROR_UNAVAILABLE;
+    }
+    spool->map = (char *)map;
+    spool->header = (struct lokan_spool_header *)map;
+    spool->data = spool->map + LOKAN_SPOOL_HEADER_BYTES;
+    if (!recovered) {
+        memset(spool->header, 0, sizeof(*spool->header));
+        memcpy(spool->header->magic, LOKAN_SPOOL_MAGIC, sizeof(spool->header->magic));
+        spool->header->capacity = capacity;
+        spool->dirty = 1;
+    }
+    spool->capacity = spool->header->capacity;
+
+    *out_spool = spool;
+    return LOKAN_OK;
+}
+
+void lokan_spool_close(struct lokan_spool *spool) {
+    if (!spool) {
+        return;
+    }
+    if (spool->map) {
+        lokan_spool_sync(spool);
+        munmap(spool->map, spool->map_len);
+    }
+    if (spool->fd >= 0) {
+        close(spool->fd);
+    }
+    lokan_free(spool->allocator, spool);
+}
+
+lokan_result_t lokan_spool_sync(struct lokan_spool *spool) {
+    if (!spool->dirty) {
+        return LOKAN_OK;
+    }
+    /* One msync covers every record appended since the last one: the group commit. */
+    if (msync(spool->map, spool->map_len, MS_SYNC) != 0) {
+        return LOKAN_ERROR_UNAVAILABLE;
+    }
+    spool->dirty = 0;
+    return LOKAN_OK;
+}
+
+int lokan_spool_dirty(const struct lokan_spool *spool) {
+    return spool->dirty;
+}
+
+/*
+ * Reads the record at the head into out, skipping wrap markers. A record
+ * whose payload fails its checksum, such as one torn by a crash before its
+ * sync, is skipped; one whose header is implausible discards the rest of the
+ * spool, as there is no telling where the next record starts.
+ */
+int lokan_spool_peek(struct lokan_spool *spool, struct lokan_spool_record *out) {
+    struct lokan_spool_header *header = spool->header;
+    while (header->head < header->tail) {
+        uint64_t room = lokan_spool_room(spool, header->head);
+        const struct lokan_spool_record_header *record =
+            (const struct lokan_spool_record_header *)(spool->data + header->head % spool->capacity);
+        if (room < sizeof(*record) || record->len == LOKAN_SPOOL_WRAP) {
+            header->head = lokan_spool_next_lap(spool, header->head);
+            spool->dirty = 1;
+            continue;
+        }
+        uint64_t footprint = lokan_spool_align(sizeof(*record) + (uint64_t)record->len);
+        const char *payload = (const char *)(record + 1);
+        if (footprint > room || footprint > header->tail - header->head) {
+            header->head = header->tail;
+            spool->dirty = 1;
+            break;
+        }
+        if (record->crc != (uint32_t)crc32(0L, (const Bytef *)payload, (uInt)record->len)) {
+            header->head += footprint;
+            spool->dirty = 1;
+            continue;
+        }
+        out->offset = header->head;
+        out->next = header->head + footprint;
+        out->data = payload;
+        out->len = record->len;
+        out->envelopes = record->envelopes;
+        out->format = (lokan_body_format_t)record->format;
+        return 1;
+    }
+    if (header->head > header->tail) {
+        header->head = header->tail;
+    }
+    return 0;
+}
+
+void lokan_spool_release(struct lokan_spool *spool, const struct lokan_spool_record *record) {
+    /* The record may already have been evicted to make room for newer ones. */
+    if (spool->header->head == record->offset) {
+        spool->header->head = record->next;
+        spool->dirty = 1;
+    }
+}
+
+lokan_result_t lokan_spool_append(
+    struct lokan_spool *spool,
+    lokan_body_format_t format,
+    const char *data,
+    size_t len,
+    uint32_t envelopes,
+    uint64_t *out_evicted) {
+    struct lokan_spool_header *header = spool->header;
+    uint64_t footprint = lokan_spool_align(sizeof(struct lokan_spool_record_header) + (uint64_t)len);
+    *out_evicted = 0;
+    if (len >= LOKAN_SPOOL_WRAP || footprint > spool->capacity) {
+        return LOKAN_ERROR_OVERFLOW;
+    }
+
+    /* A record never straddles the end of the area; the gap before it counts as used. */
+    uint64_t start = header->tail;
+    if (lokan_spool_room(spool, start) < footprint) {
+        start = lokan_spool_next_lap(spool, start);
+    }
+    while (start + footprint - header->head > spool->capacity) {
+        struct lokan_spool_record oldest;
+        if (!lokan_spool_peek(spool, &oldest)) {
+            break;
+        }
+        *out_evicted += oldest.envelopes;
+        lokan_spool_release(spool, &oldest);
+    }
+    if (header->head == header->tail) {
+        /* Nothing is kept, so the head moves along with the record and a wrap costs no space. */
+        header->head = header->tail = start;
+    }
+
+    if (start != header->tail && lokan_spool_room(spool, header->tail) >= sizeof(struct lokan_spool_record_header)) {
+        struct lokan_spool_record_header *wrap =
+            (struct lokan_spool_record_header *)(spool->data + header->tail % spool->capacity);
+        wrap->len = LOKAN_SPOOL_WRAP;
+    }
+    struct lokan_spool_record_header *record = (struct lokan_spool_record_header *)(spool->data + start % spool->capacity);
+    record->len = (uint32_t)len;
+    record->envelopes = envelopes;
+    record->crc = (uint32_t)crc32(0L, (const Bytef *)data, (uInt)len);
+    record->format = (uint32_t)format;
+    memcpy(record + 1, data, len);
+    header->tail = start + footprint;
+    spool->dirty = 1;
+    return LOKAN_OK;
+}
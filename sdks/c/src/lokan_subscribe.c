@@ -0,0 +1,629 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <curl/curl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOKAN_SUBSCRIPTION_DEFAULT_RING (64 * 1024)
+#define LOKAN_SUBSCRIPTION_DEFAULT_MIN_MS 250
+#define LOKAN_SUBSCRIPTION_DEFAULT_MAX_MS 30000
+#define LOKAN_SUBSCRIPTION_DEFAULT_IDLE_MS 60000
+#define LOKAN_SUBSCRIPTION_LAST_ID_HEADER "Last-Event-ID: "
+
+/*
+ * The ring holds records back to back: this header, then the type, id and
+ * data each followed by a NUL, padded to 8 bytes. A record that does not fit
+ * before the end of the ring starts again at offset 0; the skipped tail is
+ * marked with a zero-size header when there is room for one.
+ */
+struct lokan_ring_record {
+    uint32_t size;
+    uint32_t type_len;
+    uint32_t id_len;
+    uint32_t data_len;
+};
+
+struct lokan_subscription {
+    lokan_client_t *client;
+    char *path;
+    lokan_subscription_overflow_t overflow;
+    long reconnect_min_ms;
+    long reconnect_max_ms;
+    pthread_t thread;
+    int thread_started;
+
+    /* Guards everything from here to the network-thread state. */
+    pthread_mutex_t lock;
+    /* Signalled when events are queued, for lokan_subscription_poll. */
+    pthread_cond_t readable;
+    /* Signalled when space frees up or on stop, for the network thread. */
+    pthread_cond_t writable;
+    int stopping;
+    char *ring;
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    size_t used;
+    size_t queued;
+    /* The record at tail is being delivered and must not be dropped. */
+    int in_flight;
+    lokan_subscription_stats_t stats;
+
+    /* Network thread only: SSE parser state for the open stream. */
+    unsigned int seed;
+    int streaming;
+    int received;
+    /* The last chunk ended in CR, so a leading LF belongs to that line end. */
+    int skip_lf;
+    struct lokan_memory line;
+    int line_overflow;
+    struct lokan_memory data;
+    int has_data;
+    int oversized;
+    char type[LOKAN_SUBSCRIPTION_TYPE_MAX];
+    size_t type_len;
+    /* Last event id buffer; it persists across events and reconnects. */
+    char id[LOKAN_SUBSCRIPTION_ID_MAX];
+    size_t id_len;
+    /* Reconnect delay requested by the server's retry field, or 0. */
+    long retry_ms;
+};
+
+static size_t lokan_ring_align(size_t size) {
+    return (size + 7u) & ~(size_t)7u;
+}
+
+static void lokan_deadline_after(struct timespec *deadline, long ms) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += ms / 1000;
+    deadline->tv_nsec += (ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Claims size contiguous bytes at head, wrapping to 0 when the end is too short. */
+static char *lokan_ring_reserve(lokan_subscription_t *subscription, size_t size) {
+    if (subscription->used == 0) {
+        subscription->head = 0;
+        subscription->tail = 0;
+    } else if (subscription->used == subscription->capacity) {
+        return NULL;
+    }
+    size_t head = subscription->head;
+    if (subscription->used == 0 || head > subscription->tail) {
+        /* Free space runs from head to the end, then from 0 to tail. */
+        if (subscription->capacity - head < size) {
+            if (subscription->tail < size) {
+                return NULL;
+            }
+            if (subscription->capacity - head >= sizeof(struct lokan_ring_record)) {
+                memset(subscription->ring + head, 0, sizeof(struct lokan_ring_record));
+            }
+            subscription->used += subscription->capacity - head;
+            head = 0;
+        }
+    } else if (subscription->tail - head < size) {
+        return NULL;
+    }
+    subscription->head = head + size;
+    subscription->used += size;
+    return subscription->ring + head;
+}
+
+static struct lokan_ring_record *lokan_ring_front(lokan_subscription_t *subscription) {
+    size_t remaining = subscription->capacity - subscription->tail;
+    if (remaining < sizeof(struct lokan_ring_record) ||
+        ((struct lokan_ring_record *)(subscription->ring + subscription->tail))->size == 0) {
+        subscription->used -= remaining;
+        subscription->tail = 0;
+    }
+    return (struct lokan_ring_record *)(subscription->ring + subscription->tail);
+}
+
+static void lokan_ring_pop(lokan_subscription_t *subscription) {
+    struct lokan_ring_record *record = lokan_ring_front(subscription);
+    subscription->tail += record->size;
+    subscription->used -= record->size;
+    subscription->queued--;
+    if (subscription->used == 0) {
+        subscription->head = 0;
+        subscription->tail = 0;
+    }
+}
+
+static void lokan_subscription_enqueue(lokan_subscription_t *subscription, const char *type, size_t type_len) {
+    /* The data buffer holds a '\n' after every line; the last one is not part of the event. */
+    size_t data_len = subscription->oversized ? 0 : subscription->data.size - 1;
+    size_t size = lokan_ring_align(sizeof(struct lokan_ring_record) + type_len + subscription->id_len + data_len + 3);
+
+    pthread_mutex_lock(&subscription->lock);
+    subscription->stats.received++;
+    char *slot = NULL;
+    if (!subscription->oversized && size <= subscription->capacity) {
+        while ((slot = lokan_ring_reserve(subscription, size)) == NULL) {
+            if (subscription->overflow == LOKAN_SUBSCRIPTION_DROP_OLDEST && subscription->queued > 0 &&
+                !subscription->in_flight) {
+                lokan_ring_pop(subscription);
+                subscription->stats.dropped++;
+            } else if (subscription->overflow == LOKAN_SUBSCRIPTION_BLOCK && !subscription->stopping) {
+                pthread_cond_wait(&subscription->writable, &subscription->lock);
+            } else {
+                break;
+            }
+        }
+    }
+    if (!slot) {
+        subscription->stats.dropped++;
+        pthread_mutex_unlock(&subscription->lock);
+        return;
+    }
+
+    struct lokan_ring_record *record = (struct lokan_ring_record *)slot;
+    record->size = (uint32_t)size;
+    record->type_len = (uint32_t)type_len;
+    record->id_len = (uint32_t)subscription->id_len;
+    record->data_len = (uint32_t)data_len;
+    char *out = slot + sizeof(*record);
+    memcpy(out, type, type_len);
+    out[type_len] = '\0';
+    out += type_len + 1;
+    memcpy(out, subscription->id, subscription->id_len);
+    out[subscription->id_len] = '\0';
+    out += subscription->id_len + 1;
+    memcpy(out, subscription->data.data, data_len);
+    out[data_len] = '\0';
+    subscription->queued++;
+    pthread_cond_signal(&subscription->readable);
+    pthread_mutex_unlock(&subscription->lock);
+}
+
+static void lokan_sse_dispatch(lokan_subscription_t *subscription) {
+    /* The resume point moves even for events without data. */
+    pthread_mutex_lock(&subscription->lock);
+    memcpy(subscription->stats.last_event_id, subscription->id, subscription->id_len);
+    subscription->stats.last_event_id[subscription->id_len] = '\0';
+    pthread_mutex_unlock(&subscription->lock);
+
+    if (subscription->has_data) {
+        subscription->received = 1;
+        if (subscription->type_len > 0) {
+            lokan_subscription_enqueue(subscription, subscription->type, subscription->type_len);
+        } else {
+            lokan_subscription_enqueue(subscription, "message", sizeof("message") - 1);
+        }
+    }
+    subscription->data.size = 0;
+    subscription->has_data = 0;
+    subscription->oversized = 0;
+    subscription->type_len = 0;
+}
+
+static void lokan_sse_field(lokan_subscription_t *subscription, const char *line, size_t len) {
+    const char *colon = (const char *)memchr(line, ':', len);
+    size_t name_len = colon ? (size_t)(colon - line) : len;
+    const char *value = colon ? colon + 1 : line + len;
+    size_t value_len = (size_t)(line + len - value);
+    if (value_len > 0 && *value == ' ') {
+        value++;
+        value_len--;
+    }
+
+    if (name_len == 4 && memcmp(line, "data", 4) == 0) {
+        subscription->has_data = 1;
+        /* Events larger than the ring could never be queued, so stop collecting them. */
+        if (subscription->oversized || subscription->data.size + value_len + 1 > subscription->capacity ||
+            lokan_memory_reserve(&subscription->data, subscription->data.size + value_len + 1) != LOKAN_OK) {
+            subscription->oversized = 1;
+            return;
+        }
+        memcpy(subscription->data.data + subscription->data.size, value, value_len);
+        subscription->data.size += value_len;
+        subscription->data.data[subscription->data.size++] = '\n';
+    } else if (name_len == 5 && memcmp(line, "event", 5) == 0) {
+        if (value_len < sizeof(subscription->type)) {
+            memcpy(subscription->type, value, value_len);
+            subscription->type_len = value_len;
+        }
+    } else if (name_len == 2 && memcmp(line, "id", 2) == 0) {
+        /* Ids too long to send back on reconnect are ignored rather than truncated. */
+        if (value_len < sizeof(subscription->id) && !memchr(value, '\0', value_len)) {
+            memcpy(subscription->id, value, value_len);
+            subscription->id_len = value_len;
+        }
+    } else if (name_len == 5 && memcmp(line, "retry", 5) == 0) {
+        long retry_ms = 0;
+        for (size_t i = 0; i < value_len; ++i) {
+            if (value[i] < '0' || value[i] > '9') {
+                return;
+            }
+            if (retry_ms < 24L * 3600 * 1000) {
+                retry_ms = retry_ms * 10 + (value[i] - '0');
+            }
+        }
+        if (value_len > 0) {
+            subscription->retry_ms = retry_ms;
+        }
+    }
+}
+
+static void lokan_sse_line(lokan_subscription_t *subscription, const char *line, size_t len) {
+    if (subscription->line_overflow) {
+        /* The line was cut short; dropping its event beats delivering part of it. */
+        subscription->line_overflow = 0;
+        subscription->oversized = 1;
+        subscription->has_data = 1;
+        return;
+    }
+    if (len == 0) {
+        lokan_sse_dispatch(subscription);
+    } else if (line[0] != ':') {
+        lokan_sse_field(subscription, line, len);
+    }
+}
+
+/* Holds the start of a line until the chunk carrying its end arrives. */
+static void lokan_sse_hold(lokan_subscription_t *subscription, const char *text, size_t len) {
+    if (len == 0 || subscription->line_overflow) {
+        return;
+    }
+    struct lokan_memory *line = &subscription->line;
+    if (line->size + len > subscription->capacity || lokan_memory_reserve(line, line->size + len) != LOKAN_OK) {
+        subscription->line_overflow = 1;
+        return;
+    }
+    memcpy(line->data + line->size, text, len);
+    line->size += len;
+}
+
+static void lokan_sse_feed(lokan_subscription_t *subscription, const char *text, size_t len) {
+    size_t i = 0;
+    if (subscription->skip_lf && len > 0) {
+        subscription->skip_lf = 0;
+        if (text[0] == '\n') {
+            i = 1;
+        }
+    }
+    size_t start = i;
+    for (; i < len; ++i) {
+        if (text[i] != '\n' && text[i] != '\r') {
+            continue;
+        }
+        if (subscription->line.size > 0) {
+            lokan_sse_hold(subscription, text + start, i - start);
+            lokan_sse_line(subscription, subscription->line.data, subscription->line.size);
+            subscription->line.size = 0;
+        } else {
+            /* Lines that arrive whole are parsed in place. */
+            lokan_sse_line(subscription, text + start, i - start);
+        }
+        if (text[i] == '\r') {
+            if (i + 1 < len) {
+                if (text[i + 1] == '\n') {
+                    i++;
+                }
+            } else {
+                subscription->skip_lf = 1;
+            }
+        }
+        start = i + 1;
+    }
+    lokan_sse_hold(subscription, text + start, len - start);
+}
+
+static int lokan_subscription_stopping(lokan_subscription_t *subscription) {
+    pthread_mutex_lock(&subscription->lock);
+    int stopping = subscription->stopping;
+    pthread_mutex_unlock(&subscription->lock);
+    return stopping;
+}
+
+/* The blank line ending a response's headers settles whether the stream is up. */
+static size_t lokan_subscription_header(char *buffer, size_t size, size_t nitems, void *userp) {
+    lokan_subscription_t *subscription = (lokan_subscription_t *)userp;
+    size_t len = size * nitems;
+    if (len > 2 || (len > 0 && buffer[0] != '\r' && buffer[0] != '\n')) {
+        return len;
+    }
+    long status = 0;
+    curl_easy_getinfo(subscription->client->handle, CURLINFO_RESPONSE_CODE, &status);
+    /* Interim responses end the same way; only the final one can open the stream. */
+    subscription->streaming = status == 200;
+    if (subscription->streaming) {
+        pthread_mutex_lock(&subscription->lock);
+        subscription->stats.connects++;
+        subscription->stats.connected = 1;
+        pthread_mutex_unlock(&subscription->lock);
+    }
+    return len;
+}
+
+static size_t lokan_subscription_write(void *contents, size_t size, size_t nmemb, void *userp) {
+    lokan_subscription_t *subscription = (lokan_subscription_t *)userp;
+    size_t len = size * nmemb;
+    if (subscription->streaming) {
+        lokan_sse_feed(subscription, (const char *)contents, len);
+    }
+    /* Error bodies are read and discarded so the attempt ends normally. */
+    return len;
+}
+
+/* Called at least once a second while the stream is idle, which bounds how long stop waits. */
+static int lokan_subscription_progress(void *userp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    (void)dltotal;
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+    return lokan_subscription_stopping((lokan_subscription_t *)userp);
+}
+
+/* Runs one connection until the stream ends; returns the response status, or 0. */
+static long lokan_subscription_connect(lokan_subscription_t *subscription) {
+    CURL *handle = subscription->client->handle;
+    if (lokan_set_url(subscription->client, handle, subscription->path) != LOKAN_OK) {
+        return 0;
+    }
+
+    /* Every connection starts a fresh stream; only the last event id carries over. */
+    subscription->streaming = 0;
+    subscription->received = 0;
+    subscription->skip_lf = 0;
+    subscription->line.size = 0;
+    subscription->line_overflow = 0;
+    subscription->data.size = 0;
+    subscription->has_data = 0;
+    subscription->oversized = 0;
+    subscription->type_len = 0;
+
+    char last_id_header[sizeof(LOKAN_SUBSCRIPTION_LAST_ID_HEADER) + LOKAN_SUBSCRIPTION_ID_MAX];
+    struct curl_slist *headers = curl_slist_append(NULL, "Accept: text/event-stream");
+    struct curl_slist *appended = headers ? curl_slist_append(headers, "Cache-Control: no-cache") : NULL;
+    if (appended && subscription->id_len > 0) {
+        memcpy(last_id_header, LOKAN_SUBSCRIPTION_LAST_ID_HEADER, sizeof(LOKAN_SUBSCRIPTION_LAST_ID_HEADER) - 1);
+        memcpy(last_id_header + sizeof(LOKAN_SUBSCRIPTION_LAST_ID_HEADER) - 1, subscription->id, subscription->id_len);
+        last_id_header[sizeof(LOKAN_SUBSCRIPTION_LAST_ID_HEADER) - 1 + subscription->id_len] = '\0';
+        appended = curl_slist_append(appended, last_id_header);
+    }
+    if (!appended) {
+        curl_slist_free_all(headers);
+        return 0;
+    }
+    headers = appended;
+
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
+    curl_easy_perform(handle);
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, NULL);
+    curl_slist_free_all(headers);
+
+    long status = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+    return status;
+}
+
+/* Exponential backoff with jitter, so hubs dropped together do not reconnect together. */
+static long lokan_subscription_delay(lokan_subscription_t *subscription, unsigned int attempt) {
+    long delay = subscription->retry_ms > 0 ? subscription->retry_ms : subscription->reconnect_min_ms;
+    for (unsigned int i = 0; i < attempt && delay < subscription->reconnect_max_ms; ++i) {
+        delay *= 2;
+    }
+    if (delay > subscription->reconnect_max_ms) {
+        delay = subscription->reconnect_max_ms;
+    }
+    long half = delay / 2;
+    return half + (long)(rand_r(&subscription->seed) % (unsigned long)(half + 1));
+}
+
+static void *lokan_subscription_run(void *arg) {
+    lokan_subscription_t *subscription = (lokan_subscription_t *)arg;
+    unsigned int attempt = 0;
+    while (!lokan_subscription_stopping(subscription)) {
+        long status = lokan_subscription_connect(subscription);
+        /* A stream that delivered events was healthy, so the backoff starts over. */
+        if (subscription->received) {
+            attempt = 0;
+        }
+        struct timespec deadline;
+        lokan_deadline_after(&deadline, lokan_subscription_delay(subscription, attempt++));
+
+        pthread_mutex_lock(&subscription->lock);
+        subscription->stats.connected = 0;
+        subscription->stats.last_status = status;
+        subscription->stats.disconnects++;
+        while (!subscription->stopping &&
+               pthread_cond_timedwait(&subscription->writable, &subscription->lock, &deadline) == 0) {
+        }
+        pthread_mutex_unlock(&subscription->lock);
+    }
+    return NULL;
+}
+
+static void lokan_subscription_free(lokan_subscription_t *subscription) {
+    /* The allocator lives inside the client, so it is copied out before the client goes. */
+    lokan_allocator_t allocator = subscription->client->allocator;
+    lokan_free(&allocator, subscription->line.data);
+    lokan_free(&allocator, subscription->data.data);
+    lokan_free(&allocator, subscription->ring);
+    lokan_free(&allocator, subscription->path);
+    pthread_cond_destroy(&subscription->readable);
+    pthread_cond_destroy(&subscription->writable);
+    pthread_mutex_destroy(&subscription->lock);
+    lokan_client_cleanup(subscription->client);
+    lokan_free(&allocator, subscription);
+}
+
+static void lokan_subscription_configure_handle(lokan_subscription_t *subscription, long idle_timeout_ms) {
+    CURL *handle = subscription->client->handle;
+    long idle_s = (idle_timeout_ms + 999) / 1000;
+    /* The stream stays open indefinitely; a silent connection is what counts as dead. */
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, 0L);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS, subscription->client->timeout_ms);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, idle_s);
+    curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, lokan_subscription_write);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void *)subscription);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, lokan_subscription_header);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, (void *)subscription);
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, lokan_subscription_progress);
+    curl_easy_setopt(handle, CURLOPT_XFERINFODATA, (void *)subscription);
+}
+
+lokan_result_t lokan_subscription_start(
+    lokan_subscription_t **out_subscription,
+    const lokan_client_config_t *client_config,
+    const lokan_subscription_config_t *config) {
+    if (!out_subscription || !client_config || !config || !config->path) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    size_t resume_len = config->last_event_id ? strlen(config->last_event_id) : 0;
+    if (resume_len >= LOKAN_SUBSCRIPTION_ID_MAX) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    lokan_client_t *client = NULL;
+    lokan_result_t result = lokan_client_init(&client, client_config);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    const lokan_allocator_t *allocator = &client->allocator;
+    lokan_subscription_t *subscription =
+        (lokan_subscription_t *)lokan_calloc(allocator, 1, sizeof(lokan_subscription_t));
+    if (!subscription) {
+        lokan_client_cleanup(client);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+
+    subscription->client = client;
+    subscription->overflow = config->overflow;
+    subscription->reconnect_min_ms =
+        config->reconnect_min_ms > 0 ? config->reconnect_min_ms : LOKAN_SUBSCRIPTION_DEFAULT_MIN_MS;
+    subscription->reconnect_max_ms =
+        config->reconnect_max_ms > 0 ? config->reconnect_max_ms : LOKAN_SUBSCRIPTION_DEFAULT_MAX_MS;
+    if (subscription->reconnect_max_ms < subscription->reconnect_min_ms) {
+        subscription->reconnect_max_ms = subscription->reconnect_min_ms;
+    }
+    size_t ring_bytes = config->ring_bytes > 0 ? config->ring_bytes : LOKAN_SUBSCRIPTION_DEFAULT_RING;
+    subscription->capacity = lokan_ring_align(ring_bytes);
+    subscription->seed = (unsigned int)lokan_now_ms() ^ (unsigned int)(uintptr_t)subscription;
+    subscription->line.allocator = allocator;
+    subscription->data.allocator = allocator;
+    if (resume_len > 0) {
+        memcpy(subscription->id, config->last_event_id, resume_len);
+        subscription->id_len = resume_len;
+        memcpy(subscription->stats.last_event_id, config->last_event_id, resume_len);
+    }
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&subscription->lock, NULL);
+    pthread_cond_init(&subscription->readable, &cond_attr);
+    pthread_cond_init(&subscription->writable, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    subscription->path = lokan_strdup(allocator, config->path);
+    subscription->ring = (char *)lokan_alloc(allocator, subscription->capacity);
+    if (!subscription->path || !subscription->ring) {
+        lokan_subscription_free(subscription);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+
+    long idle_timeout_ms = config->idle_timeout_ms > 0 ? config->idle_timeout_ms : LOKAN_SUBSCRIPTION_DEFAULT_IDLE_MS;
+    lokan_subscription_configure_handle(subscription, idle_timeout_ms);
+
+    if (pthread_create(&subscription->thread, NULL, lokan_subscription_run, subscription) != 0) {
+        lokan_subscription_free(subscription);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+    subscription->thread_started = 1;
+
+    *out_subscription = subscription;
+    return LOKAN_OK;
+}
+
+lokan_result_t lokan_subscription_poll(
+    lokan_subscription_t *subscription,
+    int timeout_ms,
+    lokan_event_cb on_event,
+    void *user_data,
+    size_t *out_delivered) {
+    if (!subscription || !on_event) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    size_t delivered = 0;
+
+    pthread_mutex_lock(&subscription->lock);
+    if (timeout_ms < 0) {
+        while (subscription->queued == 0 && !subscription->stopping) {
+            pthread_cond_wait(&subscription->readable, &subscription->lock);
+        }
+    } else if (timeout_ms > 0) {
+        struct timespec deadline;
+        lokan_deadline_after(&deadline, timeout_ms);
+        while (subscription->queued == 0 && !subscription->stopping &&
+               pthread_cond_timedwait(&subscription->readable, &subscription->lock, &deadline) == 0) {
+        }
+    }
+
+    /* Only what was queued on entry, so a fast stream cannot keep the caller here forever. */
+    size_t pending = subscription->queued;
+    while (delivered < pending) {
+        const struct lokan_ring_record *record = lokan_ring_front(subscription);
+        const char *text = (const char *)(record + 1);
+        lokan_event_t event;
+        event.type.data = text;
+        event.type.size = record->type_len;
+        event.id.data = text + record->type_len + 1;
+        event.id.size = record->id_len;
+        event.data.data = event.id.data + record->id_len + 1;
+        event.data.size = record->data_len;
+
+        /* The network thread never writes over or drops the in-flight record, so it is read unlocked. */
+        subscription->in_flight = 1;
+        pthread_mutex_unlock(&subscription->lock);
+        on_event(&event, user_data);
+        pthread_mutex_lock(&subscription->lock);
+        subscription->in_flight = 0;
+
+        lokan_ring_pop(subscription);
+        subscription->stats.delivered++;
+        delivered++;
+        pthread_cond_signal(&subscription->writable);
+    }
+    pthread_mutex_unlock(&subscription->lock);
+
+    if (out_delivered) {
+        *out_delivered = delivered;
+    }
+    return LOKAN_OK;
+}
+
+void lokan_subscription_stop(lokan_subscription_t *subscription) {
+    if (!subscription) {
+        return;
+    }
+    pthread_mutex_lock(&subscription->lock);
+    subscription->stopping = 1;
+    pthread_cond_broadcast(&subscription->writable);
+    pthread_cond_broadcast(&subscription->readable);
+    pthread_mutex_unlock(&subscription->lock);
+    if (subscription->thread_started) {
+        pthread_join(subscription->thread, NULL);
+    }
+    lokan_subscription_free(subscription);
+}
+
+void lokan_subscription_get_stats(lokan_subscription_t *subscription, lokan_subscription_stats_t *out_stats) {
+    if (!subscription || !out_stats) {
+        return;
+    }
+    pthread_mutex_lock(&subscription->lock);
+    *out_stats = subscription->stats;
+    pthread_mutex_unlock(&subscription->lock);
+}
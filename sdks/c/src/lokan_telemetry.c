@@ -0,0 +1,726 @@
+#include "lokan.h"
+#include "lokan_internal.h"
+
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOKAN_TELEMETRY_DEFAULT_PATH "/ingest/batch"
+#define LOKAN_TELEMETRY_PREFIX "{\"envelopes\":["
+#define LOKAN_TELEMETRY_SUFFIX "]}"
+#define LOKAN_TELEMETRY_SOURCE_OPEN "{\"source\":\""
+#define LOKAN_TELEMETRY_PAYLOAD_OPEN "\",\"payload\":"
+/* Longest %.17g rendering of a finite double, e.g. -2.2250738585072014e-308. */
+#define LOKAN_TELEMETRY_NUMBER_MAX 24
+#define LOKAN_TELEMETRY_SPOOL_DEFAULT_BYTES (4 * 1024 * 1024)
+/* telemetry-pipe refuses larger batches, and a refused batch is dropped. */
+#define LOKAN_TELEMETRY_MAX_ENVELOPES 10000
+
+/*
+ * The CBOR form has the JSON form's shape: {"envelopes": [...]} with the
+ * array of indefinite length, so envelopes are appended without a count and
+ * the break byte (0xff) closes it when the batch is sent. Each envelope is a
+ * two-entry map of "source" and the "payload" map.
+ */
+#define LOKAN_CBOR_PREFIX "\xa1\x69" "envelopes" "\x9f"
+#define LOKAN_CBOR_SUFFIX "\xff"
+#define LOKAN_CBOR_SOURCE_OPEN "\xa2\x66" "source"
+#define LOKAN_CBOR_PAYLOAD_OPEN "\x67" "payload"
+
+/* CBOR major types (RFC 8949, section 3.1). */
+#define LOKAN_CBOR_UNSIGNED 0
+#define LOKAN_CBOR_NEGATIVE 1
+#define LOKAN_CBOR_TEXT 3
+#define LOKAN_CBOR_MAP 5
+
+/*
+ * A batch buffer always starts with the request prefix and holds envelopes,
+ * separated by commas in the JSON form. offsets[i] is where envelope i begins,
+ * which lets the drop-oldest policy cut whole envelopes off the front.
+ */
+struct lokan_telemetry_buffer {
+    char *data;
+    size_t size;
+    size_t *offsets;
+    size_t count;
+    uint64_t opened_ms;
+};
+
+struct lokan_telemetry {
+    lokan_client_t *client;
+    char *path;
+    size_t capacity;
+    size_t max_envelopes;
+    size_t flush_threshold;
+    long max_age_ms;
+    lokan_telemetry_overflow_t overflow;
+    lokan_telemetry_format_t format;
+    const char *prefix;
+    size_t prefix_len;
+    const char *suffix;
+    size_t suffix_len;
+    /* Bytes between envelopes: the JSON form's comma. */
+    size_t separator_len;
+
+    /* Guards active, stats and the buffer swap; sending is only touched by the owner. */
+    pthread_mutex_t lock;
+    pthread_cond_t space;
+    struct lokan_telemetry_buffer buffers[2];
+    struct lokan_telemetry_buffer *active;
+    struct lokan_telemetry_buffer *sending;
+    lokan_telemetry_stats_t stats;
+
+    /* Offline spool and its drain, both owner-only; NULL without spool_path. */
+    struct lokan_spool *spool;
+    long spool_sync_ms;
+    long drain_interval_ms;
+    uint64_t synced_ms;
+    uint64_t drain_after_ms;
+    int draining;
+    /* The record in flight, released from the spool once the service accepts it. */
+    struct lokan_spool_record drained;
+};
+
+static void lokan_telemetry_buffer_reset(const lokan_telemetry_t *batch, struct lokan_telemetry_buffer *buffer) {
+    memcpy(buffer->data, batch->prefix, batch->prefix_len);
+    buffer->size = batch->prefix_len;
+    buffer->count = 0;
+    buffer->opened_ms = 0;
+}
+
+static int lokan_telemetry_fits(const lokan_telemetry_t *batch, const struct lokan_telemetry_buffer *buffer, size_t envelope_len) {
+    size_t needed = envelope_len + (buffer->count > 0 ? batch->separator_len : 0);
+    return buffer->count < batch->max_envelopes && buffer->size + needed + batch->suffix_len <= batch->capacity;
+}
+
+static void lokan_telemetry_drop_front(lokan_telemetry_t *batch, struct lokan_telemetry_buffer *buffer, size_t drop) {
+    if (drop >= buffer->count) {
+        batch->stats.dropped += buffer->count;
+        uint64_t opened = buffer->opened_ms;
+        lokan_telemetry_buffer_reset(batch, buffer);
+        buffer->opened_ms = opened;
+        return;
+    }
+    size_t start = buffer->offsets[drop];
+    size_t shift = start - batch->prefix_len;
+    memmove(buffer->data + batch->prefix_len, buffer->data + start, buffer->size - start);
+    buffer->size -= shift;
+    for (size_t i = drop; i < buffer->count; ++i) {
+        buffer->offsets[i - drop] = buffer->offsets[i] - shift;
+    }
+    buffer->count -= drop;
+    batch->stats.dropped += drop;
+}
+
+/* Smallest number of leading envelopes to discard so envelope_len fits. */
+static size_t lokan_telemetry_drop_needed(const lokan_telemetry_t *batch, const struct lokan_telemetry_buffer *buffer, size_t envelope_len) {
+    for (size_t drop = 1; drop < buffer->count; ++drop) {
+        size_t remaining = buffer->count - drop;
+        size_t size = batch->prefix_len + (buffer->size - buffer->offsets[drop]);
+        if (remaining < batch->max_envelopes &&
+            size + envelope_len + batch->separator_len + batch->suffix_len <= batch->capacity) {
+            return drop;
+        }
+    }
+    return buffer->count;
+}
+
+lokan_result_t lokan_telemetry_create(
+    lokan_telemetry_t **out_batch,
+    lokan_client_t *client,
+    const lokan_telemetry_config_t *config) {
+    if (!out_batch || !client) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    lokan_telemetry_config_t defaults = {0};
+    if (!config) {
+        config = &defaults;
+    }
+
+    const lokan_allocator_t *allocator = &client->allocator;
+    lokan_telemetry_t *batch = (lokan_telemetry_t *)lokan_calloc(allocator, 1, sizeof(lokan_telemetry_t));
+    if (!batch) {
+        return LOKAN_ERROR_ALLOCATION;
+    }
+
+    batch->client = client;
+    batch->capacity = config->max_batch_bytes > 0 ? config->max_batch_bytes : 64 * 1024;
+    batch->max_envelopes = config->max_batch_envelopes > 0 ? config->max_batch_envelopes : 512;
+    if (batch->max_envelopes > LOKAN_TELEMETRY_MAX_ENVELOPES) {
+        batch->max_envelopes = LOKAN_TELEMETRY_MAX_ENVELOPES;
+    }
+    batch->flush_threshold = config->flush_threshold_bytes > 0 ? config->flush_threshold_bytes : batch->capacity / 2;
+    batch->max_age_ms = config->max_batch_age_ms > 0 ? config->max_batch_age_ms : 1000;
+    batch->overflow = config->overflow;
+    batch->format = config->format;
+    if (batch->format == LOKAN_TELEMETRY_CBOR) {
+        batch->prefix = LOKAN_CBOR_PREFIX;
+        batch->prefix_len = sizeof(LOKAN_CBOR_PREFIX) - 1;
+        batch->suffix = LOKAN_CBOR_SUFFIX;
+        batch->suffix_len = sizeof(LOKAN_CBOR_SUFFIX) - 1;
+    } else {
+        batch->prefix = LOKAN_TELEMETRY_PREFIX;
+        batch->prefix_len = sizeof(LOKAN_TELEMETRY_PREFIX) - 1;
+        batch->suffix = LOKAN_TELEMETRY_SUFFIX;
+        batch->suffix_len = sizeof(LOKAN_TELEMETRY_SUFFIX) - 1;
+        batch->separator_len = 1;
+    }
+    batch->path = lokan_strdup(allocator, config->path ? config->path : LOKAN_TELEMETRY_DEFAULT_PATH);
+
+    if ((batch->format != LOKAN_TELEMETRY_JSON && batch->format != LOKAN_TELEMETRY_CBOR) ||
+        batch->capacity <= batch->prefix_len + batch->suffix_len) {
+        lokan_free(allocator, batch->path);
+        lokan_free(allocator, batch);
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    int allocated = batch->path != NULL;
+    for (int i = 0; i < 2 && allocated; ++i) {
+        batch->buffers[i].data = (char *)lokan_alloc(allocator, batch->capacity);
+        batch->buffers[i].offsets = (size_t *)lokan_calloc(allocator, batch->max_envelopes, sizeof(size_t));
+        allocated = batch->buffers[i].data && batch->buffers[i].offsets;
+    }
+    if (!allocated) {
+        for (int i = 0; i < 2; ++i) {
+            lokan_free(allocator, batch->buffers[i].data);
+            lokan_free(allocator, batch->buffers[i].offsets);
+        }
+        lokan_free(allocator, batch->path);
+        lokan_free(allocator, batch);
+        return LOKAN_ERROR_ALLOCATION;
+    }
+
+    if (config->spool_path) {
+        size_t spool_bytes = config->spool_bytes > 0 ? config->spool_bytes : LOKAN_TELEMETRY_SPOOL_DEFAULT_BYTES;
+        lokan_result_t opened = lokan_spool_open(&batch->spool, allocator, config->spool_path, spool_bytes);
+        if (opened != LOKAN_OK) {
+            for (int i = 0; i < 2; ++i) {
+                lokan_free(allocator, batch->buffers[i].data);
+                lokan_free(allocator, batch->buffers[i].offsets);
+            }
+            lokan_free(allocator, batch->path);
+            lokan_free(allocator, batch);
+            return opened;
+        }
+        batch->spool_sync_ms = config->spool_sync_ms > 0 ? config->spool_sync_ms : 1000;
+        batch->drain_interval_ms = config->spool_drain_interval_ms > 0 ? config->spool_drain_interval_ms : 100;
+        batch->synced_ms = lokan_now_ms();
+    }
+
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->space, NULL);
+    lokan_telemetry_buffer_reset(batch, &batch->buffers[0]);
+    lokan_telemetry_buffer_reset(batch, &batch->buffers[1]);
+    batch->active = &batch->buffers[0];
+    batch->sending = &batch->buffers[1];
+
+    *out_batch = batch;
+    return LOKAN_OK;
+}
+
+void lokan_telemetry_destroy(lokan_telemetry_t *batch) {
+    if (!batch) {
+        return;
+    }
+    if (batch->draining) {
+        lokan_request_abandon(batch->client, batch);
+    }
+    lokan_spool_close(batch->spool);
+    pthread_cond_destroy(&batch->space);
+    pthread_mutex_destroy(&batch->lock);
+    const lokan_allocator_t *allocator = &batch->client->allocator;
+    for (int i = 0; i < 2; ++i) {
+        lokan_free(allocator, batch->buffers[i].data);
+        lokan_free(allocator, batch->buffers[i].offsets);
+    }
+    lokan_free(allocator, batch->path);
+    lokan_free(allocator, batch);
+}
+
+/*
+ * Makes room for an envelope of at most envelope_len bytes in the active
+ * buffer, applying the overflow policy, and returns with the lock held and
+ * *out_buffer's size at the envelope's first byte; the caller writes it and
+ * calls lokan_telemetry_commit. On failure the lock is released.
+ */
+static lokan_result_t lokan_telemetry_reserve(
+    lokan_telemetry_t *batch,
+    size_t envelope_len,
+    struct lokan_telemetry_buffer **out_buffer) {
+    if (batch->prefix_len + envelope_len + batch->suffix_len > batch->capacity) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    struct lokan_telemetry_buffer *buffer = batch->active;
+    while (!lokan_telemetry_fits(batch, buffer, envelope_len)) {
+        if (batch->overflow == LOKAN_TELEMETRY_DROP_OLDEST) {
+            lokan_telemetry_drop_front(batch, buffer, lokan_telemetry_drop_needed(batch, buffer, envelope_len));
+        } else if (batch->overflow == LOKAN_TELEMETRY_BLOCK) {
+            pthread_cond_wait(&batch->space, &batch->lock);
+            buffer = batch->active;
+        } else {
+            batch->stats.dropped++;
+            pthread_mutex_unlock(&batch->lock);
+            return LOKAN_ERROR_OVERFLOW;
+        }
+    }
+
+    if (buffer->count == 0) {
+        buffer->opened_ms = lokan_now_ms();
+    } else if (batch->separator_len > 0) {
+        buffer->data[buffer->size++] = ',';
+    }
+    buffer->offsets[buffer->count++] = buffer->size;
+    *out_buffer = buffer;
+    return LOKAN_OK;
+}
+
+static void lokan_telemetry_commit(lokan_telemetry_t *batch, struct lokan_telemetry_buffer *buffer, const char *end) {
+    buffer->size = (size_t)(end - buffer->data);
+    batch->stats.appended++;
+    pthread_mutex_unlock(&batch->lock);
+}
+
+lokan_result_t lokan_telemetry_append(lokan_telemetry_t *batch, const char *source, const char *payload_json) {
+    if (!batch || !source || !payload_json || batch->format != LOKAN_TELEMETRY_JSON) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    const char *payload = payload_json;
+    while (*payload == ' ' || *payload == '\t' || *payload == '\n' || *payload == '\r') {
+        payload++;
+    }
+    if (*payload != '{') {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+
+    size_t payload_len = strlen(payload);
+    size_t envelope_len = (sizeof(LOKAN_TELEMETRY_SOURCE_OPEN) - 1) + lokan_json_escaped_len(source) +
+                          (sizeof(LOKAN_TELEMETRY_PAYLOAD_OPEN) - 1) + payload_len + 1;
+    struct lokan_telemetry_buffer *buffer = NULL;
+    lokan_result_t result = lokan_telemetry_reserve(batch, envelope_len, &buffer);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+
+    char *out = buffer->data + buffer->size;
+    memcpy(out, LOKAN_TELEMETRY_SOURCE_OPEN, sizeof(LOKAN_TELEMETRY_SOURCE_OPEN) - 1);
+    out += sizeof(LOKAN_TELEMETRY_SOURCE_OPEN) - 1;
+    out = lokan_json_escape_into(out, source);
+    memcpy(out, LOKAN_TELEMETRY_PAYLOAD_OPEN, sizeof(LOKAN_TELEMETRY_PAYLOAD_OPEN) - 1);
+    out += sizeof(LOKAN_TELEMETRY_PAYLOAD_OPEN) - 1;
+    memcpy(out, payload, payload_len);
+    out += payload_len;
+    *out++ = '}';
+    lokan_telemetry_commit(batch, buffer, out);
+    return LOKAN_OK;
+}
+
+static size_t lokan_cbor_head_len(uint64_t value) {
+    if (value < 24) {
+        return 1;
+    }
+    if (value <= 0xff) {
+        return 2;
+    }
+    if (value <= 0xffff) {
+        return 3;
+    }
+    return value <= 0xffffffffu ? 5 : 9;
+}
+
+/* Writes a major type and its argument in the shortest form. */
+static char *lokan_cbor_head(char *out, unsigned major, uint64_t value) {
+    size_t len = lokan_cbor_head_len(value);
+    unsigned char *bytes = (unsigned char *)out;
+    if (len == 1) {
+        bytes[0] = (unsigned char)((major << 5) | value);
+        return out + 1;
+    }
+    static const unsigned char info[] = {0, 0, 24, 25, 0, 26, 0, 0, 0, 27};
+    bytes[0] = (unsigned char)((major << 5) | info[len]);
+    for (size_t i = 1; i < len; ++i) {
+        bytes[i] = (unsigned char)(value >> (8 * (len - 1 - i)));
+    }
+    return out + len;
+}
+
+static size_t lokan_cbor_text_len(const char *text) {
+    size_t len = strlen(text);
+    return lokan_cbor_head_len(len) + len;
+}
+
+static char *lokan_cbor_text(char *out, const char *text) {
+    size_t len = strlen(text);
+    out = lokan_cbor_head(out, LOKAN_CBOR_TEXT, len);
+    memcpy(out, text, len);
+    return out + len;
+}
+
+static uint64_t lokan_cbor_integer_argument(int64_t value) {
+    /* A negative n is encoded as -1 - n, which never overflows. */
+    return value >= 0 ? (uint64_t)value : (uint64_t)(-1 - value);
+}
+
+/* Single precision when it holds the value exactly, which most meter readings do; double otherwise. */
+static int lokan_cbor_fits_float(double value) {
+    if (isnan(value) || isinf(value)) {
+        return 1;
+    }
+    /* Narrowing a finite double outside float's range is undefined, so that is ruled out first. */
+    return fabs(value) <= FLT_MAX && (double)(float)value == value;
+}
+
+static size_t lokan_cbor_number_len(double value) {
+    return lokan_cbor_fits_float(value) ? 5 : 9;
+}
+
+static char *lokan_cbor_number(char *out, double value) {
+    unsigned char *bytes = (unsigned char *)out;
+    if (lokan_cbor_fits_float(value)) {
+        float narrow = (float)value;
+        uint32_t bits = 0;
+        memcpy(&bits, &narrow, sizeof(bits));
+        bytes[0] = 0xfa;
+        for (int i = 0; i < 4; ++i) {
+            bytes[1 + i] = (unsigned char)(bits >> (24 - 8 * i));
+        }
+        return out + 5;
+    }
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    bytes[0] = 0xfb;
+    for (int i = 0; i < 8; ++i) {
+        bytes[1 + i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    return out + 9;
+}
+
+/* Shortest %g rendering that reads back as the same double. */
+static size_t lokan_telemetry_format_number(char *out, size_t capacity, double value) {
+    int len = snprintf(out, capacity, "%.15g", value);
+    if (strtod(out, NULL) != value) {
+        len = snprintf(out, capacity, "%.17g", value);
+    }
+    return (size_t)len;
+}
+
+/* Exact size of the envelope, or for JSON numbers an upper bound; 0 if a field is unusable. */
+static size_t lokan_telemetry_fields_len(
+    const lokan_telemetry_t *batch,
+    const char *source,
+    const lokan_telemetry_field_t *fields,
+    size_t count) {
+    int cbor = batch->format == LOKAN_TELEMETRY_CBOR;
+    size_t len = cbor ? (sizeof(LOKAN_CBOR_SOURCE_OPEN) - 1) + lokan_cbor_text_len(source) +
+                            (sizeof(LOKAN_CBOR_PAYLOAD_OPEN) - 1) + lokan_cbor_head_len(count)
+                      : (sizeof(LOKAN_TELEMETRY_SOURCE_OPEN) - 1) + lokan_json_escaped_len(source) +
+                            (sizeof(LOKAN_TELEMETRY_PAYLOAD_OPEN) - 1) + 2 + 1;
+    for (size_t i = 0; i < count; ++i) {
+        const lokan_telemetry_field_t *field = &fields[i];
+        if (!field->name || (field->kind == LOKAN_TELEMETRY_STRING && !field->string)) {
+            return 0;
+        }
+        if (cbor) {
+            len += lokan_cbor_text_len(field->name);
+        } else {
+            /* "name": plus the comma before every member but the first. */
+            len += lokan_json_escaped_len(field->name) + 3 + (i > 0 ? 1 : 0);
+        }
+        switch (field->kind) {
+            case LOKAN_TELEMETRY_NUMBER:
+                if (!cbor && !isfinite(field->number)) {
+                    return 0;
+                }
+                len += cbor ? lokan_cbor_number_len(field->number) : LOKAN_TELEMETRY_NUMBER_MAX;
+                break;
+            case LOKAN_TELEMETRY_INTEGER:
+                len += cbor ? lokan_cbor_head_len(lokan_cbor_integer_argument(field->integer)) : 20;
+                break;
+            case LOKAN_TELEMETRY_BOOL:
+                len += cbor ? 1 : 5;
+                break;
+            case LOKAN_TELEMETRY_STRING:
+                len += cbor ? lokan_cbor_text_len(field->string) : lokan_json_escaped_len(field->string) + 2;
+                break;
+            default:
+                return 0;
+        }
+    }
+    return len;
+}
+
+static char *lokan_telemetry_write_cbor(
+    char *out,
+    const char *source,
+    const lokan_telemetry_field_t *fields,
+    size_t count) {
+    memcpy(out, LOKAN_CBOR_SOURCE_OPEN, sizeof(LOKAN_CBOR_SOURCE_OPEN) - 1);
+    out = lokan_cbor_text(out + sizeof(LOKAN_CBOR_SOURCE_OPEN) - 1, source);
+    memcpy(out, LOKAN_CBOR_PAYLOAD_OPEN, sizeof(LOKAN_CBOR_PAYLOAD_OPEN) - 1);
+    out = lokan_cbor_head(out + sizeof(LOKAN_CBOR_PAYLOAD_OPEN) - 1, LOKAN_CBOR_MAP, count);
+    for (size_t i = 0; i < count; ++i) {
+        const lokan_telemetry_field_t *field = &fields[i];
+        out = lokan_cbor_text(out, field->name);
+        switch (field->kind) {
+            case LOKAN_TELEMETRY_NUMBER:
+                out = lokan_cbor_number(out, field->number);
+                break;
+            case LOKAN_TELEMETRY_INTEGER:
+                out = lokan_cbor_head(out, field->integer >= 0 ? LOKAN_CBOR_UNSIGNED : LOKAN_CBOR_NEGATIVE,
+                                      lokan_cbor_integer_argument(field->integer));
+                break;
+            case LOKAN_TELEMETRY_BOOL:
+                *out++ = (char)(field->boolean ? 0xf5 : 0xf4);
+                break;
+            case LOKAN_TELEMETRY_STRING:
+                out = lokan_cbor_text(out, field->string);
+                break;
+        }
+    }
+    return out;
+}
+
+static char *lokan_telemetry_write_json(
+    char *out,
+    const char *source,
+    const lokan_telemetry_field_t *fields,
+    size_t count) {
+    memcpy(out, LOKAN_TELEMETRY_SOURCE_OPEN, sizeof(LOKAN_TELEMETRY_SOURCE_OPEN) - 1);
+    out = lokan_json_escape_into(out + sizeof(LOKAN_TELEMETRY_SOURCE_OPEN) - 1, source);
+    memcpy(out, LOKAN_TELEMETRY_PAYLOAD_OPEN, sizeof(LOKAN_TELEMETRY_PAYLOAD_OPEN) - 1);
+    out += sizeof(LOKAN_TELEMETRY_PAYLOAD_OPEN) - 1;
+    *out++ = '{';
+    for (size_t i = 0; i < count; ++i) {
+        const lokan_telemetry_field_t *field = &fields[i];
+        if (i > 0) {
+            *out++ = ',';
+        }
+        *out++ = '"';
+        out = lokan_json_escape_into(out, field->name);
+        *out++ = '"';
+        *out++ = ':';
+        char number[LOKAN_TELEMETRY_NUMBER_MAX + 8];
+        size_t len = 0;
+        switch (field->kind) {
+            case LOKAN_TELEMETRY_NUMBER:
+                len = lokan_telemetry_format_number(number, sizeof(number), field->number);
+                memcpy(out, number, len);
+                out += len;
+                break;
+            case LOKAN_TELEMETRY_INTEGER:
+                len = (size_t)snprintf(number, sizeof(number), "%lld", (long long)field->integer);
+                memcpy(out, number, len);
+                out += len;
+                break;
+            case LOKAN_TELEMETRY_BOOL:
+                len = field->boolean ? 4 : 5;
+                memcpy(out, field->boolean ? "true" : "false", len);
+                out += len;
+                break;
+            case LOKAN_TELEMETRY_STRING:
+                *out++ = '"';
+                out = lokan_json_escape_into(out, field->string);
+                *out++ = '"';
+                break;
+        }
+    }
+    *out++ = '}';
+    *out++ = '}';
+    return out;
+}
+
+lokan_result_t lokan_telemetry_append_fields(
+    lokan_telemetry_t *batch,
+    const char *source,
+    const lokan_telemetry_field_t *fields,
+    size_t count) {
+    if (!batch || !source || (!fields && count > 0)) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    size_t envelope_len = lokan_telemetry_fields_len(batch, source, fields, count);
+    if (envelope_len == 0) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    struct lokan_telemetry_buffer *buffer = NULL;
+    lokan_result_t result = lokan_telemetry_reserve(batch, envelope_len, &buffer);
+    if (result != LOKAN_OK) {
+        return result;
+    }
+    char *out = buffer->data + buffer->size;
+    if (batch->format == LOKAN_TELEMETRY_CBOR) {
+        out = lokan_telemetry_write_cbor(out, source, fields, count);
+    } else {
+        out = lokan_telemetry_write_json(out, source, fields, count);
+    }
+    lokan_telemetry_commit(batch, buffer, out);
+    return LOKAN_OK;
+}
+
+/* Swaps the active buffer out for sending if nothing is already waiting to be sent. */
+static void lokan_telemetry_rotate(lokan_telemetry_t *batch) {
+    if (batch->sending->count > 0) {
+        return;
+    }
+    pthread_mutex_lock(&batch->lock);
+    if (batch->active->count > 0) {
+        struct lokan_telemetry_buffer *full = batch->active;
+        batch->active = batch->sending;
+        batch->sending = full;
+        pthread_cond_broadcast(&batch->space);
+    }
+    pthread_mutex_unlock(&batch->lock);
+}
+
+/* Whether a failed send may succeed later unchanged: no connection, an open circuit, or a 408, 429 or 5xx. */
+static int lokan_telemetry_retryable(lokan_result_t result, long status) {
+    if (result == LOKAN_ERROR_HTTP) {
+        return status == 408 || status == 429 || status >= 500;
+    }
+    return result == LOKAN_ERROR_CURL || result == LOKAN_ERROR_UNAVAILABLE || result == LOKAN_ERROR_RATE_LIMITED;
+}
+
+static lokan_result_t lokan_telemetry_send(lokan_telemetry_t *batch) {
+    struct lokan_telemetry_buffer *buffer = batch->sending;
+    if (buffer->count == 0) {
+        return LOKAN_OK;
+    }
+
+    /* The suffix always fits: appends leave room for it. */
+    memcpy(buffer->data + buffer->size, batch->suffix, batch->suffix_len);
+    lokan_iovec_t body = {buffer->data, buffer->size + batch->suffix_len};
+    struct lokan_body_reader reader = {&body, 1, 0, 0, body.len,
+                                       batch->format == LOKAN_TELEMETRY_CBOR ? LOKAN_BODY_CBOR : LOKAN_BODY_JSON};
+    long status = 0;
+    lokan_result_t result = lokan_perform_reader(batch->client, batch->path, "POST", &reader, &status);
+
+    uint64_t evicted = 0;
+    int retryable = result != LOKAN_OK && lokan_telemetry_retryable(result, status);
+    int spooled = retryable && batch->spool &&
+                  lokan_spool_append(batch->spool, reader.format, body.data, body.len, (uint32_t)buffer->count,
+                                     &evicted) == LOKAN_OK;
+
+    pthread_mutex_lock(&batch->lock);
+    if (result == LOKAN_OK) {
+        batch->stats.batches_sent++;
+        batch->stats.envelopes_sent += buffer->count;
+        lokan_telemetry_buffer_reset(batch, buffer);
+    } else if (spooled) {
+        batch->stats.failed_flushes++;
+        batch->stats.envelopes_spooled += buffer->count;
+        batch->stats.spool_dropped += evicted;
+        lokan_telemetry_buffer_reset(batch, buffer);
+    } else if (!retryable) {
+        /* Resending a refused body would hold the buffer and back up every append behind it. */
+        batch->stats.failed_flushes++;
+        batch->stats.rejected += buffer->count;
+        lokan_telemetry_buffer_reset(batch, buffer);
+    } else {
+        batch->stats.failed_flushes++;
+        /* Back off a full age interval before poll retries this batch. */
+        buffer->opened_ms = lokan_now_ms();
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return result;
+}
+
+lokan_result_t lokan_telemetry_flush(lokan_telemetry_t *batch) {
+    if (!batch) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    /* A retained batch goes first, then whatever accumulated behind it. */
+    for (int pass = 0; pass < 2; ++pass) {
+        lokan_telemetry_rotate(batch);
+        lokan_result_t result = lokan_telemetry_send(batch);
+        if (result != LOKAN_OK) {
+            return result;
+        }
+    }
+    return LOKAN_OK;
+}
+
+static void lokan_telemetry_drained(const lokan_response_t *response, void *user_data) {
+    lokan_telemetry_t *batch = (lokan_telemetry_t *)user_data;
+    uint64_t now = lokan_now_ms();
+    batch->draining = 0;
+    if (response->result != LOKAN_OK && lokan_telemetry_retryable(response->result, response->status)) {
+        /* Still offline; wait as long as a retained batch would before trying again. */
+        batch->drain_after_ms = now + (uint64_t)batch->max_age_ms;
+        return;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    if (response->result == LOKAN_OK) {
+        batch->stats.batches_sent++;
+        batch->stats.envelopes_sent += batch->drained.envelopes;
+    } else {
+        /* Rejected outright, so resending it would only wedge the spool. */
+        batch->stats.spool_dropped += batch->drained.envelopes;
+    }
+    pthread_mutex_unlock(&batch->lock);
+    lokan_spool_release(batch->spool, &batch->drained);
+    batch->drain_after_ms = now + (uint64_t)batch->drain_interval_ms;
+}
+
+/* Resends the oldest spooled batch when one is due, and syncs the spool once per spool_sync_ms. */
+static void lokan_telemetry_drain(lokan_telemetry_t *batch, uint64_t now) {
+    lokan_client_t *client = batch->client;
+    if (batch->draining) {
+        lokan_client_perform(client, NULL);
+    }
+    if (!batch->draining && now >= batch->drain_after_ms && lokan_spool_peek(batch->spool, &batch->drained)) {
+        lokan_iovec_t body = {batch->drained.data, batch->drained.len};
+        struct lokan_body_reader reader = {&body, 1, 0, 0, body.len, batch->drained.format};
+        if (lokan_request_submit_reader(client, "POST", batch->path, &reader, lokan_telemetry_drained, batch) ==
+            LOKAN_OK) {
+            batch->draining = 1;
+        } else {
+            batch->drain_after_ms = now + (uint64_t)batch->max_age_ms;
+        }
+    }
+    if (lokan_spool_dirty(batch->spool) && now - batch->synced_ms >= (uint64_t)batch->spool_sync_ms) {
+        lokan_spool_sync(batch->spool);
+        batch->synced_ms = now;
+    }
+}
+
+lokan_result_t lokan_telemetry_poll(lokan_telemetry_t *batch) {
+    if (!batch) {
+        return LOKAN_ERROR_INVALID_ARGUMENT;
+    }
+    uint64_t now = lokan_now_ms();
+    uint64_t max_age = (uint64_t)batch->max_age_ms;
+    if (batch->spool) {
+        lokan_telemetry_drain(batch, now);
+    }
+
+    if (batch->sending->count > 0) {
+        if (now - batch->sending->opened_ms < max_age) {
+            return LOKAN_OK;
+        }
+        return lokan_telemetry_flush(batch);
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    const struct lokan_telemetry_buffer *active = batch->active;
+    int due = active->count > 0 &&
+              (active->size >= batch->flush_threshold ||
+               active->count >= batch->max_envelopes ||
+               now - active->opened_ms >= max_age);
+    pthread_mutex_unlock(&batch->lock);
+
+    return due ? lokan_telemetry_flush(batch) : LOKAN_OK;
+}
+
+void lokan_telemetry_get_stats(lokan_telemetry_t *batch, lokan_telemetry_stats_t *out_stats) {
+    if (!batch || !out_stats) {
+        return;
+    }
+    pthread_mutex_lock(&batch->lock);
+    *out_stats = batch->stats;
+    pthread_mutex_unlock(&batch->lock);
+}
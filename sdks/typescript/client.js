@@ -140,6 +140,14 @@ export async function deviceRegistryListDevices(options = {}) {
   return await response.json();
 }
 
+export async function deviceRegistryListChanges(options = {}) {
+  const response = await request('/device-registry/devices/changes', 'GET', options);
+  if (!response.ok) {
+    throw new Error(`Request failed with status ${response.status}`);
+  }
+  return await response.json();
+}
+
 export async function deviceRegistryDiagnostics(options = {}) {
   const response = await request('/device-registry/diag', 'GET', options);
   if (!response.ok) {
@@ -348,6 +356,14 @@ export async function telemetryPipeIngest(body, options = {}) {
   return;
 }
 
+export async function telemetryPipeIngestBatch(body, options = {}) {
+  const response = await request('/telemetry-pipe/ingest/batch', 'POST', { ...options, body });
+  if (!response.ok) {
+    throw new Error(`Request failed with status ${response.status}`);
+  }
+  return await response.json();
+}
+
 export async function telemetryPipeMetrics(options = {}) {
   const response = await request('/telemetry-pipe/metrics', 'GET', options);
   if (!response.ok) {
@@ -3,8 +3,8 @@
  * Thin client helpers for the LokanOS API bundle.
  */
 
-import type { DiagnosticInfo, HealthStatus } from './types.js';
-export type { DiagnosticInfo, HealthStatus } from './types.js';
+import type { DiagnosticInfo, HealthStatus, TelemetryEnvelope, TelemetryIngestResult } from './types.js';
+export type { DiagnosticInfo, HealthStatus, TelemetryEnvelope, TelemetryIngestResult } from './types.js';
 
 export interface RequestOptions {
   /** Base URL for the LokanOS API (e.g. https://api.example.com). */
@@ -136,6 +136,7 @@ export type AuditLogListEntriesResponse = {
   entries: {
       [key: string]: unknown;
     }[];
+  nextCursor?: string;
 };
 
 export async function auditLogListEntries(options: RequestOptions = {}): Promise<AuditLogListEntriesResponse> {
@@ -173,6 +174,7 @@ export type DeviceRegistryListDevicesResponse = {
   devices: {
       [key: string]: unknown;
     }[];
+  nextCursor?: string;
 };
 
 export async function deviceRegistryListDevices(options: RequestOptions = {}): Promise<DeviceRegistryListDevicesResponse> {
@@ -184,6 +186,28 @@ export async function deviceRegistryListDevices(options: RequestOptions = {}): P
   return data as DeviceRegistryListDevicesResponse;
 }
 
+export type DeviceRegistryListChangesResponse = {
+  changes: {
+      deleted: boolean;
+      device?: {
+        [key: string]: unknown;
+      };
+      id: string;
+      seq: number;
+    }[];
+  hasMore: boolean;
+  latestSeq: number;
+};
+
+export async function deviceRegistryListChanges(options: RequestOptions = {}): Promise<DeviceRegistryListChangesResponse> {
+  const response = await request('/device-registry/devices/changes', 'GET', options);
+  if (!response.ok) {
+    throw new Error(`Request failed with status ${response.status}`);
+  }
+  const data = await response.json();
+  return data as DeviceRegistryListChangesResponse;
+}
+
 export type DeviceRegistryDiagnosticsResponse = DiagnosticInfo;
 
 export async function deviceRegistryDiagnostics(options: RequestOptions = {}): Promise<DeviceRegistryDiagnosticsResponse> {
@@ -495,6 +519,21 @@ export async function telemetryPipeIngest(body: TelemetryPipeIngestRequest, opti
   return undefined as TelemetryPipeIngestResponse;
 }
 
+export type TelemetryPipeIngestBatchRequest = {
+  envelopes: TelemetryEnvelope[];
+};
+
+export type TelemetryPipeIngestBatchResponse = TelemetryIngestResult;
+
+export async function telemetryPipeIngestBatch(body: TelemetryPipeIngestBatchRequest, options: RequestOptions = {}): Promise<TelemetryPipeIngestBatchResponse> {
+  const response = await request('/telemetry-pipe/ingest/batch', 'POST', { ...options, body });
+  if (!response.ok) {
+    throw new Error(`Request failed with status ${response.status}`);
+  }
+  const data = await response.json();
+  return data as TelemetryPipeIngestBatchResponse;
+}
+
 export type TelemetryPipeMetricsResponse = string;
 
 export async function telemetryPipeMetrics(options: RequestOptions = {}): Promise<TelemetryPipeMetricsResponse> {
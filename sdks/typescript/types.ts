@@ -20,3 +20,14 @@ export type ErrorResponse = {
 export type HealthStatus = {
   status: string;
 };
+
+export type TelemetryEnvelope = {
+  payload: {
+    [key: string]: unknown;
+  };
+  source: string;
+};
+
+export type TelemetryIngestResult = {
+  accepted: number;
+};
@@ -3,7 +3,7 @@ use std::path::PathBuf;
 use std::sync::Arc;
 
 use axum::body::Body;
-use axum::extract::{MatchedPath, State};
+use axum::extract::{MatchedPath, Query, State};
 use axum::http::{header, HeaderValue, Request, StatusCode};
 use axum::middleware::{from_fn, Next};
 use axum::response::{IntoResponse, Response};
@@ -13,7 +13,7 @@ use chrono::{DateTime, Utc};
 use serde::{Deserialize, Serialize};
 use sha2::{Digest, Sha256};
 use tokio::fs::{self, OpenOptions};
-use tokio::io::AsyncWriteExt;
+use tokio::io::{AsyncReadExt, AsyncSeekExt, AsyncWriteExt};
 use tokio::net::TcpListener;
 use tokio::sync::Mutex;
 
@@ -33,6 +33,9 @@ const DEFAULT_PORT: u16 = 8008;
 const DEFAULT_PATH: &str = "audit.log";
 
 const VERSION: &str = env!("CARGO_PKG_VERSION");
+const DEFAULT_PAGE_LIMIT: usize = 100;
+/// Largest page a client may ask for; bigger limits are clamped.
+const MAX_PAGE_LIMIT: usize = 1000;
 
 fn build_sha() -> &'static str {
     option_env!("BUILD_SHA").unwrap_or("unknown")
@@ -50,6 +53,10 @@ struct AppState {
 struct AuditWriter {
     path: PathBuf,
     prev_hash: Vec<u8>,
+    /// Byte offset of every record line, oldest first, so a page reads only its own lines.
+    offsets: Vec<u64>,
+    /// Length of the log file, where the next record starts.
+    end: u64,
 }
 
 #[derive(Debug, Clone, Serialize, Deserialize)]
@@ -71,12 +78,28 @@ struct AuditRecord {
     event: IncomingEvent,
 }
 
+#[derive(Debug, Clone, Default, Deserialize)]
+struct PageParams {
+    cursor: Option<String>,
+    limit: Option<usize>,
+}
+
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+struct EntryPage {
+    entries: Vec<AuditRecord>,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    next_cursor: Option<String>,
+}
+
 #[derive(Debug, thiserror::Error)]
 enum AuditError {
     #[error("i/o error: {0}")]
     Io(String),
     #[error("malformed log entry")]
     Malformed,
+    #[error("invalid page cursor")]
+    InvalidCursor,
 }
 
 impl From<std::io::Error> for AuditError {
@@ -90,6 +113,7 @@ impl IntoResponse for AuditError {
         let status = match self {
             AuditError::Io(_) => StatusCode::INTERNAL_SERVER_ERROR,
             AuditError::Malformed => StatusCode::BAD_REQUEST,
+            AuditError::InvalidCursor => StatusCode::BAD_REQUEST,
         };
         (
             status,
@@ -126,9 +150,11 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
     let app = Router::new()
         .route("/v1/events", post(record_event))
         .route("/v1/events/export", get(export_events))
+        .route("/v1/entries", get(list_entries))
         .route("/metrics", get(metrics))
         .with_state(state)
         .merge(health_router(SERVICE_NAME))
+        .layer(from_fn(common_compress::gzip))
         .layer(from_fn(track_http_metrics));
 
     let listener = TcpListener::bind(addr).await?;
@@ -154,6 +180,36 @@ async fn export_events(
     Ok(Json(entries))
 }
 
+/// Pages through the log from newest to oldest. The cursor is the position of
+/// the oldest record already returned; the log only grows at the other end, so
+/// records appended while paging never shift later pages.
+async fn list_entries(
+    State(state): State<AppState>,
+    Query(params): Query<PageParams>,
+) -> Result<Json<EntryPage>, AuditError> {
+    let before = params
+        .cursor
+        .as_deref()
+        .map(|raw| raw.parse::<usize>().map_err(|_| AuditError::InvalidCursor))
+        .transpose()?;
+    let limit = params.limit.unwrap_or(DEFAULT_PAGE_LIMIT);
+    let writer = state.writer.lock().await;
+    let (start, end) = page_bounds(writer.offsets.len(), before, limit);
+    let mut entries = writer.read_range(start, end).await?;
+    entries.reverse();
+    Ok(Json(EntryPage {
+        entries,
+        next_cursor: (start > 0).then(|| start.to_string()),
+    }))
+}
+
+/// Records `start..end` (oldest first) of a page of at most `limit` ending before `before`.
+fn page_bounds(total: usize, before: Option<usize>, limit: usize) -> (usize, usize) {
+    let end = before.unwrap_or(total).min(total);
+    let start = end.saturating_sub(limit.clamp(1, MAX_PAGE_LIMIT));
+    (start, end)
+}
+
 async fn metrics() -> impl IntoResponse {
     (
         StatusCode::OK,
@@ -191,30 +247,38 @@ impl AuditWriter {
             }
         }
 
-        let prev_hash = Self::hydrate_prev_hash(&path).await?;
-        Ok(Self { path, prev_hash })
+        let mut writer = Self {
+            path,
+            prev_hash: vec![0u8; 32],
+            offsets: Vec::new(),
+            end: 0,
+        };
+        writer.hydrate().await?;
+        Ok(writer)
     }
 
-    async fn hydrate_prev_hash(path: &PathBuf) -> Result<Vec<u8>, AuditError> {
-        if !path.exists() {
-            return Ok(vec![0u8; 32]);
-        }
-        let contents = fs::read(path).await?;
-        if contents.is_empty() {
-            return Ok(vec![0u8; 32]);
+    /// Restores the hash chain and the line index from an existing log.
+    async fn hydrate(&mut self) -> Result<(), AuditError> {
+        if !self.path.exists() {
+            return Ok(());
         }
-        let mut prev = vec![0u8; 32];
-        for line in contents
-            .split(|b| *b == b'\n')
-            .filter(|line| !line.is_empty())
-        {
+        let contents = fs::read(&self.path).await?;
+        let mut offset = 0u64;
+        for line in contents.split(|b| *b == b'\n') {
+            let start = offset;
+            offset += line.len() as u64 + 1;
+            if line.is_empty() {
+                continue;
+            }
             let record: AuditRecord =
                 serde_json::from_slice(line).map_err(|_| AuditError::Malformed)?;
-            prev = STANDARD
+            self.prev_hash = STANDARD
                 .decode(record.hash)
                 .map_err(|_| AuditError::Malformed)?;
+            self.offsets.push(start);
         }
-        Ok(prev)
+        self.end = contents.len() as u64;
+        Ok(())
     }
 
     async fn append(&mut self, event: IncomingEvent) -> Result<(), AuditError> {
@@ -234,17 +298,33 @@ impl AuditWriter {
             .append(true)
             .open(&self.path)
             .await?;
-        file.write_all(
-            serde_json::to_vec(&record)
-                .map_err(|_| AuditError::Malformed)?
-                .as_slice(),
-        )
-        .await?;
-        file.write_all(b"\n").await?;
+        let mut line = serde_json::to_vec(&record).map_err(|_| AuditError::Malformed)?;
+        line.push(b'\n');
+        file.write_all(&line).await?;
         self.prev_hash = hash.to_vec();
+        self.offsets.push(self.end);
+        self.end += line.len() as u64;
         Ok(())
     }
 
+    /// Reads records `start..end` in log order, touching only their bytes.
+    async fn read_range(&self, start: usize, end: usize) -> Result<Vec<AuditRecord>, AuditError> {
+        if start >= end {
+            return Ok(Vec::new());
+        }
+        let from = self.offsets[start];
+        let to = self.offsets.get(end).copied().unwrap_or(self.end);
+        let mut file = fs::File::open(&self.path).await?;
+        file.seek(std::io::SeekFrom::Start(from)).await?;
+        let mut contents = vec![0u8; (to - from) as usize];
+        file.read_exact(&mut contents).await?;
+        contents
+            .split(|b| *b == b'\n')
+            .filter(|line| !line.is_empty())
+            .map(|line| serde_json::from_slice(line).map_err(|_| AuditError::Malformed))
+            .collect()
+    }
+
     async fn read_all(&self) -> Result<Vec<AuditRecord>, AuditError> {
         if !self.path.exists() {
             return Ok(Vec::new());
@@ -262,3 +342,23 @@ impl AuditWriter {
         Ok(records)
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn pages_walk_from_newest_to_oldest() {
+        assert_eq!(page_bounds(250, None, 100), (150, 250));
+        assert_eq!(page_bounds(250, Some(150), 100), (50, 150));
+        assert_eq!(page_bounds(250, Some(50), 100), (0, 50));
+    }
+
+    #[test]
+    fn page_bounds_clamp_cursor_and_limit() {
+        assert_eq!(page_bounds(10, Some(500), 100), (0, 10));
+        assert_eq!(page_bounds(10, None, 0), (9, 10));
+        assert_eq!(page_bounds(5000, None, 5000), (4000, 5000));
+        assert_eq!(page_bounds(0, None, 100), (0, 0));
+    }
+}
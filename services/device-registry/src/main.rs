@@ -1,11 +1,12 @@
 use axum::body::Body;
-use axum::extract::{ws::Message, MatchedPath, Path, State, WebSocketUpgrade};
+use axum::extract::{ws::Message, MatchedPath, Path, Query, State, WebSocketUpgrade};
 use axum::http::{header, HeaderValue, Request, StatusCode};
 use axum::middleware::{from_fn, Next};
 use axum::response::sse::{Event, KeepAlive};
 use axum::response::{IntoResponse, Response, Sse};
 use axum::routing::{get, put};
 use axum::{Json, Router};
+use base64::{engine::general_purpose::URL_SAFE_NO_PAD, Engine as _};
 use futures_core::Stream;
 use futures_util::{SinkExt, StreamExt};
 use serde::{Deserialize, Serialize};
@@ -39,6 +40,10 @@ const DEFAULT_DB_URL: &str = "postgres://localhost/device_registry";
 const DEFAULT_DB_URL: &str = "sqlite://device-registry.db";
 
 const VERSION: &str = env!("CARGO_PKG_VERSION");
+/// Largest page a client may ask for; bigger limits are clamped.
+const MAX_PAGE_LIMIT: u32 = 1000;
+/// Largest number of changes returned by one `/v1/devices/changes` call.
+const MAX_CHANGE_LIMIT: u32 = 1000;
 
 fn build_sha() -> &'static str {
     option_env!("BUILD_SHA").unwrap_or("unknown")
@@ -118,6 +123,68 @@ struct UpdateDevice {
     state: Option<serde_json::Value>,
 }
 
+#[derive(Debug, Clone, Default, Deserialize)]
+struct PageParams {
+    cursor: Option<String>,
+    limit: Option<u32>,
+}
+
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+struct DevicePage {
+    devices: Vec<Device>,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    next_cursor: Option<String>,
+}
+
+/// Position after the last device of a page in `ORDER BY name, id`, so pages
+/// stay stable while devices are added or removed between requests.
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+struct DeviceCursor {
+    name: String,
+    id: String,
+}
+
+impl DeviceCursor {
+    fn encode(&self) -> String {
+        URL_SAFE_NO_PAD.encode(serde_json::to_vec(self).unwrap_or_default())
+    }
+
+    fn decode(raw: &str) -> Result<Self, RegistryError> {
+        let bytes = URL_SAFE_NO_PAD
+            .decode(raw)
+            .map_err(|_| RegistryError::InvalidCursor)?;
+        serde_json::from_slice(&bytes).map_err(|_| RegistryError::InvalidCursor)
+    }
+}
+
+#[derive(Debug, Clone, Default, Deserialize)]
+struct ChangeParams {
+    #[serde(default)]
+    since: i64,
+    limit: Option<u32>,
+}
+
+/// The latest change to one device after `since`. Several writes to the same
+/// device collapse into one entry carrying its current record, so a mirror
+/// applies each device at most once per call.
+#[derive(Debug, Clone, Serialize)]
+struct DeviceChange {
+    seq: i64,
+    id: String,
+    deleted: bool,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    device: Option<Device>,
+}
+
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+struct ChangePage {
+    changes: Vec<DeviceChange>,
+    latest_seq: i64,
+    has_more: bool,
+}
+
 #[derive(Debug, Clone, Deserialize)]
 struct CapabilityPayload {
     capability: String,
@@ -129,6 +196,10 @@ struct CapabilityPayload {
 enum RegistryError {
     #[error("record not found")]
     NotFound,
+    #[error("invalid page cursor")]
+    InvalidCursor,
+    #[error("change sequence is ahead of the registry; resync from 0")]
+    SequenceAhead,
     #[error("database error: {0}")]
     Database(#[from] sqlx::Error),
 }
@@ -137,6 +208,8 @@ impl IntoResponse for RegistryError {
     fn into_response(self) -> axum::response::Response {
         let status = match self {
             RegistryError::NotFound => StatusCode::NOT_FOUND,
+            RegistryError::InvalidCursor => StatusCode::BAD_REQUEST,
+            RegistryError::SequenceAhead => StatusCode::GONE,
             RegistryError::Database(_) => StatusCode::INTERNAL_SERVER_ERROR,
         };
         let msg = self.to_string();
@@ -174,6 +247,7 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
     let app = Router::new()
         .route("/v1/rooms", get(list_rooms).post(create_room))
         .route("/v1/devices", get(list_devices).post(create_device))
+        .route("/v1/devices/changes", get(list_device_changes))
         .route(
             "/v1/devices/:id",
             get(fetch_device).put(update_device).delete(delete_device),
@@ -209,6 +283,12 @@ async fn init_schema(pool: &DbPool) -> Result<(), sqlx::Error> {
         properties TEXT NOT NULL
     )";
 
+    #[cfg(feature = "postgres")]
+    let create_changes = "CREATE TABLE IF NOT EXISTS device_changes (
+        seq BIGSERIAL PRIMARY KEY,
+        device_id TEXT NOT NULL
+    )";
+
     #[cfg(not(feature = "postgres"))]
     let create_capabilities = "CREATE TABLE IF NOT EXISTS capabilities (
         id INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -217,6 +297,12 @@ async fn init_schema(pool: &DbPool) -> Result<(), sqlx::Error> {
         properties TEXT NOT NULL
     )";
 
+    #[cfg(not(feature = "postgres"))]
+    let create_changes = "CREATE TABLE IF NOT EXISTS device_changes (
+        seq INTEGER PRIMARY KEY AUTOINCREMENT,
+        device_id TEXT NOT NULL
+    )";
+
     let create_rooms = "CREATE TABLE IF NOT EXISTS rooms (id TEXT PRIMARY KEY, name TEXT NOT NULL)";
     let create_devices = "CREATE TABLE IF NOT EXISTS devices (
         id TEXT PRIMARY KEY,
@@ -229,6 +315,22 @@ async fn init_schema(pool: &DbPool) -> Result<(), sqlx::Error> {
     sqlx::query(create_rooms).execute(pool).await?;
     sqlx::query(create_devices).execute(pool).await?;
     sqlx::query(create_capabilities).execute(pool).await?;
+    // Serves keyset pagination of the device list without sorting the table per page.
+    sqlx::query("CREATE INDEX IF NOT EXISTS devices_name_id ON devices (name, id)")
+        .execute(pool)
+        .await?;
+    sqlx::query(create_changes).execute(pool).await?;
+    sqlx::query("CREATE INDEX IF NOT EXISTS device_changes_device ON device_changes (device_id)")
+        .execute(pool)
+        .await?;
+    // A registry that predates the change log starts it with one change per
+    // existing device, so a mirror syncing from 0 still sees all of them.
+    sqlx::query(
+        "INSERT INTO device_changes (device_id) SELECT id FROM devices \
+         WHERE NOT EXISTS (SELECT 1 FROM device_changes)",
+    )
+    .execute(pool)
+    .await?;
     Ok(())
 }
 
@@ -291,23 +393,82 @@ async fn create_room(
     Ok(Json(room))
 }
 
-async fn list_devices(State(state): State<AppState>) -> Result<Json<Vec<Device>>, RegistryError> {
-    let rows =
-        sqlx::query("SELECT id, room_id, name, kind, status, state FROM devices ORDER BY name")
+/// Without `limit` or `cursor` the whole list is returned as a bare array, as
+/// before; with either, one page is returned as `{"devices", "nextCursor"}`.
+async fn list_devices(
+    State(state): State<AppState>,
+    Query(params): Query<PageParams>,
+) -> Result<Response, RegistryError> {
+    if params.limit.is_none() && params.cursor.is_none() {
+        let rows = sqlx::query(
+            "SELECT id, room_id, name, kind, status, state FROM devices ORDER BY name, id",
+        )
+        .fetch_all(&state.pool)
+        .await?;
+        let devices: Vec<Device> = rows.into_iter().map(device_from_row).collect();
+        return Ok(Json(devices).into_response());
+    }
+
+    let limit = params
+        .limit
+        .unwrap_or(MAX_PAGE_LIMIT)
+        .clamp(1, MAX_PAGE_LIMIT);
+    // One row past the page says whether another page follows.
+    let fetch = i64::from(limit) + 1;
+    let rows = match params.cursor.as_deref() {
+        Some(raw) => {
+            let after = DeviceCursor::decode(raw)?;
+            sqlx::query(
+                "SELECT id, room_id, name, kind, status, state FROM devices \
+                 WHERE name > ? OR (name = ? AND id > ?) ORDER BY name, id LIMIT ?",
+            )
+            .bind(&after.name)
+            .bind(&after.name)
+            .bind(&after.id)
+            .bind(fetch)
             .fetch_all(&state.pool)
-            .await?;
-    let devices = rows
-        .into_iter()
-        .map(|row| Device {
-            id: row.get("id"),
-            room_id: row.get("room_id"),
-            name: row.get("name"),
-            kind: row.get("kind"),
-            status: row.get("status"),
-            state: parse_state(row.get("state")),
+            .await?
+        }
+        None => {
+            sqlx::query(
+                "SELECT id, room_id, name, kind, status, state FROM devices \
+                 ORDER BY name, id LIMIT ?",
+            )
+            .bind(fetch)
+            .fetch_all(&state.pool)
+            .await?
+        }
+    };
+
+    let mut devices: Vec<Device> = rows.into_iter().map(device_from_row).collect();
+    let next_cursor = if devices.len() > limit as usize {
+        devices.truncate(limit as usize);
+        devices.last().map(|device| {
+            DeviceCursor {
+                name: device.name.clone(),
+                id: device.id.clone(),
+            }
+            .encode()
         })
-        .collect();
-    Ok(Json(devices))
+    } else {
+        None
+    };
+    Ok(Json(DevicePage {
+        devices,
+        next_cursor,
+    })
+    .into_response())
+}
+
+fn device_from_row(row: sqlx::any::AnyRow) -> Device {
+    Device {
+        id: row.get("id"),
+        room_id: row.get("room_id"),
+        name: row.get("name"),
+        kind: row.get("kind"),
+        status: row.get("status"),
+        state: parse_state(row.get("state")),
+    }
 }
 
 async fn create_device(
@@ -321,6 +482,7 @@ async fn create_device(
     let status = payload.status.clone();
     let state_value = payload.state.clone();
     let state_json = serde_json::to_string(&payload.state).unwrap_or_else(|_| "{}".to_string());
+    let mut tx = state.pool.begin().await?;
     sqlx::query(
         "INSERT INTO devices (id, room_id, name, kind, status, state) VALUES (?, ?, ?, ?, ?, ?)",
     )
@@ -330,8 +492,10 @@ async fn create_device(
     .bind(&kind)
     .bind(&status)
     .bind(state_json)
-    .execute(&state.pool)
+    .execute(&mut *tx)
     .await?;
+    record_change(&mut tx, &id).await?;
+    tx.commit().await?;
 
     let device = Device {
         id: id.clone(),
@@ -381,6 +545,7 @@ async fn update_device(
     let updated_status = payload.status.unwrap_or(existing.status.clone());
     let updated_state = payload.state.unwrap_or(existing.state.clone());
 
+    let mut tx = state.pool.begin().await?;
     sqlx::query(
         "UPDATE devices SET room_id = ?, name = ?, kind = ?, status = ?, state = ? WHERE id = ?",
     )
@@ -390,8 +555,10 @@ async fn update_device(
     .bind(&updated_status)
     .bind(serde_json::to_string(&updated_state).unwrap_or_else(|_| existing.state.to_string()))
     .bind(&id)
-    .execute(&state.pool)
+    .execute(&mut *tx)
     .await?;
+    record_change(&mut tx, &id).await?;
+    tx.commit().await?;
 
     let device = Device {
         id: id.clone(),
@@ -414,11 +581,14 @@ async fn update_device_state(
     let existing = fetch_device(State(state.clone()), Path(id.clone()))
         .await?
         .0;
+    let mut tx = state.pool.begin().await?;
     sqlx::query("UPDATE devices SET state = ? WHERE id = ?")
         .bind(serde_json::to_string(&new_state).unwrap_or_else(|_| existing.state.to_string()))
         .bind(&id)
-        .execute(&state.pool)
+        .execute(&mut *tx)
         .await?;
+    record_change(&mut tx, &id).await?;
+    tx.commit().await?;
 
     let device = Device {
         state: new_state.clone(),
@@ -432,13 +602,16 @@ async fn delete_device(
     State(state): State<AppState>,
     Path(id): Path<String>,
 ) -> Result<StatusCode, RegistryError> {
+    let mut tx = state.pool.begin().await?;
     let result = sqlx::query("DELETE FROM devices WHERE id = ?")
         .bind(&id)
-        .execute(&state.pool)
+        .execute(&mut *tx)
         .await?;
     if result.rows_affected() == 0 {
         return Err(RegistryError::NotFound);
     }
+    record_change(&mut tx, &id).await?;
+    tx.commit().await?;
     publish_event(
         &state.events,
         EventKind::Deleted,
@@ -448,6 +621,93 @@ async fn delete_device(
     Ok(StatusCode::NO_CONTENT)
 }
 
+/// Appends to the change log inside the transaction of the write it records,
+/// so a change is visible to `/v1/devices/changes` exactly when the write is.
+///
+/// A seq is drawn at insert but only becomes visible at commit. Were writers
+/// concurrent, a later seq could commit first, and a mirror that read past it
+/// would never ask for the earlier one. So writers take the log in turn: on
+/// postgres through an advisory lock held until this transaction ends; SQLite
+/// already admits one writer at a time.
+async fn record_change(
+    tx: &mut sqlx::Transaction<'_, sqlx::Any>,
+    device_id: &str,
+) -> Result<(), sqlx::Error> {
+    #[cfg(feature = "postgres")]
+    let insert = "INSERT INTO device_changes (device_id) VALUES ($1)";
+    #[cfg(not(feature = "postgres"))]
+    let insert = "INSERT INTO device_changes (device_id) VALUES (?)";
+
+    #[cfg(feature = "postgres")]
+    sqlx::query("SELECT pg_advisory_xact_lock(hashtext('device_changes'))")
+        .execute(&mut **tx)
+        .await?;
+    sqlx::query(insert)
+        .bind(device_id)
+        .execute(&mut **tx)
+        .await?;
+    Ok(())
+}
+
+/// Devices changed after `since`, oldest change first. A deleted device reads
+/// as `deleted` with no record. `latestSeq` is what to pass as `since` next;
+/// with `hasMore` set the caller should ask again straight away.
+async fn list_device_changes(
+    State(state): State<AppState>,
+    Query(params): Query<ChangeParams>,
+) -> Result<Json<ChangePage>, RegistryError> {
+    let limit = params
+        .limit
+        .unwrap_or(MAX_CHANGE_LIMIT)
+        .clamp(1, MAX_CHANGE_LIMIT);
+    let latest: Option<i64> = sqlx::query("SELECT MAX(seq) AS seq FROM device_changes")
+        .fetch_one(&state.pool)
+        .await?
+        .get("seq");
+    if params.since > latest.unwrap_or(0) {
+        // The log was reset under the caller (e.g. a restored database); its
+        // mirror no longer matches anything the log can bring it back to.
+        return Err(RegistryError::SequenceAhead);
+    }
+
+    let rows = sqlx::query(
+        "SELECT c.seq, c.device_id, d.id, d.room_id, d.name, d.kind, d.status, d.state \
+         FROM (SELECT device_id, MAX(seq) AS seq FROM device_changes WHERE seq > ? \
+               GROUP BY device_id) c \
+         LEFT JOIN devices d ON d.id = c.device_id \
+         ORDER BY c.seq LIMIT ?",
+    )
+    .bind(params.since)
+    .bind(i64::from(limit) + 1)
+    .fetch_all(&state.pool)
+    .await?;
+
+    let has_more = rows.len() > limit as usize;
+    let changes: Vec<DeviceChange> = rows
+        .into_iter()
+        .take(limit as usize)
+        .map(|row| {
+            let present: Option<String> = row.get("id");
+            DeviceChange {
+                seq: row.get("seq"),
+                id: row.get("device_id"),
+                deleted: present.is_none(),
+                device: present.map(|_| device_from_row(row)),
+            }
+        })
+        .collect();
+    Ok(Json(change_page(changes, params.since, has_more)))
+}
+
+fn change_page(changes: Vec<DeviceChange>, since: i64, has_more: bool) -> ChangePage {
+    let latest_seq = changes.last().map_or(since, |change| change.seq);
+    ChangePage {
+        changes,
+        latest_seq,
+        has_more,
+    }
+}
+
 async fn list_capabilities(
     State(state): State<AppState>,
     Path(id): Path<String>,
@@ -571,3 +831,105 @@ fn default_status() -> String {
 fn parse_state(raw: String) -> serde_json::Value {
     serde_json::from_str(&raw).unwrap_or_else(|_| serde_json::json!({}))
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn cursor_round_trips_through_its_encoding() {
+        let cursor = DeviceCursor {
+            name: "Kitchen / \"main\" light".to_string(),
+            id: Uuid::new_v4().to_string(),
+        };
+        let encoded = cursor.encode();
+        assert!(encoded
+            .bytes()
+            .all(|b| b.is_ascii_alphanumeric() || b == b'-' || b == b'_'));
+        assert_eq!(DeviceCursor::decode(&encoded).unwrap(), cursor);
+    }
+
+    #[test]
+    fn change_page_advances_to_its_last_change() {
+        let change = |seq: i64, deleted: bool| DeviceChange {
+            seq,
+            id: format!("device-{seq}"),
+            deleted,
+            device: None,
+        };
+        let page = change_page(vec![change(4, false), change(9, true)], 3, true);
+        assert_eq!(page.latest_seq, 9);
+        let body = serde_json::to_value(&page).unwrap();
+        assert_eq!(body["latestSeq"], 9);
+        assert_eq!(body["hasMore"], true);
+        assert_eq!(body["changes"][1]["deleted"], true);
+        assert!(body["changes"][1].get("device").is_none());
+
+        let empty = change_page(Vec::new(), 12, false);
+        assert_eq!(empty.latest_seq, 12);
+    }
+
+    #[test]
+    fn malformed_cursor_is_rejected() {
+        assert!(matches!(
+            DeviceCursor::decode("not a cursor"),
+            Err(RegistryError::InvalidCursor)
+        ));
+        assert!(matches!(
+            DeviceCursor::decode(&URL_SAFE_NO_PAD.encode(b"[1,2]")),
+            Err(RegistryError::InvalidCursor)
+        ));
+    }
+
+    /// Runs against the scratch database in DEVICE_REGISTRY_TEST_DATABASE_URL,
+    /// e.g. postgres://localhost/device_registry_test; skipped when unset.
+    #[cfg(feature = "postgres")]
+    #[tokio::test]
+    async fn changes_become_visible_in_seq_order() {
+        let Ok(url) = std::env::var("DEVICE_REGISTRY_TEST_DATABASE_URL") else {
+            return;
+        };
+        sqlx::any::install_default_drivers();
+        let pool = init_pool(&url).await.unwrap();
+        init_schema(&pool).await.unwrap();
+        let visible = |pool: DbPool| async move {
+            let seq: Option<i64> = sqlx::query("SELECT MAX(seq) AS seq FROM device_changes")
+                .fetch_one(&pool)
+                .await
+                .unwrap()
+                .get("seq");
+            seq.unwrap_or(0)
+        };
+        let before = visible(pool.clone()).await;
+
+        let mut first = pool.begin().await.unwrap();
+        record_change(&mut first, "ordering-first").await.unwrap();
+        let second = tokio::spawn({
+            let pool = pool.clone();
+            async move {
+                let mut tx = pool.begin().await.unwrap();
+                record_change(&mut tx, "ordering-second").await.unwrap();
+                tx.commit().await.unwrap();
+            }
+        });
+
+        // Without the lock the second writer would commit the next seq here,
+        // and a reader would see it while the first one's is still missing.
+        tokio::time::sleep(std::time::Duration::from_millis(200)).await;
+        assert!(
+            !second.is_finished(),
+            "second writer overtook an open change"
+        );
+        assert_eq!(visible(pool.clone()).await, before);
+
+        first.commit().await.unwrap();
+        second.await.unwrap();
+        let rows = sqlx::query("SELECT device_id FROM device_changes WHERE seq > $1 ORDER BY seq")
+            .bind(before)
+            .fetch_all(&pool)
+            .await
+            .unwrap();
+        let ids: Vec<String> = rows.iter().map(|row| row.get("device_id")).collect();
+        assert_eq!(ids, ["ordering-first", "ordering-second"]);
+    }
+}
@@ -1,32 +1,35 @@
+use std::convert::Infallible;
 use std::net::SocketAddr;
+use std::sync::Arc;
 
 use axum::body::Body;
 use axum::extract::{MatchedPath, State};
-use axum::http::{header, HeaderValue, Request, StatusCode};
+use axum::http::{header, HeaderMap, HeaderValue, Request, StatusCode};
 use axum::middleware::{from_fn, Next};
-use axum::response::sse::{Event, KeepAlive};
+use axum::response::sse::{Event, Sse};
 use axum::response::{IntoResponse, Response};
 use axum::routing::{get, post};
 use axum::{Json, Router};
 use chrono::{DateTime, Utc};
 use futures_core::Stream;
-use futures_util::StreamExt;
 use serde::{Deserialize, Serialize};
 use tokio::net::TcpListener;
-use tokio::sync::broadcast;
-use tokio_stream::wrappers::BroadcastStream;
 
 use common_config::service_port;
 use common_obs::{
     encode_prometheus_metrics, health_router, http_request_observe, ObsInit,
     PROMETHEUS_CONTENT_TYPE,
 };
+use common_sse::{sse_response, EventFanout};
 
 use std::time::Instant;
 
 const SERVICE_NAME: &str = "presence-svc";
 const PORT_ENV: &str = "PRESENCE_SVC_PORT";
 const DEFAULT_PORT: u16 = 8004;
+const FANOUT_CAPACITY: usize = 128;
+/// Events kept for subscribers that reconnect with `Last-Event-ID`.
+const REPLAY_CAPACITY: usize = 256;
 
 const VERSION: &str = env!("CARGO_PKG_VERSION");
 
@@ -40,9 +43,12 @@ fn build_time() -> &'static str {
 
 #[derive(Clone)]
 struct AppState {
-    events: broadcast::Sender<PresenceEvent>,
+    events: Arc<PresenceFanout>,
 }
 
+/// Serialized presence events, fanned out to SSE subscribers.
+type PresenceFanout = EventFanout<Arc<str>>;
+
 #[derive(Debug, Clone, Deserialize)]
 struct WebhookPayload {
     person_id: String,
@@ -89,8 +95,9 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
     let port = service_port(PORT_ENV, DEFAULT_PORT);
     let addr = SocketAddr::from(([0, 0, 0, 0], port));
 
-    let (tx, _) = broadcast::channel(128);
-    let state = AppState { events: tx };
+    let state = AppState {
+        events: Arc::new(PresenceFanout::new(FANOUT_CAPACITY, REPLAY_CAPACITY)),
+    };
 
     tracing::info!(
         event = "service_start",
@@ -147,19 +154,15 @@ async fn intake_ble(State(state): State<AppState>, Json(payload): Json<BlePayloa
     StatusCode::ACCEPTED
 }
 
+/// Server-sent presence events. Each carries an `id`; a client reconnecting
+/// with `Last-Event-ID` first receives the retained events it missed, behind a
+/// `gap` event when some were evicted or dropped for lagging, or a `resync`
+/// event when its id predates a restart.
 async fn stream_events(
     State(state): State<AppState>,
-) -> axum::response::Sse<impl Stream<Item = Result<Event, anyhow::Error>>> {
-    let stream = BroadcastStream::new(state.events.subscribe()).filter_map(|event| async {
-        match event {
-            Ok(event) => match serde_json::to_string(&event) {
-                Ok(payload) => Some(Ok(Event::default().data(payload))),
-                Err(err) => Some(Err(anyhow::anyhow!(err))),
-            },
-            Err(_) => None,
-        }
-    });
-    axum::response::Sse::new(stream).keep_alive(KeepAlive::new())
+    headers: HeaderMap,
+) -> Sse<impl Stream<Item = Result<Event, Infallible>>> {
+    sse_response(&state.events, &headers)
 }
 
 async fn metrics() -> impl IntoResponse {
@@ -191,9 +194,12 @@ async fn track_http_metrics(req: Request<Body>, next: Next) -> Response {
     response
 }
 
-fn dispatch_event(sender: &broadcast::Sender<PresenceEvent>, event: PresenceEvent) {
+fn dispatch_event(fanout: &PresenceFanout, event: PresenceEvent) {
     tracing::info!(person = %event.person_id, location = %event.location, source = ?event.source, "presence event");
-    let _ = sender.send(event);
+    match serde_json::to_string(&event) {
+        Ok(payload) => fanout.publish(payload.into()),
+        Err(err) => tracing::warn!(error = %err, "presence event not serializable"),
+    }
 }
 
 fn now_ts() -> DateTime<Utc> {
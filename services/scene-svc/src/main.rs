@@ -1,3 +1,4 @@
+use std::collections::HashSet;
 use std::net::SocketAddr;
 use std::sync::Arc;
 
@@ -9,6 +10,7 @@ use axum::middleware::{from_fn, Next};
 use axum::response::{IntoResponse, Response};
 use axum::routing::{get, post};
 use axum::{Json, Router};
+use futures_util::future::join_all;
 use serde::{Deserialize, Serialize};
 use tokio::net::TcpListener;
 
@@ -24,6 +26,7 @@ const SERVICE_NAME: &str = "scene-svc";
 const PORT_ENV: &str = "SCENE_SVC_PORT";
 const DEFAULT_PORT: u16 = 8003;
 const DEFAULT_REGISTRY_URL: &str = "http://127.0.0.1:8001";
+const MAX_BATCH_SCENES: usize = 64;
 
 const VERSION: &str = env!("CARGO_PKG_VERSION");
 
@@ -42,7 +45,6 @@ struct AppState<C: DeviceRegistryClient + Send + Sync + 'static> {
 
 #[derive(Debug, Clone, Deserialize)]
 struct SceneRequest {
-    #[allow(dead_code)]
     pub scene_id: Option<String>,
     pub operations: Vec<DeviceOperation>,
 }
@@ -53,12 +55,25 @@ struct DeviceOperation {
     pub state: serde_json::Value,
 }
 
+#[derive(Debug, Clone, Deserialize)]
+struct BatchSceneRequest {
+    scenes: Vec<SceneRequest>,
+}
+
 #[derive(Debug, Clone, Serialize)]
 struct SceneResponse {
+    #[serde(skip_serializing_if = "Option::is_none")]
+    scene_id: Option<String>,
     status: SceneStatus,
     results: Vec<DeviceApplyResult>,
 }
 
+/// One result per scene, in request order.
+#[derive(Debug, Clone, Serialize)]
+struct BatchSceneResponse {
+    results: Vec<SceneResponse>,
+}
+
 #[derive(Debug, Clone, Serialize)]
 #[serde(rename_all = "snake_case")]
 enum SceneStatus {
@@ -94,6 +109,24 @@ enum SceneError {
     Unexpected,
 }
 
+#[derive(Debug, thiserror::Error)]
+enum BatchError {
+    #[error("batch must contain between 1 and {} scenes", MAX_BATCH_SCENES)]
+    BatchSize,
+}
+
+impl IntoResponse for BatchError {
+    fn into_response(self) -> Response {
+        (
+            StatusCode::BAD_REQUEST,
+            Json(serde_json::json!({
+                "error": { "code": "invalid_batch", "message": self.to_string() }
+            })),
+        )
+            .into_response()
+    }
+}
+
 #[async_trait]
 trait DeviceRegistryClient: Clone + Send + Sync {
     async fn fetch_state(&self, device_id: &str) -> Result<serde_json::Value, SceneError>;
@@ -164,6 +197,29 @@ struct SceneExecutor<C: DeviceRegistryClient> {
 }
 
 impl<C: DeviceRegistryClient> SceneExecutor<C> {
+    /// Applies independent scenes concurrently. A scene that touches a device
+    /// an earlier scene in the batch also touches waits for it, so devices end
+    /// in the state they would after applying the scenes one by one.
+    async fn apply_scenes(&self, scenes: Vec<SceneRequest>) -> Vec<SceneResponse> {
+        let mut results = Vec::with_capacity(scenes.len());
+        let mut wave: Vec<SceneRequest> = Vec::new();
+        let mut touched: HashSet<String> = HashSet::new();
+        for scene in scenes {
+            if scene
+                .operations
+                .iter()
+                .any(|op| touched.contains(op.device_id.as_str()))
+            {
+                results.extend(join_all(wave.drain(..).map(|scene| self.apply_scene(scene))).await);
+                touched.clear();
+            }
+            touched.extend(scene.operations.iter().map(|op| op.device_id.clone()));
+            wave.push(scene);
+        }
+        results.extend(join_all(wave.into_iter().map(|scene| self.apply_scene(scene))).await);
+        results
+    }
+
     async fn apply_scene(&self, request: SceneRequest) -> SceneResponse {
         let mut results = Vec::with_capacity(request.operations.len());
         let mut previous_states: Vec<(String, serde_json::Value)> = Vec::new();
@@ -240,7 +296,11 @@ impl<C: DeviceRegistryClient> SceneExecutor<C> {
             SceneStatus::Applied
         };
 
-        SceneResponse { status, results }
+        SceneResponse {
+            scene_id: request.scene_id,
+            status,
+            results,
+        }
     }
 }
 
@@ -272,17 +332,23 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
         "starting service"
     );
 
-    let app = Router::new()
+    let listener = TcpListener::bind(addr).await?;
+    axum::serve(listener, router(state).into_make_service()).await?;
+
+    Ok(())
+}
+
+/// Scene payloads may arrive gzipped, and sized responses go out gzipped to
+/// clients that accept it.
+fn router<C: DeviceRegistryClient + Send + Sync + 'static>(state: AppState<C>) -> Router {
+    Router::new()
         .route("/v1/scenes:apply", post(apply_scene))
+        .route("/v1/scenes:batchApply", post(apply_scenes))
         .route("/metrics", get(metrics))
         .with_state(state)
         .merge(health_router(SERVICE_NAME))
-        .layer(from_fn(track_http_metrics));
-
-    let listener = TcpListener::bind(addr).await?;
-    axum::serve(listener, app.into_make_service()).await?;
-
-    Ok(())
+        .layer(from_fn(common_compress::gzip))
+        .layer(from_fn(track_http_metrics))
 }
 
 async fn apply_scene<C: DeviceRegistryClient + Send + Sync + 'static>(
@@ -293,6 +359,17 @@ async fn apply_scene<C: DeviceRegistryClient + Send + Sync + 'static>(
     Json(response)
 }
 
+async fn apply_scenes<C: DeviceRegistryClient + Send + Sync + 'static>(
+    State(state): State<AppState<C>>,
+    Json(payload): Json<BatchSceneRequest>,
+) -> Result<Json<BatchSceneResponse>, BatchError> {
+    if payload.scenes.is_empty() || payload.scenes.len() > MAX_BATCH_SCENES {
+        return Err(BatchError::BatchSize);
+    }
+    let results = state.executor.apply_scenes(payload.scenes).await;
+    Ok(Json(BatchSceneResponse { results }))
+}
+
 async fn metrics() -> impl IntoResponse {
     (
         StatusCode::OK,
@@ -396,4 +473,135 @@ mod tests {
             .find(|r| r.device_id == "one" && matches!(r.status, DeviceStatus::RolledBack));
         assert!(applied.is_some(), "device one should have been rolled back");
     }
+
+    fn scene(id: &str, devices: &[(&str, &str)]) -> SceneRequest {
+        SceneRequest {
+            scene_id: Some(id.to_string()),
+            operations: devices
+                .iter()
+                .map(|(device, power)| DeviceOperation {
+                    device_id: device.to_string(),
+                    state: serde_json::json!({ "power": power }),
+                })
+                .collect(),
+        }
+    }
+
+    #[tokio::test]
+    async fn batch_returns_results_in_request_order() {
+        let registry = MockRegistry::default();
+        {
+            let mut devices = registry.devices.lock().await;
+            for id in ["hall", "kitchen", "porch"] {
+                devices.insert(id.to_string(), serde_json::json!({"power": "on"}));
+            }
+        }
+        *registry.fail_on.lock().await = Some("kitchen".to_string());
+
+        let executor = SceneExecutor {
+            client: registry.clone(),
+        };
+        let results = executor
+            .apply_scenes(vec![
+                scene("hall-off", &[("hall", "off")]),
+                scene("kitchen-off", &[("kitchen", "off")]),
+                scene("porch-off", &[("porch", "off")]),
+            ])
+            .await;
+
+        let ids: Vec<_> = results.iter().map(|r| r.scene_id.as_deref()).collect();
+        assert_eq!(
+            ids,
+            vec![Some("hall-off"), Some("kitchen-off"), Some("porch-off")]
+        );
+        assert!(matches!(results[0].status, SceneStatus::Applied));
+        assert!(matches!(results[1].status, SceneStatus::Failed));
+        assert!(matches!(results[2].status, SceneStatus::Applied));
+    }
+
+    #[tokio::test]
+    async fn batch_applies_overlapping_scenes_in_order() {
+        let registry = MockRegistry::default();
+        {
+            let mut devices = registry.devices.lock().await;
+            devices.insert("lamp".to_string(), serde_json::json!({"power": "off"}));
+            devices.insert("fan".to_string(), serde_json::json!({"power": "off"}));
+        }
+
+        let executor = SceneExecutor {
+            client: registry.clone(),
+        };
+        executor
+            .apply_scenes(vec![
+                scene("evening", &[("lamp", "on"), ("fan", "on")]),
+                scene("all-off", &[("lamp", "off")]),
+            ])
+            .await;
+
+        let devices = registry.devices.lock().await;
+        assert_eq!(devices["lamp"], serde_json::json!({"power": "off"}));
+        assert_eq!(devices["fan"], serde_json::json!({"power": "on"}));
+    }
+
+    #[tokio::test]
+    async fn gzipped_batch_applies_and_answers_gzipped() {
+        use tower::ServiceExt;
+
+        let registry = MockRegistry::default();
+        registry
+            .devices
+            .lock()
+            .await
+            .insert("lamp".to_string(), serde_json::json!({"power": "off"}));
+        let scenes: Vec<_> = (0..32)
+            .map(|n| {
+                serde_json::json!({
+                    "scene_id": format!("scene-{n}"),
+                    "operations": [{ "device_id": "lamp", "state": { "power": "on" } }]
+                })
+            })
+            .collect();
+        let body = serde_json::to_vec(&serde_json::json!({ "scenes": scenes })).unwrap();
+        let request = Request::post("/v1/scenes:batchApply")
+            .header(header::CONTENT_TYPE, "application/json")
+            .header(header::CONTENT_ENCODING, "gzip")
+            .header(header::ACCEPT_ENCODING, "gzip")
+            .body(Body::from(common_compress::deflate(&body)))
+            .unwrap();
+
+        let state = AppState {
+            executor: Arc::new(SceneExecutor {
+                client: registry.clone(),
+            }),
+        };
+        let response = router(state).oneshot(request).await.unwrap();
+        assert_eq!(response.status(), StatusCode::OK);
+        assert_eq!(response.headers()[header::CONTENT_ENCODING], "gzip");
+        let compressed = axum::body::to_bytes(response.into_body(), usize::MAX)
+            .await
+            .unwrap();
+        let body = common_compress::inflate(&compressed, common_compress::MAX_BODY_BYTES).unwrap();
+        let results: serde_json::Value = serde_json::from_slice(&body).unwrap();
+        assert_eq!(results["results"].as_array().unwrap().len(), 32);
+        assert_eq!(results["results"][31]["status"], "applied");
+        assert_eq!(
+            registry.devices.lock().await["lamp"],
+            serde_json::json!({"power": "on"})
+        );
+    }
+
+    #[test]
+    fn batch_body_from_the_sdk_parses() {
+        // What lokan_apply_scenes sends for a scene with and without a payload.
+        let payload: BatchSceneRequest = serde_json::from_str(
+            r#"{"scenes":[{"scene_id":"evening","operations":[]},{"scene_id":"porch","operations":[{"device_id":"porch-light","state":{"power":"on"}}]}]}"#,
+        )
+        .unwrap();
+        assert_eq!(payload.scenes.len(), 2);
+        assert_eq!(payload.scenes[1].operations[0].device_id, "porch-light");
+        assert!(
+            serde_json::from_str::<BatchSceneRequest>(r#"{"scenes":[{"sceneId":"evening"}]}"#)
+                .is_err()
+        );
+    }
 }
@@ -1,17 +1,24 @@
+use std::convert::Infallible;
 use std::net::SocketAddr;
+use std::sync::Arc;
 
-use axum::body::Body;
-use axum::extract::MatchedPath;
-use axum::http::{header, HeaderValue, Request, StatusCode};
+use axum::body::{Body, Bytes};
+use axum::extract::{MatchedPath, State};
+use axum::http::{header, HeaderMap, HeaderValue, Request, StatusCode};
 use axum::middleware::{from_fn, Next};
+use axum::response::sse::{Event, Sse};
 use axum::response::{IntoResponse, Response};
-use axum::routing::get;
-use axum::Router;
+use axum::routing::{get, post};
+use axum::{Json, Router};
 use common_config::service_port;
 use common_obs::{
     encode_prometheus_metrics, health_router, http_request_observe, ObsInit,
     PROMETHEUS_CONTENT_TYPE,
 };
+use common_sse::{sse_response, EventFanout};
+use futures_util::Stream;
+use serde::de::DeserializeOwned;
+use serde::{Deserialize, Serialize};
 use tokio::net::TcpListener;
 
 use std::time::Instant;
@@ -19,6 +26,12 @@ use std::time::Instant;
 const SERVICE_NAME: &str = "telemetry-pipe";
 const PORT_ENV: &str = "TELEMETRY_PIPE_PORT";
 const DEFAULT_PORT: u16 = 8007;
+const MAX_BATCH_ENVELOPES: usize = 10_000;
+/// Ingest bodies may be CBOR (RFC 8949) with the same shape as the JSON form.
+const CBOR_CONTENT_TYPE: &str = "application/cbor";
+const FANOUT_CAPACITY: usize = 1024;
+/// Envelopes kept for stream subscribers that reconnect with `Last-Event-ID`.
+const REPLAY_CAPACITY: usize = 1024;
 
 const VERSION: &str = env!("CARGO_PKG_VERSION");
 
@@ -30,6 +43,69 @@ fn build_time() -> &'static str {
     option_env!("BUILD_TIME").unwrap_or("unknown")
 }
 
+#[derive(Clone)]
+struct AppState {
+    envelopes: Arc<EnvelopeFanout>,
+}
+
+/// Serialized envelopes, fanned out to stream subscribers.
+type EnvelopeFanout = EventFanout<Arc<str>>;
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
+struct TelemetryEnvelope {
+    source: String,
+    payload: serde_json::Map<String, serde_json::Value>,
+}
+
+#[derive(Debug, Deserialize)]
+struct TelemetryBatch {
+    envelopes: Vec<TelemetryEnvelope>,
+}
+
+#[derive(Debug, Serialize)]
+struct IngestResponse {
+    accepted: usize,
+}
+
+#[derive(Debug, thiserror::Error)]
+enum IngestError {
+    #[error("envelope source must not be empty")]
+    EmptySource,
+    #[error("batch must contain between 1 and {} envelopes", MAX_BATCH_ENVELOPES)]
+    BatchSize,
+    #[error("malformed request body: {0}")]
+    MalformedBody(String),
+    #[error("content type must be application/json or application/cbor")]
+    UnsupportedMediaType,
+}
+
+impl IngestError {
+    fn code(&self) -> &'static str {
+        match self {
+            IngestError::EmptySource => "invalid_envelope",
+            IngestError::BatchSize => "invalid_batch",
+            IngestError::MalformedBody(_) => "invalid_body",
+            IngestError::UnsupportedMediaType => "unsupported_media_type",
+        }
+    }
+}
+
+impl IntoResponse for IngestError {
+    fn into_response(self) -> Response {
+        let status = match self {
+            IngestError::UnsupportedMediaType => StatusCode::UNSUPPORTED_MEDIA_TYPE,
+            _ => StatusCode::BAD_REQUEST,
+        };
+        (
+            status,
+            Json(serde_json::json!({
+                "error": { "code": self.code(), "message": self.to_string() }
+            })),
+        )
+            .into_response()
+    }
+}
+
 #[tokio::main]
 async fn main() -> Result<(), Box<dyn std::error::Error>> {
     ObsInit::init(SERVICE_NAME).map_err(|err| -> Box<dyn std::error::Error> { Box::new(err) })?;
@@ -46,17 +122,103 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
         "starting service"
     );
 
-    let app = Router::new()
-        .route("/metrics", get(metrics))
-        .merge(health_router(SERVICE_NAME))
-        .layer(from_fn(track_http_metrics));
+    let state = AppState {
+        envelopes: Arc::new(EnvelopeFanout::new(FANOUT_CAPACITY, REPLAY_CAPACITY)),
+    };
 
     let listener = TcpListener::bind(addr).await?;
-    axum::serve(listener, app.into_make_service()).await?;
+    axum::serve(listener, router(state).into_make_service()).await?;
 
     Ok(())
 }
 
+/// Ingest bodies may arrive gzipped, and sized responses go out gzipped to
+/// clients that accept it.
+fn router(state: AppState) -> Router {
+    Router::new()
+        .route("/v1/ingest", post(ingest))
+        .route("/v1/ingest/batch", post(ingest_batch))
+        .route("/v1/ingest/stream", get(stream_envelopes))
+        .route("/metrics", get(metrics))
+        .with_state(state)
+        .merge(health_router(SERVICE_NAME))
+        .layer(from_fn(common_compress::gzip))
+        .layer(from_fn(track_http_metrics))
+}
+
+async fn ingest(
+    State(state): State<AppState>,
+    headers: HeaderMap,
+    body: Bytes,
+) -> Result<(StatusCode, Json<IngestResponse>), IngestError> {
+    let envelope: TelemetryEnvelope = decode_body(&headers, &body)?;
+    let accepted = accept_envelopes(&state.envelopes, vec![envelope])?;
+    Ok((StatusCode::ACCEPTED, Json(IngestResponse { accepted })))
+}
+
+async fn ingest_batch(
+    State(state): State<AppState>,
+    headers: HeaderMap,
+    body: Bytes,
+) -> Result<(StatusCode, Json<IngestResponse>), IngestError> {
+    let batch: TelemetryBatch = decode_body(&headers, &body)?;
+    let accepted = accept_envelopes(&state.envelopes, batch.envelopes)?;
+    Ok((StatusCode::ACCEPTED, Json(IngestResponse { accepted })))
+}
+
+/// Decodes an ingest body by its Content-Type. Both encodings land in the same
+/// types, so envelopes fan out as JSON whichever way they arrived.
+fn decode_body<T: DeserializeOwned>(headers: &HeaderMap, body: &[u8]) -> Result<T, IngestError> {
+    let media_type = headers
+        .get(header::CONTENT_TYPE)
+        .and_then(|value| value.to_str().ok())
+        .and_then(|value| value.split(';').next())
+        .map(str::trim)
+        .unwrap_or_default();
+    if media_type.eq_ignore_ascii_case(CBOR_CONTENT_TYPE) {
+        ciborium::from_reader(body).map_err(|err| IngestError::MalformedBody(err.to_string()))
+    } else if media_type.eq_ignore_ascii_case("application/json") {
+        serde_json::from_slice(body).map_err(|err| IngestError::MalformedBody(err.to_string()))
+    } else {
+        Err(IngestError::UnsupportedMediaType)
+    }
+}
+
+/// Validates the whole batch before fanning any envelope out, so a rejected
+/// request never delivers a partial batch downstream.
+fn accept_envelopes(
+    fanout: &EnvelopeFanout,
+    envelopes: Vec<TelemetryEnvelope>,
+) -> Result<usize, IngestError> {
+    if envelopes.is_empty() || envelopes.len() > MAX_BATCH_ENVELOPES {
+        return Err(IngestError::BatchSize);
+    }
+    if envelopes.iter().any(|envelope| envelope.source.is_empty()) {
+        return Err(IngestError::EmptySource);
+    }
+
+    let accepted = envelopes.len();
+    for envelope in envelopes {
+        match serde_json::to_string(&envelope) {
+            Ok(payload) => fanout.publish(payload.into()),
+            Err(err) => tracing::warn!(error = %err, "envelope not serializable"),
+        }
+    }
+    tracing::debug!(accepted, "telemetry ingested");
+    Ok(accepted)
+}
+
+/// Server-sent ingested envelopes. Each carries an `id`; a client reconnecting
+/// with `Last-Event-ID` first receives the retained envelopes it missed, behind
+/// a `gap` event when some were evicted or dropped for lagging, or a `resync`
+/// event when its id predates a restart.
+async fn stream_envelopes(
+    State(state): State<AppState>,
+    headers: HeaderMap,
+) -> Sse<impl Stream<Item = Result<Event, Infallible>>> {
+    sse_response(&state.envelopes, &headers)
+}
+
 async fn metrics() -> impl IntoResponse {
     (
         StatusCode::OK,
@@ -85,3 +247,121 @@ async fn track_http_metrics(req: Request<Body>, next: Next) -> Response {
 
     response
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use common_sse::SequencedEvent;
+
+    fn envelope(source: &str) -> TelemetryEnvelope {
+        TelemetryEnvelope {
+            source: source.to_string(),
+            payload: serde_json::Map::new(),
+        }
+    }
+
+    fn source(envelope: &SequencedEvent<Arc<str>>) -> String {
+        serde_json::from_str::<TelemetryEnvelope>(&envelope.payload)
+            .unwrap()
+            .source
+    }
+
+    #[test]
+    fn batch_fans_out_every_envelope() {
+        let fanout = EnvelopeFanout::new(8, 8);
+        let mut receiver = fanout.subscribe(None).live;
+        let accepted =
+            accept_envelopes(&fanout, vec![envelope("meter-1"), envelope("meter-2")]).unwrap();
+        assert_eq!(accepted, 2);
+        assert_eq!(source(&receiver.try_recv().unwrap()), "meter-1");
+        assert_eq!(source(&receiver.try_recv().unwrap()), "meter-2");
+    }
+
+    #[test]
+    fn rejected_batch_delivers_nothing() {
+        let fanout = EnvelopeFanout::new(8, 8);
+        let mut receiver = fanout.subscribe(None).live;
+        let result = accept_envelopes(&fanout, vec![envelope("meter-1"), envelope("")]);
+        assert!(matches!(result, Err(IngestError::EmptySource)));
+        assert!(receiver.try_recv().is_err());
+    }
+
+    fn content_type(value: &'static str) -> HeaderMap {
+        let mut headers = HeaderMap::new();
+        headers.insert(header::CONTENT_TYPE, HeaderValue::from_static(value));
+        headers
+    }
+
+    #[test]
+    fn cbor_batch_decodes_like_json() {
+        // As the C SDK writes it: an indefinite-length envelope array and a
+        // single-precision reading.
+        let mut body = vec![0xa1, 0x69];
+        body.extend_from_slice(b"envelopes");
+        body.extend_from_slice(&[0x9f, 0xa2, 0x66]);
+        body.extend_from_slice(b"source");
+        body.push(0x67);
+        body.extend_from_slice(b"meter-7");
+        body.push(0x67);
+        body.extend_from_slice(b"payload");
+        body.extend_from_slice(&[0xa2, 0x65]);
+        body.extend_from_slice(b"watts");
+        body.push(0xfa);
+        body.extend_from_slice(&412.5f32.to_be_bytes());
+        body.push(0x63);
+        body.extend_from_slice(b"seq");
+        body.extend_from_slice(&[0x39, 0x01, 0xf3, 0xff]);
+
+        let batch: TelemetryBatch = decode_body(&content_type(CBOR_CONTENT_TYPE), &body).unwrap();
+        let json: TelemetryBatch = decode_body(
+            &content_type("application/json; charset=utf-8"),
+            br#"{"envelopes":[{"source":"meter-7","payload":{"watts":412.5,"seq":-500}}]}"#,
+        )
+        .unwrap();
+        assert_eq!(batch.envelopes.len(), 1);
+        assert_eq!(batch.envelopes[0].source, json.envelopes[0].source);
+        assert_eq!(batch.envelopes[0].payload, json.envelopes[0].payload);
+    }
+
+    #[test]
+    fn unknown_content_type_is_rejected() {
+        let result: Result<TelemetryBatch, _> = decode_body(&content_type("text/plain"), b"{}");
+        assert!(matches!(result, Err(IngestError::UnsupportedMediaType)));
+        let result: Result<TelemetryBatch, _> =
+            decode_body(&content_type(CBOR_CONTENT_TYPE), &[0xa1, 0x69]);
+        assert!(matches!(result, Err(IngestError::MalformedBody(_))));
+    }
+
+    #[tokio::test]
+    async fn gzipped_batch_is_ingested() {
+        use tower::ServiceExt;
+
+        let envelopes = Arc::new(EnvelopeFanout::new(8, 8));
+        let mut receiver = envelopes.subscribe(None).live;
+        let body = common_compress::deflate(
+            br#"{"envelopes":[{"source":"meter-1","payload":{}},{"source":"meter-2","payload":{}}]}"#,
+        );
+        let request = Request::post("/v1/ingest/batch")
+            .header(header::CONTENT_TYPE, "application/json")
+            .header(header::CONTENT_ENCODING, "gzip")
+            .body(Body::from(body))
+            .unwrap();
+
+        let response = router(AppState { envelopes })
+            .oneshot(request)
+            .await
+            .unwrap();
+        assert_eq!(response.status(), StatusCode::ACCEPTED);
+        assert_eq!(source(&receiver.try_recv().unwrap()), "meter-1");
+        assert_eq!(source(&receiver.try_recv().unwrap()), "meter-2");
+    }
+
+    #[test]
+    fn empty_batch_is_rejected() {
+        let fanout = EnvelopeFanout::new(8, 8);
+        assert!(matches!(
+            accept_envelopes(&fanout, Vec::new()),
+            Err(IngestError::BatchSize)
+        ));
+    }
+}
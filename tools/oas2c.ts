@@ -0,0 +1,432 @@
+#!/usr/bin/env node
+
+const fs = require('fs');
+const path = require('path');
+
+function main() {
+  const repoRoot = path.resolve(__dirname, '..');
+  const bundlePath = path.join(repoRoot, 'openapi', '_bundle.json');
+  if (!fs.existsSync(bundlePath)) {
+    throw new Error(`OpenAPI bundle not found at ${bundlePath}`);
+  }
+  const raw = fs.readFileSync(bundlePath, 'utf8');
+  const spec = JSON.parse(raw);
+
+  const sdkDir = path.join(repoRoot, 'sdks', 'c');
+  const generator = createGenerator(spec);
+  const result = generator.generate();
+  fs.writeFileSync(path.join(sdkDir, 'include', 'lokan_api.h'), result.header);
+  fs.writeFileSync(path.join(sdkDir, 'src', 'lokan_api.c'), result.source);
+
+  console.log('Generated C SDK API in sdks/c');
+}
+
+/*
+ * Every operation becomes one C entry point on the existing client, so it
+ * reuses the client's connection, buffers and endpoint cache. Paths in the
+ * bundle carry the service prefix (/scene-svc/diag); the C client's base URL
+ * already names the service, so the prefix is dropped here.
+ *
+ * JSON object responses decode into a struct through a field table that the
+ * runtime walks in a single SAX pass. Responses that are an object wrapping a
+ * single array stream each element to a callback instead, text responses are
+ * returned as a view, and request bodies are passed through as JSON text.
+ * Lists that also carry a nextCursor and take a cursor query parameter get a
+ * second entry point that opens a prefetching page iterator on them. Query
+ * parameters become arguments after the client, appended to the path per
+ * call; optional ones are left out when NULL or 0.
+ */
+function createGenerator(spec) {
+  const schemas = (spec.components && spec.components.schemas) || {};
+  const structs = new Map();
+
+  function resolve(schema) {
+    if (schema && schema.$ref) {
+      const refMatch = /^#\/components\/schemas\/(.+)$/.exec(schema.$ref);
+      if (!refMatch || !schemas[refMatch[1]]) {
+        throw new Error(`Unresolvable schema reference ${schema.$ref}`);
+      }
+      return { name: refMatch[1], schema: schemas[refMatch[1]] };
+    }
+    return { name: undefined, schema: schema || {} };
+  }
+
+  function flattenFields(schema, keyPrefix, namePrefix, ancestorsRequired, fields) {
+    const properties = schema.properties || {};
+    const required = new Set(schema.required || []);
+    for (const propName of Object.keys(properties)) {
+      const prop = resolve(properties[propName]).schema;
+      const key = keyPrefix ? `${keyPrefix}.${propName}` : propName;
+      const name = namePrefix ? `${namePrefix}_${toSnake(propName)}` : toSnake(propName);
+      const isRequired = ancestorsRequired && required.has(propName);
+      const type = prop.type || inferType(prop);
+      if (type === 'object' && prop.properties && prop.additionalProperties === undefined) {
+        flattenFields(prop, key, name, isRequired, fields);
+        continue;
+      }
+      let kind;
+      switch (type) {
+        case 'string':
+          kind = 'STRING';
+          break;
+        case 'integer':
+          kind = 'INT64';
+          break;
+        case 'number':
+          kind = 'DOUBLE';
+          break;
+        case 'boolean':
+          kind = 'BOOL';
+          break;
+        default:
+          kind = 'RAW';
+      }
+      fields.push({ key, name, kind, required: isRequired });
+    }
+    return fields;
+  }
+
+  function defineStruct(typeName, label, schema) {
+    if (structs.has(typeName)) {
+      return structs.get(typeName);
+    }
+    const fields = flattenFields(schema, '', '', true, []);
+    if (fields.length > 32) {
+      throw new Error(`${label} has ${fields.length} members; the present mask holds 32`);
+    }
+    const macroPrefix = typeName.replace(/_t$/, '').toUpperCase();
+    for (const field of fields) {
+      field.bit = `${macroPrefix}_HAS_${field.name.toUpperCase()}`;
+    }
+    const struct = { typeName, label, fields, macroPrefix };
+    structs.set(typeName, struct);
+    return struct;
+  }
+
+  function classifyResponse(operation, operationId) {
+    const responses = operation.responses || {};
+    const success = Object.keys(responses)
+      .map((code) => ({ code, numeric: parseInt(code, 10) }))
+      .filter(({ numeric }) => !Number.isNaN(numeric) && numeric >= 200 && numeric < 300)
+      .sort((a, b) => a.numeric - b.numeric)[0];
+    const content = (success && responses[success.code].content) || {};
+    const mediaTypes = Object.keys(content);
+    if (mediaTypes.length === 0) {
+      return { kind: 'none' };
+    }
+    const jsonMedia = mediaTypes.find((key) => /json/i.test(key));
+    if (!jsonMedia) {
+      return { kind: 'text' };
+    }
+    const resolved = resolve(content[jsonMedia].schema);
+    const schema = resolved.schema;
+    const properties = schema.properties || {};
+    const propNames = Object.keys(properties);
+    const listNames = propNames.filter((name) => name !== 'nextCursor');
+    if (!resolved.name && listNames.length === 1 && resolve(properties[listNames[0]]).schema.type === 'array') {
+      const cursorParam = (operation.parameters || []).some((param) => param.in === 'query' && param.name === 'cursor');
+      return { kind: 'list', arrayKey: listNames[0], paged: cursorParam && propNames.includes('nextCursor') };
+    }
+    const typeName = resolved.name ? `lokan_${toSnake(resolved.name)}_t` : `lokan_${toSnake(operationId)}_result_t`;
+    const label = resolved.name || `${operationId} response`;
+    return { kind: 'struct', struct: defineStruct(typeName, label, schema) };
+  }
+
+  function resolveParameter(param) {
+    if (param && param.$ref) {
+      const refMatch = /^#\/components\/parameters\/(.+)$/.exec(param.$ref);
+      const parameters = (spec.components && spec.components.parameters) || {};
+      if (!refMatch || !parameters[refMatch[1]]) {
+        throw new Error(`Unresolvable parameter reference ${param.$ref}`);
+      }
+      return parameters[refMatch[1]];
+    }
+    return param;
+  }
+
+  function queryParameters(operation, operationId) {
+    return (operation.parameters || [])
+      .map(resolveParameter)
+      .filter((param) => param.in === 'query')
+      .map((param) => {
+        const type = resolve(param.schema).schema.type;
+        if (type !== 'string' && type !== 'integer') {
+          throw new Error(`${operationId}: query parameter ${param.name} has unsupported type ${type}`);
+        }
+        return { name: param.name, cName: toSnake(param.name), isString: type === 'string', required: Boolean(param.required) };
+      });
+  }
+
+  function collectOperations() {
+    const operations = [];
+    const paths = spec.paths || {};
+    const sortedPaths = Object.keys(paths).sort((a, b) => a.localeCompare(b));
+    for (const apiPath of sortedPaths) {
+      const pathItem = paths[apiPath] || {};
+      const methods = Object.keys(pathItem).sort((a, b) => a.localeCompare(b));
+      for (const method of methods) {
+        const operation = pathItem[method];
+        if (!operation || typeof operation !== 'object' || !operation.operationId) {
+          continue;
+        }
+        operations.push({
+          operationId: operation.operationId,
+          functionName: `lokan_${toSnake(operation.operationId)}`,
+          method: method.toUpperCase(),
+          apiPath,
+          clientPath: apiPath.replace(/^\/[^/]+/, '') || '/',
+          summary: operation.summary || '',
+          hasBody: Boolean(operation.requestBody),
+          query: queryParameters(operation, operation.operationId),
+          response: classifyResponse(operation, operation.operationId),
+        });
+      }
+    }
+    return operations;
+  }
+
+  function parameters(op) {
+    const params = ['lokan_client_t *client'];
+    for (const param of op.query) {
+      params.push(param.isString ? `const char *${param.cName}` : `int64_t ${param.cName}`);
+    }
+    if (op.hasBody) {
+      params.push('const char *body_json', 'size_t body_len');
+    }
+    switch (op.response.kind) {
+      case 'struct':
+        params.push(`${op.response.struct.typeName} *out`);
+        break;
+      case 'list':
+        params.push('lokan_json_element_cb on_element', 'void *user_data');
+        break;
+      case 'text':
+        params.push('lokan_view_t *out_text');
+        break;
+      default:
+        break;
+    }
+    params.push('long *out_status');
+    return params;
+  }
+
+  function signature(op) {
+    return `lokan_result_t ${op.functionName}(${parameters(op).join(', ')})`;
+  }
+
+  function iteratorSignature(op) {
+    return `lokan_result_t ${op.functionName}_iter(lokan_client_t *client, size_t page_size, lokan_list_iter_t **out_iter)`;
+  }
+
+  function operationComment(op) {
+    let detail = '';
+    if (op.response.kind === 'list') {
+      detail = ` Streams each entry of "${op.response.arrayKey}" to on_element.`;
+    }
+    if (op.query.some((param) => !param.required)) {
+      detail += ' Optional query parameters are left out when NULL or 0.';
+    }
+    return `/* ${op.method} ${op.apiPath}: ${op.summary}${detail} */`;
+  }
+
+  function generateHeader(operations) {
+    const lines = [
+      '/*',
+      ' * This file is auto-generated by tools/oas2c.ts.',
+      ' * Do not edit this file directly.',
+      ' *',
+      ' * Typed entry points for every operation in openapi/_bundle.json. Paths are',
+      ' * relative to the client\'s base URL, which names the service, e.g.',
+      ' * https://host/device-registry for the DeviceRegistry functions. Decoded',
+      ' * strings and raw JSON members borrow client memory and stay valid until',
+      ' * the next call on the same client; raw members are not NUL-terminated.',
+      ' * A missing required member or a member of the wrong type fails the call',
+      ' * with LOKAN_ERROR_PARSE.',
+      ' */',
+      '',
+      '#ifndef LOKAN_API_H',
+      '#define LOKAN_API_H',
+      '',
+      '#include "lokan.h"',
+      '',
+      '#ifdef __cplusplus',
+      'extern "C" {',
+      '#endif',
+      '',
+    ];
+
+    for (const struct of structs.values()) {
+      struct.fields.forEach((field, index) => {
+        lines.push(`#define ${field.bit} (1u << ${index})`);
+      });
+      lines.push('');
+      lines.push(`/* ${struct.label} */`);
+      lines.push('typedef struct {');
+      lines.push(`    /* ${struct.macroPrefix}_HAS_* bits for the members the response carried. */`);
+      lines.push('    uint32_t present;');
+      for (const field of struct.fields) {
+        if (field.kind === 'RAW') {
+          lines.push('    /* Raw JSON text of the member. */');
+        }
+        lines.push(`    ${cType(field.kind)} ${field.name};`);
+      }
+      lines.push(`} ${struct.typeName};`);
+      lines.push('');
+    }
+
+    for (const op of operations) {
+      lines.push(operationComment(op));
+      lines.push(`${signature(op)};`);
+      lines.push('');
+      if (op.response.kind === 'list' && op.response.paged) {
+        lines.push(`/* ${op.method} ${op.apiPath} page by page; see lokan_list_iter_create. */`);
+        lines.push(`${iteratorSignature(op)};`);
+        lines.push('');
+      }
+    }
+
+    lines.push('#ifdef __cplusplus', '}', '#endif', '', '#endif /* LOKAN_API_H */', '');
+    return lines.join('\n');
+  }
+
+  function generateSource(operations) {
+    const lines = [
+      '/*',
+      ' * This file is auto-generated by tools/oas2c.ts.',
+      ' * Do not edit this file directly.',
+      ' */',
+      '',
+      '#include "lokan_api.h"',
+      '#include "lokan_internal.h"',
+      '',
+      '#include <stddef.h>',
+      '',
+    ];
+
+    for (const struct of structs.values()) {
+      const base = struct.typeName.replace(/_t$/, '');
+      lines.push(`static const struct lokan_field ${base}_fields[] = {`);
+      for (const field of struct.fields) {
+        lines.push(
+          `    {"${field.key}", ${Buffer.byteLength(field.key)}, LOKAN_FIELD_${field.kind}, ` +
+            `offsetof(${struct.typeName}, ${field.name}), ${field.bit}},`
+        );
+      }
+      lines.push('};');
+      lines.push('');
+      const required = struct.fields.filter((field) => field.required).map((field) => field.bit);
+      lines.push(`static const struct lokan_schema ${base}_schema = {`);
+      lines.push(`    ${base}_fields,`);
+      lines.push(`    ${struct.fields.length},`);
+      lines.push(`    sizeof(${struct.typeName}),`);
+      lines.push(`    offsetof(${struct.typeName}, present),`);
+      lines.push(`    ${required.length > 0 ? required.join(' | ') : '0'}`);
+      lines.push('};');
+      lines.push('');
+    }
+
+    for (const op of operations) {
+      const body = op.hasBody ? 'body_json, body_len' : 'NULL, 0';
+      const pathArg = op.query.length > 0 ? 'path' : `"${op.clientPath}"`;
+      let call;
+      switch (op.response.kind) {
+        case 'struct': {
+          const base = op.response.struct.typeName.replace(/_t$/, '');
+          call = `lokan_request_decode(client, "${op.method}", ${pathArg}, ${body}, &${base}_schema, out, out_status)`;
+          break;
+        }
+        case 'list':
+          if (op.method !== 'GET' || op.hasBody) {
+            throw new Error(`${op.operationId}: list streaming only supports GET without a body`);
+          }
+          call = `lokan_stream_list(client, ${pathArg}, "${op.response.arrayKey}", on_element, user_data, out_status)`;
+          break;
+        case 'text':
+          call = `lokan_request_view(client, "${op.method}", ${pathArg}, ${body}, out_status, out_text)`;
+          break;
+        default:
+          call = `lokan_perform_request(client, ${pathArg}, "${op.method}", ${body}, NULL, out_status)`;
+          break;
+      }
+      lines.push(`${signature(op)} {`);
+      if (op.query.length === 0) {
+        lines.push(`    return ${call};`);
+      } else {
+        lines.push('    if (!client) {');
+        lines.push('        return LOKAN_ERROR_INVALID_ARGUMENT;');
+        lines.push('    }');
+        lines.push('    const struct lokan_query_param query[] = {');
+        for (const param of op.query) {
+          const value = param.isString ? `${param.cName}, 0` : `NULL, ${param.cName}`;
+          lines.push(`        {"${param.name}", ${param.isString ? 1 : 0}, ${param.required ? 1 : 0}, ${value}},`);
+        }
+        lines.push('    };');
+        lines.push('    char inline_path[LOKAN_INLINE_BODY_MAX];');
+        lines.push(
+          `    char *path = lokan_query_path(&client->allocator, inline_path, sizeof(inline_path), "${op.clientPath}", query, ${op.query.length});`
+        );
+        lines.push('    if (!path) {');
+        lines.push('        return LOKAN_ERROR_ALLOCATION;');
+        lines.push('    }');
+        lines.push(`    lokan_result_t result = ${call};`);
+        lines.push('    if (path != inline_path) {');
+        lines.push('        lokan_free(&client->allocator, path);');
+        lines.push('    }');
+        lines.push('    return result;');
+      }
+      lines.push('}');
+      lines.push('');
+      if (op.response.kind === 'list' && op.response.paged) {
+        lines.push(`${iteratorSignature(op)} {`);
+        lines.push(
+          `    return lokan_list_iter_create(out_iter, client, "${op.clientPath}", "${op.response.arrayKey}", page_size);`
+        );
+        lines.push('}');
+        lines.push('');
+      }
+    }
+
+    return lines.join('\n');
+  }
+
+  function generate() {
+    const operations = collectOperations();
+    return { header: generateHeader(operations), source: generateSource(operations) };
+  }
+
+  return { generate };
+}
+
+function cType(kind) {
+  switch (kind) {
+    case 'INT64':
+      return 'int64_t';
+    case 'DOUBLE':
+      return 'double';
+    case 'BOOL':
+      return 'int';
+    default:
+      return 'lokan_view_t';
+  }
+}
+
+function inferType(schema) {
+  if (schema.properties || schema.additionalProperties) {
+    return 'object';
+  }
+  if (schema.items) {
+    return 'array';
+  }
+  return undefined;
+}
+
+function toSnake(name) {
+  return name
+    .replace(/([a-z0-9])([A-Z])/g, '$1_$2')
+    .replace(/([A-Z]+)([A-Z][a-z])/g, '$1_$2')
+    .replace(/[^A-Za-z0-9]+/g, '_')
+    .replace(/^_+|_+$/g, '')
+    .toLowerCase();
+}
+
+main();